@@ -27,7 +27,10 @@
 /* RTP Header Extensions */
 #define RTP_HDR_EXT_ABS_SEND_TIME_URI "http://www.webrtc.org/experiments/rtp-hdrext/abs-send-time"
 #define RTP_HDR_EXT_ABS_SEND_TIME_SIZE 3
-#define RTP_HDR_EXT_ABS_SEND_TIME_ID 3  /* TODO: do it dynamic when needed */
+#define RTP_HDR_EXT_ABS_SEND_TIME_ID 3  /* Offered, answers keep the remote one */
+#define RTP_HDR_EXT_TRANSPORT_CC_URI "http://www.ietf.org/id/draft-holmer-rmcat-transport-wide-cc-extensions-01"
+#define RTP_HDR_EXT_TRANSPORT_CC_SIZE 2
+#define RTP_HDR_EXT_TRANSPORT_CC_ID 5
 
 /* RTP/RTCP profiles */
 #define SDP_MEDIA_RTP_AVP_PROTO "RTP/AVP"
@@ -32,6 +32,7 @@
 #include "sdpagent/kmssdpmediadirext.h"
 #include "sdpagent/kmssdpulpfecext.h"
 #include "sdpagent/kmssdpredundantext.h"
+#include "sdpagent/kmssdpextmapext.h"
 #include "sdpagent/kmssdprtpavpfmediahandler.h"
 #include "kmsremb.h"
 #include "kmsrefstruct.h"
@@ -42,6 +43,8 @@
 #include <gst/video/video-event.h>
 #include "kmsbufferlacentymeta.h"
 #include "kmsstats.h"
+#include "kmsfactorycache.h"
+#include "kmsrtphdrext.h"
 
 #include <glib/gstdio.h>
 #include <gio/gio.h>
@@ -225,10 +228,14 @@ struct _KmsBaseRtpEndpointPrivate
   guint min_video_recv_bw;
   guint min_video_send_bw;
   guint max_video_send_bw;
+  KmsBandwidthEstimator bandwidth_estimator;
 
   /* Medias protected by ulpfec */
   KmsList *prot_medias;
 
+  /* Transport-wide sequence number, shared by every media */
+  gint transport_seq;
+
   /* REMB */
   GstStructure *remb_params;
   KmsRembLocal *rl;
@@ -273,6 +280,7 @@ static guint obj_signals[LAST_SIGNAL] = { 0 };
 #define MIN_VIDEO_RECV_BW_DEFAULT 0
 #define MIN_VIDEO_SEND_BW_DEFAULT 100  // kbps
 #define MAX_VIDEO_SEND_BW_DEFAULT 500  // kbps
+#define DEFAULT_BANDWIDTH_ESTIMATOR KMS_BANDWIDTH_ESTIMATOR_LOSS
 
 enum
 {
@@ -290,6 +298,7 @@ enum
   PROP_MAX_PORT,
   PROP_SUPPORT_FEC,
   PROP_OFFER_DIR,
+  PROP_BANDWIDTH_ESTIMATOR,
   PROP_LAST
 };
 
@@ -311,187 +320,239 @@ is_proto (const gchar * term, const gchar * opt, const gchar * proto)
 
 /* RTP hdrext begin */
 
-typedef struct _HdrExtData
+static GstPadProbeReturn
+kms_base_rtp_endpoint_rtp_hdr_ext_probe (GstPad * pad, GstPadProbeInfo * info,
+    gpointer gp)
 {
-  GstPad *pad;
-  /* Useful to make buffers writable when needed. */
-  gboolean add_hdr;
-  gboolean set_time;
-  gint abs_send_time_id;
-} HdrExtData;
+  KmsRtpHdrExtRegistry *registry = gp;
 
-static HdrExtData *
-hdr_ext_data_new (GstPad * pad, gboolean add_hdr, gboolean set_time,
-    gint abs_send_time_id)
-{
-  HdrExtData *data;
+  if (GST_PAD_PROBE_INFO_TYPE (info) & GST_PAD_PROBE_TYPE_BUFFER) {
+    GstBuffer *buffer = GST_PAD_PROBE_INFO_BUFFER (info);
 
-  data = g_slice_new0 (HdrExtData);
-  data->pad = pad;
-  data->add_hdr = add_hdr;
-  data->set_time = set_time;
-  data->abs_send_time_id = abs_send_time_id;
+    if (!kms_rtp_hdr_ext_registry_process (registry, &buffer)) {
+      GST_WARNING_OBJECT (pad, "RTP hdrext not processed");
+    }
 
-  return data;
-}
+    GST_PAD_PROBE_INFO_DATA (info) = buffer;
+  } else if (GST_PAD_PROBE_INFO_TYPE (info) & GST_PAD_PROBE_TYPE_BUFFER_LIST) {
+    GstBufferList *bufflist = GST_PAD_PROBE_INFO_BUFFER_LIST (info);
+    guint processed;
 
-static void
-hdr_ext_data_destroy (HdrExtData * data)
-{
-  g_slice_free (HdrExtData, data);
-}
+    processed = kms_rtp_hdr_ext_registry_process_list (registry, &bufflist);
+    if (processed < gst_buffer_list_length (bufflist)) {
+      GST_WARNING_OBJECT (pad, "RTP hdrext not processed in %u packets",
+          gst_buffer_list_length (bufflist) - processed);
+    }
 
-static void
-hdr_ext_data_destroy_pointer (gpointer data)
-{
-  hdr_ext_data_destroy ((HdrExtData *) data);
+    GST_PAD_PROBE_INFO_DATA (info) = bufflist;
+  }
+
+  return GST_PAD_PROBE_OK;
 }
 
 static void
-kms_base_rtp_endpoint_rtp_hdr_ext_set_time (guint8 * data)
+kms_base_rtp_endpoint_add_rtp_hdr_ext (KmsBaseRtpEndpoint * self,
+    KmsRtpHdrExtRegistry * registry, const GstSDPMedia * media,
+    const gchar * uri, guint size, KmsRtpHdrExtFunc func, gpointer user_data)
 {
-  GstClockTime current_time, ms;
-  guint value;
+  gint id;
+
+  id = sdp_utils_get_extmap_id (media, uri);
+  if (id == -1) {
+    GST_DEBUG_OBJECT (self, "%s not negotiated", uri);
+    return;
+  }
 
-  current_time = kms_utils_get_time_nsecs ();
-  ms = GST_TIME_AS_MSECONDS (current_time);
-  value = (((ms << 18) / 1000) & 0x00ffffff);
+  if (id < 1 || id > 255) {
+    GST_WARNING_OBJECT (self, "Invalid id %d for %s", id, uri);
+    return;
+  }
 
-  data[0] = (guint8) (value >> 16);
-  data[1] = (guint8) (value >> 8);
-  data[2] = (guint8) (value);
+  GST_DEBUG_OBJECT (self, "Stamping %s (id: %d)", uri, id);
+  kms_rtp_hdr_ext_registry_add (registry, id, size, KMS_RTP_HDR_EXT_ADD, func,
+      user_data, NULL);
 }
 
+/* Stamps the negotiated extensions on the packets sent through @pad */
 static void
-kms_base_rtp_endpoint_add_rtp_hdr_ext (HdrExtData * data, GstBuffer * buffer)
+kms_base_rtp_endpoint_config_rtp_hdr_ext (KmsBaseRtpEndpoint * self,
+    const GstSDPMedia * media, GstPad * pad)
 {
-  GstRTPBuffer rtp = { NULL, };
-  guint8 id = data->abs_send_time_id;
-  GstMapFlags map_flags;
-  guint8 *time;
-  guint size;
+  KmsRtpHdrExtRegistry *registry;
 
-  if (data->add_hdr) {
-    map_flags = GST_MAP_WRITE;
-  } else {
-    map_flags = GST_MAP_READ;
-  }
+  registry = kms_rtp_hdr_ext_registry_new ();
+
+  kms_base_rtp_endpoint_add_rtp_hdr_ext (self, registry, media,
+      RTP_HDR_EXT_ABS_SEND_TIME_URI, RTP_HDR_EXT_ABS_SEND_TIME_SIZE,
+      kms_rtp_hdr_ext_abs_send_time, NULL);
+  kms_base_rtp_endpoint_add_rtp_hdr_ext (self, registry, media,
+      RTP_HDR_EXT_TRANSPORT_CC_URI, RTP_HDR_EXT_TRANSPORT_CC_SIZE,
+      kms_rtp_hdr_ext_transport_seq, &self->priv->transport_seq);
 
-  if (!gst_rtp_buffer_map (buffer, map_flags, &rtp)) {
-    GST_WARNING_OBJECT (data->pad, "Can not map RTP buffer");
+  if (kms_rtp_hdr_ext_registry_get_n_handlers (registry) == 0) {
+    kms_rtp_hdr_ext_registry_free (registry);
     return;
   }
 
-  if (!gst_rtp_buffer_get_extension_onebyte_header (&rtp,
-          id, 0, (gpointer) & time, &size)) {
-    GST_TRACE_OBJECT (data->pad,
-        "RTP hdrext abs-send-time with id '%d' not found", id);
+  GST_DEBUG_OBJECT (self, "Add probe for RTP hdrext (%" GST_PTR_FORMAT ").",
+      pad);
+  gst_pad_add_probe (pad,
+      GST_PAD_PROBE_TYPE_BUFFER | GST_PAD_PROBE_TYPE_BUFFER_LIST,
+      kms_base_rtp_endpoint_rtp_hdr_ext_probe, registry,
+      (GDestroyNotify) kms_rtp_hdr_ext_registry_free);
+}
+
+typedef struct _RecvHdrExtData
+{
+  KmsBaseRtpEndpoint *self;
+  KmsRtpHdrExtRegistry *registry;
 
-    if (data->add_hdr) {
-      GST_TRACE_OBJECT (data->pad, " Adding new one.");
-    } else {
-      GST_WARNING_OBJECT (data->pad, "Cannot add new one: not writable");
-      goto end;
-    }
+  /* Read from the packet being processed, -1 if absent */
+  gint transport_seq;
+  gint abs_send_time;
+} RecvHdrExtData;
 
-    time = g_malloc0 (RTP_HDR_EXT_ABS_SEND_TIME_SIZE);
-    if (data->set_time) {
-      kms_base_rtp_endpoint_rtp_hdr_ext_set_time (time);
-    }
+static void
+recv_hdr_ext_data_destroy (RecvHdrExtData * data)
+{
+  kms_rtp_hdr_ext_registry_free (data->registry);
+  g_slice_free (RecvHdrExtData, data);
+}
 
-    if (!gst_rtp_buffer_add_extension_onebyte_header (&rtp,
-            id, time, RTP_HDR_EXT_ABS_SEND_TIME_SIZE)) {
-      GST_WARNING_OBJECT (data->pad, "RTP hdrext abs-send-time not added");
-    }
+static gboolean
+kms_base_rtp_endpoint_read_transport_seq (GstBuffer * buffer, guint8 * data,
+    guint size, gboolean present, gpointer user_data)
+{
+  RecvHdrExtData *recv = user_data;
 
-    g_free (time);
-  } else if (data->set_time) {
-    if (size != RTP_HDR_EXT_ABS_SEND_TIME_SIZE) {
-      GST_WARNING_OBJECT (data->pad,
-          "RTP hdrext abs-send-time size with id '%d' not matching", id);
-    } else {
-      GST_TRACE_OBJECT (data->pad,
-          "RTP hdrext abs-send-time with id '%d' found. Update time.", id);
-      kms_base_rtp_endpoint_rtp_hdr_ext_set_time (time);
-    }
+  if (present && size == RTP_HDR_EXT_TRANSPORT_CC_SIZE) {
+    recv->transport_seq = GST_READ_UINT16_BE (data);
   }
 
-end:
-  gst_rtp_buffer_unmap (&rtp);
+  return FALSE;
 }
 
 static gboolean
-kms_base_rtp_endpoint_add_rtp_hdr_ext_bufflist (GstBuffer ** buf, guint idx,
-    HdrExtData * data)
+kms_base_rtp_endpoint_read_abs_send_time (GstBuffer * buffer, guint8 * data,
+    guint size, gboolean present, gpointer user_data)
 {
-  if (data->add_hdr) {
-    *buf = gst_buffer_make_writable (*buf);
+  RecvHdrExtData *recv = user_data;
+
+  if (present && size == RTP_HDR_EXT_ABS_SEND_TIME_SIZE) {
+    recv->abs_send_time = GST_READ_UINT24_BE (data);
   }
-  kms_base_rtp_endpoint_add_rtp_hdr_ext (data, *buf);
 
-  return TRUE;
+  return FALSE;
+}
+
+static void
+kms_base_rtp_endpoint_recv_rtp_hdr_ext (RecvHdrExtData * data,
+    KmsRembLocal * rl, GstBuffer * buffer, GstClockTime arrival_time)
+{
+  data->transport_seq = -1;
+  data->abs_send_time = -1;
+
+  /* Handlers only read, so @buffer is never replaced */
+  if (!kms_rtp_hdr_ext_registry_process (data->registry, &buffer)) {
+    return;
+  }
+
+  if (data->transport_seq < 0) {
+    return;
+  }
+
+  if (data->abs_send_time < 0) {
+    /* Like audio packets, only accounted for losses */
+    kms_remb_local_add_seq (rl, data->transport_seq);
+    return;
+  }
+
+  kms_remb_local_add_packet (rl, data->transport_seq, data->abs_send_time,
+      arrival_time, gst_buffer_get_size (buffer));
 }
 
 static GstPadProbeReturn
-kms_base_rtp_endpoint_add_rtp_hdr_ext_probe (GstPad * pad,
+kms_base_rtp_endpoint_recv_rtp_hdr_ext_probe (GstPad * pad,
     GstPadProbeInfo * info, gpointer gp)
 {
-  HdrExtData *data = (HdrExtData *) gp;
+  RecvHdrExtData *data = gp;
+  KmsBaseRtpEndpoint *self = data->self;
+  GstClockTime arrival_time;
+  KmsRembLocal *rl;
 
-  if (GST_PAD_PROBE_INFO_TYPE (info) & GST_PAD_PROBE_TYPE_BUFFER) {
-    GstBuffer *buffer = GST_PAD_PROBE_INFO_BUFFER (info);
+  if (self->priv->bandwidth_estimator != KMS_BANDWIDTH_ESTIMATOR_DELAY) {
+    return GST_PAD_PROBE_OK;
+  }
 
-    if (data->add_hdr) {
-      buffer = gst_buffer_make_writable (buffer);
-    }
-    kms_base_rtp_endpoint_add_rtp_hdr_ext (data, buffer);
-    GST_PAD_PROBE_INFO_DATA (info) = buffer;
+  rl = g_atomic_pointer_get (&self->priv->rl);
+  if (rl == NULL) {
+    return GST_PAD_PROBE_OK;
+  }
+
+  arrival_time = kms_utils_get_time_nsecs ();
+
+  if (GST_PAD_PROBE_INFO_TYPE (info) & GST_PAD_PROBE_TYPE_BUFFER) {
+    kms_base_rtp_endpoint_recv_rtp_hdr_ext (data, rl,
+        GST_PAD_PROBE_INFO_BUFFER (info), arrival_time);
   } else if (GST_PAD_PROBE_INFO_TYPE (info) & GST_PAD_PROBE_TYPE_BUFFER_LIST) {
     GstBufferList *bufflist = GST_PAD_PROBE_INFO_BUFFER_LIST (info);
+    guint i, len;
 
-    if (data->add_hdr) {
-      bufflist = gst_buffer_list_make_writable (bufflist);
+    len = gst_buffer_list_length (bufflist);
+    for (i = 0; i < len; i++) {
+      kms_base_rtp_endpoint_recv_rtp_hdr_ext (data, rl,
+          gst_buffer_list_get (bufflist, i), arrival_time);
     }
-    gst_buffer_list_foreach (bufflist,
-        (GstBufferListFunc) kms_base_rtp_endpoint_add_rtp_hdr_ext_bufflist,
-        data);
-
-    GST_PAD_PROBE_INFO_DATA (info) = bufflist;
   }
 
   return GST_PAD_PROBE_OK;
 }
 
+/*
+ * Feeds the delay-based bandwidth estimation with the send times and
+ * transport-wide sequence numbers of the packets received through @pad.
+ * Without @send_times only the sequence numbers are read: every media
+ * takes them from the same counter, so those of the others are needed to
+ * tell losses from gaps.
+ */
 static void
-kms_base_rtp_endpoint_config_rtp_hdr_ext (KmsBaseRtpEndpoint * self,
-    const GstSDPMedia * media, GstElement * payloader)
+kms_base_rtp_endpoint_config_recv_rtp_hdr_ext (KmsBaseRtpEndpoint * self,
+    const GstSDPMedia * media, GstPad * pad, gboolean send_times)
 {
-  HdrExtData *data;
-  gint abs_send_time_id;
-  GstPad *pad;
+  RecvHdrExtData *data;
+  gint seq_id, time_id = -1;
 
-  abs_send_time_id = sdp_utils_get_abs_send_time_id (media);
-  if (abs_send_time_id == -1) {
-    GST_DEBUG_OBJECT (self, "abs-send-time-id not configured.");
-    return;
+  seq_id = sdp_utils_get_extmap_id (media, RTP_HDR_EXT_TRANSPORT_CC_URI);
+  if (send_times) {
+    time_id = sdp_utils_get_extmap_id (media, RTP_HDR_EXT_ABS_SEND_TIME_URI);
   }
 
-  pad = gst_element_get_static_pad (payloader, "src");
-  if (pad == NULL) {
-    GST_WARNING_OBJECT (self, "No RTP pad to configure hdrext probe.");
+  if (seq_id < 1 || seq_id > 255 || (send_times && (time_id < 1
+              || time_id > 255))) {
+    GST_DEBUG_OBJECT (self, "No delay-based estimation for %s",
+        gst_sdp_media_get_media (media));
     return;
   }
 
-  data = hdr_ext_data_new (pad, TRUE, FALSE, abs_send_time_id);
+  data = g_slice_new0 (RecvHdrExtData);
+  data->self = self;
+  data->registry = kms_rtp_hdr_ext_registry_new ();
+
+  kms_rtp_hdr_ext_registry_add (data->registry, seq_id,
+      RTP_HDR_EXT_TRANSPORT_CC_SIZE, 0,
+      kms_base_rtp_endpoint_read_transport_seq, data, NULL);
+  if (send_times) {
+    kms_rtp_hdr_ext_registry_add (data->registry, time_id,
+        RTP_HDR_EXT_ABS_SEND_TIME_SIZE, 0,
+        kms_base_rtp_endpoint_read_abs_send_time, data, NULL);
+  }
 
-  GST_DEBUG_OBJECT (self,
-      "Add probe for adding abs-send-time (id: %d, %" GST_PTR_FORMAT
-      ").", abs_send_time_id, pad);
+  GST_DEBUG_OBJECT (self, "Add probe for received RTP hdrext (%"
+      GST_PTR_FORMAT ").", pad);
   gst_pad_add_probe (pad,
       GST_PAD_PROBE_TYPE_BUFFER | GST_PAD_PROBE_TYPE_BUFFER_LIST,
-      kms_base_rtp_endpoint_add_rtp_hdr_ext_probe, data,
-      hdr_ext_data_destroy_pointer);
-  g_object_unref (pad);
+      kms_base_rtp_endpoint_recv_rtp_hdr_ext_probe, data,
+      (GDestroyNotify) recv_hdr_ext_data_destroy);
 }
 
 /* RTP hdrext end */
@@ -555,8 +616,10 @@ kms_base_rtp_configure_extensions (KmsBaseRtpEndpoint * self,
     const gchar * media, KmsSdpMediaHandler * handler)
 {
   KmsSdpMediaDirectionExt *mediadirext;
+  KmsSdpExtmapExt *extmapext;
   KmsSdpUlpFecExt *ulpfecext;
   KmsSdpRedundantExt *redext;
+  GError *err = NULL;
   ExtData *edata;
 
   mediadirext = kms_sdp_media_direction_ext_new ();
@@ -569,6 +632,19 @@ kms_base_rtp_configure_extensions (KmsBaseRtpEndpoint * self,
   kms_sdp_media_handler_add_media_extension (handler,
       KMS_I_SDP_MEDIA_EXTENSION (mediadirext));
 
+  extmapext = kms_sdp_extmap_ext_new ();
+
+  /* TODO: offer transport-wide-cc once transport-cc feedback (RTPFB FMT 15) */
+  /* is produced and consumed, peers negotiating it wait for that feedback  */
+  if (!kms_sdp_extmap_ext_add_uri (extmapext, RTP_HDR_EXT_ABS_SEND_TIME_ID,
+          RTP_HDR_EXT_ABS_SEND_TIME_URI, &err)) {
+    GST_WARNING_OBJECT (self, "Cannot add extmap '%s'", err->message);
+    g_clear_error (&err);
+  }
+
+  kms_sdp_media_handler_add_media_extension (handler,
+      KMS_I_SDP_MEDIA_EXTENSION (extmapext));
+
   if (!self->priv->support_fec) {
     return;
   }
@@ -600,9 +676,6 @@ kms_base_rtp_create_media_handler (KmsBaseSdpEndpoint * base_sdp,
 {
   KmsBaseRtpEndpoint *self = KMS_BASE_RTP_ENDPOINT (base_sdp);
 
-  KmsSdpRtpAvpMediaHandler *h_avp;
-  GError *err = NULL;
-
   if (*handler == NULL) {
     /* Media not supported */
     return;
@@ -620,15 +693,6 @@ kms_base_rtp_create_media_handler (KmsBaseSdpEndpoint * base_sdp,
         "nack", self->priv->rtcp_nack,
         "goog-remb", self->priv->rtcp_remb, NULL);
   }
-  h_avp = KMS_SDP_RTP_AVP_MEDIA_HANDLER (*handler);
-  kms_sdp_rtp_avp_media_handler_add_extmap (h_avp, RTP_HDR_EXT_ABS_SEND_TIME_ID,
-      RTP_HDR_EXT_ABS_SEND_TIME_URI, &err);
-
-  if (err != NULL) {
-    GST_WARNING_OBJECT (base_sdp, "Cannot add extmap '%s'", err->message);
-    g_error_free (err);
-    err = NULL;
-  }
 
   kms_base_rtp_configure_extensions (self, media, *handler);
 }
@@ -903,10 +967,15 @@ kms_base_rtp_endpoint_request_rtp_sink (KmsIRtpSessionManager * manager,
     pad =
         gst_element_get_request_pad (self->priv->rtpbin,
         AUDIO_RTPBIN_RECV_RTP_SINK);
+
+    /* Only for the losses, REMB is not sent for audio */
+    kms_base_rtp_endpoint_config_recv_rtp_hdr_ext (self, media, pad, FALSE);
   } else if (g_strcmp0 (VIDEO_STREAM_NAME, media_str) == 0) {
     pad =
         gst_element_get_request_pad (self->priv->rtpbin,
         VIDEO_RTPBIN_RECV_RTP_SINK);
+
+    kms_base_rtp_endpoint_config_recv_rtp_hdr_ext (self, media, pad, TRUE);
   } else {
     GST_ERROR_OBJECT (self, "'%s' not valid", media_str);
     return NULL;
@@ -928,32 +997,18 @@ kms_base_rtp_endpoint_request_rtp_src (KmsIRtpSessionManager * manager,
         gst_element_get_static_pad (self->priv->rtpbin,
         AUDIO_RTPBIN_SEND_RTP_SRC);
   } else if (g_strcmp0 (VIDEO_STREAM_NAME, media_str) == 0) {
-    gint abs_send_time_id;
-
     pad =
         gst_element_get_static_pad (self->priv->rtpbin,
         VIDEO_RTPBIN_SEND_RTP_SRC);
 
     kms_utils_drop_until_keyframe (pad, TRUE);
-
-    /* TODO: check if needed for audio */
-    abs_send_time_id = sdp_utils_get_abs_send_time_id (media);
-    if (abs_send_time_id != -1) {
-      HdrExtData *data = hdr_ext_data_new (pad, FALSE, TRUE, abs_send_time_id);
-
-      GST_DEBUG_OBJECT (self,
-          "Add probe for updating abs-send-time (id: %d, %" GST_PTR_FORMAT ").",
-          abs_send_time_id, pad);
-      gst_pad_add_probe (pad,
-          GST_PAD_PROBE_TYPE_BUFFER | GST_PAD_PROBE_TYPE_BUFFER_LIST,
-          kms_base_rtp_endpoint_add_rtp_hdr_ext_probe,
-          data, hdr_ext_data_destroy_pointer);
-    }
   } else {
     GST_ERROR_OBJECT (self, "'%s' not valid", media_str);
     return NULL;
   }
 
+  kms_base_rtp_endpoint_config_rtp_hdr_ext (self, media, pad);
+
   return pad;
 }
 
@@ -1092,6 +1147,9 @@ kms_base_rtp_endpoint_create_remb_manager (KmsBaseRtpEndpoint *self,
     kms_remb_remote_set_params (self->priv->rm, self->priv->remb_params);
   }
 
+  kms_remb_local_set_delay_based (self->priv->rl,
+      self->priv->bandwidth_estimator == KMS_BANDWIDTH_ESTIMATOR_DELAY);
+
   GST_DEBUG_OBJECT (self, "REMB managers added");
 }
 
@@ -1184,15 +1242,12 @@ kms_base_rtp_endpoint_get_payloader_for_caps (GstCaps * caps)
 {
   GstElementFactory *factory;
   GstElement *payloader = NULL;
-  GList *payloader_list, *filtered_list;
+  GList *filtered_list;
   GParamSpec *pspec;
 
-  payloader_list =
-      gst_element_factory_list_get_elements (GST_ELEMENT_FACTORY_TYPE_PAYLOADER,
-      GST_RANK_NONE);
   filtered_list =
-      gst_element_factory_list_filter (payloader_list, caps, GST_PAD_SRC,
-      FALSE);
+      kms_factory_cache_get_factories (KMS_FACTORY_CACHE_PAYLOADER, caps,
+      GST_PAD_SRC);
 
   if (filtered_list == NULL) {
     goto end;
@@ -1233,7 +1288,6 @@ kms_base_rtp_endpoint_get_payloader_for_caps (GstCaps * caps)
 
 end:
   gst_plugin_feature_list_free (filtered_list);
-  gst_plugin_feature_list_free (payloader_list);
 
   return payloader;
 }
@@ -1243,14 +1297,11 @@ kms_base_rtp_endpoint_get_depayloader_for_caps (GstCaps * caps)
 {
   GstElementFactory *factory;
   GstElement *depayloader = NULL;
-  GList *payloader_list, *filtered_list, *l;
+  GList *filtered_list, *l;
 
-  payloader_list =
-      gst_element_factory_list_get_elements
-      (GST_ELEMENT_FACTORY_TYPE_DEPAYLOADER, GST_RANK_NONE);
   filtered_list =
-      gst_element_factory_list_filter (payloader_list, caps, GST_PAD_SINK,
-      FALSE);
+      kms_factory_cache_get_factories (KMS_FACTORY_CACHE_DEPAYLOADER, caps,
+      GST_PAD_SINK);
 
   if (filtered_list == NULL) {
     goto end;
@@ -1263,11 +1314,6 @@ kms_base_rtp_endpoint_get_depayloader_for_caps (GstCaps * caps)
       continue;
     }
 
-    if (g_strcmp0 (gst_plugin_feature_get_name (factory), "asteriskh263") == 0) {
-      /* Do not use asteriskh263 for H263 */
-      continue;
-    }
-
     depayloader = gst_element_factory_create (factory, NULL);
 
     if (depayloader != NULL) {
@@ -1278,27 +1324,21 @@ kms_base_rtp_endpoint_get_depayloader_for_caps (GstCaps * caps)
 
 end:
   gst_plugin_feature_list_free (filtered_list);
-  gst_plugin_feature_list_free (payloader_list);
 
   return depayloader;
 }
 
 static void
 add_mark_data_cb (GstPad * pad, KmsMediaType type, GstClockTimeDiff t,
-    KmsList * meta_data, gpointer user_data)
+    KmsBufferLatencyMeta * meta, gpointer user_data)
 {
   E2EProbeData *data = (E2EProbeData *) user_data;
-  StreamE2EAvgStat *stat;
 
-  stat = kms_list_lookup (meta_data, data->id);
-
-  if (stat != NULL) {
+  /* The mark keeps a reference to the stat, which owns the id */
+  if (!kms_buffer_latency_meta_add_mark (meta, data->stat->id,
+          KMS_REF_STRUCT_CAST (data->stat))) {
     GST_WARNING_OBJECT (pad, "Can not mark buffer for e2e latency. "
         "Already used ID: %s", data->id);
-  } else {
-    /* add mark data to this meta */
-    kms_list_prepend (meta_data, g_strdup (data->id),
-        kms_stats_stream_e2e_avg_stat_ref (data->stat));
   }
 }
 
@@ -1331,7 +1371,7 @@ kms_base_rtp_endpoint_configure_2e2_latency (KmsBaseRtpEndpoint * self,
   stat = g_hash_table_lookup (self->priv->stats.avg_e2e, id);
 
   if (stat == NULL) {
-    stat = kms_stats_stream_e2e_avg_stat_new (type);
+    stat = kms_stats_stream_e2e_avg_stat_new (type, id);
     g_hash_table_insert (self->priv->stats.avg_e2e, g_strdup (id), stat);
   }
 
@@ -1342,7 +1382,7 @@ kms_base_rtp_endpoint_configure_2e2_latency (KmsBaseRtpEndpoint * self,
   KMS_ELEMENT_UNLOCK (self);
 
   kms_stats_add_buffer_latency_notification_probe (pad, add_mark_data_cb,
-      TRUE /* lock the data */ , data, (GDestroyNotify) e2e_probe_data_destroy);
+      data, (GDestroyNotify) e2e_probe_data_destroy);
 }
 
 static void
@@ -1468,8 +1508,6 @@ kms_base_rtp_endpoint_set_media_payloader (KmsBaseRtpEndpoint * self,
     type = KMS_ELEMENT_PAD_TYPE_AUDIO;
     rtpbin_pad_name = AUDIO_RTPBIN_SEND_RTP_SINK;
   } else if (g_strcmp0 (VIDEO_STREAM_NAME, media_str) == 0) {
-    /* TODO: check if is needed for audio  */
-    kms_base_rtp_endpoint_config_rtp_hdr_ext (self, media, payloader);
     type = KMS_ELEMENT_PAD_TYPE_VIDEO;
     rtpbin_pad_name = VIDEO_RTPBIN_SEND_RTP_SINK;
   } else {
@@ -1478,13 +1516,24 @@ kms_base_rtp_endpoint_set_media_payloader (KmsBaseRtpEndpoint * self,
   }
 
   if (rtpbin_pad_name != NULL) {
+    KmsStatsSnapshot *snapshot;
     KmsIRtpConnection *conn;
+    KmsMediaType media_type;
+    GstPad *pad;
 
     conn = kms_base_rtp_session_get_connection (sess, handler);
     if (conn == NULL) {
       return;
     }
 
+    media_type = (type == KMS_ELEMENT_PAD_TYPE_AUDIO) ?
+        KMS_MEDIA_TYPE_AUDIO : KMS_MEDIA_TYPE_VIDEO;
+    snapshot = kms_element_get_stats_snapshot (KMS_ELEMENT (self));
+    pad = gst_element_get_static_pad (payloader, "src");
+    kms_stats_snapshot_add_buffers_probe (pad,
+        &snapshot->packets_sent[media_type], &snapshot->bytes_sent[media_type]);
+    g_object_unref (pad);
+
     kms_base_rtp_endpoint_connect_payloader (self, conn, type, payloader,
         rtpbin_pad_name);
   }
@@ -1797,11 +1846,15 @@ static void
 kms_base_rtp_endpoint_update_stats (KmsBaseRtpEndpoint * self,
     GstElement * depayloader, KmsMediaType media)
 {
+  KmsStatsSnapshot *snapshot;
   KmsStatsProbe *probe;
   GstPad *pad;
 
+  snapshot = kms_element_get_stats_snapshot (KMS_ELEMENT (self));
   pad = gst_element_get_static_pad (depayloader, "sink");
   probe = kms_stats_probe_new (pad, media);
+  kms_stats_snapshot_add_buffers_probe (pad, &snapshot->packets_received[media],
+      &snapshot->bytes_received[media]);
   g_object_unref (pad);
 
   KMS_ELEMENT_LOCK (self);
@@ -2422,6 +2475,13 @@ kms_base_rtp_endpoint_set_property (GObject * object, guint property_id,
         self->priv->remb_params = g_value_dup_boxed (value);
       }
       break;
+    case PROP_BANDWIDTH_ESTIMATOR:
+      self->priv->bandwidth_estimator = g_value_get_enum (value);
+      if (self->priv->rl != NULL) {
+        kms_remb_local_set_delay_based (self->priv->rl,
+            self->priv->bandwidth_estimator == KMS_BANDWIDTH_ESTIMATOR_DELAY);
+      }
+      break;
     case PROP_MIN_PORT:{
       guint v = g_value_get_uint (value);
 
@@ -2515,6 +2575,9 @@ kms_base_rtp_endpoint_get_property (GObject * object, guint property_id,
     case PROP_SUPPORT_FEC:
       g_value_set_boolean (value, self->priv->support_fec);
       break;
+    case PROP_BANDWIDTH_ESTIMATOR:
+      g_value_set_enum (value, self->priv->bandwidth_estimator);
+      break;
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
       break;
@@ -2734,6 +2797,7 @@ kms_element_get_e2e_latency_stats (KmsBaseRtpEndpoint * self, gchar * selector)
         (avg->type ==
             KMS_MEDIA_TYPE_AUDIO) ? AUDIO_STREAM_NAME : VIDEO_STREAM_NAME,
         "avg", G_TYPE_UINT64, (guint64) avg->avg, NULL);
+    kms_stats_latency_histogram_to_structure (&avg->histogram, pad_latency);
 
     gst_structure_set (stats, padname, GST_TYPE_STRUCTURE, pad_latency, NULL);
     gst_structure_free (pad_latency);
@@ -2831,6 +2895,26 @@ kms_base_rtp_endpoint_collect_media_stats (KmsElement * obj, gboolean enable)
       (kms_base_rtp_endpoint_parent_class)->collect_media_stats (obj, enable);
 }
 
+static void
+kms_base_rtp_endpoint_fill_stats_snapshot (KmsElement * obj,
+    KmsStatsSnapshot * snapshot)
+{
+  KmsBaseRtpEndpoint *self = KMS_BASE_RTP_ENDPOINT (obj);
+  KmsRembRemote *rm;
+  KmsRembLocal *rl;
+
+  /* REMB managers live until finalize, no need to lock the element */
+  rl = g_atomic_pointer_get (&self->priv->rl);
+  if (rl != NULL) {
+    snapshot->remb_sent = g_atomic_int_get (&rl->remb);
+  }
+
+  rm = g_atomic_pointer_get (&self->priv->rm);
+  if (rm != NULL) {
+    snapshot->remb_received = g_atomic_int_get (&rm->remb);
+  }
+}
+
 static void
 kms_base_rtp_endpoint_constructed (GObject * gobject)
 {
@@ -2868,6 +2952,8 @@ kms_base_rtp_endpoint_class_init (KmsBaseRtpEndpointClass * klass)
   kmselement_class->stats = GST_DEBUG_FUNCPTR (kms_base_rtp_endpoint_stats);
   kmselement_class->collect_media_stats =
       GST_DEBUG_FUNCPTR (kms_base_rtp_endpoint_collect_media_stats);
+  kmselement_class->fill_stats_snapshot =
+      GST_DEBUG_FUNCPTR (kms_base_rtp_endpoint_fill_stats_snapshot);
 
   gstelement_class = GST_ELEMENT_CLASS (klass);
   gst_element_class_set_details_simple (gstelement_class,
@@ -2970,6 +3056,12 @@ kms_base_rtp_endpoint_class_init (KmsBaseRtpEndpointClass * klass)
           "Forward error correction supported", FALSE,
           G_PARAM_READABLE | G_PARAM_STATIC_STRINGS));
 
+  g_object_class_install_property (object_class, PROP_BANDWIDTH_ESTIMATOR,
+      g_param_spec_enum ("bandwidth-estimator", "Bandwidth estimator",
+          "Estimation of the video bandwidth for receiving, sent in REMB",
+          KMS_TYPE_BANDWIDTH_ESTIMATOR, DEFAULT_BANDWIDTH_ESTIMATOR,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
   /* set signals */
   obj_signals[GET_CONNECTION_STATE] =
       g_signal_new ("get-connection_state",
@@ -3396,6 +3488,7 @@ kms_base_rtp_endpoint_init (KmsBaseRtpEndpoint * self)
   self->priv->min_video_recv_bw = MIN_VIDEO_RECV_BW_DEFAULT;
   self->priv->min_video_send_bw = MIN_VIDEO_SEND_BW_DEFAULT;
   self->priv->max_video_send_bw = MAX_VIDEO_SEND_BW_DEFAULT;
+  self->priv->bandwidth_estimator = DEFAULT_BANDWIDTH_ESTIMATOR;
 
   self->priv->rtpbin = gst_element_factory_make ("rtpbin", NULL);
   g_assert (self->priv->rtpbin);
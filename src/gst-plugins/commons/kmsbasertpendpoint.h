@@ -21,6 +21,7 @@
 #include "kmsirtpconnection.h"
 #include "kmsmediatype.h"
 #include "kmsmediastate.h"
+#include "kmsbandwidthestimator.h"
 #include "kmsconnectionstate.h"
 
 G_BEGIN_DECLS
@@ -188,30 +188,45 @@ kms_base_rtp_session_create_bundle_connection_default (KmsBaseRtpSession *
   return NULL;
 }
 
+typedef struct _E2ELatencyData
+{
+  const gchar *name;
+  GstClockTimeDiff t;
+} E2ELatencyData;
+
+static gboolean
+kms_base_rtp_session_e2e_mark_cb (const gchar * id, KmsRefStruct * data,
+    gpointer user_data)
+{
+  E2ELatencyData *latency = user_data;
+  StreamE2EAvgStat *stat;
+
+  if (!g_str_has_prefix (id, latency->name)) {
+    /* This element did not add this mark to the metada */
+    return TRUE;
+  }
+
+  stat = (StreamE2EAvgStat *) data;
+  stat->avg = KMS_STATS_CALCULATE_LATENCY_AVG (latency->t, stat->avg);
+  kms_stats_latency_histogram_record (&stat->histogram, latency->t);
+
+  return TRUE;
+}
+
 static void
 kms_base_rtp_session_e2e_latency_cb (GstPad * pad, KmsMediaType type,
-    GstClockTimeDiff t, KmsList * mdata, gpointer user_data)
+    GstClockTimeDiff t, KmsBufferLatencyMeta * meta, gpointer user_data)
 {
   KmsBaseRtpSession *self = KMS_BASE_RTP_SESSION (user_data);
-  KmsListIter iter;
-  gpointer key, value;
+  E2ELatencyData latency;
   gchar *name;
 
   name = gst_element_get_name (KMS_SDP_SESSION (self)->ep);
 
-  kms_list_iter_init (&iter, mdata);
-  while (kms_list_iter_next (&iter, &key, &value)) {
-    gchar *id = (gchar *) key;
-    StreamE2EAvgStat *stat;
-
-    if (!g_str_has_prefix (id, name)) {
-      /* This element did not add this mark to the metada */
-      continue;
-    }
-
-    stat = (StreamE2EAvgStat *) value;
-    stat->avg = KMS_STATS_CALCULATE_LATENCY_AVG (t, stat->avg);
-  }
+  latency.name = name;
+  latency.t = t;
+  kms_buffer_latency_meta_foreach_mark (meta,
+      kms_base_rtp_session_e2e_mark_cb, &latency);
 
   g_free (name);
 }
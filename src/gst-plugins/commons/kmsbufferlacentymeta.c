@@ -15,9 +15,84 @@
  *
  */
 
-#include "kmsrefstruct.h"
 #include "kmsbufferlacentymeta.h"
 
+#define MARKS_PER_BLOCK 8
+
+typedef struct _KmsBufferLatencyMark
+{
+  const gchar *id;              /* NULL until a writer claims the slot */
+  KmsRefStruct *data;           /* NULL until the mark is published */
+} KmsBufferLatencyMark;
+
+typedef struct _KmsBufferLatencyBlock KmsBufferLatencyBlock;
+
+/* Slots are claimed in order, the first one with a NULL id is free */
+struct _KmsBufferLatencyBlock
+{
+  KmsBufferLatencyMark marks[MARKS_PER_BLOCK];
+  KmsBufferLatencyBlock *next;
+};
+
+/* Append only storage shared by a buffer and its copies. Marks are never
+ * modified or removed once published, so readers only need atomic loads */
+struct _KmsBufferLatencyMarks
+{
+  gint refcount;
+  KmsBufferLatencyBlock block;
+};
+
+static KmsBufferLatencyMarks *
+kms_buffer_latency_marks_new ()
+{
+  KmsBufferLatencyMarks *marks;
+
+  marks = g_slice_new0 (KmsBufferLatencyMarks);
+  marks->refcount = 1;
+
+  return marks;
+}
+
+static KmsBufferLatencyMarks *
+kms_buffer_latency_marks_ref (KmsBufferLatencyMarks * marks)
+{
+  g_atomic_int_inc (&marks->refcount);
+
+  return marks;
+}
+
+static void
+kms_buffer_latency_block_clear (KmsBufferLatencyBlock * block)
+{
+  guint i;
+
+  for (i = 0; i < MARKS_PER_BLOCK; i++) {
+    if (block->marks[i].data != NULL) {
+      kms_ref_struct_unref (block->marks[i].data);
+    }
+  }
+}
+
+static void
+kms_buffer_latency_marks_unref (KmsBufferLatencyMarks * marks)
+{
+  KmsBufferLatencyBlock *block, *next;
+
+  if (!g_atomic_int_dec_and_test (&marks->refcount)) {
+    return;
+  }
+
+  kms_buffer_latency_block_clear (&marks->block);
+
+  for (block = marks->block.next; block != NULL; block = next) {
+    next = block->next;
+    kms_buffer_latency_block_clear (block);
+    g_slice_free (KmsBufferLatencyBlock, block);
+  }
+
+  g_slice_free (KmsBufferLatencyMarks, marks);
+}
+
 GType
 kms_buffer_latency_meta_api_get_type (void)
 {
@@ -33,6 +108,29 @@ kms_buffer_latency_meta_api_get_type (void)
   return type;
 }
 
+/* Storage is created on demand, but once a copy shares it, it never changes */
+static KmsBufferLatencyMarks *
+kms_buffer_latency_meta_get_marks (KmsBufferLatencyMeta * meta)
+{
+  KmsBufferLatencyMarks *marks, *created;
+
+  marks = g_atomic_pointer_get (&meta->marks);
+
+  if (marks != NULL) {
+    return marks;
+  }
+
+  created = kms_buffer_latency_marks_new ();
+
+  if (g_atomic_pointer_compare_and_exchange (&meta->marks, NULL, created)) {
+    return created;
+  }
+
+  kms_buffer_latency_marks_unref (created);
+
+  return g_atomic_pointer_get (&meta->marks);
+}
+
 static gboolean
 kms_buffer_latency_meta_init (GstMeta * meta, gpointer params,
     GstBuffer * buffer)
@@ -42,9 +140,8 @@ kms_buffer_latency_meta_init (GstMeta * meta, gpointer params,
   lmeta->ts = GST_CLOCK_TIME_NONE;
   lmeta->valid = FALSE;
 
-  g_rec_mutex_init (&lmeta->datamutex);
-  lmeta->data = kms_list_new_full (g_str_equal, g_free,
-      (GDestroyNotify) kms_ref_struct_unref);
+  /* Created on the first mark or copy, most buffers never get either */
+  lmeta->marks = NULL;
 
   return TRUE;
 }
@@ -68,13 +165,9 @@ kms_buffer_latency_meta_transform (GstBuffer * transbuf, GstMeta * meta,
     return FALSE;
   }
 
-  if (new_meta->data != NULL) {
-    kms_list_unref (new_meta->data);
-  }
-
-  KMS_BUFFER_LATENCY_DATA_LOCK (lmeta);
-  new_meta->data = kms_list_ref (lmeta->data);
-  KMS_BUFFER_LATENCY_DATA_UNLOCK (lmeta);
+  /* Marks added later to either buffer have to be seen by both */
+  new_meta->marks =
+      kms_buffer_latency_marks_ref (kms_buffer_latency_meta_get_marks (lmeta));
 
   return TRUE;
 }
@@ -84,11 +177,10 @@ kms_buffer_latency_meta_free (GstMeta * meta, GstBuffer * buffer)
 {
   KmsBufferLatencyMeta *lmeta = (KmsBufferLatencyMeta *) meta;
 
-  KMS_BUFFER_LATENCY_DATA_LOCK (lmeta);
-  kms_list_unref (lmeta->data);
-  KMS_BUFFER_LATENCY_DATA_UNLOCK (lmeta);
-
-  g_rec_mutex_clear (&lmeta->datamutex);
+  if (lmeta->marks != NULL) {
+    kms_buffer_latency_marks_unref (lmeta->marks);
+    lmeta->marks = NULL;
+  }
 }
 
 const GstMetaInfo *
@@ -127,3 +219,95 @@ kms_buffer_add_buffer_latency_meta (GstBuffer * buffer, GstClockTime ts,
 
   return meta;
 }
+
+gboolean
+kms_buffer_latency_meta_add_mark (KmsBufferLatencyMeta * meta,
+    const gchar * id, KmsRefStruct * data)
+{
+  KmsBufferLatencyMarks *marks;
+  KmsBufferLatencyBlock *block, *next;
+  const gchar *claimed;
+  gint i;
+
+  g_return_val_if_fail (meta != NULL, FALSE);
+  g_return_val_if_fail (id != NULL && data != NULL, FALSE);
+
+  marks = kms_buffer_latency_meta_get_marks (meta);
+
+  /* Claiming a slot with a CAS on its id is both the duplicate check and the
+   * append: every slot before it has been compared, and a concurrent writer
+   * of the same id finds this one claimed */
+  for (block = &marks->block;;) {
+    for (i = 0; i < MARKS_PER_BLOCK; i++) {
+      KmsBufferLatencyMark *mark = &block->marks[i];
+
+      claimed = g_atomic_pointer_get (&mark->id);
+
+      if (claimed == NULL) {
+        if (g_atomic_pointer_compare_and_exchange (&mark->id, NULL, id)) {
+          /* Publishing data makes the mark visible to readers */
+          g_atomic_pointer_set (&mark->data, kms_ref_struct_ref (data));
+          return TRUE;
+        }
+
+        claimed = g_atomic_pointer_get (&mark->id);
+      }
+
+      if (g_strcmp0 (claimed, id) == 0) {
+        return FALSE;
+      }
+    }
+
+    next = g_atomic_pointer_get (&block->next);
+
+    if (next == NULL) {
+      next = g_slice_new0 (KmsBufferLatencyBlock);
+
+      if (!g_atomic_pointer_compare_and_exchange (&block->next, NULL, next)) {
+        g_slice_free (KmsBufferLatencyBlock, next);
+        next = g_atomic_pointer_get (&block->next);
+      }
+    }
+
+    block = next;
+  }
+}
+
+void
+kms_buffer_latency_meta_foreach_mark (KmsBufferLatencyMeta * meta,
+    KmsBufferLatencyMarkFunc func, gpointer user_data)
+{
+  KmsBufferLatencyMarks *marks;
+  KmsBufferLatencyBlock *block;
+  KmsRefStruct *data;
+  gint i;
+
+  g_return_if_fail (meta != NULL && func != NULL);
+
+  marks = g_atomic_pointer_get (&meta->marks);
+
+  if (marks == NULL) {
+    return;
+  }
+
+  for (block = &marks->block; block != NULL;
+      block = g_atomic_pointer_get (&block->next)) {
+    for (i = 0; i < MARKS_PER_BLOCK; i++) {
+      if (g_atomic_pointer_get (&block->marks[i].id) == NULL) {
+        /* No more claimed slots */
+        return;
+      }
+
+      data = g_atomic_pointer_get (&block->marks[i].data);
+
+      if (data == NULL) {
+        /* Slot claimed by a writer that has not published it yet */
+        continue;
+      }
+
+      if (!func (block->marks[i].id, data, user_data)) {
+        return;
+      }
+    }
+  }
+}
@@ -21,16 +21,19 @@
 #include <gst/gst.h>
 
 #include "kmsmediatype.h"
-#include "kmslist.h"
+#include "kmsrefstruct.h"
 
 G_BEGIN_DECLS
 
 typedef struct _KmsBufferLatencyMeta KmsBufferLatencyMeta;
+typedef struct _KmsBufferLatencyMarks KmsBufferLatencyMarks;
 
 /**
  * KmsBufferLatencyMeta:
  * @meta: the parent type
  * @ts: The time stamp
+ * @marks: Marks added by the elements the buffer went through, shared with
+ * the copies of the buffer. Only accessed through the functions below.
  *
  * Buffer metadata for measuring buffer latency since the buffer is generated
  * until it is processed by a sink.
@@ -42,14 +45,12 @@ struct _KmsBufferLatencyMeta {
   KmsMediaType type;
   gboolean valid;
 
-  GRecMutex datamutex;
-  KmsList *data; /* <string, refstruct> */
+  KmsBufferLatencyMarks *marks;
 };
 
-#define KMS_BUFFER_LATENCY_DATA_LOCK(mdata) \
-  (g_rec_mutex_lock (&((KmsBufferLatencyMeta *)mdata)->datamutex))
-#define KMS_BUFFER_LATENCY_DATA_UNLOCK(mdata) \
-  (g_rec_mutex_unlock (&((KmsBufferLatencyMeta *)mdata)->datamutex))
+/* Called for each mark, return FALSE to stop iterating */
+typedef gboolean (*KmsBufferLatencyMarkFunc) (const gchar *id,
+    KmsRefStruct *data, gpointer user_data);
 
 GType kms_buffer_latency_meta_api_get_type (void);
 #define KMS_BUFFER_LATENCY_META_API_TYPE \
@@ -65,6 +66,13 @@ const GstMetaInfo *kms_buffer_latency_meta_get_info (void);
 KmsBufferLatencyMeta * kms_buffer_add_buffer_latency_meta (GstBuffer *buffer,
   GstClockTime ts, gboolean valid, KmsMediaType type);
 
+/* Marks never change once added, so no lock is needed to read or add them.
+ * @id has to stay valid while @data is alive, usually @data owns it */
+gboolean kms_buffer_latency_meta_add_mark (KmsBufferLatencyMeta *meta,
+  const gchar *id, KmsRefStruct *data);
+void kms_buffer_latency_meta_foreach_mark (KmsBufferLatencyMeta *meta,
+  KmsBufferLatencyMarkFunc func, gpointer user_data);
+
 G_END_DECLS
 
 #endif /* __KMS_BUFFER_LATENCY_META_H__ */
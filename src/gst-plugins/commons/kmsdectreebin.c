@@ -21,6 +21,8 @@
 
 #include "kmsdectreebin.h"
 #include "kmsutils.h"
+#include "kmsfactorycache.h"
+#include "kmsframeallocator.h"
 
 #define GST_DEFAULT_NAME "dectreebin"
 #define GST_CAT_DEFAULT kms_dec_tree_bin_debug
@@ -29,35 +31,17 @@ GST_DEBUG_CATEGORY_STATIC (GST_CAT_DEFAULT);
 #define kms_dec_tree_bin_parent_class parent_class
 G_DEFINE_TYPE (KmsDecTreeBin, kms_dec_tree_bin, KMS_TYPE_TREE_BIN);
 
-static GstElement *
-create_decoder_for_caps (const GstCaps * caps, const GstCaps * raw_caps)
+static GstElementFactory *
+find_decoder_factory (const GstCaps * caps, const GstCaps * raw_caps)
 {
-  GList *decoder_list, *filtered_list, *aux_list, *l;
+  GList *filtered_list, *aux_list, *l;
   GstElementFactory *decoder_factory = NULL;
-  GstElement *decoder = NULL;
-  gboolean contains_openh264 = FALSE;
-
-  decoder_list =
-      gst_element_factory_list_get_elements (GST_ELEMENT_FACTORY_TYPE_DECODER,
-      GST_RANK_NONE);
-
-  /* HACK: Augment the openh264 rank */
-  for (l = decoder_list; l != NULL; l = l->next) {
-    decoder_factory = GST_ELEMENT_FACTORY (l->data);
-
-    if (g_str_has_prefix (GST_OBJECT_NAME (decoder_factory), "openh264")) {
-      decoder_list = g_list_remove (decoder_list, l->data);
-      decoder_list = g_list_prepend (decoder_list, decoder_factory);
-      contains_openh264 = TRUE;
-      break;
-    }
-  }
-  decoder_factory = NULL;
 
   /* Remove stream-format from raw_caps to allow select openh264dec */
-  if (contains_openh264 &&
-      g_str_has_suffix (gst_structure_get_name (gst_caps_get_structure (caps,
-                  0)), "h264")) {
+  if (g_str_has_suffix (gst_structure_get_name (gst_caps_get_structure (caps,
+                  0)), "h264")
+      && kms_factory_cache_has_factory (KMS_FACTORY_CACHE_DECODER,
+          "openh264")) {
     GstCaps *caps_copy;
     GstStructure *structure;
 
@@ -65,13 +49,13 @@ create_decoder_for_caps (const GstCaps * caps, const GstCaps * raw_caps)
     gst_structure_remove_field (structure, "stream-format");
     caps_copy = gst_caps_new_full (structure, NULL);
     aux_list =
-        gst_element_factory_list_filter (decoder_list, caps_copy, GST_PAD_SINK,
-        FALSE);
+        kms_factory_cache_get_factories (KMS_FACTORY_CACHE_DECODER, caps_copy,
+        GST_PAD_SINK);
     gst_caps_unref (caps_copy);
   } else {
     aux_list =
-        gst_element_factory_list_filter (decoder_list, caps, GST_PAD_SINK,
-        FALSE);
+        kms_factory_cache_get_factories (KMS_FACTORY_CACHE_DECODER, caps,
+        GST_PAD_SINK);
   }
 
   filtered_list =
@@ -84,13 +68,28 @@ create_decoder_for_caps (const GstCaps * caps, const GstCaps * raw_caps)
   }
 
   if (decoder_factory != NULL) {
-    decoder = gst_element_factory_create (decoder_factory, NULL);
+    gst_object_ref (decoder_factory);
   }
 
   gst_plugin_feature_list_free (filtered_list);
-  gst_plugin_feature_list_free (decoder_list);
   gst_plugin_feature_list_free (aux_list);
 
+  return decoder_factory;
+}
+
+static GstElement *
+create_decoder_for_caps (const GstCaps * caps, const GstCaps * raw_caps)
+{
+  GstElementFactory *decoder_factory;
+  GstElement *decoder = NULL;
+
+  decoder_factory = find_decoder_factory (caps, raw_caps);
+
+  if (decoder_factory != NULL) {
+    decoder = gst_element_factory_create (decoder_factory, NULL);
+    gst_object_unref (decoder_factory);
+  }
+
   return decoder;
 }
 
@@ -112,6 +111,10 @@ kms_dec_tree_bin_configure (KmsDecTreeBin * self, const GstCaps * caps,
   GST_DEBUG_OBJECT (self, "Decoder found: %" GST_PTR_FORMAT, dec);
   name = gst_element_get_name (dec);
 
+  pad = gst_element_get_static_pad (dec, "src");
+  kms_frame_allocator_propose (pad);
+  gst_object_unref (pad);
+
   if (g_str_has_prefix (name, "opusdec")) {
     g_object_set (dec, "plc", TRUE, "use-inband-fec", TRUE, NULL);
   }
@@ -163,6 +166,45 @@ kms_dec_tree_bin_new (const GstCaps * caps, const GstCaps * raw_caps)
   return KMS_DEC_TREE_BIN (dec);
 }
 
+static gint
+compare_factory (const GValue * item, GstElementFactory * factory)
+{
+  GstElement *element = g_value_get_object (item);
+
+  return gst_element_get_factory (element) == factory ? 0 : 1;
+}
+
+gboolean
+kms_dec_tree_bin_can_decode (KmsDecTreeBin * self, const GstCaps * caps,
+    const GstCaps * raw_caps)
+{
+  GstElementFactory *decoder_factory;
+  GstIterator *it;
+  GValue item = G_VALUE_INIT;
+  gboolean found = FALSE;
+
+  g_return_val_if_fail (KMS_IS_DEC_TREE_BIN (self), FALSE);
+
+  decoder_factory = find_decoder_factory (caps, raw_caps);
+
+  if (decoder_factory == NULL) {
+    return FALSE;
+  }
+
+  it = gst_bin_iterate_elements (GST_BIN (self));
+  found = gst_iterator_find_custom (it, (GCompareFunc) compare_factory, &item,
+      decoder_factory);
+  gst_iterator_free (it);
+
+  if (found) {
+    g_value_unset (&item);
+  }
+
+  gst_object_unref (decoder_factory);
+
+  return found;
+}
+
 static void
 kms_dec_tree_bin_init (KmsDecTreeBin * self)
 {
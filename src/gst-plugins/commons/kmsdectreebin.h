@@ -50,6 +50,8 @@ struct _KmsDecTreeBinClass
 GType kms_dec_tree_bin_get_type (void);
 
 KmsDecTreeBin * kms_dec_tree_bin_new (const GstCaps * caps, const GstCaps * raw_aps);
+/* TRUE if @self holds the decoder that would be chosen for these caps */
+gboolean kms_dec_tree_bin_can_decode (KmsDecTreeBin *self, const GstCaps * caps, const GstCaps * raw_caps);
 
 G_END_DECLS
 #endif /* __KMS_DEC_TREE_BIN_H__ */
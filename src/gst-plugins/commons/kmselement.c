@@ -86,6 +86,8 @@ typedef struct _StreamInputAvgStat
   KmsRefStruct ref;
   KmsMediaType type;
   gdouble avg;
+  KmsStatsLatencyHistogram histogram;
+  KmsStatsSnapshot *snapshot;
 } StreamInputAvgStat;
 
 typedef struct _PendingPad
@@ -100,6 +102,7 @@ typedef struct _KmsElementStats
   GSList *probes;
   /* Input average stream stats */
   GHashTable *avg_iss;          /* <"pad_name", StreamInputAvgStat> */
+  KmsStatsSnapshot snapshot;
 } KmsElementStats;
 
 typedef struct _KmsOutputElementData
@@ -323,7 +326,7 @@ stream_input_avg_stat_destroy (StreamInputAvgStat * stat)
 }
 
 static StreamInputAvgStat *
-stream_input_avg_stat_new (KmsMediaType type)
+stream_input_avg_stat_new (KmsMediaType type, KmsStatsSnapshot * snapshot)
 {
   StreamInputAvgStat *stat;
 
@@ -331,6 +334,8 @@ stream_input_avg_stat_new (KmsMediaType type)
   kms_ref_struct_init (KMS_REF_STRUCT_CAST (stat),
       (GDestroyNotify) stream_input_avg_stat_destroy);
   stat->type = type;
+  stat->snapshot = snapshot;
+  kms_stats_latency_histogram_init (&stat->histogram);
 
   return stat;
 }
@@ -565,11 +570,14 @@ cb_buffer_received (GstPad * pad, GstPadProbeInfo * info, gpointer data)
   KmsElement *element;
 
   if (weak_ptr == NULL) {
-    return FALSE;
+    return GST_PAD_PROBE_DROP;
   }
 
   element = KMS_ELEMENT (weak_ptr);
-  if (g_atomic_int_compare_and_exchange (&fd_data->media_flowing, 0, 1)) {
+
+  /* Already flowing: nothing to signal, skip the atomic exchange */
+  if (g_atomic_int_get (&fd_data->media_flowing) == 0 &&
+      g_atomic_int_compare_and_exchange (&fd_data->media_flowing, 0, 1)) {
     if (fd_data->media_flow_type == KMS_MEDIA_FLOW_IN) {
       g_signal_emit (G_OBJECT (element),
           element_signals[SIGNAL_FLOW_IN_MEDIA], 0, TRUE,
@@ -909,7 +917,7 @@ get_sink_pad_name (KmsElementPadType type, const gchar * description)
 
 static void
 kms_element_calculate_stats (GstPad * pad, KmsMediaType type,
-    GstClockTimeDiff t, KmsList * mdata, gpointer user_data)
+    GstClockTimeDiff t, KmsBufferLatencyMeta * meta, gpointer user_data)
 {
   StreamInputAvgStat *sstat = (StreamInputAvgStat *) user_data;
 
@@ -922,6 +930,9 @@ kms_element_calculate_stats (GstPad * pad, KmsMediaType type,
   }
 
   sstat->avg = KMS_STATS_CALCULATE_LATENCY_AVG (t, sstat->avg);
+  kms_stats_latency_histogram_record (&sstat->histogram, t);
+  KMS_STATS_SNAPSHOT_SET (sstat->snapshot->input_latency[sstat->type],
+      (guint64) sstat->avg);
 }
 
 static void
@@ -957,7 +968,8 @@ kms_element_set_sink_input_stats (KmsElement * self, GstPad * pad,
   } else {
     GST_DEBUG_OBJECT (self, "Generating average stats for pad %" GST_PTR_FORMAT,
         pad);
-    sstat = stream_input_avg_stat_new (media_type);
+    sstat = stream_input_avg_stat_new (media_type,
+        &self->priv->stats.snapshot);
     g_hash_table_insert (self->priv->stats.avg_iss, padname, sstat);
   }
 
@@ -966,7 +978,7 @@ kms_element_set_sink_input_stats (KmsElement * self, GstPad * pad,
 
   if (self->priv->stats_enabled) {
     GST_INFO_OBJECT (self, "Enabling average stat for %" GST_PTR_FORMAT, pad);
-    kms_stats_probe_add_latency (s_probe, kms_element_calculate_stats, FALSE,
+    kms_stats_probe_add_latency (s_probe, kms_element_calculate_stats,
         stream_input_avg_stat_ref (sstat),
         (GDestroyNotify) kms_ref_struct_unref);
   }
@@ -1673,6 +1685,7 @@ kms_element_get_input_latency_stats (KmsElement * self, gchar * selector)
         (avg->type ==
             KMS_MEDIA_TYPE_AUDIO) ? AUDIO_STREAM_NAME : VIDEO_STREAM_NAME,
         "avg", G_TYPE_UINT64, (guint64) avg->avg, NULL);
+    kms_stats_latency_histogram_to_structure (&avg->histogram, pad_latency);
 
     gst_structure_set (stats, padname, GST_TYPE_STRUCTURE, pad_latency, NULL);
     gst_structure_free (pad_latency);
@@ -1709,6 +1722,30 @@ kms_element_stats_impl (KmsElement * self, gchar * selector)
   return stats;
 }
 
+KmsStatsSnapshot *
+kms_element_get_stats_snapshot (KmsElement * self)
+{
+  g_return_val_if_fail (KMS_IS_ELEMENT (self), NULL);
+
+  return &self->priv->stats.snapshot;
+}
+
+void
+kms_element_read_stats_snapshot (KmsElement * self,
+    KmsStatsSnapshot * snapshot)
+{
+  KmsElementClass *klass;
+
+  g_return_if_fail (KMS_IS_ELEMENT (self));
+
+  kms_stats_snapshot_read (&self->priv->stats.snapshot, snapshot);
+
+  klass = KMS_ELEMENT_GET_CLASS (self);
+  if (klass->fill_stats_snapshot != NULL) {
+    klass->fill_stats_snapshot (self, snapshot);
+  }
+}
+
 static GstPad *
 kms_element_get_probed_pad (KmsStatsProbe * probe, KmsElement * self)
 {
@@ -1782,7 +1819,7 @@ kms_element_enable_media_stats (KmsStatsProbe * probe, KmsElement * self)
 
   if (sstat != NULL) {
     kms_stats_probe_add_latency (probe, kms_element_calculate_stats,
-        FALSE, stream_input_avg_stat_ref (sstat),
+        stream_input_avg_stat_ref (sstat),
         (GDestroyNotify) kms_ref_struct_unref);
   }
 }
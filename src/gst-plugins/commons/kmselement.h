@@ -21,6 +21,7 @@
 #include "kmsloop.h"
 #include "kmselementpadtype.h"
 #include "kmsmediatype.h"
+#include "kmsstats.h"
 
 G_BEGIN_DECLS
 
@@ -95,6 +96,8 @@ struct _KmsElementClass
   KmsRequestNewSrcElementReturn (*request_new_src_element) (KmsElement * self, KmsElementPadType type, const gchar * description, const gchar * name);
   gboolean (*request_new_sink_pad) (KmsElement * self, KmsElementPadType type, const gchar * description, const gchar * name);
   gboolean (*release_requested_sink_pad) (KmsElement * self, GstPad *pad);
+  /* Fills the values not counted on the streaming threads. Must not block */
+  void (*fill_stats_snapshot) (KmsElement * self, KmsStatsSnapshot * snapshot);
 };
 
 GType kms_element_get_type (void);
@@ -138,5 +141,10 @@ void kms_element_remove_sink_by_type_full (KmsElement *self,
 
 KmsElementPadType kms_element_get_pad_type (KmsElement * self, GstPad * pad);
 
+/* Live counters of the element, only to be updated with KMS_STATS_SNAPSHOT_* */
+KmsStatsSnapshot *kms_element_get_stats_snapshot (KmsElement * self);
+void kms_element_read_stats_snapshot (KmsElement * self,
+    KmsStatsSnapshot * snapshot);
+
 G_END_DECLS
 #endif /* __KMS_ELEMENT_H__ */
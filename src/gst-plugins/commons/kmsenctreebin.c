@@ -21,6 +21,8 @@
 
 #include "kmsenctreebin.h"
 #include "kmsutils.h"
+#include "kmsfactorycache.h"
+#include "kmsframeallocator.h"
 
 #define GST_DEFAULT_NAME "enctreebin"
 #define GST_CAT_DEFAULT kms_enc_tree_bin_debug
@@ -50,6 +52,27 @@ typedef enum
   UNSUPPORTED
 } EncoderType;
 
+typedef enum
+{
+  PROFILE_LOW_LATENCY,
+  PROFILE_THROUGHPUT,
+  PROFILE_QUALITY
+} EncoderProfile;
+
+static const gchar *profile_names[] = {
+  "low-latency",
+  "throughput",
+  "quality"
+};
+
+/* Largest resolutions encoded with 1 and 2 threads in low latency profile */
+#define ONE_THREAD_MAX_PIXELS (640 * 480)
+#define TWO_THREADS_MAX_PIXELS (1280 * 720)
+/* Used to guess the resolution when caps do not tell it */
+#define ONE_THREAD_MAX_BITRATE 1000000
+#define TWO_THREADS_MAX_BITRATE 2500000
+#define MAX_THREADS 8
+
 struct _KmsEncTreeBinPrivate
 {
   GstElement *enc;
@@ -63,6 +86,8 @@ struct _KmsEncTreeBinPrivate
 
   gint max_bitrate;
   gint min_bitrate;
+
+  EncoderProfile profile;
 };
 
 static const gchar *
@@ -134,32 +159,123 @@ set_encoder_configuration (GstElement * encoder, GstStructure * codec_config,
   }
 }
 
+static EncoderProfile
+get_encoder_profile (GstStructure * codec_configs)
+{
+  const gchar *name;
+  guint i;
+
+  if (codec_configs == NULL) {
+    return PROFILE_LOW_LATENCY;
+  }
+
+  name = gst_structure_get_string (codec_configs, KMS_ENC_TREE_BIN_PROFILE);
+
+  if (name == NULL) {
+    return PROFILE_LOW_LATENCY;
+  }
+
+  for (i = 0; i < G_N_ELEMENTS (profile_names); i++) {
+    if (g_strcmp0 (name, profile_names[i]) == 0) {
+      return i;
+    }
+  }
+
+  GST_WARNING ("Unknown encoder profile '%s', using %s", name,
+      profile_names[PROFILE_LOW_LATENCY]);
+
+  return PROFILE_LOW_LATENCY;
+}
+
+/*
+ * Threads for the low latency profile, one per 640x480 area, up to 4. If
+ * the resolution is not known yet, the bitrate tells about the expected one.
+ * Other profiles trade latency for throughput and use twice these.
+ */
+static guint
+get_encoder_threads (EncoderProfile profile, gint width, gint height,
+    gint bitrate)
+{
+  guint threads;
+
+  if (width > 0 && height > 0) {
+    gint64 pixels = (gint64) width * height;
+
+    if (pixels <= ONE_THREAD_MAX_PIXELS) {
+      threads = 1;
+    } else if (pixels <= TWO_THREADS_MAX_PIXELS) {
+      threads = 2;
+    } else {
+      threads = 4;
+    }
+  } else if (bitrate <= ONE_THREAD_MAX_BITRATE) {
+    threads = 1;
+  } else if (bitrate <= TWO_THREADS_MAX_BITRATE) {
+    threads = 2;
+  } else {
+    threads = 4;
+  }
+
+  if (profile != PROFILE_LOW_LATENCY) {
+    threads *= 2;
+  }
+
+  return CLAMP (threads, 1, MIN (MAX_THREADS, g_get_num_processors ()));
+}
+
+/* vp8enc splits the last stage in 2^n partitions that threads share */
 static void
-configure_encoder (GstElement * encoder, EncoderType type, gint target_bitrate,
-    GstStructure * codec_configs)
+configure_vp8_threads (GstElement * encoder, guint threads)
 {
-  GST_DEBUG ("Configure encoder: %" GST_PTR_FORMAT, encoder);
+  /* *INDENT-OFF* */
+  g_object_set (G_OBJECT (encoder),
+                "threads", (gint) threads,
+                "token-partitions", MIN (g_bit_storage (threads) - 1, 3),
+                NULL);
+  /* *INDENT-ON* */
+}
+
+static void
+configure_encoder (GstElement * encoder, EncoderType type,
+    EncoderProfile profile, const GstCaps * caps, gint target_bitrate,
+    gint max_bitrate, GstStructure * codec_configs)
+{
+  GstStructure *st = gst_caps_get_structure (caps, 0);
+  gint width = 0, height = 0;
+  guint threads;
+
+  gst_structure_get_int (st, "width", &width);
+  gst_structure_get_int (st, "height", &height);
+  threads = get_encoder_threads (profile, width, height,
+      max_bitrate < G_MAXINT ? max_bitrate : target_bitrate);
+
+  GST_DEBUG ("Configure encoder: %" GST_PTR_FORMAT " with %s profile, %u"
+      " threads", encoder, profile_names[profile], threads);
+
   switch (type) {
     case VP8:
     {
       /* *INDENT-OFF* */
       g_object_set (G_OBJECT (encoder),
                     "deadline", G_GINT64_CONSTANT (200000),
-                    "threads", 1,
-                    "cpu-used", 16,
+                    "cpu-used", profile == PROFILE_QUALITY ? 4 : 16,
                     "resize-allowed", TRUE,
                     "target-bitrate", target_bitrate,
                     "end-usage", /* cbr */ 1,
                     NULL);
       /* *INDENT-ON* */
+      configure_vp8_threads (encoder, threads);
       break;
     }
     case X264:
     {
       /* *INDENT-OFF* */
       g_object_set (G_OBJECT (encoder),
-                    "speed-preset", /* veryfast */ 3,
-                    "threads", (guint) 1,
+                    "speed-preset", profile == PROFILE_QUALITY ?
+                        /* fast */ 5 : /* veryfast */ 3,
+                    "threads", threads,
+                    /* Slices do not add frames of delay, frame threads do */
+                    "sliced-threads", profile == PROFILE_LOW_LATENCY,
                     "bitrate", target_bitrate / 1000,
                     "key-int-max", 60,
                     "tune", /* zero-latency */ 4,
@@ -173,6 +289,8 @@ configure_encoder (GstElement * encoder, EncoderType type, gint target_bitrate,
       g_object_set (G_OBJECT (encoder),
                     "rate-control", /* bitrate */ 1,
                     "bitrate", target_bitrate,
+                    "multi-thread", threads,
+                    "num-slices", threads,
                     NULL);
       /* *INDENT-ON* */
       break;
@@ -214,31 +332,15 @@ kms_enc_tree_bin_set_encoder_type (KmsEncTreeBin * self)
   g_free (name);
 }
 
-static void
-kms_enc_tree_bin_create_encoder_for_caps (KmsEncTreeBin * self,
-    const GstCaps * caps, gint target_bitrate, GstStructure * codec_configs)
+static GstElementFactory *
+kms_enc_tree_bin_find_encoder_factory (const GstCaps * caps)
 {
-  GList *encoder_list, *filtered_list, *l;
+  GList *filtered_list, *l;
   GstElementFactory *encoder_factory = NULL;
 
-  encoder_list =
-      gst_element_factory_list_get_elements (GST_ELEMENT_FACTORY_TYPE_ENCODER,
-      GST_RANK_NONE);
-
-  /* HACK: Augment the openh264 rank */
-  for (l = encoder_list; l != NULL; l = l->next) {
-    encoder_factory = GST_ELEMENT_FACTORY (l->data);
-
-    if (g_str_has_prefix (GST_OBJECT_NAME (encoder_factory), "openh264")) {
-      encoder_list = g_list_remove (encoder_list, l->data);
-      encoder_list = g_list_prepend (encoder_list, encoder_factory);
-      break;
-    }
-  }
-
-  encoder_factory = NULL;
   filtered_list =
-      gst_element_factory_list_filter (encoder_list, caps, GST_PAD_SRC, FALSE);
+      kms_factory_cache_get_factories (KMS_FACTORY_CACHE_ENCODER, caps,
+      GST_PAD_SRC);
 
   for (l = filtered_list; l != NULL && encoder_factory == NULL; l = l->next) {
     encoder_factory = GST_ELEMENT_FACTORY (l->data);
@@ -246,15 +348,32 @@ kms_enc_tree_bin_create_encoder_for_caps (KmsEncTreeBin * self,
       encoder_factory = NULL;
   }
 
+  if (encoder_factory != NULL) {
+    gst_object_ref (encoder_factory);
+  }
+
+  gst_plugin_feature_list_free (filtered_list);
+
+  return encoder_factory;
+}
+
+static void
+kms_enc_tree_bin_create_encoder_for_caps (KmsEncTreeBin * self,
+    const GstCaps * caps, gint target_bitrate, GstStructure * codec_configs)
+{
+  GstElementFactory *encoder_factory;
+
+  encoder_factory = kms_enc_tree_bin_find_encoder_factory (caps);
+
   if (encoder_factory != NULL) {
     self->priv->enc = gst_element_factory_create (encoder_factory, NULL);
     kms_enc_tree_bin_set_encoder_type (self);
-    configure_encoder (self->priv->enc, self->priv->enc_type, target_bitrate,
+    self->priv->profile = get_encoder_profile (codec_configs);
+    configure_encoder (self->priv->enc, self->priv->enc_type,
+        self->priv->profile, caps, target_bitrate, self->priv->max_bitrate,
         codec_configs);
+    gst_object_unref (encoder_factory);
   }
-
-  gst_plugin_feature_list_free (filtered_list);
-  gst_plugin_feature_list_free (encoder_list);
 }
 
 static gint
@@ -281,13 +400,8 @@ kms_enc_tree_bin_get_bitrate (KmsEncTreeBin * self)
 }
 
 static void
-kms_enc_tree_bin_set_target_bitrate (KmsEncTreeBin * self)
+kms_enc_tree_bin_apply_bitrate (KmsEncTreeBin * self, gint target_bitrate)
 {
-  gint target_bitrate = kms_enc_tree_bin_get_bitrate (self);
-
-  if (target_bitrate <= 0) {
-    return;
-  }
 
   GST_DEBUG_OBJECT (self->priv->enc, "Set target encoding bitrate: %d bps",
       target_bitrate);
@@ -328,6 +442,18 @@ kms_enc_tree_bin_set_target_bitrate (KmsEncTreeBin * self)
   }
 }
 
+static void
+kms_enc_tree_bin_set_target_bitrate (KmsEncTreeBin * self)
+{
+  gint target_bitrate = kms_enc_tree_bin_get_bitrate (self);
+
+  if (target_bitrate <= 0) {
+    return;
+  }
+
+  kms_enc_tree_bin_apply_bitrate (self, target_bitrate);
+}
+
 void
 kms_enc_tree_bin_set_bitrate_limits (KmsEncTreeBin * self, gint min_bitrate,
     gint max_bitrate)
@@ -339,6 +465,42 @@ kms_enc_tree_bin_set_bitrate_limits (KmsEncTreeBin * self, gint min_bitrate,
   kms_enc_tree_bin_set_target_bitrate (self);
 }
 
+gboolean
+kms_enc_tree_bin_reset (KmsEncTreeBin * self, const GstCaps * caps,
+    gint target_bitrate, gint min_bitrate, gint max_bitrate,
+    GstStructure * codec_configs)
+{
+  GstElementFactory *encoder_factory;
+  gboolean same_encoder;
+
+  g_return_val_if_fail (KMS_IS_ENC_TREE_BIN (self), FALSE);
+
+  encoder_factory = kms_enc_tree_bin_find_encoder_factory (caps);
+  same_encoder = encoder_factory != NULL
+      && gst_element_get_factory (self->priv->enc) == encoder_factory;
+  g_clear_object (&encoder_factory);
+
+  if (!same_encoder) {
+    GST_DEBUG_OBJECT (self, "Encoder %" GST_PTR_FORMAT " is not the one for"
+        " caps %" GST_PTR_FORMAT, self->priv->enc, caps);
+    return FALSE;
+  }
+
+  self->priv->max_bitrate = max_bitrate;
+  self->priv->min_bitrate = min_bitrate;
+  self->priv->remb_bitrate = -1;
+  self->priv->tag_bitrate = -1;
+  self->priv->current_bitrate = KMS_ENC_TREE_BIN_LIMIT (self, target_bitrate);
+  self->priv->profile = get_encoder_profile (codec_configs);
+
+  /* Not started yet, so every setting can still be changed */
+  configure_encoder (self->priv->enc, self->priv->enc_type,
+      self->priv->profile, caps, self->priv->current_bitrate, max_bitrate,
+      codec_configs);
+
+  return TRUE;
+}
+
 gint
 kms_enc_tree_bin_get_min_bitrate (KmsEncTreeBin * self)
 {
@@ -384,6 +546,45 @@ tag_event_probe (GstPad * pad, GstPadProbeInfo * info, gpointer data)
   return GST_PAD_PROBE_OK;
 }
 
+/*
+ * Threads are chosen again once the resolution is known, on the first caps
+ * event, before vp8enc initializes its encoder. Later resolution changes keep
+ * them, as vp8enc does not apply new ones once started. x264enc and
+ * openh264enc refuse changes once playing.
+ */
+static GstPadProbeReturn
+resolution_probe (GstPad * pad, GstPadProbeInfo * info, gpointer data)
+{
+  KmsEncTreeBin *self = data;
+  GstEvent *event = gst_pad_probe_info_get_event (info);
+  GstCaps *caps;
+  GstStructure *st;
+  gint width, height, threads, last_threads;
+
+  if (GST_EVENT_TYPE (event) != GST_EVENT_CAPS) {
+    return GST_PAD_PROBE_OK;
+  }
+
+  gst_event_parse_caps (event, &caps);
+  st = gst_caps_get_structure (caps, 0);
+
+  if (!gst_structure_get_int (st, "width", &width)
+      || !gst_structure_get_int (st, "height", &height)) {
+    return GST_PAD_PROBE_OK;
+  }
+
+  threads = get_encoder_threads (self->priv->profile, width, height, 0);
+  g_object_get (self->priv->enc, "threads", &last_threads, NULL);
+
+  if (threads != last_threads) {
+    GST_DEBUG_OBJECT (self, "Using %d threads for %dx%d", threads, width,
+        height);
+    configure_vp8_threads (self->priv->enc, threads);
+  }
+
+  return GST_PAD_PROBE_REMOVE;
+}
+
 /*
  * FIXME: This is a hack to make x264 work.
  *
@@ -446,8 +647,8 @@ kms_enc_tree_bin_configure (KmsEncTreeBin * self, const GstCaps * caps,
 {
   KmsTreeBin *tree_bin = KMS_TREE_BIN (self);
   GstElement *rate, *convert, *mediator, *output_tee, *capsfilter = NULL;
-  GstElement *queue;
-  GstPad *enc_src;
+  GstElement *queue, *adapter, *last;
+  GstPad *enc_src, *enc_sink;
 
   self->priv->current_bitrate = target_bitrate;
 
@@ -470,20 +671,41 @@ kms_enc_tree_bin_configure (KmsEncTreeBin * self, const GstCaps * caps,
       tag_event_probe, self, NULL);
   g_object_unref (enc_src);
 
-  rate = kms_utils_create_rate_for_caps (caps);
-  convert = kms_utils_create_convert_for_caps (caps);
-  mediator = kms_utils_create_mediator_element (caps);
+  enc_sink = gst_element_get_static_pad (self->priv->enc, "sink");
+  /* Frames converted or scaled for the encoder */
+  kms_frame_allocator_propose (enc_sink);
+
+  if (self->priv->enc_type == VP8) {
+    gst_pad_add_probe (enc_sink, GST_PAD_PROBE_TYPE_EVENT_DOWNSTREAM,
+        resolution_probe, self, NULL);
+  }
+  g_object_unref (enc_sink);
+
+  adapter = kms_utils_create_video_adapter_for_caps (caps);
+  if (adapter != NULL) {
+    /* Drops, scales and converts frames on its own, in one pass */
+    rate = mediator = NULL;
+    convert = adapter;
+  } else {
+    rate = kms_utils_create_rate_for_caps (caps);
+    convert = kms_utils_create_convert_for_caps (caps);
+    mediator = kms_utils_create_mediator_element (caps);
+  }
   queue = kms_utils_element_factory_make ("queue", "enctreebin_");
   g_object_set (queue, "leaky", 2, "max-size-time", LEAKY_TIME, NULL);
 
   if (rate) {
     gst_bin_add (GST_BIN (self), rate);
   }
-  gst_bin_add_many (GST_BIN (self), convert, mediator, queue, self->priv->enc,
-      NULL);
+  if (mediator) {
+    gst_bin_add (GST_BIN (self), mediator);
+  }
+  gst_bin_add_many (GST_BIN (self), convert, queue, self->priv->enc, NULL);
   gst_element_sync_state_with_parent (self->priv->enc);
   gst_element_sync_state_with_parent (queue);
-  gst_element_sync_state_with_parent (mediator);
+  if (mediator) {
+    gst_element_sync_state_with_parent (mediator);
+  }
   gst_element_sync_state_with_parent (convert);
   if (rate) {
     gst_element_sync_state_with_parent (rate);
@@ -517,12 +739,17 @@ kms_enc_tree_bin_configure (KmsEncTreeBin * self, const GstCaps * caps,
   if (rate) {
     gst_element_link (rate, convert);
   }
-  if (self->priv->enc_type == X264) {
-    gst_element_link_many (convert, mediator, capsfilter, queue,
-        self->priv->enc, output_tee, NULL);
+  if (mediator) {
+    gst_element_link (convert, mediator);
+    last = mediator;
   } else {
-    gst_element_link_many (convert, mediator, queue, self->priv->enc,
+    last = convert;
+  }
+  if (self->priv->enc_type == X264) {
+    gst_element_link_many (last, capsfilter, queue, self->priv->enc,
         output_tee, NULL);
+  } else {
+    gst_element_link_many (last, queue, self->priv->enc, output_tee, NULL);
   }
 
   return TRUE;
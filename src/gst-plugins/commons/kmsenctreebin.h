@@ -21,6 +21,14 @@
 #include "kmstreebin.h"
 
 G_BEGIN_DECLS
+
+/*
+ * String field of the codec configuration selecting how encoders use the
+ * CPU: "low-latency" (default), "throughput" or "quality". Threads, token
+ * partitions and slices are chosen from the resolution and bitrate.
+ */
+#define KMS_ENC_TREE_BIN_PROFILE "profile"
+
 /* #defines don't like whitespacey bits */
 #define KMS_TYPE_ENC_TREE_BIN \
   (kms_enc_tree_bin_get_type())
@@ -54,6 +62,9 @@ GType kms_enc_tree_bin_get_type (void);
 
 KmsEncTreeBin * kms_enc_tree_bin_new (const GstCaps * caps, gint target_bitrate, gint min_bitrate, gint max_bitrate, GstStructure *codec_configs);
 void kms_enc_tree_bin_set_bitrate_limits (KmsEncTreeBin *self, gint min_bitrate, gint max_bitrate);
+/* Makes an unused bin behave as if it had been created with these */
+/* arguments. Returns FALSE if @caps would select another encoder   */
+gboolean kms_enc_tree_bin_reset (KmsEncTreeBin *self, const GstCaps * caps, gint target_bitrate, gint min_bitrate, gint max_bitrate, GstStructure *codec_configs);
 gint kms_enc_tree_bin_get_min_bitrate (KmsEncTreeBin *self);
 gint kms_enc_tree_bin_get_max_bitrate (KmsEncTreeBin *self);
 
@@ -0,0 +1,215 @@
+/*
+ * (C) Copyright 2016 Kurento (http://kurento.org/)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#  include <config.h>
+#endif
+
+#include "kmsfactorycache.h"
+
+#define GST_CAT_DEFAULT kms_factory_cache_debug
+GST_DEBUG_CATEGORY_STATIC (GST_CAT_DEFAULT);
+#define GST_DEFAULT_NAME "factorycache"
+
+/* Results are dropped all at once when there are more than these */
+#define MAX_CACHED_RESULTS 512
+
+#define N_FACTORY_TYPES (KMS_FACTORY_CACHE_DEPAYLOADER + 1)
+
+typedef enum
+{
+  OVERRIDE_NONE,
+  OVERRIDE_PREFERRED,
+  OVERRIDE_EXCLUDED
+} KmsFactoryOverride;
+
+static const GstElementFactoryListType factory_types[N_FACTORY_TYPES] = {
+  GST_ELEMENT_FACTORY_TYPE_ENCODER,
+  GST_ELEMENT_FACTORY_TYPE_DECODER,
+  GST_ELEMENT_FACTORY_TYPE_PAYLOADER,
+  GST_ELEMENT_FACTORY_TYPE_DEPAYLOADER
+};
+
+/* Applied on top of the registry ranks, matching factory name prefixes */
+static const struct
+{
+  KmsFactoryCacheType type;
+  const gchar *prefix;
+  KmsFactoryOverride override;
+} rank_overrides[] = {
+  {KMS_FACTORY_CACHE_ENCODER, "openh264", OVERRIDE_PREFERRED},
+  {KMS_FACTORY_CACHE_DECODER, "openh264", OVERRIDE_PREFERRED},
+  /* Do not use asteriskh263 for H263 */
+  {KMS_FACTORY_CACHE_DEPAYLOADER, "asteriskh263", OVERRIDE_EXCLUDED},
+};
+
+static GMutex cache_mutex;
+static gboolean cache_valid = FALSE;
+static guint32 cache_cookie;
+static GList *cache_factories[N_FACTORY_TYPES];
+/* "type/direction/caps" -> GList * of factories */
+static GHashTable *cache_results;
+
+static KmsFactoryOverride
+kms_factory_cache_get_override (KmsFactoryCacheType type, const gchar * name)
+{
+  guint i;
+
+  for (i = 0; i < G_N_ELEMENTS (rank_overrides); i++) {
+    if (rank_overrides[i].type == type
+        && g_str_has_prefix (name, rank_overrides[i].prefix)) {
+      return rank_overrides[i].override;
+    }
+  }
+
+  return OVERRIDE_NONE;
+}
+
+static GList *
+kms_factory_cache_build (KmsFactoryCacheType type)
+{
+  GList *list, *preferred = NULL, *l, *next;
+
+  list = gst_element_factory_list_get_elements (factory_types[type],
+      GST_RANK_NONE);
+
+  for (l = list; l != NULL; l = next) {
+    next = l->next;
+
+    switch (kms_factory_cache_get_override (type, GST_OBJECT_NAME (l->data))) {
+      case OVERRIDE_PREFERRED:
+        list = g_list_remove_link (list, l);
+        preferred = g_list_concat (preferred, l);
+        break;
+      case OVERRIDE_EXCLUDED:
+        gst_object_unref (l->data);
+        list = g_list_delete_link (list, l);
+        break;
+      default:
+        break;
+    }
+  }
+
+  return g_list_concat (preferred, list);
+}
+
+/* Must be called with the cache mutex held */
+static void
+kms_factory_cache_refresh (void)
+{
+  guint32 cookie;
+  guint i;
+
+  cookie = gst_registry_get_feature_list_cookie (gst_registry_get ());
+
+  if (cache_valid && cookie == cache_cookie) {
+    return;
+  }
+
+  GST_DEBUG ("Building factory lists, registry cookie %u", cookie);
+
+  for (i = 0; i < N_FACTORY_TYPES; i++) {
+    gst_plugin_feature_list_free (cache_factories[i]);
+    cache_factories[i] = kms_factory_cache_build (i);
+  }
+
+  if (cache_results == NULL) {
+    cache_results = g_hash_table_new_full (g_str_hash, g_str_equal, g_free,
+        (GDestroyNotify) gst_plugin_feature_list_free);
+  } else {
+    g_hash_table_remove_all (cache_results);
+  }
+
+  cache_cookie = cookie;
+  cache_valid = TRUE;
+}
+
+GList *
+kms_factory_cache_get_factories (KmsFactoryCacheType type,
+    const GstCaps * caps, GstPadDirection direction)
+{
+  GList *result;
+  gchar *caps_str, *key;
+
+  g_return_val_if_fail (type < N_FACTORY_TYPES, NULL);
+  g_return_val_if_fail (GST_IS_CAPS (caps), NULL);
+
+  caps_str = gst_caps_to_string (caps);
+  key = g_strdup_printf ("%d/%d/%s", type, direction, caps_str);
+  g_free (caps_str);
+
+  g_mutex_lock (&cache_mutex);
+
+  kms_factory_cache_refresh ();
+
+  result = g_hash_table_lookup (cache_results, key);
+
+  if (result == NULL) {
+    result = gst_element_factory_list_filter (cache_factories[type], caps,
+        direction, FALSE);
+
+    if (g_hash_table_size (cache_results) >= MAX_CACHED_RESULTS) {
+      g_hash_table_remove_all (cache_results);
+    }
+
+    /* Empty results are not cached, they are looked up again */
+    if (result != NULL) {
+      g_hash_table_insert (cache_results, key, result);
+      key = NULL;
+    }
+  } else {
+    GST_TRACE ("Cache hit for %s", key);
+  }
+
+  result = g_list_copy_deep (result, (GCopyFunc) gst_object_ref, NULL);
+
+  g_mutex_unlock (&cache_mutex);
+
+  g_free (key);
+
+  return result;
+}
+
+gboolean
+kms_factory_cache_has_factory (KmsFactoryCacheType type, const gchar * prefix)
+{
+  gboolean ret = FALSE;
+  GList *l;
+
+  g_return_val_if_fail (type < N_FACTORY_TYPES, FALSE);
+
+  g_mutex_lock (&cache_mutex);
+
+  kms_factory_cache_refresh ();
+
+  for (l = cache_factories[type]; l != NULL && !ret; l = l->next) {
+    ret = g_str_has_prefix (GST_OBJECT_NAME (l->data), prefix);
+  }
+
+  g_mutex_unlock (&cache_mutex);
+
+  return ret;
+}
+
+static void init_debug (void) __attribute__ ((constructor));
+
+static void
+init_debug (void)
+{
+  GST_DEBUG_CATEGORY_INIT (GST_CAT_DEFAULT, GST_DEFAULT_NAME, 0,
+      GST_DEFAULT_NAME);
+}
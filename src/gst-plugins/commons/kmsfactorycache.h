@@ -0,0 +1,48 @@
+/*
+ * (C) Copyright 2016 Kurento (http://kurento.org/)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+#ifndef __KMS_FACTORY_CACHE_H__
+#define __KMS_FACTORY_CACHE_H__
+
+#include <gst/gst.h>
+
+G_BEGIN_DECLS
+
+typedef enum
+{
+  KMS_FACTORY_CACHE_ENCODER,
+  KMS_FACTORY_CACHE_DECODER,
+  KMS_FACTORY_CACHE_PAYLOADER,
+  KMS_FACTORY_CACHE_DEPAYLOADER
+} KmsFactoryCacheType;
+
+/*
+ * Same result as filtering gst_element_factory_list_get_elements() with
+ * gst_element_factory_list_filter(), after applying Kurento's rank
+ * overrides. Lists and results are cached until the registry changes.
+ *
+ * Returns: (transfer full): the factories, best first. Free with
+ * gst_plugin_feature_list_free()
+ */
+GList * kms_factory_cache_get_factories (KmsFactoryCacheType type,
+    const GstCaps * caps, GstPadDirection direction);
+
+/* TRUE if there is a factory of @type whose name starts with @prefix */
+gboolean kms_factory_cache_has_factory (KmsFactoryCacheType type,
+    const gchar * prefix);
+
+G_END_DECLS
+#endif /* __KMS_FACTORY_CACHE_H__ */
@@ -0,0 +1,389 @@
+/*
+ * (C) Copyright 2016 Kurento (http://kurento.org/)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#  include <config.h>
+#endif
+
+#include "kmsframeallocator.h"
+
+#define GST_CAT_DEFAULT kms_frame_allocator_debug
+GST_DEBUG_CATEGORY_STATIC (GST_CAT_DEFAULT);
+#define GST_DEFAULT_NAME "frameallocator"
+
+#define KMS_FRAME_ALLOCATOR_NAME "KmsFrameAllocator"
+
+/* Smaller blocks, as audio, are not worth recycling */
+#define FRAME_MIN_SIZE (16 * 1024)
+/* Sizes are rounded up to a multiple of this */
+#define FRAME_SIZE_CLASS (16 * 1024)
+/* Enough for the SIMD code of converters and encoders */
+#define FRAME_ALIGN 63
+/* Released memory over this is given back to the system */
+#define FRAME_CACHE_MAX_BYTES (64 * 1024 * 1024)
+
+#define ROUND_UP_CLASS(size) \
+  (((size) + FRAME_SIZE_CLASS - 1) / FRAME_SIZE_CLASS * FRAME_SIZE_CLASS)
+
+typedef struct _KmsFrameAllocator
+{
+  GstAllocator parent;
+
+  /* Protected by the object lock */
+  guint64 in_use;
+  guint64 peak;
+  guint64 allocations;
+  guint64 reuses;
+} KmsFrameAllocator;
+
+typedef struct _KmsFrameAllocatorClass
+{
+  GstAllocatorClass parent_class;
+} KmsFrameAllocatorClass;
+
+static GType kms_frame_allocator_get_type (void);
+
+G_DEFINE_TYPE (KmsFrameAllocator, kms_frame_allocator, GST_TYPE_ALLOCATOR);
+
+static G_DEFINE_QUARK (KMS_FRAME_ALLOCATOR, kms_frame_allocator);
+static G_DEFINE_QUARK (KMS_FRAME_MEMORY_OWNER, kms_frame_memory_owner);
+
+static GMutex cache_mutex;
+/* Class size -> GSList of GstMemory */
+static GHashTable *cache;
+static gsize cached_bytes = 0;
+
+static void
+kms_frame_allocator_account (KmsFrameAllocator * self, gint64 bytes,
+    gboolean reused)
+{
+  GST_OBJECT_LOCK (self);
+
+  self->in_use += bytes;
+
+  if (bytes > 0) {
+    self->peak = MAX (self->peak, self->in_use);
+
+    if (reused) {
+      self->reuses++;
+    } else {
+      self->allocations++;
+    }
+  }
+
+  GST_OBJECT_UNLOCK (self);
+}
+
+static gboolean
+kms_frame_memory_dispose (GstMiniObject * obj)
+{
+  GstMemory *mem = (GstMemory *) obj;
+  KmsFrameAllocator *owner;
+  GSList *list;
+
+  owner = gst_mini_object_get_qdata (obj, kms_frame_memory_owner_quark ());
+  if (owner != NULL) {
+    kms_frame_allocator_account (owner, -(gint64) mem->maxsize, FALSE);
+    /* Drops the reference to the owner */
+    gst_mini_object_set_qdata (obj, kms_frame_memory_owner_quark (), NULL,
+        NULL);
+  }
+
+  if (GST_MEMORY_IS_READONLY (mem)) {
+    goto free;
+  }
+
+  g_mutex_lock (&cache_mutex);
+
+  if (cached_bytes + mem->maxsize > FRAME_CACHE_MAX_BYTES) {
+    g_mutex_unlock (&cache_mutex);
+    goto free;
+  }
+
+  /* Keep it alive, as buffer pools do with their buffers */
+  gst_memory_ref (mem);
+  mem->offset = 0;
+  mem->size = mem->maxsize;
+
+  list = g_hash_table_lookup (cache, GSIZE_TO_POINTER (mem->maxsize));
+  g_hash_table_insert (cache, GSIZE_TO_POINTER (mem->maxsize),
+      g_slist_prepend (list, mem));
+  cached_bytes += mem->maxsize;
+
+  g_mutex_unlock (&cache_mutex);
+
+  return FALSE;
+
+free:
+  obj->dispose = NULL;
+
+  return TRUE;
+}
+
+static GstMemory *
+kms_frame_allocator_take_cached (gsize class_size)
+{
+  GstMemory *mem = NULL;
+  GSList *list;
+
+  g_mutex_lock (&cache_mutex);
+
+  list = g_hash_table_lookup (cache, GSIZE_TO_POINTER (class_size));
+
+  if (list != NULL) {
+    mem = list->data;
+    list = g_slist_delete_link (list, list);
+
+    if (list != NULL) {
+      g_hash_table_insert (cache, GSIZE_TO_POINTER (class_size), list);
+    } else {
+      g_hash_table_remove (cache, GSIZE_TO_POINTER (class_size));
+    }
+
+    cached_bytes -= class_size;
+  }
+
+  g_mutex_unlock (&cache_mutex);
+
+  return mem;
+}
+
+static GstMemory *
+kms_frame_allocator_alloc (GstAllocator * allocator, gsize size,
+    GstAllocationParams * params)
+{
+  KmsFrameAllocator *self = (KmsFrameAllocator *) allocator;
+  GstAllocationParams frame_params;
+  GstMemory *mem;
+  gsize class_size;
+  gboolean reused = TRUE;
+
+  if (size < FRAME_MIN_SIZE || params->flags != 0 || params->prefix != 0
+      || params->padding != 0 || params->align > FRAME_ALIGN) {
+    /* Not a plain frame, the system allocator handles it */
+    return gst_allocator_alloc (NULL, size, params);
+  }
+
+  class_size = ROUND_UP_CLASS (size);
+  mem = kms_frame_allocator_take_cached (class_size);
+
+  if (mem == NULL) {
+    gst_allocation_params_init (&frame_params);
+    frame_params.align = FRAME_ALIGN;
+
+    mem = gst_allocator_alloc (NULL, class_size, &frame_params);
+    if (mem == NULL) {
+      return NULL;
+    }
+
+    GST_MINI_OBJECT_CAST (mem)->dispose = kms_frame_memory_dispose;
+    reused = FALSE;
+  }
+
+  gst_memory_resize (mem, 0, size);
+
+  gst_mini_object_set_qdata (GST_MINI_OBJECT_CAST (mem),
+      kms_frame_memory_owner_quark (), gst_object_ref (self),
+      gst_object_unref);
+  kms_frame_allocator_account (self, class_size, reused);
+
+  return mem;
+}
+
+static void
+kms_frame_allocator_class_init (KmsFrameAllocatorClass * klass)
+{
+  GstAllocatorClass *allocator_class = GST_ALLOCATOR_CLASS (klass);
+
+  allocator_class->alloc = kms_frame_allocator_alloc;
+  /* Memory comes from the system allocator, which frees it */
+  allocator_class->free = NULL;
+
+  GST_DEBUG_CATEGORY_INIT (GST_CAT_DEFAULT, GST_DEFAULT_NAME, 0,
+      GST_DEFAULT_NAME);
+
+  cache = g_hash_table_new (NULL, NULL);
+}
+
+static void
+kms_frame_allocator_init (KmsFrameAllocator * self)
+{
+  GST_OBJECT_FLAG_SET (self, GST_ALLOCATOR_FLAG_CUSTOM_ALLOC);
+}
+
+static GstElement *
+get_pipeline (GstElement * element)
+{
+  GstObject *object, *parent;
+
+  object = gst_object_ref (element);
+
+  while ((parent = gst_object_get_parent (object)) != NULL) {
+    gst_object_unref (object);
+    object = parent;
+  }
+
+  if (!GST_IS_PIPELINE (object)) {
+    gst_object_unref (object);
+    return NULL;
+  }
+
+  return GST_ELEMENT (object);
+}
+
+static GstAllocator *
+kms_frame_allocator_get_for_pipeline (GstElement * pipeline, gboolean create)
+{
+  GstAllocator *allocator;
+
+  GST_OBJECT_LOCK (pipeline);
+
+  allocator = g_object_get_qdata (G_OBJECT (pipeline),
+      kms_frame_allocator_quark ());
+
+  if (allocator == NULL && create) {
+    allocator = g_object_new (kms_frame_allocator_get_type (), "name",
+        KMS_FRAME_ALLOCATOR_NAME, NULL);
+    gst_object_ref_sink (allocator);
+    g_object_set_qdata_full (G_OBJECT (pipeline),
+        kms_frame_allocator_quark (), allocator, gst_object_unref);
+  }
+
+  if (allocator != NULL) {
+    gst_object_ref (allocator);
+  }
+
+  GST_OBJECT_UNLOCK (pipeline);
+
+  return allocator;
+}
+
+GstAllocator *
+kms_frame_allocator_get (GstElement * element)
+{
+  GstElement *pipeline;
+  GstAllocator *allocator;
+
+  g_return_val_if_fail (GST_IS_ELEMENT (element), NULL);
+
+  pipeline = get_pipeline (element);
+  if (pipeline == NULL) {
+    return NULL;
+  }
+
+  allocator = kms_frame_allocator_get_for_pipeline (pipeline, TRUE);
+  gst_object_unref (pipeline);
+
+  return allocator;
+}
+
+static GstPadProbeReturn
+allocation_query_probe (GstPad * pad, GstPadProbeInfo * info, gpointer data)
+{
+  GstQuery *query = gst_pad_probe_info_get_query (info);
+  GstAllocator *allocator = NULL;
+  GstElement *element;
+
+  /* Only once answered, not to hide what the elements propose */
+  if (GST_QUERY_TYPE (query) != GST_QUERY_ALLOCATION
+      || !(GST_PAD_PROBE_INFO_TYPE (info) & GST_PAD_PROBE_TYPE_PULL)) {
+    return GST_PAD_PROBE_OK;
+  }
+
+  if (gst_query_get_n_allocation_params (query) > 0) {
+    gst_query_parse_nth_allocation_param (query, 0, &allocator, NULL);
+
+    if (allocator != NULL) {
+      gst_object_unref (allocator);
+      return GST_PAD_PROBE_OK;
+    }
+  }
+
+  element = gst_pad_get_parent_element (pad);
+  if (element == NULL) {
+    return GST_PAD_PROBE_OK;
+  }
+
+  allocator = kms_frame_allocator_get (element);
+  g_object_unref (element);
+
+  if (allocator != NULL) {
+    GstAllocationParams params;
+
+    GST_DEBUG_OBJECT (pad, "Proposing frame allocator");
+    gst_allocation_params_init (&params);
+
+    if (gst_query_get_n_allocation_params (query) > 0) {
+      gst_query_set_nth_allocation_param (query, 0, allocator, &params);
+    } else {
+      gst_query_add_allocation_param (query, allocator, &params);
+    }
+
+    gst_object_unref (allocator);
+  }
+
+  return GST_PAD_PROBE_OK;
+}
+
+void
+kms_frame_allocator_propose (GstPad * pad)
+{
+  g_return_if_fail (GST_IS_PAD (pad));
+
+  gst_pad_add_probe (pad, GST_PAD_PROBE_TYPE_QUERY_DOWNSTREAM,
+      allocation_query_probe, NULL, NULL);
+}
+
+GstStructure *
+kms_frame_allocator_get_stats (GstElement * pipeline)
+{
+  KmsFrameAllocator *self;
+  GstStructure *stats;
+
+  g_return_val_if_fail (GST_IS_ELEMENT (pipeline), NULL);
+
+  self = (KmsFrameAllocator *)
+      kms_frame_allocator_get_for_pipeline (pipeline, FALSE);
+
+  if (self == NULL) {
+    return NULL;
+  }
+
+  GST_OBJECT_LOCK (self);
+  stats = gst_structure_new (KMS_FRAME_ALLOCATOR_STATS_STRUCT_NAME,
+      "in-use", G_TYPE_UINT64, self->in_use,
+      "peak", G_TYPE_UINT64, self->peak,
+      "allocations", G_TYPE_UINT64, self->allocations,
+      "reuses", G_TYPE_UINT64, self->reuses, NULL);
+  GST_OBJECT_UNLOCK (self);
+
+  gst_object_unref (self);
+
+  return stats;
+}
+
+gsize
+kms_frame_allocator_get_cached_bytes (void)
+{
+  gsize bytes;
+
+  g_mutex_lock (&cache_mutex);
+  bytes = cached_bytes;
+  g_mutex_unlock (&cache_mutex);
+
+  return bytes;
+}
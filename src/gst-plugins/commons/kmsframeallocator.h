@@ -0,0 +1,50 @@
+/*
+ * (C) Copyright 2016 Kurento (http://kurento.org/)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+#ifndef __KMS_FRAME_ALLOCATOR_H__
+#define __KMS_FRAME_ALLOCATOR_H__
+
+#include <gst/gst.h>
+
+G_BEGIN_DECLS
+
+#define KMS_FRAME_ALLOCATOR_STATS_STRUCT_NAME "frame-memory-stats"
+
+/*
+ * Allocator for raw media frames. Memory is handed out in size classes and,
+ * when released, kept in a process wide cache to be recycled by any
+ * pipeline instead of going back to the system.
+ *
+ * There is one allocator per pipeline, so that memory is accounted to the
+ * pipeline that asked for it. Returns NULL if @element is not in a pipeline.
+ */
+GstAllocator * kms_frame_allocator_get (GstElement * element);
+
+/*
+ * Offer the allocator of the pipeline in the ALLOCATION queries that go
+ * through @pad and do not carry any allocator yet.
+ */
+void kms_frame_allocator_propose (GstPad * pad);
+
+/* Memory in use now and at most, and blocks allocated or recycled for */
+/* @pipeline, or NULL if it never used the allocator                   */
+GstStructure * kms_frame_allocator_get_stats (GstElement * pipeline);
+
+/* Bytes cached for recycling, shared by all the pipelines */
+gsize kms_frame_allocator_get_cached_bytes (void);
+
+G_END_DECLS
+#endif /* __KMS_FRAME_ALLOCATOR_H__ */
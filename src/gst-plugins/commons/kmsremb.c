@@ -39,6 +39,10 @@ G_DEFINE_QUARK (KMS_REMB_REMOTE, kms_remb_remote);
 
 #define REMB_MAX_FACTOR_INPUT_BR 2
 
+/* abs-send-time is 6.18 fixed point seconds, it wraps every 64 seconds */
+#define ABS_SEND_TIME_FRACTION_BITS 18
+#define ABS_SEND_TIME_BITS 24
+
 static void
 kms_remb_base_destroy (KmsRembBase * self)
 {
@@ -329,6 +333,33 @@ kms_remb_local_get_video_recv_info (KmsRembLocal * self,
   return TRUE;
 }
 
+/* Returns FALSE to fall back on losses, when there is no estimation yet */
+static gboolean
+kms_remb_local_update_delay_based (KmsRembLocal * self)
+{
+  guint bitrate;
+
+  KMS_REMB_BASE_LOCK (self);
+  bitrate = self->estimator != NULL ?
+      kms_twcc_estimator_get_bitrate (self->estimator) : 0;
+  KMS_REMB_BASE_UNLOCK (self);
+
+  if (bitrate == 0) {
+    return FALSE;
+  }
+
+  self->remb = bitrate;
+
+  if (self->max_bw > 0) {
+    self->remb = MIN (self->remb, self->max_bw * 1000);
+  }
+
+  GST_TRACE_OBJECT (KMS_REMB_BASE (self)->rtpsess,
+      "REMB: %" G_GUINT32_FORMAT " (delay-based)", self->remb);
+
+  return TRUE;
+}
+
 static gboolean
 kms_remb_local_update (KmsRembLocal * self)
 {
@@ -340,6 +371,10 @@ kms_remb_local_update (KmsRembLocal * self)
     return FALSE;
   }
 
+  if (kms_remb_local_update_delay_based (self)) {
+    return TRUE;
+  }
+
   if (!self->probed) {
     if (bitrate == 0) {
       GST_DEBUG_OBJECT (KMS_REMB_BASE (self)->rtpsess,
@@ -548,6 +583,10 @@ kms_remb_local_destroy (KmsRembLocal * self)
     kms_utils_remb_event_manager_destroy (self->event_manager);
   }
 
+  if (self->estimator != NULL) {
+    kms_twcc_estimator_free (self->estimator);
+  }
+
   g_slist_free_full (self->remote_sessions,
       (GDestroyNotify) kms_rl_remote_session_destroy);
   kms_remb_base_destroy (KMS_REMB_BASE (self));
@@ -594,6 +633,86 @@ kms_remb_local_add_remote_session (KmsRembLocal * rl, GObject * rtpsess,
   rl->remote_sessions = g_slist_append (rl->remote_sessions, rlrs);
 }
 
+void
+kms_remb_local_set_delay_based (KmsRembLocal * rl, gboolean delay_based)
+{
+  KMS_REMB_BASE_LOCK (rl);
+
+  if (delay_based && rl->estimator == NULL) {
+    guint min_bitrate, max_bitrate;
+
+    min_bitrate = MAX (rl->min_bw * 1000, REMB_MIN);
+    max_bitrate = rl->max_bw > 0 ? rl->max_bw * 1000 : G_MAXUINT;
+    rl->estimator = kms_twcc_estimator_new (min_bitrate,
+        MAX (min_bitrate, max_bitrate));
+    rl->last_abs_send_time = 0;
+  } else if (!delay_based && rl->estimator != NULL) {
+    kms_twcc_estimator_free (rl->estimator);
+    rl->estimator = NULL;
+  }
+
+  KMS_REMB_BASE_UNLOCK (rl);
+
+  GST_DEBUG_OBJECT (KMS_REMB_BASE (rl)->rtpsess, "Estimation based on %s",
+      delay_based ? "delay" : "losses");
+}
+
+void
+kms_remb_local_add_packet (KmsRembLocal * rl, guint16 transport_seq,
+    guint32 abs_send_time, GstClockTime arrival_time, guint size)
+{
+  GstClockTime send_time;
+  guint64 ext;
+  gint32 diff;
+
+  KMS_REMB_BASE_LOCK (rl);
+
+  if (rl->estimator == NULL) {
+    goto end;
+  }
+
+  if (rl->last_abs_send_time == 0) {
+    /* Start one cycle in, so older packets do not go below zero */
+    ext = (G_GUINT64_CONSTANT (1) << ABS_SEND_TIME_BITS) | abs_send_time;
+  } else {
+    /* Unwrap to the value closest to the last one, so a late packet */
+    /* sent before a wrap stays before it                             */
+    diff = (gint32) ((abs_send_time - (guint32) rl->last_abs_send_time) <<
+        (32 - ABS_SEND_TIME_BITS)) >> (32 - ABS_SEND_TIME_BITS);
+    ext = rl->last_abs_send_time + diff;
+  }
+
+  if (ext > rl->last_abs_send_time) {
+    rl->last_abs_send_time = ext;
+  }
+  send_time = gst_util_uint64_scale (ext, GST_SECOND,
+      1 << ABS_SEND_TIME_FRACTION_BITS);
+
+  /* Same format as the traces replayed by the twcc test */
+  GST_TRACE_OBJECT (KMS_REMB_BASE (rl)->rtpsess, "twcc-trace %"
+      G_GUINT16_FORMAT " %" G_GUINT64_FORMAT " %" G_GUINT64_FORMAT " %u",
+      transport_seq, send_time / GST_USECOND, arrival_time / GST_USECOND,
+      size);
+
+  kms_twcc_estimator_add_packet (rl->estimator, transport_seq, send_time,
+      arrival_time, size);
+
+end:
+  KMS_REMB_BASE_UNLOCK (rl);
+}
+
+void
+kms_remb_local_add_seq (KmsRembLocal * rl, guint16 transport_seq)
+{
+  KMS_REMB_BASE_LOCK (rl);
+
+  if (rl->estimator != NULL) {
+    kms_twcc_estimator_add_seq (rl->estimator, transport_seq);
+  }
+
+  KMS_REMB_BASE_UNLOCK (rl);
+}
+
 void
 kms_remb_local_set_params (KmsRembLocal * rl, GstStructure * params)
 {
@@ -19,6 +19,7 @@
 #define __KMS_REMB_H__
 
 #include "kmsutils.h" /* TODO: must be not needed */
+#include "kmstwcc.h"
 
 G_BEGIN_DECLS
 
@@ -69,6 +70,11 @@ struct _KmsRembLocal
   GstClockTime last_time;
   guint64 fraction_lost_record;
   RembEventManager *event_manager;
+
+  /* Delay-based estimation, NULL when based on losses */
+  KmsTwccEstimator *estimator;
+  /* Newest unwrapped abs-send-time, 0 until the first packet */
+  guint64 last_abs_send_time;
 };
 
 KmsRembLocal * kms_remb_local_create (GObject *rtpsess,
@@ -77,6 +83,13 @@ void kms_remb_local_destroy (KmsRembLocal *rl);
 void kms_remb_local_add_remote_session (KmsRembLocal *rl, GObject *rtpsess, guint ssrc);
 void kms_remb_local_set_params (KmsRembLocal *rl, GstStructure *params);
 void kms_remb_local_get_params (KmsRembLocal *rl, GstStructure **params);
+void kms_remb_local_set_delay_based (KmsRembLocal *rl, gboolean delay_based);
+/* Received packet for the delay-based estimation, @abs_send_time as in the
+ * header extension (6.18 fixed point seconds) */
+void kms_remb_local_add_packet (KmsRembLocal *rl, guint16 transport_seq,
+  guint32 abs_send_time, GstClockTime arrival_time, guint size);
+/* Received packet without send time, only accounted for losses */
+void kms_remb_local_add_seq (KmsRembLocal *rl, guint16 transport_seq);
 /* KmsRembLocal end */
 
 /* KmsRembRemote begin */
@@ -0,0 +1,727 @@
+/*
+ * (C) Copyright 2016 Kurento (http://kurento.org/)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#  include <config.h>
+#endif
+
+#include <string.h>
+
+#include "kmsrtphdrext.h"
+#include "kmsutils.h"
+
+#define GST_CAT_DEFAULT kms_rtp_hdr_ext_debug
+GST_DEBUG_CATEGORY_STATIC (GST_CAT_DEFAULT);
+#define GST_DEFAULT_NAME "rtphdrext"
+
+#define RTP_FIXED_HEADER_SIZE 12
+#define RTP_MAX_CSRC_SIZE (15 * 4)
+#define RTP_EXT_HEADER_SIZE 4
+#define RTP_ONE_BYTE_PROFILE 0xBEDE
+/* The low 4 bits are application dependent */
+#define RTP_TWO_BYTE_PROFILE 0x1000
+#define RTP_TWO_BYTE_PROFILE_MASK 0xFFF0
+/* Longer extensions are left alone, they never show up in practice */
+#define RTP_MAX_EXT_DATA_SIZE 1024
+#define RTP_MAX_ELEMENTS 32
+
+#define ONE_BYTE_MAX_ID 14
+#define ONE_BYTE_MAX_SIZE 16
+#define TWO_BYTE_MAX_SIZE 255
+
+#define ROUND_UP_4(x) (((x) + 3) & ~3)
+
+#define ABS_SEND_TIME_SIZE 3
+#define TRANSPORT_SEQ_SIZE 2
+#define AUDIO_LEVEL_SIZE 1
+
+static GMutex stats_mutex;
+static guint64 copies_avoided = 0;
+
+typedef struct _KmsRtpHdrExtElement
+{
+  guint8 id;
+  guint8 size;
+  /* Of its data in KmsRtpHeader.data */
+  guint16 offset;
+} KmsRtpHdrExtElement;
+
+/* Everything in front of the payload, kept on the stack while rewritten */
+typedef struct _KmsRtpHeader
+{
+  guint8 fixed[RTP_FIXED_HEADER_SIZE + RTP_MAX_CSRC_SIZE];
+  guint fixed_size;
+  /* 0 when the packet carries no extension */
+  guint16 profile;
+  KmsRtpHdrExtElement elements[RTP_MAX_ELEMENTS];
+  guint n_elements;
+  /* Data of the elements, back to back, with room for new ones */
+  guint8 data[2 * RTP_MAX_EXT_DATA_SIZE];
+  guint data_size;
+  /* Of the whole header in the original packet */
+  guint size;
+} KmsRtpHeader;
+
+typedef struct _KmsRtpHdrExtHandler
+{
+  guint8 id;
+  guint size;
+  KmsRtpHdrExtFlags flags;
+  KmsRtpHdrExtFunc func;
+  gpointer user_data;
+  GDestroyNotify notify;
+} KmsRtpHdrExtHandler;
+
+struct _KmsRtpHdrExtRegistry
+{
+  GArray *handlers;
+};
+
+static gboolean
+kms_rtp_header_add_element (KmsRtpHeader * hdr, guint8 id,
+    const guint8 * data, guint size)
+{
+  KmsRtpHdrExtElement *elem;
+
+  if (hdr->n_elements == RTP_MAX_ELEMENTS
+      || hdr->data_size + size > sizeof (hdr->data)) {
+    return FALSE;
+  }
+
+  elem = &hdr->elements[hdr->n_elements++];
+  elem->id = id;
+  elem->size = size;
+  elem->offset = hdr->data_size;
+
+  if (data != hdr->data + hdr->data_size) {
+    memcpy (hdr->data + hdr->data_size, data, size);
+  }
+  hdr->data_size += size;
+
+  return TRUE;
+}
+
+/* Both element formats of RFC 5285, padding skipped */
+static gboolean
+kms_rtp_header_parse_elements (KmsRtpHeader * hdr, const guint8 * ext,
+    guint ext_size)
+{
+  gboolean two_byte = hdr->profile != RTP_ONE_BYTE_PROFILE;
+  guint pos = 0;
+
+  while (pos < ext_size) {
+    guint8 id;
+    guint size, hdr_size;
+
+    if (ext[pos] == 0) {
+      /* Padding */
+      pos++;
+      continue;
+    }
+
+    if (two_byte) {
+      if (pos + 2 > ext_size) {
+        return FALSE;
+      }
+
+      id = ext[pos];
+      size = ext[pos + 1];
+      hdr_size = 2;
+    } else {
+      id = ext[pos] >> 4;
+      size = (ext[pos] & 0x0f) + 1;
+      hdr_size = 1;
+
+      if (id == 15) {
+        /* Reserved, the rest must be ignored */
+        return TRUE;
+      }
+    }
+
+    if (pos + hdr_size + size > ext_size) {
+      return FALSE;
+    }
+
+    if (!kms_rtp_header_add_element (hdr, id, ext + pos + hdr_size, size)) {
+      GST_DEBUG ("Too many header extension elements");
+      return FALSE;
+    }
+
+    pos += hdr_size + size;
+  }
+
+  return TRUE;
+}
+
+static gboolean
+kms_rtp_header_read (KmsRtpHeader * hdr, GstBuffer * buffer)
+{
+  guint8 ext_hdr[RTP_EXT_HEADER_SIZE];
+  guint8 ext[RTP_MAX_EXT_DATA_SIZE];
+  gsize buffer_size = gst_buffer_get_size (buffer);
+  guint csrc_size, ext_size;
+
+  if (gst_buffer_extract (buffer, 0, hdr->fixed, RTP_FIXED_HEADER_SIZE) !=
+      RTP_FIXED_HEADER_SIZE || (hdr->fixed[0] >> 6) != 2) {
+    return FALSE;
+  }
+
+  csrc_size = (hdr->fixed[0] & 0x0f) * 4;
+  hdr->fixed_size = RTP_FIXED_HEADER_SIZE + csrc_size;
+  hdr->profile = 0;
+  hdr->n_elements = 0;
+  hdr->data_size = 0;
+
+  if (gst_buffer_extract (buffer, RTP_FIXED_HEADER_SIZE,
+          hdr->fixed + RTP_FIXED_HEADER_SIZE, csrc_size) != csrc_size) {
+    return FALSE;
+  }
+
+  hdr->size = hdr->fixed_size;
+
+  if (!(hdr->fixed[0] & 0x10)) {
+    return TRUE;
+  }
+
+  if (gst_buffer_extract (buffer, hdr->fixed_size, ext_hdr,
+          RTP_EXT_HEADER_SIZE) != RTP_EXT_HEADER_SIZE) {
+    return FALSE;
+  }
+
+  hdr->profile = GST_READ_UINT16_BE (ext_hdr);
+  if (hdr->profile != RTP_ONE_BYTE_PROFILE &&
+      (hdr->profile & RTP_TWO_BYTE_PROFILE_MASK) != RTP_TWO_BYTE_PROFILE) {
+    GST_LOG ("Not an RFC 5285 header extension: 0x%04x", hdr->profile);
+    return FALSE;
+  }
+
+  ext_size = GST_READ_UINT16_BE (ext_hdr + 2) * 4;
+  hdr->size += RTP_EXT_HEADER_SIZE + ext_size;
+
+  if (ext_size > RTP_MAX_EXT_DATA_SIZE || hdr->size > buffer_size) {
+    return FALSE;
+  }
+
+  if (gst_buffer_extract (buffer, hdr->fixed_size + RTP_EXT_HEADER_SIZE,
+          ext, ext_size) != ext_size) {
+    return FALSE;
+  }
+
+  return kms_rtp_header_parse_elements (hdr, ext, ext_size);
+}
+
+static KmsRtpHdrExtElement *
+kms_rtp_header_find (KmsRtpHeader * hdr, guint8 id)
+{
+  guint i;
+
+  for (i = 0; i < hdr->n_elements; i++) {
+    if (hdr->elements[i].id == id) {
+      return &hdr->elements[i];
+    }
+  }
+
+  return NULL;
+}
+
+/* The one-byte format is kept whenever the elements fit in it */
+static guint16
+kms_rtp_header_get_out_profile (KmsRtpHeader * hdr)
+{
+  guint i;
+
+  if (hdr->profile != 0 && hdr->profile != RTP_ONE_BYTE_PROFILE) {
+    return hdr->profile;
+  }
+
+  for (i = 0; i < hdr->n_elements; i++) {
+    if (hdr->elements[i].id > ONE_BYTE_MAX_ID || hdr->elements[i].size == 0
+        || hdr->elements[i].size > ONE_BYTE_MAX_SIZE) {
+      return RTP_TWO_BYTE_PROFILE;
+    }
+  }
+
+  return RTP_ONE_BYTE_PROFILE;
+}
+
+static GstMemory *
+kms_rtp_header_to_memory (KmsRtpHeader * hdr)
+{
+  guint16 profile = kms_rtp_header_get_out_profile (hdr);
+  guint elem_hdr_size = profile == RTP_ONE_BYTE_PROFILE ? 1 : 2;
+  guint ext_size = 0, size, pos, i;
+  GstMapInfo info;
+  GstMemory *mem;
+  guint8 *ext;
+
+  for (i = 0; i < hdr->n_elements; i++) {
+    ext_size += elem_hdr_size + hdr->elements[i].size;
+  }
+  ext_size = ROUND_UP_4 (ext_size);
+
+  size = hdr->fixed_size;
+  if (hdr->n_elements > 0) {
+    size += RTP_EXT_HEADER_SIZE + ext_size;
+  }
+
+  mem = gst_allocator_alloc (NULL, size, NULL);
+  if (mem == NULL || !gst_memory_map (mem, &info, GST_MAP_WRITE)) {
+    if (mem != NULL) {
+      gst_memory_unref (mem);
+    }
+    return NULL;
+  }
+
+  memcpy (info.data, hdr->fixed, hdr->fixed_size);
+
+  if (hdr->n_elements == 0) {
+    info.data[0] &= ~0x10;
+    gst_memory_unmap (mem, &info);
+    return mem;
+  }
+
+  info.data[0] |= 0x10;
+  ext = info.data + hdr->fixed_size;
+  GST_WRITE_UINT16_BE (ext, profile);
+  GST_WRITE_UINT16_BE (ext + 2, ext_size / 4);
+  ext += RTP_EXT_HEADER_SIZE;
+
+  for (i = 0, pos = 0; i < hdr->n_elements; i++) {
+    KmsRtpHdrExtElement *elem = &hdr->elements[i];
+
+    if (elem_hdr_size == 1) {
+      ext[pos] = (elem->id << 4) | (elem->size - 1);
+    } else {
+      ext[pos] = elem->id;
+      ext[pos + 1] = elem->size;
+    }
+
+    memcpy (ext + pos + elem_hdr_size, hdr->data + elem->offset, elem->size);
+    pos += elem_hdr_size + elem->size;
+  }
+
+  memset (ext + pos, 0, ext_size - pos);
+
+  gst_memory_unmap (mem, &info);
+
+  return mem;
+}
+
+/* Puts @header in front of the payload of @buffer, in place of the old one */
+static void
+kms_rtp_header_replace (GstBuffer * buffer, guint old_size, GstMemory * header)
+{
+  GstBuffer *payload;
+  guint i, n;
+
+  if (gst_buffer_n_memory (buffer) > 1
+      && gst_buffer_peek_memory (buffer, 0)->size == old_size) {
+    /* Usual case, payloaders keep the header in a memory of its own */
+    gst_buffer_replace_memory (buffer, 0, header);
+    return;
+  }
+
+  /* Shares the payload memory, it is not copied */
+  payload = gst_buffer_copy_region (buffer, GST_BUFFER_COPY_MEMORY, old_size,
+      gst_buffer_get_size (buffer) - old_size);
+
+  gst_buffer_remove_all_memory (buffer);
+  gst_buffer_append_memory (buffer, header);
+
+  n = gst_buffer_n_memory (payload);
+  for (i = 0; i < n; i++) {
+    gst_buffer_append_memory (buffer, gst_buffer_get_memory (payload, i));
+  }
+
+  gst_buffer_unref (payload);
+}
+
+/* Runs @func of every handler on the elements, returns TRUE if any wrote */
+static gboolean
+kms_rtp_header_run_handlers (KmsRtpHeader * hdr, GstBuffer * buffer,
+    const KmsRtpHdrExtHandler * handlers, guint n_handlers)
+{
+  gboolean changed = FALSE;
+  guint i;
+
+  for (i = 0; i < n_handlers; i++) {
+    const KmsRtpHdrExtHandler *handler = &handlers[i];
+    KmsRtpHdrExtElement *elem;
+    guint8 *data;
+
+    elem = kms_rtp_header_find (hdr, handler->id);
+    if (elem != NULL) {
+      if (handler->func (buffer, hdr->data + elem->offset, elem->size, TRUE,
+              handler->user_data)) {
+        changed = TRUE;
+      }
+      continue;
+    }
+
+    if (!(handler->flags & KMS_RTP_HDR_EXT_ADD)
+        || hdr->data_size + handler->size > sizeof (hdr->data)) {
+      continue;
+    }
+
+    /* Written in place, it is only kept if the handler asks for it */
+    data = hdr->data + hdr->data_size;
+    memset (data, 0, handler->size);
+
+    if (handler->func (buffer, data, handler->size, FALSE, handler->user_data)) {
+      if (kms_rtp_header_add_element (hdr, handler->id, data, handler->size)) {
+        changed = TRUE;
+      } else {
+        GST_DEBUG ("No room for element %u", handler->id);
+      }
+    }
+  }
+
+  return changed;
+}
+
+/* Returns TRUE if processed, @copy_avoided tells if mapping would have copied */
+static gboolean
+kms_rtp_hdr_ext_process_buffer (const KmsRtpHdrExtHandler * handlers,
+    guint n_handlers, GstBuffer ** buffer, gboolean * copy_avoided)
+{
+  KmsRtpHeader hdr;
+  GstMemory *mem;
+
+  *copy_avoided = FALSE;
+
+  if (!kms_rtp_header_read (&hdr, *buffer)) {
+    GST_DEBUG ("Cannot parse RTP header of %" GST_PTR_FORMAT, *buffer);
+    return FALSE;
+  }
+
+  if (!kms_rtp_header_run_handlers (&hdr, *buffer, handlers, n_handlers)) {
+    /* Nothing to change */
+    return TRUE;
+  }
+
+  mem = kms_rtp_header_to_memory (&hdr);
+  if (mem == NULL) {
+    return FALSE;
+  }
+
+  /* Mapping the whole packet for writing would merge and copy its memory */
+  *copy_avoided = gst_buffer_n_memory (*buffer) > 1
+      || !gst_buffer_is_all_memory_writable (*buffer)
+      || !gst_buffer_is_writable (*buffer);
+
+  *buffer = gst_buffer_make_writable (*buffer);
+  kms_rtp_header_replace (*buffer, hdr.size, mem);
+
+  return TRUE;
+}
+
+static void
+kms_rtp_hdr_ext_account (guint copies)
+{
+  if (copies == 0) {
+    return;
+  }
+
+  g_mutex_lock (&stats_mutex);
+  copies_avoided += copies;
+  g_mutex_unlock (&stats_mutex);
+}
+
+typedef struct _ListData
+{
+  const KmsRtpHdrExtHandler *handlers;
+  guint n_handlers;
+  guint processed;
+  guint copies_avoided;
+} ListData;
+
+static gboolean
+process_list_buffer (GstBuffer ** buffer, guint idx, gpointer user_data)
+{
+  ListData *list_data = user_data;
+  gboolean copy_avoided;
+
+  if (kms_rtp_hdr_ext_process_buffer (list_data->handlers,
+          list_data->n_handlers, buffer, &copy_avoided)) {
+    list_data->processed++;
+  }
+
+  if (copy_avoided) {
+    list_data->copies_avoided++;
+  }
+
+  return TRUE;
+}
+
+static guint
+kms_rtp_hdr_ext_process_list (const KmsRtpHdrExtHandler * handlers,
+    guint n_handlers, GstBufferList ** list)
+{
+  ListData list_data = { handlers, n_handlers, 0, 0 };
+
+  /* Only the list is copied, its buffers are replaced if they change */
+  *list = gst_buffer_list_make_writable (*list);
+  gst_buffer_list_foreach (*list, process_list_buffer, &list_data);
+
+  /* Once for the whole list */
+  kms_rtp_hdr_ext_account (list_data.copies_avoided);
+
+  return list_data.processed;
+}
+
+typedef struct _WriteData
+{
+  const guint8 *data;
+  guint size;
+  KmsRtpHdrExtFlags flags;
+  /* Packets where the element is as asked */
+  guint written;
+} WriteData;
+
+static gboolean
+write_element (GstBuffer * buffer, guint8 * data, guint size,
+    gboolean present, gpointer user_data)
+{
+  WriteData *write_data = user_data;
+
+  if (size != write_data->size) {
+    GST_DEBUG ("Element of %u bytes, not %u", size, write_data->size);
+    return FALSE;
+  }
+
+  write_data->written++;
+
+  if (present && (!(write_data->flags & KMS_RTP_HDR_EXT_UPDATE)
+          || memcmp (data, write_data->data, size) == 0)) {
+    /* Nothing to change */
+    return FALSE;
+  }
+
+  memcpy (data, write_data->data, size);
+
+  return TRUE;
+}
+
+static gboolean
+check_element (guint8 id, guint size)
+{
+  return id >= 1 && size >= 1 && size <= TWO_BYTE_MAX_SIZE;
+}
+
+gboolean
+kms_rtp_hdr_ext_write (GstBuffer ** buffer, guint8 id, const guint8 * data,
+    guint size, KmsRtpHdrExtFlags flags)
+{
+  WriteData write_data = { data, size, flags, 0 };
+  KmsRtpHdrExtHandler handler = { id, size, flags, write_element, &write_data,
+    NULL
+  };
+  gboolean copy_avoided;
+
+  g_return_val_if_fail (buffer != NULL && GST_IS_BUFFER (*buffer), FALSE);
+  g_return_val_if_fail (check_element (id, size), FALSE);
+
+  if (!kms_rtp_hdr_ext_process_buffer (&handler, 1, buffer, &copy_avoided)) {
+    return FALSE;
+  }
+
+  kms_rtp_hdr_ext_account (copy_avoided ? 1 : 0);
+
+  return write_data.written > 0;
+}
+
+guint
+kms_rtp_hdr_ext_write_list (GstBufferList ** list, guint8 id,
+    const guint8 * data, guint size, KmsRtpHdrExtFlags flags)
+{
+  WriteData write_data = { data, size, flags, 0 };
+  KmsRtpHdrExtHandler handler = { id, size, flags, write_element, &write_data,
+    NULL
+  };
+
+  g_return_val_if_fail (list != NULL && GST_IS_BUFFER_LIST (*list), 0);
+  g_return_val_if_fail (check_element (id, size), 0);
+
+  kms_rtp_hdr_ext_process_list (&handler, 1, list);
+
+  return write_data.written;
+}
+
+guint64
+kms_rtp_hdr_ext_get_copies_avoided (void)
+{
+  guint64 ret;
+
+  g_mutex_lock (&stats_mutex);
+  ret = copies_avoided;
+  g_mutex_unlock (&stats_mutex);
+
+  return ret;
+}
+
+static void
+kms_rtp_hdr_ext_handler_clear (KmsRtpHdrExtHandler * handler)
+{
+  if (handler->notify != NULL) {
+    handler->notify (handler->user_data);
+  }
+}
+
+KmsRtpHdrExtRegistry *
+kms_rtp_hdr_ext_registry_new (void)
+{
+  KmsRtpHdrExtRegistry *registry;
+
+  registry = g_slice_new0 (KmsRtpHdrExtRegistry);
+  registry->handlers =
+      g_array_new (FALSE, TRUE, sizeof (KmsRtpHdrExtHandler));
+  g_array_set_clear_func (registry->handlers,
+      (GDestroyNotify) kms_rtp_hdr_ext_handler_clear);
+
+  return registry;
+}
+
+void
+kms_rtp_hdr_ext_registry_free (KmsRtpHdrExtRegistry * registry)
+{
+  g_return_if_fail (registry != NULL);
+
+  g_array_unref (registry->handlers);
+  g_slice_free (KmsRtpHdrExtRegistry, registry);
+}
+
+gboolean
+kms_rtp_hdr_ext_registry_add (KmsRtpHdrExtRegistry * registry, guint8 id,
+    guint size, KmsRtpHdrExtFlags flags, KmsRtpHdrExtFunc func,
+    gpointer user_data, GDestroyNotify notify)
+{
+  KmsRtpHdrExtHandler handler = { id, size, flags, func, user_data, notify };
+  guint i;
+
+  g_return_val_if_fail (registry != NULL, FALSE);
+  g_return_val_if_fail (func != NULL, FALSE);
+  g_return_val_if_fail (check_element (id, size), FALSE);
+
+  for (i = 0; i < registry->handlers->len; i++) {
+    if (g_array_index (registry->handlers, KmsRtpHdrExtHandler, i).id == id) {
+      GST_WARNING ("Header extension %u already handled", id);
+      return FALSE;
+    }
+  }
+
+  g_array_append_val (registry->handlers, handler);
+
+  return TRUE;
+}
+
+guint
+kms_rtp_hdr_ext_registry_get_n_handlers (KmsRtpHdrExtRegistry * registry)
+{
+  g_return_val_if_fail (registry != NULL, 0);
+
+  return registry->handlers->len;
+}
+
+gboolean
+kms_rtp_hdr_ext_registry_process (KmsRtpHdrExtRegistry * registry,
+    GstBuffer ** buffer)
+{
+  gboolean copy_avoided, ret;
+
+  g_return_val_if_fail (registry != NULL, FALSE);
+  g_return_val_if_fail (buffer != NULL && GST_IS_BUFFER (*buffer), FALSE);
+
+  ret = kms_rtp_hdr_ext_process_buffer ((KmsRtpHdrExtHandler *)
+      registry->handlers->data, registry->handlers->len, buffer,
+      &copy_avoided);
+  kms_rtp_hdr_ext_account (copy_avoided ? 1 : 0);
+
+  return ret;
+}
+
+guint
+kms_rtp_hdr_ext_registry_process_list (KmsRtpHdrExtRegistry * registry,
+    GstBufferList ** list)
+{
+  g_return_val_if_fail (registry != NULL, 0);
+  g_return_val_if_fail (list != NULL && GST_IS_BUFFER_LIST (*list), 0);
+
+  return kms_rtp_hdr_ext_process_list ((KmsRtpHdrExtHandler *)
+      registry->handlers->data, registry->handlers->len, list);
+}
+
+gboolean
+kms_rtp_hdr_ext_abs_send_time (GstBuffer * buffer, guint8 * data,
+    guint size, gboolean present, gpointer user_data)
+{
+  GstClockTime ms;
+  guint value;
+
+  if (size != ABS_SEND_TIME_SIZE) {
+    return FALSE;
+  }
+
+  ms = GST_TIME_AS_MSECONDS (kms_utils_get_time_nsecs ());
+  value = (((ms << 18) / 1000) & 0x00ffffff);
+
+  data[0] = (guint8) (value >> 16);
+  data[1] = (guint8) (value >> 8);
+  data[2] = (guint8) (value);
+
+  return TRUE;
+}
+
+gboolean
+kms_rtp_hdr_ext_transport_seq (GstBuffer * buffer, guint8 * data,
+    guint size, gboolean present, gpointer user_data)
+{
+  guint seq;
+
+  if (size != TRANSPORT_SEQ_SIZE) {
+    return FALSE;
+  }
+
+  seq = g_atomic_int_add ((gint *) user_data, 1);
+  GST_WRITE_UINT16_BE (data, seq & 0xffff);
+
+  return TRUE;
+}
+
+gboolean
+kms_rtp_hdr_ext_audio_level (GstBuffer * buffer, guint8 * data,
+    guint size, gboolean present, gpointer user_data)
+{
+  KmsRtpHdrExtAudioLevel *level = user_data;
+
+  if (!present || size < AUDIO_LEVEL_SIZE) {
+    return FALSE;
+  }
+
+  g_atomic_int_set (&level->level, data[0] & 0x7f);
+  g_atomic_int_set (&level->voice, (data[0] & 0x80) != 0);
+
+  return FALSE;
+}
+
+static void init_debug (void) __attribute__ ((constructor));
+
+static void
+init_debug (void)
+{
+  GST_DEBUG_CATEGORY_INIT (GST_CAT_DEFAULT, GST_DEFAULT_NAME, 0,
+      GST_DEFAULT_NAME);
+}
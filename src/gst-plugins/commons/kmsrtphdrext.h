@@ -0,0 +1,110 @@
+/*
+ * (C) Copyright 2016 Kurento (http://kurento.org/)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+#ifndef __KMS_RTP_HDR_EXT_H__
+#define __KMS_RTP_HDR_EXT_H__
+
+#include <gst/gst.h>
+
+G_BEGIN_DECLS
+
+typedef enum
+{
+  /* Add the element when the packet does not carry it */
+  KMS_RTP_HDR_EXT_ADD = 1 << 0,
+  /* Overwrite the element when the packet carries it */
+  KMS_RTP_HDR_EXT_UPDATE = 1 << 1,
+} KmsRtpHdrExtFlags;
+
+/*
+ * Writes the header extension element @id (RFC 5285) in the RTP packet
+ * @buffer, as a two-byte element when it does not fit in a one-byte one.
+ * Only the RTP header is rewritten, into a memory block of its own; the
+ * payload memory is shared with the original packet, never mapped for
+ * writing nor copied. @buffer is made writable only when it has to change.
+ *
+ * Returns FALSE if the element could not be written: not a valid packet,
+ * or an element of another size.
+ */
+gboolean kms_rtp_hdr_ext_write (GstBuffer ** buffer, guint8 id,
+    const guint8 * data, guint size, KmsRtpHdrExtFlags flags);
+
+/* The same for every packet of @list, returns how many were written */
+guint kms_rtp_hdr_ext_write_list (GstBufferList ** list, guint8 id,
+    const guint8 * data, guint size, KmsRtpHdrExtFlags flags);
+
+/* Packets whose payload would have been copied to write their header */
+guint64 kms_rtp_hdr_ext_get_copies_avoided (void);
+
+/*
+ * Called for element @id of every packet. @data holds its @size bytes when
+ * @present; otherwise it is zeroed room for a new element, offered only to
+ * handlers added with KMS_RTP_HDR_EXT_ADD. Returns TRUE if @data was written
+ * and has to go into the packet.
+ */
+typedef gboolean (*KmsRtpHdrExtFunc) (GstBuffer * buffer, guint8 * data,
+    guint size, gboolean present, gpointer user_data);
+
+/*
+ * Header extension handlers keyed by their negotiated id. Packets are parsed
+ * once for all of them, one-byte or two-byte elements alike, and their
+ * header rewritten once if any handler changed it.
+ */
+typedef struct _KmsRtpHdrExtRegistry KmsRtpHdrExtRegistry;
+
+KmsRtpHdrExtRegistry *kms_rtp_hdr_ext_registry_new (void);
+void kms_rtp_hdr_ext_registry_free (KmsRtpHdrExtRegistry * registry);
+
+/* Returns FALSE if @id already has a handler. @size is that of new elements */
+gboolean kms_rtp_hdr_ext_registry_add (KmsRtpHdrExtRegistry * registry,
+    guint8 id, guint size, KmsRtpHdrExtFlags flags, KmsRtpHdrExtFunc func,
+    gpointer user_data, GDestroyNotify notify);
+
+guint kms_rtp_hdr_ext_registry_get_n_handlers (KmsRtpHdrExtRegistry *
+    registry);
+
+/* Returns FALSE if @buffer is not an RTP packet the handlers can be run on */
+gboolean kms_rtp_hdr_ext_registry_process (KmsRtpHdrExtRegistry * registry,
+    GstBuffer ** buffer);
+
+/* The same for every packet of @list, returns how many were processed */
+guint kms_rtp_hdr_ext_registry_process_list (KmsRtpHdrExtRegistry *
+    registry, GstBufferList ** list);
+
+/* Stamps the current time, 6.18 fixed point seconds (abs-send-time) */
+gboolean kms_rtp_hdr_ext_abs_send_time (GstBuffer * buffer, guint8 * data,
+    guint size, gboolean present, gpointer user_data);
+
+/*
+ * Stamps consecutive sequence numbers (transport-wide-cc) taken from the
+ * gint counter @user_data, shared by all the streams of a transport.
+ */
+gboolean kms_rtp_hdr_ext_transport_seq (GstBuffer * buffer, guint8 * data,
+    guint size, gboolean present, gpointer user_data);
+
+typedef struct _KmsRtpHdrExtAudioLevel
+{
+  /* -dBov of the last packet, 127 for silence */
+  gint level;
+  gboolean voice;
+} KmsRtpHdrExtAudioLevel;
+
+/* Reads ssrc-audio-level (RFC 6464) into @user_data */
+gboolean kms_rtp_hdr_ext_audio_level (GstBuffer * buffer, guint8 * data,
+    guint size, gboolean present, gpointer user_data);
+
+G_END_DECLS
+#endif /* __KMS_RTP_HDR_EXT_H__ */
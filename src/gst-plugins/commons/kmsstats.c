@@ -19,6 +19,8 @@
 #include "kmsutils.h"
 #include "kmsbufferlacentymeta.h"
 
+#include <string.h>
+
 struct _KmsStatsProbe
 {
   GstPad *pad;
@@ -26,12 +28,27 @@ struct _KmsStatsProbe
   gulong probe_id;
 };
 
+typedef struct _KmsLatencySampling
+{
+  KmsRefStruct ref;
+  gint rate;
+  guint64 interval;
+} KmsLatencySampling;
+
 typedef struct _BufferLatencyValues
 {
   gboolean valid;
   KmsMediaType type;
+
+  /* Sampling state, only used by the probes stamping the buffers */
+  GstPad *pad;
+  KmsLatencySampling *sampling;
+  guint count;
+  GstClockTime last;
 } BufferLatencyValues;
 
+static G_DEFINE_QUARK (KMS_LATENCY_SAMPLING, kms_latency_sampling);
+
 typedef struct _ProbeData ProbeData;
 typedef void (*BufferCb) (GstBuffer * buffer, ProbeData * pdata);
 
@@ -44,8 +61,6 @@ typedef struct _ProbeData
   GCallback cb;
   gpointer user_data;
   GDestroyNotify destroy_data;
-
-  gboolean locked;
 } ProbeData;
 
 static BufferLatencyValues *
@@ -53,10 +68,11 @@ buffer_latency_values_new (gboolean is_valid, KmsMediaType type)
 {
   BufferLatencyValues *blv;
 
-  blv = g_slice_new (BufferLatencyValues);
+  blv = g_slice_new0 (BufferLatencyValues);
 
   blv->valid = is_valid;
   blv->type = type;
+  blv->last = GST_CLOCK_TIME_NONE;
 
   return blv;
 }
@@ -64,13 +80,127 @@ buffer_latency_values_new (gboolean is_valid, KmsMediaType type)
 static void
 buffer_latency_values_destroy (BufferLatencyValues * blv)
 {
+  if (blv->sampling != NULL) {
+    kms_ref_struct_unref (KMS_REF_STRUCT_CAST (blv->sampling));
+  }
+
   g_slice_free (BufferLatencyValues, blv);
 }
 
+static void
+kms_latency_sampling_destroy (KmsLatencySampling * sampling)
+{
+  g_slice_free (KmsLatencySampling, sampling);
+}
+
+static KmsLatencySampling *
+kms_latency_sampling_get (GstElement * pipeline)
+{
+  KmsLatencySampling *sampling;
+
+  GST_OBJECT_LOCK (pipeline);
+
+  sampling = g_object_get_qdata (G_OBJECT (pipeline),
+      kms_latency_sampling_quark ());
+
+  if (sampling == NULL) {
+    sampling = g_slice_new0 (KmsLatencySampling);
+    kms_ref_struct_init (KMS_REF_STRUCT_CAST (sampling),
+        (GDestroyNotify) kms_latency_sampling_destroy);
+    sampling->rate = 1;
+    g_object_set_qdata_full (G_OBJECT (pipeline),
+        kms_latency_sampling_quark (), sampling,
+        (GDestroyNotify) kms_ref_struct_unref);
+  }
+
+  kms_ref_struct_ref (KMS_REF_STRUCT_CAST (sampling));
+
+  GST_OBJECT_UNLOCK (pipeline);
+
+  return sampling;
+}
+
+void
+kms_stats_set_latency_sampling (GstElement * pipeline, guint rate,
+    GstClockTime interval)
+{
+  KmsLatencySampling *sampling;
+
+  g_return_if_fail (GST_IS_ELEMENT (pipeline));
+
+  sampling = kms_latency_sampling_get (pipeline);
+
+  g_atomic_int_set (&sampling->rate, MAX (rate, 1));
+  __atomic_store_n (&sampling->interval, interval, __ATOMIC_RELAXED);
+
+  kms_ref_struct_unref (KMS_REF_STRUCT_CAST (sampling));
+}
+
+static GstElement *
+get_pipeline (GstPad * pad)
+{
+  GstObject *object, *parent;
+
+  object = gst_object_get_parent (GST_OBJECT (pad));
+
+  if (object == NULL) {
+    return NULL;
+  }
+
+  while ((parent = gst_object_get_parent (object)) != NULL) {
+    gst_object_unref (object);
+    object = parent;
+  }
+
+  if (!GST_IS_PIPELINE (object)) {
+    /* Not added to a pipeline yet */
+    gst_object_unref (object);
+    return NULL;
+  }
+
+  return GST_ELEMENT (object);
+}
+
+static gboolean
+buffer_latency_values_sample (BufferLatencyValues * blv, GstClockTime * time)
+{
+  GstClockTime interval = 0;
+  guint rate = 1;
+
+  if (blv->sampling == NULL) {
+    GstElement *pipeline = get_pipeline (blv->pad);
+
+    if (pipeline != NULL) {
+      blv->sampling = kms_latency_sampling_get (pipeline);
+      gst_object_unref (pipeline);
+    }
+  }
+
+  if (blv->sampling != NULL) {
+    rate = g_atomic_int_get (&blv->sampling->rate);
+    interval = __atomic_load_n (&blv->sampling->interval, __ATOMIC_RELAXED);
+  }
+
+  if (rate > 1 && blv->count++ % rate != 0) {
+    return FALSE;
+  }
+
+  *time = kms_utils_get_time_nsecs ();
+
+  if (interval > 0 && GST_CLOCK_TIME_IS_VALID (blv->last) &&
+      *time < blv->last + interval) {
+    return FALSE;
+  }
+
+  blv->last = *time;
+
+  return TRUE;
+}
+
 static ProbeData *
 probe_data_new (BufferCb invoke_cb, gpointer invoke_data,
-    GDestroyNotify destroy_invoke, GCallback cb, gboolean locked,
-    gpointer user_data, GDestroyNotify destroy_data)
+    GDestroyNotify destroy_invoke, GCallback cb, gpointer user_data,
+    GDestroyNotify destroy_data)
 {
   ProbeData *pdata;
 
@@ -84,8 +214,6 @@ probe_data_new (BufferCb invoke_cb, gpointer invoke_data,
   pdata->user_data = user_data;
   pdata->destroy_data = destroy_data;
 
-  pdata->locked = locked;
-
   return pdata;
 }
 
@@ -138,6 +266,161 @@ process_buffer_probe_cb (GstPad * pad, GstPadProbeInfo * info,
   return GST_PAD_PROBE_OK;
 }
 
+#define HISTOGRAM_LINEAR_BUCKETS 16
+#define HISTOGRAM_SUB_BUCKETS 8
+
+void
+kms_stats_latency_histogram_init (KmsStatsLatencyHistogram * histogram)
+{
+  memset (histogram, 0, sizeof (KmsStatsLatencyHistogram));
+  histogram->min = G_MAXUINT64;
+}
+
+static guint
+kms_stats_latency_histogram_index (guint64 usecs)
+{
+  guint shift, index;
+
+  if (usecs < HISTOGRAM_LINEAR_BUCKETS) {
+    return usecs;
+  }
+
+  /* Keep the 4 most significant bits: 1 + the sub bucket */
+  shift = g_bit_storage (usecs) - 4;
+  index = (shift + 1) * HISTOGRAM_SUB_BUCKETS + (usecs >> shift) -
+      HISTOGRAM_SUB_BUCKETS;
+
+  return MIN (index, KMS_STATS_HISTOGRAM_BUCKETS - 1);
+}
+
+static guint64
+kms_stats_latency_histogram_lower_bound (guint index)
+{
+  guint shift;
+
+  if (index < HISTOGRAM_LINEAR_BUCKETS) {
+    return index;
+  }
+
+  shift = index / HISTOGRAM_SUB_BUCKETS - 1;
+
+  return (guint64) (index % HISTOGRAM_SUB_BUCKETS + HISTOGRAM_SUB_BUCKETS) <<
+      shift;
+}
+
+/* Middle of the bucket, in nano seconds */
+static guint64
+kms_stats_latency_histogram_value (guint index)
+{
+  guint64 lower, upper;
+
+  lower = kms_stats_latency_histogram_lower_bound (index);
+
+  if (index + 1 == KMS_STATS_HISTOGRAM_BUCKETS) {
+    return lower * GST_USECOND;
+  }
+
+  upper = kms_stats_latency_histogram_lower_bound (index + 1);
+
+  return (lower + upper) * GST_USECOND / 2;
+}
+
+void
+kms_stats_latency_histogram_record (KmsStatsLatencyHistogram * histogram,
+    GstClockTimeDiff t)
+{
+  guint64 nsecs = t > 0 ? t : 0;
+  guint64 current;
+
+  /* Extremes first, so a drained bucket always has them accounted */
+  current = __atomic_load_n (&histogram->min, __ATOMIC_RELAXED);
+  while (nsecs < current && !__atomic_compare_exchange_n (&histogram->min,
+          &current, nsecs, TRUE, __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+
+  current = __atomic_load_n (&histogram->max, __ATOMIC_RELAXED);
+  while (nsecs > current && !__atomic_compare_exchange_n (&histogram->max,
+          &current, nsecs, TRUE, __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+
+  __atomic_fetch_add (&histogram->buckets[kms_stats_latency_histogram_index
+          (GST_TIME_AS_USECONDS (nsecs))], 1, __ATOMIC_RELAXED);
+}
+
+static guint64
+kms_stats_latency_histogram_percentile (const guint64 * buckets, guint64 count,
+    gdouble percentile)
+{
+  guint64 rank, accumulated = 0;
+  guint i;
+
+  rank = MAX ((guint64) (percentile * count + 0.5), 1);
+
+  for (i = 0; i < KMS_STATS_HISTOGRAM_BUCKETS; i++) {
+    accumulated += buckets[i];
+
+    if (accumulated >= rank) {
+      return kms_stats_latency_histogram_value (i);
+    }
+  }
+
+  return kms_stats_latency_histogram_value (KMS_STATS_HISTOGRAM_BUCKETS - 1);
+}
+
+void
+kms_stats_latency_histogram_to_structure (KmsStatsLatencyHistogram *
+    histogram, GstStructure * stats)
+{
+  guint64 buckets[KMS_STATS_HISTOGRAM_BUCKETS];
+  guint64 count = 0, min, max;
+  guint i, first = 0, last = 0;
+
+  /* Drain it first, so all the values come from the same counts */
+  for (i = 0; i < KMS_STATS_HISTOGRAM_BUCKETS; i++) {
+    buckets[i] = __atomic_exchange_n (&histogram->buckets[i], 0,
+        __ATOMIC_RELAXED);
+
+    if (buckets[i] == 0) {
+      continue;
+    }
+
+    if (count == 0) {
+      first = i;
+    }
+
+    last = i;
+    count += buckets[i];
+  }
+
+  min = __atomic_exchange_n (&histogram->min, G_MAXUINT64, __ATOMIC_RELAXED);
+  max = __atomic_exchange_n (&histogram->max, 0, __ATOMIC_RELAXED);
+
+  if (count == 0) {
+    return;
+  }
+
+  if (min > max) {
+    /* Extremes taken by a concurrent drain, fall back to the buckets */
+    min = kms_stats_latency_histogram_value (first);
+    max = kms_stats_latency_histogram_value (last);
+  }
+
+  /* Same units and type than "avg". Bucket midpoints can go past the */
+  /* real extremes, percentiles are kept inside them.                 */
+  gst_structure_set (stats, "count", G_TYPE_UINT64, count,
+      "min", G_TYPE_UINT64, min, "max", G_TYPE_UINT64, max,
+      "p50", G_TYPE_UINT64,
+      CLAMP (kms_stats_latency_histogram_percentile (buckets, count, 0.50),
+          min, max),
+      "p90", G_TYPE_UINT64,
+      CLAMP (kms_stats_latency_histogram_percentile (buckets, count, 0.90),
+          min, max),
+      "p95", G_TYPE_UINT64,
+      CLAMP (kms_stats_latency_histogram_percentile (buckets, count, 0.95),
+          min, max),
+      "p99", G_TYPE_UINT64,
+      CLAMP (kms_stats_latency_histogram_percentile (buckets, count, 0.99),
+          min, max), NULL);
+}
+
 GstStructure *
 kms_stats_get_element_stats (GstStructure * stats)
 {
@@ -170,7 +453,10 @@ buffer_latency_probe_cb (GstBuffer * buffer, ProbeData * pdata)
   BufferLatencyValues *blv = (BufferLatencyValues *) pdata->invoke_data;
   GstClockTime time;
 
-  time = kms_utils_get_time_nsecs ();
+  /* Buffers not sampled get no meta, so nothing measures them later */
+  if (!buffer_latency_values_sample (blv, &time)) {
+    return;
+  }
 
   kms_buffer_add_buffer_latency_meta (buffer, time, blv->valid, blv->type);
 }
@@ -184,9 +470,10 @@ kms_stats_add_buffer_latency_meta_probe (GstPad * pad, gboolean is_valid,
   BufferLatencyValues *blv;
 
   blv = buffer_latency_values_new (is_valid, type);
+  blv->pad = pad;
 
   pdata = probe_data_new (buffer_latency_probe_cb, blv,
-      (GDestroyNotify) buffer_latency_values_destroy, NULL, FALSE, NULL, NULL);
+      (GDestroyNotify) buffer_latency_values_destroy, NULL, NULL, NULL);
 
   return gst_pad_add_probe (pad,
       GST_PAD_PROBE_TYPE_BUFFER | GST_PAD_PROBE_TYPE_BUFFER_LIST,
@@ -231,7 +518,7 @@ kms_stats_add_buffer_update_latency_meta_probe (GstPad * pad, gboolean is_valid,
   blv = buffer_latency_values_new (is_valid, type);
 
   pdata = probe_data_new (buffer_update_latency_probe_cb, blv,
-      (GDestroyNotify) buffer_latency_values_destroy, NULL, FALSE, NULL, NULL);
+      (GDestroyNotify) buffer_latency_values_destroy, NULL, NULL, NULL);
 
   return gst_pad_add_probe (pad,
       GST_PAD_PROBE_TYPE_BUFFER | GST_PAD_PROBE_TYPE_BUFFER_LIST,
@@ -266,15 +553,7 @@ buffer_for_each_meta_cb (GstBuffer * buffer, GstMeta ** meta, ProbeData * pdata)
   now = kms_utils_get_time_nsecs ();
   diff = GST_CLOCK_DIFF (blmeta->ts, now);
 
-  if (pdata->locked) {
-    KMS_BUFFER_LATENCY_DATA_LOCK (blmeta);
-  }
-
-  func (pad, blmeta->type, diff, blmeta->data, pdata->user_data);
-
-  if (pdata->locked) {
-    KMS_BUFFER_LATENCY_DATA_UNLOCK (blmeta);
-  }
+  func (pad, blmeta->type, diff, blmeta, pdata->user_data);
 
   return TRUE;
 }
@@ -288,13 +567,12 @@ buffer_latency_calculation_cb (GstBuffer * buffer, ProbeData * pdata)
 
 gulong
 kms_stats_add_buffer_latency_notification_probe (GstPad * pad,
-    BufferLatencyCallback cb, gboolean locked, gpointer user_data,
-    GDestroyNotify destroy_data)
+    BufferLatencyCallback cb, gpointer user_data, GDestroyNotify destroy_data)
 {
   ProbeData *pdata;
 
   pdata = probe_data_new (buffer_latency_calculation_cb, pad, NULL,
-      G_CALLBACK (cb), locked, user_data, destroy_data);
+      G_CALLBACK (cb), user_data, destroy_data);
 
   return gst_pad_add_probe (pad,
       GST_PAD_PROBE_TYPE_BUFFER | GST_PAD_PROBE_TYPE_BUFFER_LIST,
@@ -325,13 +603,13 @@ kms_stats_probe_destroy (KmsStatsProbe * probe)
 
 void
 kms_stats_probe_add_latency (KmsStatsProbe * probe,
-    BufferLatencyCallback callback, gboolean locked, gpointer user_data,
+    BufferLatencyCallback callback, gpointer user_data,
     GDestroyNotify destroy_data)
 {
   kms_stats_probe_remove (probe);
 
   probe->probe_id = kms_stats_add_buffer_latency_notification_probe (probe->pad,
-      callback, locked, user_data, destroy_data);
+      callback, user_data, destroy_data);
 }
 
 void
@@ -378,11 +656,12 @@ kms_stats_create_id_for_pad (GstElement * obj, GstPad * pad)
 static void
 kms_stats_stream_e2e_avg_stat_destroy (StreamE2EAvgStat * stat)
 {
+  g_free (stat->id);
   g_slice_free (StreamE2EAvgStat, stat);
 }
 
 StreamE2EAvgStat *
-kms_stats_stream_e2e_avg_stat_new (KmsMediaType type)
+kms_stats_stream_e2e_avg_stat_new (KmsMediaType type, const gchar * id)
 {
   StreamE2EAvgStat *stat;
 
@@ -390,6 +669,93 @@ kms_stats_stream_e2e_avg_stat_new (KmsMediaType type)
   kms_ref_struct_init (KMS_REF_STRUCT_CAST (stat),
       (GDestroyNotify) kms_stats_stream_e2e_avg_stat_destroy);
   stat->type = type;
+  stat->id = g_strdup (id);
+  kms_stats_latency_histogram_init (&stat->histogram);
 
   return stat;
 }
+
+static guint64
+kms_stats_snapshot_load (const guint64 * field)
+{
+  return __atomic_load_n (field, __ATOMIC_RELAXED);
+}
+
+void
+kms_stats_snapshot_read (const KmsStatsSnapshot * snapshot,
+    KmsStatsSnapshot * dst)
+{
+  guint i;
+
+  for (i = 0; i < KMS_STATS_SNAPSHOT_STREAMS; i++) {
+    dst->packets_received[i] =
+        kms_stats_snapshot_load (&snapshot->packets_received[i]);
+    dst->bytes_received[i] =
+        kms_stats_snapshot_load (&snapshot->bytes_received[i]);
+    dst->packets_sent[i] = kms_stats_snapshot_load (&snapshot->packets_sent[i]);
+    dst->bytes_sent[i] = kms_stats_snapshot_load (&snapshot->bytes_sent[i]);
+    dst->input_latency[i] =
+        kms_stats_snapshot_load (&snapshot->input_latency[i]);
+  }
+
+  dst->remb_received = kms_stats_snapshot_load (&snapshot->remb_received);
+  dst->remb_sent = kms_stats_snapshot_load (&snapshot->remb_sent);
+}
+
+typedef struct _SnapshotCounters
+{
+  guint64 *packets;
+  guint64 *bytes;
+} SnapshotCounters;
+
+static void
+snapshot_counters_destroy (SnapshotCounters * counters)
+{
+  g_slice_free (SnapshotCounters, counters);
+}
+
+static gboolean
+snapshot_count_buffer (GstBuffer ** buffer, guint idx, guint64 * bytes)
+{
+  *bytes += gst_buffer_get_size (*buffer);
+
+  return TRUE;
+}
+
+static GstPadProbeReturn
+snapshot_buffers_probe_cb (GstPad * pad, GstPadProbeInfo * info,
+    SnapshotCounters * counters)
+{
+  if (GST_PAD_PROBE_INFO_TYPE (info) & GST_PAD_PROBE_TYPE_BUFFER) {
+    GstBuffer *buffer = GST_PAD_PROBE_INFO_BUFFER (info);
+
+    KMS_STATS_SNAPSHOT_ADD (*counters->packets, 1);
+    KMS_STATS_SNAPSHOT_ADD (*counters->bytes, gst_buffer_get_size (buffer));
+  } else if (GST_PAD_PROBE_INFO_TYPE (info) & GST_PAD_PROBE_TYPE_BUFFER_LIST) {
+    GstBufferList *list = GST_PAD_PROBE_INFO_BUFFER_LIST (info);
+    guint64 bytes = 0;
+
+    gst_buffer_list_foreach (list, (GstBufferListFunc) snapshot_count_buffer,
+        &bytes);
+    KMS_STATS_SNAPSHOT_ADD (*counters->packets, gst_buffer_list_length (list));
+    KMS_STATS_SNAPSHOT_ADD (*counters->bytes, bytes);
+  }
+
+  return GST_PAD_PROBE_OK;
+}
+
+gulong
+kms_stats_snapshot_add_buffers_probe (GstPad * pad, guint64 * packets,
+    guint64 * bytes)
+{
+  SnapshotCounters *counters;
+
+  counters = g_slice_new0 (SnapshotCounters);
+  counters->packets = packets;
+  counters->bytes = bytes;
+
+  return gst_pad_add_probe (pad,
+      GST_PAD_PROBE_TYPE_BUFFER | GST_PAD_PROBE_TYPE_BUFFER_LIST,
+      (GstPadProbeCallback) snapshot_buffers_probe_cb, counters,
+      (GDestroyNotify) snapshot_counters_destroy);
+}
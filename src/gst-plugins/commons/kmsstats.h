@@ -21,6 +21,7 @@
 #include "kmsmediatype.h"
 #include "kmslist.h"
 #include "kmsrefstruct.h"
+#include "kmsbufferlacentymeta.h"
 
 G_BEGIN_DECLS
 
@@ -38,20 +39,47 @@ G_BEGIN_DECLS
   (ti) * KMS_STATS_ALPHA + (ax) * (1 - KMS_STATS_ALPHA);  \
 })
 
+/* Log-linear (HDR style) histogram of latencies in micro seconds. Values */
+/* under 16 us get their own bucket, then each power of two is split in  */
+/* 8 buckets (12.5% precision) up to 134 s. The exact min and max are     */
+/* kept aside. Recording is a few relaxed atomic operations, so any       */
+/* thread can read it while it is used.                                  */
+#define KMS_STATS_HISTOGRAM_BUCKETS 200
+
+typedef struct _KmsStatsLatencyHistogram
+{
+  guint64 buckets[KMS_STATS_HISTOGRAM_BUCKETS];
+  /* In nano seconds, G_MAXUINT64 and 0 while empty */
+  guint64 min;
+  guint64 max;
+} KmsStatsLatencyHistogram;
+
+void kms_stats_latency_histogram_init (KmsStatsLatencyHistogram *histogram);
+void kms_stats_latency_histogram_record (KmsStatsLatencyHistogram *histogram, GstClockTimeDiff t);
+/* Sets "count", "min", "max", "p50", "p90", "p95" and "p99" in @stats, in  */
+/* nano seconds, when there are samples, and empties @histogram: values    */
+/* cover the samples recorded since the previous call. A sample recorded   */
+/* while it runs may have its extremes reported one window off its bucket. */
+void kms_stats_latency_histogram_to_structure (KmsStatsLatencyHistogram *histogram, GstStructure *stats);
+
 GstStructure * kms_stats_get_element_stats (GstStructure *stats);
 
 /* buffer latency */
-typedef void (*BufferLatencyCallback) (GstPad * pad, KmsMediaType type, GstClockTimeDiff t, KmsList *data, gpointer user_data);
+typedef void (*BufferLatencyCallback) (GstPad * pad, KmsMediaType type, GstClockTimeDiff t, KmsBufferLatencyMeta *meta, gpointer user_data);
 gulong kms_stats_add_buffer_latency_meta_probe (GstPad * pad, gboolean is_valid, KmsMediaType type);
 gulong kms_stats_add_buffer_update_latency_meta_probe (GstPad * pad, gboolean is_valid, KmsMediaType type);
-gulong kms_stats_add_buffer_latency_notification_probe (GstPad * pad, BufferLatencyCallback cb, gboolean locked, gpointer user_data, GDestroyNotify destroy_data);
+gulong kms_stats_add_buffer_latency_notification_probe (GstPad * pad, BufferLatencyCallback cb, gpointer user_data, GDestroyNotify destroy_data);
+
+/* Only stamp one of every @rate buffers, and at most one per @interval. */
+/* Applies to the latency meta probes of every element in @pipeline.   */
+void kms_stats_set_latency_sampling (GstElement *pipeline, guint rate, GstClockTime interval);
 
 typedef struct _KmsStatsProbe KmsStatsProbe;
 
 KmsStatsProbe * kms_stats_probe_new (GstPad *pad, KmsMediaType type);
 void kms_stats_probe_destroy (KmsStatsProbe *probe);
 void kms_stats_probe_add_latency (KmsStatsProbe *probe, BufferLatencyCallback callback,
-  gboolean locked, gpointer user_data, GDestroyNotify destroy_data);
+  gpointer user_data, GDestroyNotify destroy_data);
 void kms_stats_probe_latency_meta_set_valid (KmsStatsProbe *probe, gboolean is_valid);
 void kms_stats_probe_remove (KmsStatsProbe *probe);
 gboolean kms_stats_probe_watches (KmsStatsProbe *probe, GstPad *pad);
@@ -61,16 +89,44 @@ typedef struct _StreamE2EAvgStat
   KmsRefStruct ref;
   KmsMediaType type;
   gdouble avg;
+  KmsStatsLatencyHistogram histogram;
+  gchar *id;
 } StreamE2EAvgStat;
 
 gchar * kms_stats_create_id_for_pad (GstElement * obj, GstPad * pad);
-StreamE2EAvgStat * kms_stats_stream_e2e_avg_stat_new (KmsMediaType type);
+StreamE2EAvgStat * kms_stats_stream_e2e_avg_stat_new (KmsMediaType type, const gchar *id);
 
 #define kms_stats_stream_e2e_avg_stat_ref(obj) \
   (StreamE2EAvgStat *) kms_ref_struct_ref (KMS_REF_STRUCT_CAST (obj))
 #define kms_stats_stream_e2e_avg_stat_unref(obj) \
   kms_ref_struct_unref (KMS_REF_STRUCT_CAST (obj))
 
+/* Flat snapshot of the counters of an element. Per stream values are */
+/* indexed by KmsMediaType. Fields are written with atomic operations */
+/* from the streaming threads, so it can be read without locking.    */
+#define KMS_STATS_SNAPSHOT_STREAMS (KMS_MEDIA_TYPE_DATA + 1)
+
+typedef struct _KmsStatsSnapshot
+{
+  guint64 packets_received[KMS_STATS_SNAPSHOT_STREAMS];
+  guint64 bytes_received[KMS_STATS_SNAPSHOT_STREAMS];
+  guint64 packets_sent[KMS_STATS_SNAPSHOT_STREAMS];
+  guint64 bytes_sent[KMS_STATS_SNAPSHOT_STREAMS];
+  /* Average latency on the input pads in nano seconds */
+  guint64 input_latency[KMS_STATS_SNAPSHOT_STREAMS];
+  /* Bandwidth estimations (bps) received from and sent to the remote peer */
+  guint64 remb_received;
+  guint64 remb_sent;
+} KmsStatsSnapshot;
+
+#define KMS_STATS_SNAPSHOT_ADD(field, val) \
+  __atomic_fetch_add (&(field), (val), __ATOMIC_RELAXED)
+#define KMS_STATS_SNAPSHOT_SET(field, val) \
+  __atomic_store_n (&(field), (val), __ATOMIC_RELAXED)
+
+void kms_stats_snapshot_read (const KmsStatsSnapshot *snapshot, KmsStatsSnapshot *dst);
+gulong kms_stats_snapshot_add_buffers_probe (GstPad *pad, guint64 *packets, guint64 *bytes);
+
 G_END_DECLS
 
 #endif /* __KMS_STATS_H__ */
@@ -0,0 +1,441 @@
+/*
+ * (C) Copyright 2016 Kurento (http://kurento.org/)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#  include <config.h>
+#endif
+
+#include "kmstranscodingmanager.h"
+#include "kmstreebin.h"
+#include "kmsmediatype.h"
+#include "kmsrefstruct.h"
+#include "kmsutils.h"
+
+#define GST_CAT_DEFAULT kms_transcoding_manager_debug
+GST_DEBUG_CATEGORY_STATIC (GST_CAT_DEFAULT);
+#define GST_DEFAULT_NAME "transcodingmanager"
+
+/* Encoders are grouped in bitrate classes of powers of two of this value */
+#define BITRATE_CLASS_UNIT 100000
+
+typedef struct _KmsTranscodingManager
+{
+  KmsRefStruct ref;
+  GMutex mutex;
+  /* GObject * -> KmsTranscodingBranch * */
+  GHashTable *branches;
+} KmsTranscodingManager;
+
+typedef struct _KmsTranscodingBranch
+{
+  KmsTranscodingManager *manager;
+  GWeakRef branch;
+  KmsTranscodingBranchType type;
+  KmsMediaType media;
+  gchar *key;
+  gboolean duplicated;
+} KmsTranscodingBranch;
+
+static G_DEFINE_QUARK (KMS_TRANSCODING_MANAGER, kms_transcoding_manager);
+
+static void
+kms_transcoding_manager_destroy (KmsTranscodingManager * manager)
+{
+  g_hash_table_unref (manager->branches);
+  g_mutex_clear (&manager->mutex);
+
+  g_slice_free (KmsTranscodingManager, manager);
+}
+
+static KmsTranscodingManager *
+kms_transcoding_manager_get (GstElement * pipeline, gboolean create)
+{
+  KmsTranscodingManager *manager;
+
+  GST_OBJECT_LOCK (pipeline);
+
+  manager = g_object_get_qdata (G_OBJECT (pipeline),
+      kms_transcoding_manager_quark ());
+
+  if (manager == NULL && create) {
+    manager = g_slice_new0 (KmsTranscodingManager);
+    kms_ref_struct_init (KMS_REF_STRUCT_CAST (manager),
+        (GDestroyNotify) kms_transcoding_manager_destroy);
+    g_mutex_init (&manager->mutex);
+    manager->branches = g_hash_table_new (NULL, NULL);
+    g_object_set_qdata_full (G_OBJECT (pipeline),
+        kms_transcoding_manager_quark (), manager,
+        (GDestroyNotify) kms_ref_struct_unref);
+  }
+
+  if (manager != NULL) {
+    kms_ref_struct_ref (KMS_REF_STRUCT_CAST (manager));
+  }
+
+  GST_OBJECT_UNLOCK (pipeline);
+
+  return manager;
+}
+
+static GstElement *
+get_pipeline (GstElement * element)
+{
+  GstObject *object, *parent;
+
+  object = gst_object_ref (element);
+
+  while ((parent = gst_object_get_parent (object)) != NULL) {
+    gst_object_unref (object);
+    object = parent;
+  }
+
+  if (!GST_IS_PIPELINE (object)) {
+    gst_object_unref (object);
+    return NULL;
+  }
+
+  return GST_ELEMENT (object);
+}
+
+/* Elements that forward a stream unchanged to all their outputs */
+static const gchar *passthrough_factories[] = {
+  "queue", "queue2", "tee", "identity", NULL
+};
+
+static gboolean
+is_passthrough (GstElement * element)
+{
+  GstElementFactory *factory = gst_element_get_factory (element);
+  const gchar *name;
+  guint i;
+
+  if (factory == NULL) {
+    return FALSE;
+  }
+
+  name = gst_plugin_feature_get_name (GST_PLUGIN_FEATURE (factory));
+
+  for (i = 0; passthrough_factories[i] != NULL; i++) {
+    if (g_strcmp0 (name, passthrough_factories[i]) == 0) {
+      return TRUE;
+    }
+  }
+
+  return FALSE;
+}
+
+/* Peer of @pad, looking through ghost pads */
+static GstPad *
+get_real_peer (GstPad * pad)
+{
+  GstPad *peer = gst_pad_get_peer (pad);
+
+  while (peer != NULL && GST_IS_PROXY_PAD (peer)) {
+    GstPad *next = NULL;
+
+    if (GST_IS_GHOST_PAD (peer)) {
+      next = gst_ghost_pad_get_target (GST_GHOST_PAD (peer));
+    } else {
+      /* Internal pad of a sink ghost pad */
+      GstProxyPad *ghost = gst_proxy_pad_get_internal (GST_PROXY_PAD (peer));
+
+      if (ghost != NULL) {
+        next = gst_pad_get_peer (GST_PAD (ghost));
+        gst_object_unref (ghost);
+      }
+    }
+
+    if (next == NULL) {
+      break;
+    }
+
+    gst_object_unref (peer);
+    peer = next;
+  }
+
+  return peer;
+}
+
+/*
+ * Pad where the stream received by @source is produced, so that sources fed
+ * by the same stream through tees and queues get the same one
+ */
+static GstPad *
+get_stream_pad (GstElement * source)
+{
+  GstElement *element = gst_object_ref (source);
+  GstPad *pad = NULL, *sink, *next;
+
+  while ((sink = gst_element_get_static_pad (element, "sink")) != NULL) {
+    gst_object_unref (element);
+    next = get_real_peer (sink);
+    gst_object_unref (sink);
+
+    if (next == NULL) {
+      return pad;
+    }
+
+    if (pad != NULL) {
+      gst_object_unref (pad);
+    }
+    pad = next;
+
+    element = gst_pad_get_parent_element (pad);
+
+    if (element == NULL) {
+      return pad;
+    }
+
+    if (!is_passthrough (element)) {
+      break;
+    }
+  }
+
+  gst_object_unref (element);
+
+  return pad;
+}
+
+static gchar *
+kms_transcoding_branch_key (GstElement * source, const GstCaps * caps,
+    gint max_bitrate)
+{
+  const gchar *codec = "ANY";
+  guint bitrate_class = 0;
+  GstPad *stream;
+  gchar *key;
+
+  if (!gst_caps_is_any (caps) && !gst_caps_is_empty (caps)) {
+    codec = gst_structure_get_name (gst_caps_get_structure (caps, 0));
+  }
+
+  /* Unlimited encoders get class 0 */
+  if (max_bitrate > 0 && max_bitrate < G_MAXINT) {
+    bitrate_class = g_bit_storage (max_bitrate / BITRATE_CLASS_UNIT) + 1;
+  }
+
+  stream = get_stream_pad (source);
+
+  if (stream == NULL) {
+    /* Not linked yet, only its own branches can be compared */
+    return g_strdup_printf ("%p/%s/%u", source, codec, bitrate_class);
+  }
+
+  key = g_strdup_printf ("%s:%s@%p/%s/%u", GST_DEBUG_PAD_NAME (stream), stream,
+      codec, bitrate_class);
+  gst_object_unref (stream);
+
+  return key;
+}
+
+static void
+kms_transcoding_branch_finalized (gpointer data, GObject * object)
+{
+  KmsTranscodingBranch *branch = data;
+  KmsTranscodingManager *manager = branch->manager;
+
+  g_mutex_lock (&manager->mutex);
+  g_hash_table_remove (manager->branches, object);
+
+  if (!branch->duplicated) {
+    GHashTableIter iter;
+    gpointer value;
+
+    /* One of the branches duplicating this one becomes the original */
+    g_hash_table_iter_init (&iter, manager->branches);
+    while (g_hash_table_iter_next (&iter, NULL, &value)) {
+      KmsTranscodingBranch *other = value;
+
+      if (other->type == branch->type &&
+          g_strcmp0 (other->key, branch->key) == 0) {
+        other->duplicated = FALSE;
+        break;
+      }
+    }
+  }
+
+  g_mutex_unlock (&manager->mutex);
+
+  GST_DEBUG ("Branch %s released", branch->key);
+
+  g_weak_ref_clear (&branch->branch);
+  g_free (branch->key);
+  g_slice_free (KmsTranscodingBranch, branch);
+
+  kms_ref_struct_unref (KMS_REF_STRUCT_CAST (manager));
+}
+
+void
+kms_transcoding_manager_add_branch (GstElement * source, GstElement * branch,
+    KmsTranscodingBranchType type, const GstCaps * caps, gint max_bitrate)
+{
+  KmsTranscodingManager *manager;
+  KmsTranscodingBranch *data;
+  GstElement *pipeline;
+  GHashTableIter iter;
+  gpointer value;
+
+  g_return_if_fail (GST_IS_ELEMENT (source));
+  g_return_if_fail (KMS_IS_TREE_BIN (branch));
+
+  pipeline = get_pipeline (source);
+
+  if (pipeline == NULL) {
+    GST_DEBUG_OBJECT (source, "Not in a pipeline, %" GST_PTR_FORMAT
+        " is not accounted", branch);
+    return;
+  }
+
+  manager = kms_transcoding_manager_get (pipeline, TRUE);
+  gst_object_unref (pipeline);
+
+  data = g_slice_new0 (KmsTranscodingBranch);
+  /* Keeps the reference taken by kms_transcoding_manager_get */
+  data->manager = manager;
+  g_weak_ref_init (&data->branch, branch);
+  data->type = type;
+  data->media = kms_utils_caps_is_audio (caps) ? KMS_MEDIA_TYPE_AUDIO :
+      KMS_MEDIA_TYPE_VIDEO;
+  data->key = kms_transcoding_branch_key (source, caps,
+      type == KMS_TRANSCODING_BRANCH_ENCODER ? max_bitrate : 0);
+
+  g_mutex_lock (&manager->mutex);
+
+  g_hash_table_iter_init (&iter, manager->branches);
+  while (g_hash_table_iter_next (&iter, NULL, &value)) {
+    KmsTranscodingBranch *other = value;
+
+    if (other->type == type && g_strcmp0 (other->key, data->key) == 0) {
+      data->duplicated = TRUE;
+      break;
+    }
+  }
+
+  g_hash_table_insert (manager->branches, branch, data);
+
+  g_mutex_unlock (&manager->mutex);
+
+  if (data->duplicated) {
+    GST_WARNING_OBJECT (source, "Duplicated %s branch %s",
+        type == KMS_TRANSCODING_BRANCH_ENCODER ? "encoding" : "decoding",
+        data->key);
+  } else {
+    GST_DEBUG_OBJECT (source, "New %s branch %s",
+        type == KMS_TRANSCODING_BRANCH_ENCODER ? "encoding" : "decoding",
+        data->key);
+  }
+
+  g_object_weak_ref (G_OBJECT (branch), kms_transcoding_branch_finalized,
+      data);
+}
+
+/* Consumers linked to the branch, not counting the tree bin's own fakesink */
+static guint
+kms_transcoding_branch_get_consumers (GstElement * branch)
+{
+  GstElement *tee = kms_tree_bin_get_output_tee (KMS_TREE_BIN (branch));
+  gint pads = 0;
+
+  if (tee != NULL) {
+    g_object_get (tee, "num-src-pads", &pads, NULL);
+  }
+
+  return pads > 0 ? pads - 1 : 0;
+}
+
+GstStructure *
+kms_transcoding_manager_get_stats (GstElement * pipeline)
+{
+  guint decoders[2] = { 0, 0 }, encoders[2] = { 0, 0 };
+  guint consumers[2] = { 0, 0 }, duplicated[2] = { 0, 0 };
+  KmsTranscodingManager *manager;
+  GSList *audio = NULL, *video = NULL, *l;
+  GHashTableIter iter;
+  gpointer value;
+  guint i;
+
+  g_return_val_if_fail (GST_IS_ELEMENT (pipeline), NULL);
+
+  manager = kms_transcoding_manager_get (pipeline, FALSE);
+
+  if (manager == NULL) {
+    return NULL;
+  }
+
+  g_mutex_lock (&manager->mutex);
+
+  g_hash_table_iter_init (&iter, manager->branches);
+  while (g_hash_table_iter_next (&iter, NULL, &value)) {
+    KmsTranscodingBranch *data = value;
+
+    i = data->media == KMS_MEDIA_TYPE_AUDIO ? 0 : 1;
+
+    if (data->type == KMS_TRANSCODING_BRANCH_DECODER) {
+      decoders[i]++;
+    } else {
+      GstElement *branch = g_weak_ref_get (&data->branch);
+
+      encoders[i]++;
+
+      if (branch == NULL) {
+        /* Being released */
+      } else if (i == 0) {
+        audio = g_slist_prepend (audio, branch);
+      } else {
+        video = g_slist_prepend (video, branch);
+      }
+    }
+
+    if (data->duplicated) {
+      duplicated[i]++;
+    }
+  }
+
+  g_mutex_unlock (&manager->mutex);
+
+  /* Dropping the last reference of a branch takes the lock again */
+  for (l = audio; l != NULL; l = l->next) {
+    consumers[0] += kms_transcoding_branch_get_consumers (l->data);
+  }
+  for (l = video; l != NULL; l = l->next) {
+    consumers[1] += kms_transcoding_branch_get_consumers (l->data);
+  }
+
+  g_slist_free_full (audio, g_object_unref);
+  g_slist_free_full (video, g_object_unref);
+
+  kms_ref_struct_unref (KMS_REF_STRUCT_CAST (manager));
+
+  return gst_structure_new (KMS_TRANSCODING_STATS_STRUCT_NAME,
+      "audio-decoders", G_TYPE_UINT, decoders[0],
+      "audio-encoders", G_TYPE_UINT, encoders[0],
+      "audio-consumers", G_TYPE_UINT, consumers[0],
+      "audio-duplicated", G_TYPE_UINT, duplicated[0],
+      "video-decoders", G_TYPE_UINT, decoders[1],
+      "video-encoders", G_TYPE_UINT, encoders[1],
+      "video-consumers", G_TYPE_UINT, consumers[1],
+      "video-duplicated", G_TYPE_UINT, duplicated[1], NULL);
+}
+
+static void init_debug (void) __attribute__ ((constructor));
+
+static void
+init_debug (void)
+{
+  GST_DEBUG_CATEGORY_INIT (GST_CAT_DEFAULT, GST_DEFAULT_NAME, 0,
+      GST_DEFAULT_NAME);
+}
@@ -0,0 +1,51 @@
+/*
+ * (C) Copyright 2016 Kurento (http://kurento.org/)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+#ifndef __KMS_TRANSCODING_MANAGER_H__
+#define __KMS_TRANSCODING_MANAGER_H__
+
+#include <gst/gst.h>
+
+G_BEGIN_DECLS
+
+#define KMS_TRANSCODING_STATS_STRUCT_NAME "transcoding-stats"
+
+typedef enum
+{
+  KMS_TRANSCODING_BRANCH_DECODER,
+  KMS_TRANSCODING_BRANCH_ENCODER
+} KmsTranscodingBranchType;
+
+/*
+ * Keeps track of the decoding and encoding tree bins alive in each pipeline.
+ * Branches are identified by (upstream stream, output codec, bitrate class),
+ * the stream being the pad that produces what @source receives, looking
+ * through ghost pads, tees and queues. A stream should be transcoded once per
+ * key for all its consumers, so a key registered twice, by the same source
+ * or by different ones, means that work is being duplicated.
+ *
+ * Branches are forgotten automatically when they are finalized.
+ */
+void kms_transcoding_manager_add_branch (GstElement * source,
+    GstElement * branch, KmsTranscodingBranchType type, const GstCaps * caps,
+    gint max_bitrate);
+
+/* Returns the number of branches of each type and media in @pipeline and */
+/* the consumers fed by them, or NULL if nothing was ever registered      */
+GstStructure * kms_transcoding_manager_get_stats (GstElement * pipeline);
+
+G_END_DECLS
+#endif /* __KMS_TRANSCODING_MANAGER_H__ */
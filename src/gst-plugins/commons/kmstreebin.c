@@ -42,6 +42,7 @@ struct _KmsTreeBinPrivate
   GstElement *input_element, *output_tee;
   GstCaps *input_caps;
   GMutex input_caps_mutex;
+  guint caps_generation;
 };
 
 GstElement *
@@ -95,6 +96,17 @@ kms_tree_bin_unlink_input_element_from_tee (KmsTreeBin * self)
   g_object_unref (queue_sink);
 }
 
+guint
+kms_tree_bin_get_consumers (KmsTreeBin * self)
+{
+  gint pads;
+
+  g_object_get (self->priv->output_tee, "num-src-pads", &pads, NULL);
+
+  /* Not counting the fakesink that keeps the tee linked */
+  return pads > 1 ? pads - 1 : 0;
+}
+
 GstCaps *
 kms_tree_bin_get_input_caps (KmsTreeBin * self)
 {
@@ -118,9 +130,16 @@ kms_tree_bin_set_input_caps (KmsTreeBin * self, GstCaps * caps)
   }
 
   self->priv->input_caps = gst_caps_ref (caps);
+  g_atomic_int_inc (&self->priv->caps_generation);
   g_mutex_unlock (&self->priv->input_caps_mutex);
 }
 
+guint
+kms_tree_bin_get_caps_generation (KmsTreeBin * self)
+{
+  return g_atomic_int_get (&self->priv->caps_generation);
+}
+
 static gboolean
 tee_query_function (GstPad * pad, GstObject * parent, GstQuery * query)
 {
@@ -58,8 +58,13 @@ void kms_tree_bin_set_input_element (KmsTreeBin * self,
 GstElement * kms_tree_bin_get_output_tee (KmsTreeBin * self);
 
 void kms_tree_bin_unlink_input_element_from_tee (KmsTreeBin * self);
+/* Elements fed by the output tee */
+guint kms_tree_bin_get_consumers (KmsTreeBin * self);
 
 GstCaps * kms_tree_bin_get_input_caps (KmsTreeBin *self);
+/* Changes every time the input caps are set, so results computed from */
+/* them can be cached                                                 */
+guint kms_tree_bin_get_caps_generation (KmsTreeBin *self);
 
 G_END_DECLS
 #endif /* __KMS_TREE_BIN_H__ */
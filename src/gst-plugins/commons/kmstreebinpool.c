@@ -0,0 +1,335 @@
+/*
+ * (C) Copyright 2016 Kurento (http://kurento.org/)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#  include <config.h>
+#endif
+
+#include "kmstreebinpool.h"
+#include "kmsagnosticcaps.h"
+
+#include <string.h>
+
+#define GST_CAT_DEFAULT kms_tree_bin_pool_debug
+GST_DEBUG_CATEGORY_STATIC (GST_CAT_DEFAULT);
+#define GST_DEFAULT_NAME "treebinpool"
+
+/* Pooled encoders are reset to the requested bitrate when checked out */
+#define POOL_TARGET_BITRATE 300000
+
+typedef enum
+{
+  POOL_ENCODER,
+  POOL_DECODER
+} KmsTreeBinPoolType;
+
+typedef struct _KmsTreeBinPoolEntry
+{
+  KmsTreeBinPoolType type;
+  const gchar *caps_str;
+  const gchar *raw_caps_str;
+  GstCaps *caps;
+  GstCaps *raw_caps;
+  /* Floating bins, ready to be checked out */
+  GQueue bins;
+  gboolean refilling;
+} KmsTreeBinPoolEntry;
+
+/* *INDENT-OFF* */
+static KmsTreeBinPoolEntry entries[] = {
+  {POOL_ENCODER, "video/x-vp8", NULL},
+  {POOL_ENCODER, "video/x-h264", NULL},
+  {POOL_ENCODER, "audio/x-opus", NULL},
+  {POOL_DECODER, "video/x-vp8", KMS_AGNOSTIC_RAW_VIDEO_CAPS},
+  {POOL_DECODER, "video/x-h264, stream-format=(string)byte-stream, "
+      "alignment=(string)au", KMS_AGNOSTIC_RAW_VIDEO_CAPS},
+  {POOL_DECODER, "audio/x-opus", KMS_AGNOSTIC_RAW_AUDIO_CAPS},
+};
+/* *INDENT-ON* */
+
+static GMutex pool_mutex;
+static guint pool_size = 0;
+static guint64 pool_hits = 0;
+static guint64 pool_misses = 0;
+static GThreadPool *refill_pool = NULL;
+
+static void
+kms_tree_bin_pool_drop_bin (gpointer bin)
+{
+  gst_object_ref_sink (bin);
+  gst_object_unref (bin);
+}
+
+static GstElement *
+kms_tree_bin_pool_build (KmsTreeBinPoolEntry * entry)
+{
+  /* Caps are only written here, and entries are refilled one at a time */
+  if (entry->caps == NULL) {
+    entry->caps = gst_caps_from_string (entry->caps_str);
+  }
+
+  if (entry->type == POOL_ENCODER) {
+    return GST_ELEMENT_CAST (kms_enc_tree_bin_new (entry->caps,
+            POOL_TARGET_BITRATE, 0, G_MAXINT, NULL));
+  }
+
+  if (entry->raw_caps == NULL) {
+    entry->raw_caps = gst_caps_from_string (entry->raw_caps_str);
+  }
+
+  return GST_ELEMENT_CAST (kms_dec_tree_bin_new (entry->caps,
+          entry->raw_caps));
+}
+
+static void
+kms_tree_bin_pool_refill (gpointer data, gpointer user_data)
+{
+  KmsTreeBinPoolEntry *entry = data;
+  GstElement *bin;
+
+  for (;;) {
+    g_mutex_lock (&pool_mutex);
+    if (g_queue_get_length (&entry->bins) >= pool_size) {
+      entry->refilling = FALSE;
+      g_mutex_unlock (&pool_mutex);
+      return;
+    }
+    g_mutex_unlock (&pool_mutex);
+
+    bin = kms_tree_bin_pool_build (entry);
+
+    g_mutex_lock (&pool_mutex);
+
+    if (bin == NULL) {
+      /* No element available for this codec, do not keep trying */
+      entry->refilling = FALSE;
+      g_mutex_unlock (&pool_mutex);
+      GST_WARNING ("Cannot build tree bin for %s", entry->caps_str);
+      return;
+    }
+
+    if (g_queue_get_length (&entry->bins) < pool_size) {
+      g_queue_push_tail (&entry->bins, bin);
+      bin = NULL;
+    }
+
+    g_mutex_unlock (&pool_mutex);
+
+    if (bin != NULL) {
+      /* Pool shrunk meanwhile */
+      kms_tree_bin_pool_drop_bin (bin);
+    }
+  }
+}
+
+/* Must be called with the pool mutex held */
+static void
+kms_tree_bin_pool_schedule_refill (KmsTreeBinPoolEntry * entry)
+{
+  if (entry->refilling || g_queue_get_length (&entry->bins) >= pool_size) {
+    return;
+  }
+
+  if (refill_pool == NULL) {
+    GError *err = NULL;
+
+    /* A single thread, building bins must not compete with media threads */
+    refill_pool = g_thread_pool_new (kms_tree_bin_pool_refill, NULL, 1,
+        FALSE, &err);
+
+    if (refill_pool == NULL) {
+      GST_ERROR ("Cannot create refill thread: %s", err->message);
+      g_error_free (err);
+      return;
+    }
+  }
+
+  entry->refilling = TRUE;
+  g_thread_pool_push (refill_pool, entry, NULL);
+}
+
+void
+kms_tree_bin_pool_set_size (guint size)
+{
+  GSList *dropped = NULL;
+  guint i;
+
+  g_mutex_lock (&pool_mutex);
+
+  GST_INFO ("Pool size changed from %u to %u", pool_size, size);
+  pool_size = size;
+
+  for (i = 0; i < G_N_ELEMENTS (entries); i++) {
+    while (g_queue_get_length (&entries[i].bins) > pool_size) {
+      dropped = g_slist_prepend (dropped, g_queue_pop_tail (&entries[i].bins));
+    }
+
+    kms_tree_bin_pool_schedule_refill (&entries[i]);
+  }
+
+  g_mutex_unlock (&pool_mutex);
+
+  g_slist_free_full (dropped, kms_tree_bin_pool_drop_bin);
+}
+
+guint
+kms_tree_bin_pool_get_size (void)
+{
+  guint size;
+
+  g_mutex_lock (&pool_mutex);
+  size = pool_size;
+  g_mutex_unlock (&pool_mutex);
+
+  return size;
+}
+
+static gboolean
+kms_tree_bin_pool_bin_matches (KmsTreeBinPoolType type, GstElement * bin,
+    const GstCaps * caps, const GstCaps * raw_caps, gint target_bitrate,
+    gint min_bitrate, gint max_bitrate, GstStructure * codec_configs)
+{
+  if (type == POOL_ENCODER) {
+    return kms_enc_tree_bin_reset (KMS_ENC_TREE_BIN (bin), caps,
+        target_bitrate, min_bitrate, max_bitrate, codec_configs);
+  } else {
+    return kms_dec_tree_bin_can_decode (KMS_DEC_TREE_BIN (bin), caps,
+        raw_caps);
+  }
+}
+
+static GstElement *
+kms_tree_bin_pool_checkout (KmsTreeBinPoolType type, const GstCaps * caps,
+    const GstCaps * raw_caps, gint target_bitrate, gint min_bitrate,
+    gint max_bitrate, GstStructure * codec_configs)
+{
+  KmsTreeBinPoolEntry *entry = NULL;
+  GstElement *bin = NULL;
+  const gchar *name;
+  guint i;
+
+  if (gst_caps_is_any (caps) || gst_caps_is_empty (caps)) {
+    return NULL;
+  }
+
+  name = gst_structure_get_name (gst_caps_get_structure (caps, 0));
+
+  g_mutex_lock (&pool_mutex);
+
+  if (pool_size == 0) {
+    g_mutex_unlock (&pool_mutex);
+    return NULL;
+  }
+
+  for (i = 0; i < G_N_ELEMENTS (entries) && entry == NULL; i++) {
+    /* Compare the structure name only */
+    if (entries[i].type == type
+        && strcspn (entries[i].caps_str, ",") == strlen (name)
+        && g_str_has_prefix (entries[i].caps_str, name)) {
+      entry = &entries[i];
+    }
+  }
+
+  if (entry == NULL) {
+    /* Codec not pooled, not accounted */
+    g_mutex_unlock (&pool_mutex);
+    return NULL;
+  }
+
+  bin = g_queue_pop_head (&entry->bins);
+
+  g_mutex_unlock (&pool_mutex);
+
+  /* Encoders can be configured only while nobody else sees them */
+  if (bin != NULL && !kms_tree_bin_pool_bin_matches (type, bin, caps, raw_caps,
+          target_bitrate, min_bitrate, max_bitrate, codec_configs)) {
+    GST_DEBUG ("Pooled bin %" GST_PTR_FORMAT " not valid for %" GST_PTR_FORMAT,
+        bin, caps);
+    g_mutex_lock (&pool_mutex);
+    g_queue_push_head (&entry->bins, bin);
+    bin = NULL;
+  } else {
+    g_mutex_lock (&pool_mutex);
+  }
+
+  if (bin != NULL) {
+    pool_hits++;
+  } else {
+    pool_misses++;
+  }
+
+  kms_tree_bin_pool_schedule_refill (entry);
+
+  g_mutex_unlock (&pool_mutex);
+
+  GST_DEBUG ("Pool %s for %" GST_PTR_FORMAT, bin != NULL ? "hit" : "miss",
+      caps);
+
+  return bin;
+}
+
+KmsEncTreeBin *
+kms_tree_bin_pool_get_encoder (const GstCaps * caps, gint target_bitrate,
+    gint min_bitrate, gint max_bitrate, GstStructure * codec_configs)
+{
+  g_return_val_if_fail (GST_IS_CAPS (caps), NULL);
+
+  return (KmsEncTreeBin *) kms_tree_bin_pool_checkout (POOL_ENCODER, caps,
+      NULL, target_bitrate, min_bitrate, max_bitrate, codec_configs);
+}
+
+KmsDecTreeBin *
+kms_tree_bin_pool_get_decoder (const GstCaps * caps, const GstCaps * raw_caps)
+{
+  g_return_val_if_fail (GST_IS_CAPS (caps), NULL);
+  g_return_val_if_fail (GST_IS_CAPS (raw_caps), NULL);
+
+  return (KmsDecTreeBin *) kms_tree_bin_pool_checkout (POOL_DECODER, caps,
+      raw_caps, 0, 0, 0, NULL);
+}
+
+GstStructure *
+kms_tree_bin_pool_get_stats (void)
+{
+  GstStructure *stats;
+  guint available = 0, i;
+
+  g_mutex_lock (&pool_mutex);
+
+  for (i = 0; i < G_N_ELEMENTS (entries); i++) {
+    available += g_queue_get_length (&entries[i].bins);
+  }
+
+  stats = gst_structure_new (KMS_TREE_BIN_POOL_STATS_STRUCT_NAME,
+      "size", G_TYPE_UINT, pool_size,
+      "available", G_TYPE_UINT, available,
+      "hits", G_TYPE_UINT64, pool_hits,
+      "misses", G_TYPE_UINT64, pool_misses, NULL);
+
+  g_mutex_unlock (&pool_mutex);
+
+  return stats;
+}
+
+static void init_debug (void) __attribute__ ((constructor));
+
+static void
+init_debug (void)
+{
+  GST_DEBUG_CATEGORY_INIT (GST_CAT_DEFAULT, GST_DEFAULT_NAME, 0,
+      GST_DEFAULT_NAME);
+}
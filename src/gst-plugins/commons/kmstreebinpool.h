@@ -0,0 +1,55 @@
+/*
+ * (C) Copyright 2016 Kurento (http://kurento.org/)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+#ifndef __KMS_TREE_BIN_POOL_H__
+#define __KMS_TREE_BIN_POOL_H__
+
+#include <gst/gst.h>
+#include "kmsenctreebin.h"
+#include "kmsdectreebin.h"
+
+G_BEGIN_DECLS
+
+#define KMS_TREE_BIN_POOL_STATS_STRUCT_NAME "tree-bin-pool-stats"
+
+/*
+ * Process wide pool of encoding and decoding tree bins for the most common
+ * codecs (VP8, H264 and Opus), built in advance by a background thread so
+ * that creating a transcoding branch does not pay for element construction.
+ *
+ * @size is the number of bins kept ready for each codec and direction. The
+ * pool is disabled, and emptied, when it is 0, which is the default.
+ */
+void kms_tree_bin_pool_set_size (guint size);
+guint kms_tree_bin_pool_get_size (void);
+
+/*
+ * Return a pooled bin behaving as the one the _new () function would create
+ * with the same arguments, or NULL if there is none ready. Returned bins are
+ * floating, as the ones created by kms_enc_tree_bin_new () and
+ * kms_dec_tree_bin_new ().
+ */
+KmsEncTreeBin * kms_tree_bin_pool_get_encoder (const GstCaps * caps,
+    gint target_bitrate, gint min_bitrate, gint max_bitrate,
+    GstStructure * codec_configs);
+KmsDecTreeBin * kms_tree_bin_pool_get_decoder (const GstCaps * caps,
+    const GstCaps * raw_caps);
+
+/* Configured size, bins ready and checkouts served (hits) or not (misses) */
+GstStructure * kms_tree_bin_pool_get_stats (void);
+
+G_END_DECLS
+#endif /* __KMS_TREE_BIN_POOL_H__ */
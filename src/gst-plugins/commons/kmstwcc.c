@@ -0,0 +1,626 @@
+/*
+ * (C) Copyright 2016 Kurento (http://kurento.org/)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#  include <config.h>
+#endif
+
+#include "kmstwcc.h"
+
+#define GST_CAT_DEFAULT kms_twcc_debug
+GST_DEBUG_CATEGORY_STATIC (GST_CAT_DEFAULT);
+#define GST_DEFAULT_NAME "twcc"
+
+/* Packets sent closer than this belong to the same group */
+#define BURST_INTERVAL (5 * GST_MSECOND)
+
+#define TRENDLINE_WINDOW 20
+#define TRENDLINE_SMOOTHING 0.9
+#define TRENDLINE_GAIN 4.0
+#define TRENDLINE_MAX_DELTAS 60
+
+/* Adaptive threshold, in ms of the gained trend */
+#define THRESHOLD_INITIAL 12.5
+#define THRESHOLD_MIN 6.0
+#define THRESHOLD_MAX 600.0
+#define THRESHOLD_K_UP 0.0087
+#define THRESHOLD_K_DOWN 0.039
+#define THRESHOLD_MAX_OUTLIER 15.0
+#define THRESHOLD_MAX_INTERVAL_MS 100.0
+#define OVERUSE_TIME_MS 10.0
+
+#define RATE_WINDOW GST_SECOND
+#define RATE_MIN_WINDOW (500 * GST_MSECOND)
+#define RATE_HISTORY 512
+
+#define DECREASE_FACTOR 0.85
+/* Between decreases, so that a congestion episode is reacted to once */
+#define DECREASE_INTERVAL (300 * GST_MSECOND)
+#define MULTIPLICATIVE_INCREASE 0.08
+/* bps per second, about a packet per response time */
+#define ADDITIVE_INCREASE 32000
+#define MAX_RATE_FACTOR 1.5
+#define MAX_RATE_MARGIN 10000
+/* Incoming rates this close to the one of the last decrease are near it */
+#define NEAR_MAX_FRACTION 0.2
+
+#define LOSS_INTERVAL GST_SECOND
+#define LOSS_MIN_PACKETS 20
+#define LOSS_THRESHOLD 0.1
+
+typedef enum
+{
+  RATE_HOLD,
+  RATE_INCREASE,
+  RATE_DECREASE
+} RateState;
+
+typedef struct _PacketGroup
+{
+  gboolean valid;
+  GstClockTime first_send;
+  GstClockTime last_send;
+  GstClockTime first_arrival;
+  GstClockTime last_arrival;
+  guint size;
+} PacketGroup;
+
+typedef struct _RateSample
+{
+  GstClockTime arrival;
+  guint size;
+} RateSample;
+
+struct _KmsTwccEstimator
+{
+  guint min_bitrate;
+  guint max_bitrate;
+
+  /* Transport-wide sequence numbers, unwrapped */
+  gint64 last_seq;
+  /* Highest one at the last loss check, packets after it are expected */
+  gint64 loss_base_seq;
+  guint received;
+  GstClockTime last_loss_check;
+
+  PacketGroup current;
+  PacketGroup previous;
+
+  /* Trendline filter, times in ms */
+  GstClockTime first_arrival;
+  gdouble accumulated_delay;
+  gdouble smoothed_delay;
+  gdouble window_x[TRENDLINE_WINDOW];
+  gdouble window_y[TRENDLINE_WINDOW];
+  guint window_len;
+  guint window_pos;
+  guint num_deltas;
+  gdouble prev_trend;
+
+  /* Overuse detector */
+  gdouble threshold;
+  GstClockTime last_threshold_update;
+  gdouble time_over_using;
+  guint overuse_count;
+  KmsTwccUsage usage;
+
+  /* Incoming rate, one sample per group */
+  RateSample history[RATE_HISTORY];
+  guint history_start;
+  guint history_len;
+  guint64 history_bytes;
+
+  /* Rate control */
+  RateState state;
+  guint bitrate;
+  GstClockTime last_rate_update;
+  GstClockTime last_decrease;
+  /* Incoming bitrate at the last decreases, -1 if unknown */
+  gdouble avg_max_bitrate;
+};
+
+KmsTwccEstimator *
+kms_twcc_estimator_new (guint min_bitrate, guint max_bitrate)
+{
+  KmsTwccEstimator *estimator;
+
+  g_return_val_if_fail (min_bitrate <= max_bitrate, NULL);
+
+  estimator = g_slice_new0 (KmsTwccEstimator);
+  estimator->min_bitrate = min_bitrate;
+  estimator->max_bitrate = max_bitrate;
+  estimator->last_seq = -1;
+  estimator->last_loss_check = GST_CLOCK_TIME_NONE;
+  estimator->first_arrival = GST_CLOCK_TIME_NONE;
+  estimator->threshold = THRESHOLD_INITIAL;
+  estimator->last_threshold_update = GST_CLOCK_TIME_NONE;
+  estimator->time_over_using = -1;
+  estimator->usage = KMS_TWCC_USAGE_NORMAL;
+  estimator->state = RATE_HOLD;
+  estimator->last_rate_update = GST_CLOCK_TIME_NONE;
+  estimator->last_decrease = GST_CLOCK_TIME_NONE;
+  estimator->avg_max_bitrate = -1;
+
+  return estimator;
+}
+
+void
+kms_twcc_estimator_free (KmsTwccEstimator * estimator)
+{
+  g_slice_free (KmsTwccEstimator, estimator);
+}
+
+static gdouble
+time_to_ms (GstClockTimeDiff t)
+{
+  return (gdouble) t / GST_MSECOND;
+}
+
+static guint
+kms_twcc_estimator_clamp (KmsTwccEstimator * estimator, gdouble bitrate)
+{
+  return CLAMP (bitrate, estimator->min_bitrate, estimator->max_bitrate);
+}
+
+/* Incoming rate */
+
+static void
+kms_twcc_estimator_add_rate_sample (KmsTwccEstimator * estimator,
+    GstClockTime arrival, guint size)
+{
+  RateSample *sample;
+
+  if (estimator->history_len == RATE_HISTORY) {
+    estimator->history_bytes -=
+        estimator->history[estimator->history_start].size;
+    estimator->history_start = (estimator->history_start + 1) % RATE_HISTORY;
+    estimator->history_len--;
+  }
+
+  sample = &estimator->history[(estimator->history_start +
+          estimator->history_len) % RATE_HISTORY];
+  sample->arrival = arrival;
+  sample->size = size;
+  estimator->history_len++;
+  estimator->history_bytes += size;
+
+  /* Keep only the last window */
+  while (estimator->history_len > 1) {
+    RateSample *oldest = &estimator->history[estimator->history_start];
+
+    if (arrival - oldest->arrival <= RATE_WINDOW) {
+      break;
+    }
+
+    estimator->history_bytes -= oldest->size;
+    estimator->history_start = (estimator->history_start + 1) % RATE_HISTORY;
+    estimator->history_len--;
+  }
+}
+
+static guint
+kms_twcc_estimator_incoming_bitrate (KmsTwccEstimator * estimator)
+{
+  RateSample *oldest, *newest;
+  GstClockTime duration;
+
+  if (estimator->history_len < 2) {
+    return 0;
+  }
+
+  oldest = &estimator->history[estimator->history_start];
+  newest = &estimator->history[(estimator->history_start +
+          estimator->history_len - 1) % RATE_HISTORY];
+  duration = newest->arrival - oldest->arrival;
+
+  if (duration < RATE_MIN_WINDOW) {
+    return 0;
+  }
+
+  /* The oldest sample arrived at the start of the window */
+  return gst_util_uint64_scale (8 * (estimator->history_bytes - oldest->size),
+      GST_SECOND, duration);
+}
+
+/* Trendline filter and overuse detector */
+
+static gdouble
+kms_twcc_estimator_trend (KmsTwccEstimator * estimator)
+{
+  gdouble x_avg = 0, y_avg = 0, num = 0, den = 0;
+  guint i;
+
+  for (i = 0; i < estimator->window_len; i++) {
+    x_avg += estimator->window_x[i];
+    y_avg += estimator->window_y[i];
+  }
+  x_avg /= estimator->window_len;
+  y_avg /= estimator->window_len;
+
+  for (i = 0; i < estimator->window_len; i++) {
+    gdouble x = estimator->window_x[i] - x_avg;
+
+    num += x * (estimator->window_y[i] - y_avg);
+    den += x * x;
+  }
+
+  if (den == 0) {
+    return estimator->prev_trend;
+  }
+
+  return num / den;
+}
+
+static void
+kms_twcc_estimator_update_threshold (KmsTwccEstimator * estimator,
+    gdouble modified_trend, GstClockTime now)
+{
+  gdouble abs_trend = ABS (modified_trend);
+  gdouble k, interval;
+
+  if (!GST_CLOCK_TIME_IS_VALID (estimator->last_threshold_update)) {
+    estimator->last_threshold_update = now;
+  }
+
+  if (abs_trend > estimator->threshold + THRESHOLD_MAX_OUTLIER) {
+    /* Do not adapt to spikes, like a sudden change of route */
+    estimator->last_threshold_update = now;
+    return;
+  }
+
+  k = abs_trend < estimator->threshold ? THRESHOLD_K_DOWN : THRESHOLD_K_UP;
+  interval = MIN (time_to_ms (now - estimator->last_threshold_update),
+      THRESHOLD_MAX_INTERVAL_MS);
+
+  estimator->threshold += k * (abs_trend - estimator->threshold) * interval;
+  estimator->threshold =
+      CLAMP (estimator->threshold, THRESHOLD_MIN, THRESHOLD_MAX);
+  estimator->last_threshold_update = now;
+}
+
+static void
+kms_twcc_estimator_detect (KmsTwccEstimator * estimator, gdouble trend,
+    gdouble send_delta_ms, GstClockTime now)
+{
+  gdouble modified_trend;
+
+  if (estimator->num_deltas < 2) {
+    estimator->usage = KMS_TWCC_USAGE_NORMAL;
+    return;
+  }
+
+  modified_trend = MIN (estimator->num_deltas, TRENDLINE_MAX_DELTAS) * trend *
+      TRENDLINE_GAIN;
+
+  if (modified_trend > estimator->threshold) {
+    if (estimator->time_over_using < 0) {
+      /* Assume it started in the middle of the last delta */
+      estimator->time_over_using = send_delta_ms / 2;
+    } else {
+      estimator->time_over_using += send_delta_ms;
+    }
+    estimator->overuse_count++;
+
+    if (estimator->time_over_using > OVERUSE_TIME_MS
+        && estimator->overuse_count > 1 && trend >= estimator->prev_trend) {
+      estimator->time_over_using = 0;
+      estimator->overuse_count = 0;
+      estimator->usage = KMS_TWCC_USAGE_OVERUSE;
+    }
+  } else if (modified_trend < -estimator->threshold) {
+    estimator->time_over_using = -1;
+    estimator->overuse_count = 0;
+    estimator->usage = KMS_TWCC_USAGE_UNDERUSE;
+  } else {
+    estimator->time_over_using = -1;
+    estimator->overuse_count = 0;
+    estimator->usage = KMS_TWCC_USAGE_NORMAL;
+  }
+
+  estimator->prev_trend = trend;
+  kms_twcc_estimator_update_threshold (estimator, modified_trend, now);
+}
+
+static void
+kms_twcc_estimator_update_trendline (KmsTwccEstimator * estimator,
+    gdouble recv_delta_ms, gdouble send_delta_ms, GstClockTime arrival)
+{
+  guint pos;
+
+  if (!GST_CLOCK_TIME_IS_VALID (estimator->first_arrival)) {
+    estimator->first_arrival = arrival;
+  }
+
+  estimator->num_deltas = MIN (estimator->num_deltas + 1, 1000);
+  estimator->accumulated_delay += recv_delta_ms - send_delta_ms;
+  estimator->smoothed_delay =
+      TRENDLINE_SMOOTHING * estimator->smoothed_delay +
+      (1 - TRENDLINE_SMOOTHING) * estimator->accumulated_delay;
+
+  if (estimator->window_len < TRENDLINE_WINDOW) {
+    pos = estimator->window_len++;
+  } else {
+    pos = estimator->window_pos;
+    estimator->window_pos = (estimator->window_pos + 1) % TRENDLINE_WINDOW;
+  }
+
+  estimator->window_x[pos] = time_to_ms (arrival - estimator->first_arrival);
+  estimator->window_y[pos] = estimator->smoothed_delay;
+
+  if (estimator->window_len == TRENDLINE_WINDOW) {
+    kms_twcc_estimator_detect (estimator,
+        kms_twcc_estimator_trend (estimator), send_delta_ms, arrival);
+  }
+}
+
+/* Rate control */
+
+static void
+kms_twcc_estimator_update_max_bitrate (KmsTwccEstimator * estimator,
+    guint incoming)
+{
+  if (estimator->avg_max_bitrate < 0) {
+    estimator->avg_max_bitrate = incoming;
+  } else {
+    estimator->avg_max_bitrate = 0.95 * estimator->avg_max_bitrate +
+        0.05 * incoming;
+  }
+}
+
+static void
+kms_twcc_estimator_check_loss (KmsTwccEstimator * estimator, GstClockTime now)
+{
+  gint64 expected = estimator->last_seq - estimator->loss_base_seq;
+  gdouble loss;
+
+  if (!GST_CLOCK_TIME_IS_VALID (estimator->last_loss_check)) {
+    estimator->last_loss_check = now;
+  }
+
+  if (now - estimator->last_loss_check < LOSS_INTERVAL
+      || expected < LOSS_MIN_PACKETS) {
+    return;
+  }
+
+  /* Late packets of the previous interval may exceed the expected ones */
+  loss = MAX (expected - (gint64) estimator->received, 0) / (gdouble) expected;
+  if (loss > LOSS_THRESHOLD) {
+    GST_DEBUG ("Loss %.2f, reducing %u bps", loss, estimator->bitrate);
+    estimator->bitrate =
+        kms_twcc_estimator_clamp (estimator,
+        estimator->bitrate * (1 - 0.5 * loss));
+  }
+
+  estimator->loss_base_seq = estimator->last_seq;
+  estimator->received = 0;
+  estimator->last_loss_check = now;
+}
+
+static void
+kms_twcc_estimator_update_rate (KmsTwccEstimator * estimator, GstClockTime now)
+{
+  guint incoming = kms_twcc_estimator_incoming_bitrate (estimator);
+  gdouble bitrate, interval;
+
+  if (estimator->bitrate == 0) {
+    if (incoming > 0) {
+      /* Start from what the sender manages to send */
+      estimator->bitrate = kms_twcc_estimator_clamp (estimator, incoming);
+      estimator->last_rate_update = now;
+      GST_DEBUG ("Initial bitrate %u bps", estimator->bitrate);
+    }
+    return;
+  }
+
+  switch (estimator->usage) {
+    case KMS_TWCC_USAGE_OVERUSE:
+      estimator->state = RATE_DECREASE;
+      break;
+    case KMS_TWCC_USAGE_UNDERUSE:
+      /* Let the queues drain */
+      estimator->state = RATE_HOLD;
+      break;
+    case KMS_TWCC_USAGE_NORMAL:
+      if (estimator->state == RATE_HOLD) {
+        estimator->state = RATE_INCREASE;
+      }
+      break;
+  }
+
+  bitrate = estimator->bitrate;
+  interval = MIN (time_to_ms (now - estimator->last_rate_update), 1000) / 1000;
+
+  switch (estimator->state) {
+    case RATE_DECREASE:
+      if (incoming > 0 && (!GST_CLOCK_TIME_IS_VALID (estimator->last_decrease)
+              || now - estimator->last_decrease >= DECREASE_INTERVAL)) {
+        bitrate = MIN (bitrate, DECREASE_FACTOR * incoming);
+        kms_twcc_estimator_update_max_bitrate (estimator, incoming);
+        estimator->last_decrease = now;
+        GST_DEBUG ("Overuse at %u bps incoming, bitrate %.0f bps", incoming,
+            bitrate);
+      }
+      estimator->state = RATE_HOLD;
+      break;
+    case RATE_INCREASE:
+      if (estimator->avg_max_bitrate >= 0 && incoming > 0
+          && incoming > estimator->avg_max_bitrate * (1 + NEAR_MAX_FRACTION)) {
+        /* Far above the last congestion, the link has changed */
+        estimator->avg_max_bitrate = -1;
+      }
+
+      if (estimator->avg_max_bitrate >= 0 && incoming > 0
+          && incoming > estimator->avg_max_bitrate * (1 - NEAR_MAX_FRACTION)) {
+        /* Close to the capacity found before, approach it carefully */
+        bitrate += ADDITIVE_INCREASE * interval;
+      } else {
+        bitrate *= 1 + MULTIPLICATIVE_INCREASE * interval;
+      }
+
+      if (incoming > 0) {
+        /* Do not run far ahead of what the sender actually sends */
+        bitrate = MIN (bitrate, MAX_RATE_FACTOR * incoming + MAX_RATE_MARGIN);
+        bitrate = MAX (bitrate, estimator->bitrate);
+      }
+      break;
+    case RATE_HOLD:
+      break;
+  }
+
+  estimator->bitrate = kms_twcc_estimator_clamp (estimator, bitrate);
+  estimator->last_rate_update = now;
+
+  kms_twcc_estimator_check_loss (estimator, now);
+}
+
+/* Packets */
+
+/*
+ * Counts @seq as received. Packets of every media share the sequence, and
+ * each media reaches us through its own thread, so a packet older than the
+ * highest one is not lost, only late. Returns FALSE for those, as their
+ * delay would be measured against a newer group.
+ */
+static gboolean
+kms_twcc_estimator_check_seq (KmsTwccEstimator * estimator, guint16 seq)
+{
+  gint16 diff;
+
+  estimator->received++;
+
+  if (estimator->last_seq < 0) {
+    estimator->last_seq = seq;
+    estimator->loss_base_seq = estimator->last_seq - 1;
+    return TRUE;
+  }
+
+  diff = (gint16) (seq - (guint16) estimator->last_seq);
+  if (diff <= 0) {
+    GST_LOG ("Late or repeated packet %u", seq);
+    return FALSE;
+  }
+
+  estimator->last_seq += diff;
+
+  return TRUE;
+}
+
+static void
+kms_twcc_estimator_complete_group (KmsTwccEstimator * estimator)
+{
+  PacketGroup *current = &estimator->current;
+  PacketGroup *previous = &estimator->previous;
+
+  if (previous->valid) {
+    GstClockTimeDiff send_delta, recv_delta;
+
+    send_delta = GST_CLOCK_DIFF (previous->last_send, current->last_send);
+    recv_delta = GST_CLOCK_DIFF (previous->last_arrival,
+        current->last_arrival);
+
+    if (recv_delta >= 0) {
+      kms_twcc_estimator_update_trendline (estimator, time_to_ms (recv_delta),
+          time_to_ms (send_delta), current->last_arrival);
+    } else {
+      GST_LOG ("Discarding group arrived before the previous one");
+    }
+  }
+
+  kms_twcc_estimator_add_rate_sample (estimator, current->last_arrival,
+      current->size);
+  kms_twcc_estimator_update_rate (estimator, current->last_arrival);
+
+  *previous = *current;
+}
+
+void
+kms_twcc_estimator_add_packet (KmsTwccEstimator * estimator,
+    guint16 transport_seq, GstClockTime send_time, GstClockTime arrival_time,
+    guint size)
+{
+  PacketGroup *current;
+
+  g_return_if_fail (estimator != NULL);
+  g_return_if_fail (GST_CLOCK_TIME_IS_VALID (send_time));
+  g_return_if_fail (GST_CLOCK_TIME_IS_VALID (arrival_time));
+
+  if (!kms_twcc_estimator_check_seq (estimator, transport_seq)) {
+    return;
+  }
+
+  current = &estimator->current;
+
+  if (current->valid && send_time >= current->first_send
+      && send_time - current->first_send > BURST_INTERVAL) {
+    kms_twcc_estimator_complete_group (estimator);
+    current->valid = FALSE;
+  }
+
+  if (!current->valid) {
+    current->valid = TRUE;
+    current->first_send = current->last_send = send_time;
+    current->first_arrival = current->last_arrival = arrival_time;
+    current->size = size;
+    return;
+  }
+
+  current->last_send = MAX (current->last_send, send_time);
+  current->last_arrival = MAX (current->last_arrival, arrival_time);
+  current->size += size;
+}
+
+void
+kms_twcc_estimator_add_seq (KmsTwccEstimator * estimator,
+    guint16 transport_seq)
+{
+  g_return_if_fail (estimator != NULL);
+
+  kms_twcc_estimator_check_seq (estimator, transport_seq);
+}
+
+guint
+kms_twcc_estimator_get_bitrate (KmsTwccEstimator * estimator)
+{
+  g_return_val_if_fail (estimator != NULL, 0);
+
+  return estimator->bitrate;
+}
+
+guint
+kms_twcc_estimator_get_incoming_bitrate (KmsTwccEstimator * estimator)
+{
+  g_return_val_if_fail (estimator != NULL, 0);
+
+  return kms_twcc_estimator_incoming_bitrate (estimator);
+}
+
+KmsTwccUsage
+kms_twcc_estimator_get_usage (KmsTwccEstimator * estimator)
+{
+  g_return_val_if_fail (estimator != NULL, KMS_TWCC_USAGE_NORMAL);
+
+  return estimator->usage;
+}
+
+static void init_debug (void) __attribute__ ((constructor));
+
+static void
+init_debug (void)
+{
+  GST_DEBUG_CATEGORY_INIT (GST_CAT_DEFAULT, GST_DEFAULT_NAME, 0,
+      GST_DEFAULT_NAME);
+}
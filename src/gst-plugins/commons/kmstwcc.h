@@ -0,0 +1,72 @@
+/*
+ * (C) Copyright 2016 Kurento (http://kurento.org/)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+#ifndef __KMS_TWCC_H__
+#define __KMS_TWCC_H__
+
+#include <gst/gst.h>
+
+G_BEGIN_DECLS
+
+typedef enum
+{
+  KMS_TWCC_USAGE_NORMAL,
+  KMS_TWCC_USAGE_UNDERUSE,
+  KMS_TWCC_USAGE_OVERUSE
+} KmsTwccUsage;
+
+/*
+ * Delay-based bandwidth estimation in the style of Google congestion
+ * control: packets are grouped in bursts, the growth of the one-way delay
+ * between groups goes through a trendline filter, and an adaptive threshold
+ * on its slope drives an AIMD rate controller. Transport-wide sequence
+ * numbers discard reordered packets and account for losses.
+ *
+ * It is driven only by the times of the packets, never by a clock, so that
+ * recorded arrival traces give the same results offline. Not thread safe.
+ */
+typedef struct _KmsTwccEstimator KmsTwccEstimator;
+
+/* Estimations are kept within [@min_bitrate, @max_bitrate] bps */
+KmsTwccEstimator *kms_twcc_estimator_new (guint min_bitrate,
+    guint max_bitrate);
+void kms_twcc_estimator_free (KmsTwccEstimator * estimator);
+
+/*
+ * @send_time is in the clock of the sender and @arrival_time in ours, each
+ * is only compared with itself. @size is that of the whole packet.
+ */
+void kms_twcc_estimator_add_packet (KmsTwccEstimator * estimator,
+    guint16 transport_seq, GstClockTime send_time, GstClockTime arrival_time,
+    guint size);
+
+/*
+ * Packet that only takes part in the loss accounting, like those of other
+ * medias sharing the transport-wide sequence numbers
+ */
+void kms_twcc_estimator_add_seq (KmsTwccEstimator * estimator,
+    guint16 transport_seq);
+
+/* Estimated bitrate in bps, 0 until enough packets have arrived */
+guint kms_twcc_estimator_get_bitrate (KmsTwccEstimator * estimator);
+
+/* Bitrate the packets have been arriving at during the last second */
+guint kms_twcc_estimator_get_incoming_bitrate (KmsTwccEstimator * estimator);
+
+KmsTwccUsage kms_twcc_estimator_get_usage (KmsTwccEstimator * estimator);
+
+G_END_DECLS
+#endif /* __KMS_TWCC_H__ */
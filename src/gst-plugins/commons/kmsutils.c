@@ -247,6 +247,32 @@ kms_utils_create_rate_for_caps (const GstCaps * caps)
   return rate;
 }
 
+static gint video_adapter_enabled = FALSE;
+
+void
+kms_utils_set_video_adapter_enabled (gboolean enabled)
+{
+  g_atomic_int_set (&video_adapter_enabled, enabled);
+}
+
+gboolean
+kms_utils_get_video_adapter_enabled (void)
+{
+  return g_atomic_int_get (&video_adapter_enabled);
+}
+
+GstElement *
+kms_utils_create_video_adapter_for_caps (const GstCaps * caps)
+{
+  if (!kms_utils_get_video_adapter_enabled ()
+      || !kms_utils_caps_is_video (caps)) {
+    return NULL;
+  }
+
+  /* Registered by the kurento plugin, which may not be loaded */
+  return gst_element_factory_make ("videoadapter", NULL);
+}
+
 const gchar *
 kms_utils_get_caps_codec_name_from_sdp (const gchar * codec_name)
 {
@@ -748,6 +774,7 @@ kms_utils_execute_with_pad_blocked (GstPad * pad, gboolean drop,
 
 #define KMS_REMB_EVENT_NAME "REMB"
 #define DEFAULT_CLEAR_INTERVAL 10 * GST_SECOND
+#define DEFAULT_HYSTERESIS 0.0
 
 GstEvent *
 kms_utils_remb_event_upstream_new (guint bitrate, guint ssrc)
@@ -801,14 +828,37 @@ kms_utils_remb_event_upstream_parse (GstEvent * event, guint * bitrate,
   return TRUE;
 }
 
+typedef enum
+{
+  REMB_HEAP_BITRATE,
+  REMB_HEAP_TIME,
+  REMB_HEAP_COUNT
+} RembHeap;
+
+/*
+ * Last REMB received for an SSRC. Besides the slot array, it is in a binary
+ * heap ordered by bitrate, to get the minimum, and in one ordered by time,
+ * to expire the oldest entries. @heap_pos is its position in each heap.
+ */
+typedef struct _RembSlot
+{
+  guint ssrc;
+  guint bitrate;
+  GstClockTime ts;
+  guint heap_pos[REMB_HEAP_COUNT];
+} RembSlot;
+
 struct _RembEventManager
 {
   GMutex mutex;
   guint remb_min;
-  GHashTable *remb_hash;
+  guint notified_min;
+  gfloat hysteresis;
+  GArray *slots;                /* RembSlot */
+  GArray *heaps[REMB_HEAP_COUNT];       /* Indexes in slots */
+  GHashTable *slot_index;       /* SSRC -> index in slots + 1 */
   GstPad *pad;
   gulong probe_id;
-  GstClockTime oldest_remb_time;
   GstClockTime clear_interval;
 
   /* Callback */
@@ -817,78 +867,217 @@ struct _RembEventManager
   GDestroyNotify user_data_destroy;
 };
 
-typedef struct _RembHashValue
+static RembSlot *
+remb_slot (RembEventManager * manager, guint index)
 {
-  guint bitrate;
-  GstClockTime ts;
-} RembHashValue;
+  return &g_array_index (manager->slots, RembSlot, index);
+}
+
+static guint
+remb_heap_get (RembEventManager * manager, RembHeap heap, guint pos)
+{
+  return g_array_index (manager->heaps[heap], guint, pos);
+}
 
-static RembHashValue *
-remb_hash_value_create (guint bitrate)
+static void
+remb_heap_set (RembEventManager * manager, RembHeap heap, guint pos,
+    guint index)
 {
-  RembHashValue *value = g_slice_new0 (RembHashValue);
+  g_array_index (manager->heaps[heap], guint, pos) = index;
+  remb_slot (manager, index)->heap_pos[heap] = pos;
+}
 
-  value->bitrate = bitrate;
-  value->ts = kms_utils_get_time_nsecs ();
+static gboolean
+remb_heap_less (RembEventManager * manager, RembHeap heap, guint a, guint b)
+{
+  RembSlot *slot_a = remb_slot (manager, remb_heap_get (manager, heap, a));
+  RembSlot *slot_b = remb_slot (manager, remb_heap_get (manager, heap, b));
+
+  if (heap == REMB_HEAP_BITRATE) {
+    return slot_a->bitrate < slot_b->bitrate;
+  }
 
-  return value;
+  return slot_a->ts < slot_b->ts;
 }
 
 static void
-remb_hash_value_destroy (gpointer value)
+remb_heap_swap (RembEventManager * manager, RembHeap heap, guint a, guint b)
 {
-  g_slice_free (RembHashValue, value);
+  guint index_a = remb_heap_get (manager, heap, a);
+
+  remb_heap_set (manager, heap, a, remb_heap_get (manager, heap, b));
+  remb_heap_set (manager, heap, b, index_a);
 }
 
 static void
-remb_event_manager_set_min (RembEventManager * manager, guint min)
+remb_heap_sift_up (RembEventManager * manager, RembHeap heap, guint pos)
 {
-  if (manager->remb_min != min) {
-    manager->remb_min = min;
+  while (pos > 0) {
+    guint parent = (pos - 1) / 2;
 
-    if (manager->callback) {
-      // TODO: Think about having a threshold to not notify in excess
-      manager->callback (manager, manager->remb_min, manager->user_data);
+    if (!remb_heap_less (manager, heap, pos, parent)) {
+      break;
     }
+
+    remb_heap_swap (manager, heap, pos, parent);
+    pos = parent;
   }
 }
 
 static void
-remb_event_manager_calc_min (RembEventManager * manager, guint default_min)
+remb_heap_sift_down (RembEventManager * manager, RembHeap heap, guint pos)
 {
-  guint remb_min = 0;
-  GstClockTime time = kms_utils_get_time_nsecs ();
-  GstClockTime oldest_time = GST_CLOCK_TIME_NONE;
-  GHashTableIter iter;
-  gpointer key, v;
-
-  g_hash_table_iter_init (&iter, manager->remb_hash);
-  while (g_hash_table_iter_next (&iter, &key, &v)) {
-    guint br = ((RembHashValue *) v)->bitrate;
-    GstClockTime ts = ((RembHashValue *) v)->ts;
-
-    if (time - ts > manager->clear_interval) {
-      GST_TRACE ("Remove entry %" G_GUINT32_FORMAT, GPOINTER_TO_UINT (key));
-      g_hash_table_iter_remove (&iter);
-      continue;
+  guint len = manager->heaps[heap]->len;
+
+  while (TRUE) {
+    guint left = 2 * pos + 1;
+    guint right = left + 1;
+    guint smallest = pos;
+
+    if (left < len && remb_heap_less (manager, heap, left, smallest)) {
+      smallest = left;
+    }
+    if (right < len && remb_heap_less (manager, heap, right, smallest)) {
+      smallest = right;
     }
 
-    if (remb_min == 0) {
-      remb_min = br;
-    } else {
-      remb_min = MIN (remb_min, br);
+    if (smallest == pos) {
+      break;
     }
 
-    oldest_time = MIN (oldest_time, ts);
+    remb_heap_swap (manager, heap, pos, smallest);
+    pos = smallest;
   }
+}
+
+/* Restores the heaps after a change in the slot at @index */
+static void
+remb_heaps_fix (RembEventManager * manager, guint index)
+{
+  RembHeap heap;
+
+  for (heap = 0; heap < REMB_HEAP_COUNT; heap++) {
+    RembSlot *slot = remb_slot (manager, index);
 
-  if (remb_min == 0 && default_min > 0) {
-    GST_DEBUG_OBJECT (manager->pad, "Setting default value: %" G_GUINT32_FORMAT,
-        default_min);
-    remb_min = default_min;
+    remb_heap_sift_up (manager, heap, slot->heap_pos[heap]);
+    remb_heap_sift_down (manager, heap, slot->heap_pos[heap]);
+  }
+}
+
+static void
+remb_slot_add (RembEventManager * manager, guint ssrc, guint bitrate,
+    GstClockTime ts)
+{
+  RembSlot slot = { 0, };
+  guint index = manager->slots->len;
+  RembHeap heap;
+
+  slot.ssrc = ssrc;
+  slot.bitrate = bitrate;
+  slot.ts = ts;
+  g_array_append_val (manager->slots, slot);
+  g_hash_table_insert (manager->slot_index, GUINT_TO_POINTER (ssrc),
+      GUINT_TO_POINTER (index + 1));
+
+  for (heap = 0; heap < REMB_HEAP_COUNT; heap++) {
+    g_array_append_val (manager->heaps[heap], index);
+    remb_slot (manager, index)->heap_pos[heap] = manager->heaps[heap]->len - 1;
+    remb_heap_sift_up (manager, heap, manager->heaps[heap]->len - 1);
+  }
+}
+
+static void
+remb_slot_remove (RembEventManager * manager, guint index)
+{
+  guint last_index = manager->slots->len - 1;
+  RembHeap heap;
+
+  for (heap = 0; heap < REMB_HEAP_COUNT; heap++) {
+    guint pos = remb_slot (manager, index)->heap_pos[heap];
+    guint last = manager->heaps[heap]->len - 1;
+
+    if (pos != last) {
+      remb_heap_swap (manager, heap, pos, last);
+    }
+
+    g_array_set_size (manager->heaps[heap], last);
+
+    if (pos != last) {
+      RembSlot *moved = remb_slot (manager, remb_heap_get (manager, heap, pos));
+
+      remb_heap_sift_up (manager, heap, pos);
+      remb_heap_sift_down (manager, heap, moved->heap_pos[heap]);
+    }
+  }
+
+  g_hash_table_remove (manager->slot_index,
+      GUINT_TO_POINTER (remb_slot (manager, index)->ssrc));
+
+  /* Keep the array compact moving the last slot to the free one */
+  if (index != last_index) {
+    RembSlot *slot = remb_slot (manager, index);
+
+    *slot = *remb_slot (manager, last_index);
+
+    for (heap = 0; heap < REMB_HEAP_COUNT; heap++) {
+      g_array_index (manager->heaps[heap], guint, slot->heap_pos[heap]) =
+          index;
+    }
+
+    g_hash_table_insert (manager->slot_index, GUINT_TO_POINTER (slot->ssrc),
+        GUINT_TO_POINTER (index + 1));
+  }
+
+  g_array_set_size (manager->slots, last_index);
+}
+
+static void
+remb_event_manager_set_min (RembEventManager * manager, guint min)
+{
+  guint last = manager->notified_min;
+
+  manager->remb_min = min;
+
+  if (min == last) {
+    return;
+  }
+
+  /* Changes within the hysteresis are not notified */
+  if (min != 0 && last != 0
+      && ABS ((gint64) min - (gint64) last) <= manager->hysteresis * last) {
+    return;
+  }
+
+  manager->notified_min = min;
+
+  if (manager->callback) {
+    manager->callback (manager, min, manager->user_data);
+  }
+}
+
+static void
+remb_event_manager_calc_min (RembEventManager * manager, GstClockTime time)
+{
+  GArray *by_time = manager->heaps[REMB_HEAP_TIME];
+  guint remb_min = 0;
+
+  while (by_time->len > 0) {
+    guint index = g_array_index (by_time, guint, 0);
+    RembSlot *slot = remb_slot (manager, index);
+
+    if (time - slot->ts <= manager->clear_interval) {
+      break;
+    }
+
+    GST_TRACE ("Remove entry %" G_GUINT32_FORMAT, slot->ssrc);
+    remb_slot_remove (manager, index);
+  }
+
+  if (manager->slots->len > 0) {
+    remb_min = remb_slot (manager, remb_heap_get (manager, REMB_HEAP_BITRATE,
+            0))->bitrate;
   }
 
-  manager->oldest_remb_time = oldest_time;
   remb_event_manager_set_min (manager, remb_min);
 }
 
@@ -896,40 +1085,27 @@ static void
 remb_event_manager_update_min (RembEventManager * manager, guint bitrate,
     guint ssrc)
 {
-  RembHashValue *last_value;
   GstClockTime time = kms_utils_get_time_nsecs ();
-  gboolean new_br = TRUE;
+  guint index;
 
   g_mutex_lock (&manager->mutex);
-  last_value = g_hash_table_lookup (manager->remb_hash,
-      GUINT_TO_POINTER (ssrc));
+  index = GPOINTER_TO_UINT (g_hash_table_lookup (manager->slot_index,
+          GUINT_TO_POINTER (ssrc)));
 
-  if (last_value != NULL) {
-    new_br = (bitrate != last_value->bitrate);
-    last_value->bitrate = bitrate;
-    last_value->ts = kms_utils_get_time_nsecs ();
-  } else {
-    RembHashValue *value;
-
-    value = remb_hash_value_create (bitrate);
-    g_hash_table_insert (manager->remb_hash, GUINT_TO_POINTER (ssrc), value);
-  }
+  if (index > 0) {
+    RembSlot *slot = remb_slot (manager, index - 1);
 
-  if (bitrate < manager->remb_min) {
-    remb_event_manager_set_min (manager, bitrate);
+    slot->bitrate = bitrate;
+    slot->ts = time;
+    remb_heaps_fix (manager, index - 1);
   } else {
-    gboolean calc_min;
-
-    calc_min = new_br && (bitrate > manager->remb_min);
-    calc_min = calc_min
-        || (time - manager->oldest_remb_time > manager->clear_interval);
-    if (calc_min) {
-      remb_event_manager_calc_min (manager, bitrate);
-    }
+    remb_slot_add (manager, ssrc, bitrate, time);
   }
 
+  remb_event_manager_calc_min (manager, time);
+
   GST_TRACE_OBJECT (manager->pad, "remb_min: %" G_GUINT32_FORMAT,
-      manager->remb_min);
+      (guint) manager->remb_min);
 
   g_mutex_unlock (&manager->mutex);
 }
@@ -958,15 +1134,19 @@ RembEventManager *
 kms_utils_remb_event_manager_create (GstPad * pad)
 {
   RembEventManager *manager = g_slice_new0 (RembEventManager);
+  RembHeap heap;
 
   g_mutex_init (&manager->mutex);
-  manager->remb_hash =
-      g_hash_table_new_full (NULL, NULL, NULL, remb_hash_value_destroy);
+  manager->slots = g_array_new (FALSE, FALSE, sizeof (RembSlot));
+  for (heap = 0; heap < REMB_HEAP_COUNT; heap++) {
+    manager->heaps[heap] = g_array_new (FALSE, FALSE, sizeof (guint));
+  }
+  manager->slot_index = g_hash_table_new (NULL, NULL);
   manager->pad = g_object_ref (pad);
   manager->probe_id = gst_pad_add_probe (pad, GST_PAD_PROBE_TYPE_EVENT_UPSTREAM,
       remb_probe, manager, NULL);
-  manager->oldest_remb_time = kms_utils_get_time_nsecs ();
   manager->clear_interval = DEFAULT_CLEAR_INTERVAL;
+  manager->hysteresis = DEFAULT_HYSTERESIS;
 
   return manager;
 }
@@ -984,11 +1164,17 @@ kms_utils_remb_event_manager_destroy_user_data (RembEventManager * manager)
 void
 kms_utils_remb_event_manager_destroy (RembEventManager * manager)
 {
+  RembHeap heap;
+
   kms_utils_remb_event_manager_destroy_user_data (manager);
 
   gst_pad_remove_probe (manager->pad, manager->probe_id);
   g_object_unref (manager->pad);
-  g_hash_table_destroy (manager->remb_hash);
+  g_hash_table_destroy (manager->slot_index);
+  for (heap = 0; heap < REMB_HEAP_COUNT; heap++) {
+    g_array_free (manager->heaps[heap], TRUE);
+  }
+  g_array_free (manager->slots, TRUE);
   g_mutex_clear (&manager->mutex);
   g_slice_free (RembEventManager, manager);
 }
@@ -1002,14 +1188,11 @@ kms_utils_remb_event_manager_pointer_destroy (gpointer manager)
 guint
 kms_utils_remb_event_manager_get_min (RembEventManager * manager)
 {
-  GstClockTime time = kms_utils_get_time_nsecs ();
   guint ret;
 
+  /* Expired entries must not count even if no REMB arrived since then */
   g_mutex_lock (&manager->mutex);
-  if (time - manager->oldest_remb_time > manager->clear_interval) {
-    remb_event_manager_calc_min (manager, 0);
-  }
-
+  remb_event_manager_calc_min (manager, kms_utils_get_time_nsecs ());
   ret = manager->remb_min;
   g_mutex_unlock (&manager->mutex);
 
@@ -1033,29 +1216,71 @@ void
 kms_utils_remb_event_manager_set_clear_interval (RembEventManager * manager,
     GstClockTime interval)
 {
+  g_mutex_lock (&manager->mutex);
   manager->clear_interval = interval;
+  g_mutex_unlock (&manager->mutex);
 }
 
 GstClockTime
 kms_utils_remb_event_manager_get_clear_interval (RembEventManager * manager)
 {
-  return manager->clear_interval;
+  GstClockTime ret;
+
+  g_mutex_lock (&manager->mutex);
+  ret = manager->clear_interval;
+  g_mutex_unlock (&manager->mutex);
+
+  return ret;
+}
+
+void
+kms_utils_remb_event_manager_set_hysteresis (RembEventManager * manager,
+    gfloat hysteresis)
+{
+  g_mutex_lock (&manager->mutex);
+  manager->hysteresis = hysteresis;
+  g_mutex_unlock (&manager->mutex);
+}
+
+gfloat
+kms_utils_remb_event_manager_get_hysteresis (RembEventManager * manager)
+{
+  gfloat ret;
+
+  g_mutex_lock (&manager->mutex);
+  ret = manager->hysteresis;
+  g_mutex_unlock (&manager->mutex);
+
+  return ret;
 }
 
 /* REMB event end */
 
 /* time begin */
 
+static KmsTimeFunc time_func = NULL;
+
 GstClockTime
 kms_utils_get_time_nsecs ()
 {
+  KmsTimeFunc func = g_atomic_pointer_get (&time_func);
   GstClockTime time;
 
+  if (G_UNLIKELY (func != NULL)) {
+    return func ();
+  }
+
   time = g_get_monotonic_time () * GST_USECOND;
 
   return time;
 }
 
+void
+kms_utils_set_time_func (KmsTimeFunc func)
+{
+  g_atomic_pointer_set (&time_func, func);
+}
+
 /* time end */
 
 /* RTP connection end */
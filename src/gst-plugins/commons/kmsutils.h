@@ -62,6 +62,11 @@ gboolean kms_utils_caps_is_raw (const GstCaps * caps);
 GstElement * kms_utils_create_convert_for_caps (const GstCaps * caps);
 GstElement * kms_utils_create_mediator_element (const GstCaps * caps);
 GstElement * kms_utils_create_rate_for_caps (const GstCaps * caps);
+/* Does the work of the three above for raw video, NULL if not available */
+/* or not enabled, which is the default                                    */
+GstElement * kms_utils_create_video_adapter_for_caps (const GstCaps * caps);
+void kms_utils_set_video_adapter_enabled (gboolean enabled);
+gboolean kms_utils_get_video_adapter_enabled (void);
 
 const gchar * kms_utils_get_caps_codec_name_from_sdp (const gchar * codec_name);
 
@@ -90,9 +95,17 @@ guint kms_utils_remb_event_manager_get_min (RembEventManager * manager);
 void kms_utils_remb_event_manager_set_callback (RembEventManager * manager, RembBitrateUpdatedCallback cb, gpointer data, GDestroyNotify destroy_notify);
 void kms_utils_remb_event_manager_set_clear_interval (RembEventManager * manager, GstClockTime interval);
 GstClockTime kms_utils_remb_event_manager_get_clear_interval (RembEventManager * manager);
+/* The callback is not called while the minimum differs from the last notified
+ * one by this fraction or less. 0 (default) notifies every change */
+void kms_utils_remb_event_manager_set_hysteresis (RembEventManager * manager, gfloat hysteresis);
+gfloat kms_utils_remb_event_manager_get_hysteresis (RembEventManager * manager);
 
 /* time */
+typedef GstClockTime (*KmsTimeFunc) (void);
 GstClockTime kms_utils_get_time_nsecs ();
+/* Replaces the monotonic clock above, so that REMB and stats code can run on
+ * simulated time. NULL restores it */
+void kms_utils_set_time_func (KmsTimeFunc func);
 
 gboolean kms_utils_contains_proto (const gchar *search_term, const gchar *proto);
 const GstStructure * kms_utils_get_structure_by_name (const GstStructure *str, const gchar *name);
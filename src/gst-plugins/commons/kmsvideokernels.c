@@ -0,0 +1,456 @@
+/*
+ * (C) Copyright 2016 Kurento (http://kurento.org/)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#  include <config.h>
+#endif
+
+#include <string.h>
+
+#include "kmsvideokernels.h"
+
+#if defined (__GNUC__) && (defined (__x86_64__) || defined (__i386__))
+#  define KMS_VIDEO_KERNELS_X86
+#  include <immintrin.h>
+#endif
+
+#if defined (__ARM_NEON) || defined (__ARM_NEON__)
+#  define KMS_VIDEO_KERNELS_NEON
+#  include <arm_neon.h>
+#endif
+
+#define WEIGHT_SHIFT 7
+#define WEIGHT_ROUND (1 << (WEIGHT_SHIFT - 1))
+
+G_STATIC_ASSERT (KMS_VIDEO_KERNELS_WEIGHT_ONE == 1 << WEIGHT_SHIFT);
+
+static inline guint8
+blend_sample (guint8 a, guint8 b, guint weight)
+{
+  /* Same rounding as the vector code: arithmetic shift of the difference */
+  return a + ((((gint) b - (gint) a) * (gint) weight + WEIGHT_ROUND) >>
+      WEIGHT_SHIFT);
+}
+
+static void
+blend_row_generic (guint8 * dst, const guint8 * a, const guint8 * b,
+    guint weight, gsize n)
+{
+  gsize i;
+
+  if (weight == 0) {
+    memcpy (dst, a, n);
+    return;
+  }
+
+  for (i = 0; i < n; i++) {
+    dst[i] = blend_sample (a[i], b[i], weight);
+  }
+}
+
+static void
+interleave_row_generic (guint8 * dst, const guint8 * u, const guint8 * v,
+    gsize n)
+{
+  gsize i;
+
+  for (i = 0; i < n; i++) {
+    dst[2 * i] = u[i];
+    dst[2 * i + 1] = v[i];
+  }
+}
+
+static void
+deinterleave_row_generic (guint8 * u, guint8 * v, const guint8 * src,
+    gsize n)
+{
+  gsize i;
+
+  for (i = 0; i < n; i++) {
+    u[i] = src[2 * i];
+    v[i] = src[2 * i + 1];
+  }
+}
+
+static const KmsVideoKernels generic_kernels = {
+  "generic",
+  blend_row_generic,
+  interleave_row_generic,
+  deinterleave_row_generic
+};
+
+#ifdef KMS_VIDEO_KERNELS_X86
+
+__attribute__ ((target ("sse4.1")))
+static inline __m128i
+blend_epi16_sse41 (__m128i a, __m128i b, __m128i weight, __m128i round)
+{
+  __m128i diff = _mm_mullo_epi16 (_mm_sub_epi16 (b, a), weight);
+
+  return _mm_add_epi16 (a, _mm_srai_epi16 (_mm_add_epi16 (diff, round),
+          WEIGHT_SHIFT));
+}
+
+__attribute__ ((target ("sse4.1")))
+static void
+blend_row_sse41 (guint8 * dst, const guint8 * a, const guint8 * b,
+    guint weight, gsize n)
+{
+  __m128i w = _mm_set1_epi16 (weight);
+  __m128i round = _mm_set1_epi16 (WEIGHT_ROUND);
+  gsize i = 0;
+
+  if (weight == 0) {
+    memcpy (dst, a, n);
+    return;
+  }
+
+  for (; i + 16 <= n; i += 16) {
+    __m128i va = _mm_loadu_si128 ((const __m128i *) (a + i));
+    __m128i vb = _mm_loadu_si128 ((const __m128i *) (b + i));
+    __m128i lo, hi;
+
+    lo = blend_epi16_sse41 (_mm_cvtepu8_epi16 (va), _mm_cvtepu8_epi16 (vb),
+        w, round);
+    hi = blend_epi16_sse41 (_mm_cvtepu8_epi16 (_mm_srli_si128 (va, 8)),
+        _mm_cvtepu8_epi16 (_mm_srli_si128 (vb, 8)), w, round);
+    _mm_storeu_si128 ((__m128i *) (dst + i), _mm_packus_epi16 (lo, hi));
+  }
+
+  for (; i < n; i++) {
+    dst[i] = blend_sample (a[i], b[i], weight);
+  }
+}
+
+__attribute__ ((target ("sse4.1")))
+static void
+interleave_row_sse41 (guint8 * dst, const guint8 * u, const guint8 * v,
+    gsize n)
+{
+  gsize i = 0;
+
+  for (; i + 16 <= n; i += 16) {
+    __m128i vu = _mm_loadu_si128 ((const __m128i *) (u + i));
+    __m128i vv = _mm_loadu_si128 ((const __m128i *) (v + i));
+
+    _mm_storeu_si128 ((__m128i *) (dst + 2 * i), _mm_unpacklo_epi8 (vu, vv));
+    _mm_storeu_si128 ((__m128i *) (dst + 2 * i + 16),
+        _mm_unpackhi_epi8 (vu, vv));
+  }
+
+  interleave_row_generic (dst + 2 * i, u + i, v + i, n - i);
+}
+
+__attribute__ ((target ("sse4.1")))
+static void
+deinterleave_row_sse41 (guint8 * u, guint8 * v, const guint8 * src, gsize n)
+{
+  /* Even bytes to the low half, odd bytes to the high half */
+  const __m128i mask = _mm_setr_epi8 (0, 2, 4, 6, 8, 10, 12, 14,
+      1, 3, 5, 7, 9, 11, 13, 15);
+  gsize i = 0;
+
+  for (; i + 16 <= n; i += 16) {
+    __m128i s0 = _mm_loadu_si128 ((const __m128i *) (src + 2 * i));
+    __m128i s1 = _mm_loadu_si128 ((const __m128i *) (src + 2 * i + 16));
+
+    s0 = _mm_shuffle_epi8 (s0, mask);
+    s1 = _mm_shuffle_epi8 (s1, mask);
+    _mm_storeu_si128 ((__m128i *) (u + i), _mm_unpacklo_epi64 (s0, s1));
+    _mm_storeu_si128 ((__m128i *) (v + i), _mm_unpackhi_epi64 (s0, s1));
+  }
+
+  deinterleave_row_generic (u + i, v + i, src + 2 * i, n - i);
+}
+
+static const KmsVideoKernels sse41_kernels = {
+  "sse4.1",
+  blend_row_sse41,
+  interleave_row_sse41,
+  deinterleave_row_sse41
+};
+
+__attribute__ ((target ("avx2")))
+static inline __m256i
+blend_epi16_avx2 (__m256i a, __m256i b, __m256i weight, __m256i round)
+{
+  __m256i diff = _mm256_mullo_epi16 (_mm256_sub_epi16 (b, a), weight);
+
+  return _mm256_add_epi16 (a, _mm256_srai_epi16 (_mm256_add_epi16 (diff,
+              round), WEIGHT_SHIFT));
+}
+
+__attribute__ ((target ("avx2")))
+static void
+blend_row_avx2 (guint8 * dst, const guint8 * a, const guint8 * b,
+    guint weight, gsize n)
+{
+  __m256i w = _mm256_set1_epi16 (weight);
+  __m256i round = _mm256_set1_epi16 (WEIGHT_ROUND);
+  gsize i = 0;
+
+  if (weight == 0) {
+    memcpy (dst, a, n);
+    return;
+  }
+
+  for (; i + 32 <= n; i += 32) {
+    __m256i va = _mm256_loadu_si256 ((const __m256i *) (a + i));
+    __m256i vb = _mm256_loadu_si256 ((const __m256i *) (b + i));
+    __m256i lo, hi, packed;
+
+    lo = blend_epi16_avx2 (_mm256_cvtepu8_epi16 (_mm256_castsi256_si128 (va)),
+        _mm256_cvtepu8_epi16 (_mm256_castsi256_si128 (vb)), w, round);
+    hi = blend_epi16_avx2 (_mm256_cvtepu8_epi16 (_mm256_extracti128_si256 (va,
+                1)), _mm256_cvtepu8_epi16 (_mm256_extracti128_si256 (vb, 1)),
+        w, round);
+    /* Packing works per 128 bit lane, put the quarters back in order */
+    packed = _mm256_packus_epi16 (lo, hi);
+    _mm256_storeu_si256 ((__m256i *) (dst + i),
+        _mm256_permute4x64_epi64 (packed, 0xD8));
+  }
+
+  for (; i < n; i++) {
+    dst[i] = blend_sample (a[i], b[i], weight);
+  }
+}
+
+__attribute__ ((target ("avx2")))
+static void
+interleave_row_avx2 (guint8 * dst, const guint8 * u, const guint8 * v,
+    gsize n)
+{
+  gsize i = 0;
+
+  for (; i + 32 <= n; i += 32) {
+    __m256i vu = _mm256_loadu_si256 ((const __m256i *) (u + i));
+    __m256i vv = _mm256_loadu_si256 ((const __m256i *) (v + i));
+    __m256i lo = _mm256_unpacklo_epi8 (vu, vv);
+    __m256i hi = _mm256_unpackhi_epi8 (vu, vv);
+
+    _mm256_storeu_si256 ((__m256i *) (dst + 2 * i),
+        _mm256_permute2x128_si256 (lo, hi, 0x20));
+    _mm256_storeu_si256 ((__m256i *) (dst + 2 * i + 32),
+        _mm256_permute2x128_si256 (lo, hi, 0x31));
+  }
+
+  interleave_row_generic (dst + 2 * i, u + i, v + i, n - i);
+}
+
+__attribute__ ((target ("avx2")))
+static void
+deinterleave_row_avx2 (guint8 * u, guint8 * v, const guint8 * src, gsize n)
+{
+  const __m256i mask = _mm256_setr_epi8 (0, 2, 4, 6, 8, 10, 12, 14,
+      1, 3, 5, 7, 9, 11, 13, 15, 0, 2, 4, 6, 8, 10, 12, 14,
+      1, 3, 5, 7, 9, 11, 13, 15);
+  gsize i = 0;
+
+  for (; i + 32 <= n; i += 32) {
+    __m256i s0 = _mm256_loadu_si256 ((const __m256i *) (src + 2 * i));
+    __m256i s1 = _mm256_loadu_si256 ((const __m256i *) (src + 2 * i + 32));
+
+    /* Each one ends as 16 u samples followed by 16 v samples */
+    s0 = _mm256_permute4x64_epi64 (_mm256_shuffle_epi8 (s0, mask), 0xD8);
+    s1 = _mm256_permute4x64_epi64 (_mm256_shuffle_epi8 (s1, mask), 0xD8);
+    _mm256_storeu_si256 ((__m256i *) (u + i),
+        _mm256_permute2x128_si256 (s0, s1, 0x20));
+    _mm256_storeu_si256 ((__m256i *) (v + i),
+        _mm256_permute2x128_si256 (s0, s1, 0x31));
+  }
+
+  deinterleave_row_generic (u + i, v + i, src + 2 * i, n - i);
+}
+
+static const KmsVideoKernels avx2_kernels = {
+  "avx2",
+  blend_row_avx2,
+  interleave_row_avx2,
+  deinterleave_row_avx2
+};
+
+#endif /* KMS_VIDEO_KERNELS_X86 */
+
+#ifdef KMS_VIDEO_KERNELS_NEON
+
+static void
+blend_row_neon (guint8 * dst, const guint8 * a, const guint8 * b,
+    guint weight, gsize n)
+{
+  gsize i = 0;
+
+  if (weight == 0) {
+    memcpy (dst, a, n);
+    return;
+  }
+
+  for (; i + 8 <= n; i += 8) {
+    uint8x8_t va = vld1_u8 (a + i);
+    int16x8_t diff = vreinterpretq_s16_u16 (vsubl_u8 (vld1_u8 (b + i), va));
+    int16x8_t res;
+
+    /* Rounding shift, as (x + WEIGHT_ROUND) >> WEIGHT_SHIFT */
+    diff = vrshrq_n_s16 (vmulq_n_s16 (diff, weight), WEIGHT_SHIFT);
+    res = vaddq_s16 (vreinterpretq_s16_u16 (vmovl_u8 (va)), diff);
+    vst1_u8 (dst + i, vqmovun_s16 (res));
+  }
+
+  for (; i < n; i++) {
+    dst[i] = blend_sample (a[i], b[i], weight);
+  }
+}
+
+static void
+interleave_row_neon (guint8 * dst, const guint8 * u, const guint8 * v,
+    gsize n)
+{
+  gsize i = 0;
+
+  for (; i + 16 <= n; i += 16) {
+    uint8x16x2_t uv;
+
+    uv.val[0] = vld1q_u8 (u + i);
+    uv.val[1] = vld1q_u8 (v + i);
+    vst2q_u8 (dst + 2 * i, uv);
+  }
+
+  interleave_row_generic (dst + 2 * i, u + i, v + i, n - i);
+}
+
+static void
+deinterleave_row_neon (guint8 * u, guint8 * v, const guint8 * src, gsize n)
+{
+  gsize i = 0;
+
+  for (; i + 16 <= n; i += 16) {
+    uint8x16x2_t uv = vld2q_u8 (src + 2 * i);
+
+    vst1q_u8 (u + i, uv.val[0]);
+    vst1q_u8 (v + i, uv.val[1]);
+  }
+
+  deinterleave_row_generic (u + i, v + i, src + 2 * i, n - i);
+}
+
+static const KmsVideoKernels neon_kernels = {
+  "neon",
+  blend_row_neon,
+  interleave_row_neon,
+  deinterleave_row_neon
+};
+
+#endif /* KMS_VIDEO_KERNELS_NEON */
+
+const KmsVideoKernels *
+kms_video_kernels_get_by_name (const gchar * name)
+{
+  g_return_val_if_fail (name != NULL, NULL);
+
+  if (g_strcmp0 (name, generic_kernels.name) == 0) {
+    return &generic_kernels;
+  }
+#ifdef KMS_VIDEO_KERNELS_X86
+  __builtin_cpu_init ();
+
+  if (g_strcmp0 (name, avx2_kernels.name) == 0) {
+    return __builtin_cpu_supports ("avx2") ? &avx2_kernels : NULL;
+  }
+
+  if (g_strcmp0 (name, sse41_kernels.name) == 0) {
+    return __builtin_cpu_supports ("sse4.1") ? &sse41_kernels : NULL;
+  }
+#endif
+
+#ifdef KMS_VIDEO_KERNELS_NEON
+  if (g_strcmp0 (name, neon_kernels.name) == 0) {
+    return &neon_kernels;
+  }
+#endif
+
+  return NULL;
+}
+
+const KmsVideoKernels *
+kms_video_kernels_get (void)
+{
+  static const gchar *preferred[] = { "avx2", "sse4.1", "neon" };
+  static gsize kernels = 0;
+
+  if (g_once_init_enter (&kernels)) {
+    const KmsVideoKernels *best = &generic_kernels;
+    guint i;
+
+    for (i = 0; i < G_N_ELEMENTS (preferred); i++) {
+      const KmsVideoKernels *k = kms_video_kernels_get_by_name (preferred[i]);
+
+      if (k != NULL) {
+        best = k;
+        break;
+      }
+    }
+
+    g_once_init_leave (&kernels, (gsize) best);
+  }
+
+  return (const KmsVideoKernels *) kernels;
+}
+
+void
+kms_video_kernels_compute_taps (guint src_width, guint dst_width,
+    guint * offsets, guint8 * weights)
+{
+  guint64 step, pos;
+  guint x;
+
+  g_return_if_fail (src_width > 0 && dst_width > 0);
+
+  /* 16.16 fixed point, sampling at the centre of each output pixel */
+  step = ((guint64) src_width << 16) / dst_width;
+  pos = step / 2;
+
+  for (x = 0; x < dst_width; x++, pos += step) {
+    gint64 p = (gint64) pos - (1 << 15);
+
+    if (p <= 0) {
+      offsets[x] = 0;
+      weights[x] = 0;
+    } else if ((p >> 16) >= src_width - 1) {
+      offsets[x] = src_width - 1;
+      weights[x] = 0;
+    } else {
+      offsets[x] = p >> 16;
+      weights[x] = (p & 0xffff) >> (16 - WEIGHT_SHIFT);
+    }
+  }
+}
+
+void
+kms_video_kernels_resample_row (guint8 * dst, const guint8 * src,
+    const guint * offsets, const guint8 * weights, guint dst_width,
+    guint channels)
+{
+  guint x, c;
+
+  for (x = 0; x < dst_width; x++) {
+    const guint8 *s = src + offsets[x] * channels;
+
+    for (c = 0; c < channels; c++) {
+      dst[x * channels + c] = weights[x] == 0 ? s[c] :
+          blend_sample (s[c], s[c + channels], weights[x]);
+    }
+  }
+}
@@ -0,0 +1,65 @@
+/*
+ * (C) Copyright 2016 Kurento (http://kurento.org/)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+#ifndef __KMS_VIDEO_KERNELS_H__
+#define __KMS_VIDEO_KERNELS_H__
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+/* Weights of the blend kernel, from 0 (first row) to this (second row) */
+#define KMS_VIDEO_KERNELS_WEIGHT_ONE 128
+
+/*
+ * Row kernels of raw video scaling and conversion, working on 8 bit
+ * samples. Buffers need no alignment.
+ */
+typedef struct _KmsVideoKernels
+{
+  const gchar *name;
+
+  /* dst = a + (b - a) * weight / KMS_VIDEO_KERNELS_WEIGHT_ONE, rounded */
+  void (*blend_row) (guint8 * dst, const guint8 * a, const guint8 * b,
+      guint weight, gsize n);
+
+  /* @n pairs of samples, as chroma goes in NV12 */
+  void (*interleave_row) (guint8 * dst, const guint8 * u, const guint8 * v,
+      gsize n);
+  void (*deinterleave_row) (guint8 * u, guint8 * v, const guint8 * src,
+      gsize n);
+} KmsVideoKernels;
+
+/* The fastest kernels this CPU can run */
+const KmsVideoKernels * kms_video_kernels_get (void);
+
+/* "generic", "sse4.1", "avx2" or "neon", NULL if this CPU cannot run them */
+const KmsVideoKernels * kms_video_kernels_get_by_name (const gchar * name);
+
+/*
+ * Horizontal resampling of a row of @channels interleaved samples. Output
+ * sample x blends input samples @offsets[x] and the next one of its channel
+ * with @weights[x], as computed by kms_video_kernels_compute_taps.
+ */
+void kms_video_kernels_resample_row (guint8 * dst, const guint8 * src,
+    const guint * offsets, const guint8 * weights, guint dst_width,
+    guint channels);
+
+void kms_video_kernels_compute_taps (guint src_width, guint dst_width,
+    guint * offsets, guint8 * weights);
+
+G_END_DECLS
+#endif /* __KMS_VIDEO_KERNELS_H__ */
@@ -0,0 +1,328 @@
+/*
+ * (C) Copyright 2016 Kurento (http://kurento.org/)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdlib.h>
+
+#include "sdp_utils.h"
+#include "kmssdpagent.h"
+#include "kmssdpextmapext.h"
+#include "kmsisdpmediaextension.h"
+
+#define OBJECT_NAME "sdpextmapext"
+
+GST_DEBUG_CATEGORY_STATIC (kms_sdp_extmap_ext_debug_category);
+#define GST_CAT_DEFAULT kms_sdp_extmap_ext_debug_category
+
+#define parent_class kms_sdp_extmap_ext_parent_class
+
+static void kms_i_sdp_media_extension_init (KmsISdpMediaExtensionInterface *
+    iface);
+
+G_DEFINE_TYPE_WITH_CODE (KmsSdpExtmapExt, kms_sdp_extmap_ext,
+    G_TYPE_OBJECT,
+    G_IMPLEMENT_INTERFACE (KMS_TYPE_I_SDP_MEDIA_EXTENSION,
+        kms_i_sdp_media_extension_init)
+    GST_DEBUG_CATEGORY_INIT (kms_sdp_extmap_ext_debug_category, OBJECT_NAME,
+        0, "debug category for sdp extmap_ext"));
+
+#define KMS_SDP_EXTMAP_EXT_GET_PRIVATE(obj) (  \
+  G_TYPE_INSTANCE_GET_PRIVATE (                \
+    (obj),                                     \
+    KMS_TYPE_SDP_EXTMAP_EXT,                   \
+    KmsSdpExtmapExtPrivate                     \
+  )                                            \
+)
+
+#define EXTMAP_ATTR "extmap"
+
+/* One-byte header extensions (RFC 5285) are limited to these ids */
+#define EXTMAP_MIN_ID 1
+#define EXTMAP_MAX_ID 14
+
+typedef struct _Extmap
+{
+  gchar *uri;
+  /* Offered first, then the last one negotiated */
+  guint8 id;
+} Extmap;
+
+struct _KmsSdpExtmapExtPrivate
+{
+  GSList *extmaps;
+};
+
+static void
+extmap_destroy (Extmap * extmap)
+{
+  g_free (extmap->uri);
+  g_slice_free (Extmap, extmap);
+}
+
+static Extmap *
+kms_sdp_extmap_ext_find (KmsSdpExtmapExt * self, const gchar * uri)
+{
+  GSList *l;
+
+  for (l = self->priv->extmaps; l != NULL; l = g_slist_next (l)) {
+    Extmap *extmap = l->data;
+
+    if (g_strcmp0 (extmap->uri, uri) == 0) {
+      return extmap;
+    }
+  }
+
+  return NULL;
+}
+
+static gboolean
+kms_sdp_extmap_ext_id_in_use (const GstSDPMedia * media, guint8 id)
+{
+  guint a;
+
+  for (a = 0;; a++) {
+    const gchar *attr;
+
+    attr = gst_sdp_media_get_attribute_val_n (media, EXTMAP_ATTR, a);
+    if (attr == NULL) {
+      return FALSE;
+    }
+
+    if (atoi (attr) == id) {
+      return TRUE;
+    }
+  }
+}
+
+static gint
+kms_sdp_extmap_ext_get_free_id (const GstSDPMedia * media, guint8 preferred)
+{
+  guint8 id;
+
+  if (!kms_sdp_extmap_ext_id_in_use (media, preferred)) {
+    return preferred;
+  }
+
+  for (id = EXTMAP_MIN_ID; id <= EXTMAP_MAX_ID; id++) {
+    if (!kms_sdp_extmap_ext_id_in_use (media, id)) {
+      return id;
+    }
+  }
+
+  return -1;
+}
+
+/* Keeps the ids of @media so that later offers do not change them */
+static void
+kms_sdp_extmap_ext_update_ids (KmsSdpExtmapExt * self,
+    const GstSDPMedia * media)
+{
+  GSList *l;
+
+  for (l = self->priv->extmaps; l != NULL; l = g_slist_next (l)) {
+    Extmap *extmap = l->data;
+    gint id;
+
+    id = sdp_utils_get_extmap_id (media, extmap->uri);
+    if (id > 0 && id != extmap->id) {
+      GST_DEBUG_OBJECT (self, "Negotiated id %d for %s", id, extmap->uri);
+      extmap->id = id;
+    }
+  }
+}
+
+static gboolean
+kms_sdp_extmap_ext_add_offer_attributes (KmsISdpMediaExtension * ext,
+    GstSDPMedia * offer, GError ** error)
+{
+  KmsSdpExtmapExt *self = KMS_SDP_EXTMAP_EXT (ext);
+  GSList *l;
+
+  for (l = self->priv->extmaps; l != NULL; l = g_slist_next (l)) {
+    Extmap *extmap = l->data;
+    gchar *attr;
+    gint id;
+
+    if (sdp_utils_get_extmap_id (offer, extmap->uri) != -1) {
+      /* Already offered by the media handler */
+      continue;
+    }
+
+    id = kms_sdp_extmap_ext_get_free_id (offer, extmap->id);
+    if (id == -1) {
+      GST_WARNING_OBJECT (self, "No id left to offer %s", extmap->uri);
+      continue;
+    }
+
+    attr = g_strdup_printf ("%d %s", id, extmap->uri);
+    if (gst_sdp_media_add_attribute (offer, EXTMAP_ATTR, attr) != GST_SDP_OK) {
+      g_set_error (error, KMS_SDP_AGENT_ERROR, SDP_AGENT_UNEXPECTED_ERROR,
+          "Can not to set attribute '%s:%s'", EXTMAP_ATTR, attr);
+      g_free (attr);
+      return FALSE;
+    }
+
+    g_free (attr);
+    extmap->id = id;
+  }
+
+  return TRUE;
+}
+
+static gboolean
+kms_sdp_extmap_ext_add_answer_attributes (KmsISdpMediaExtension * ext,
+    const GstSDPMedia * offer, GstSDPMedia * answer, GError ** error)
+{
+  KmsSdpExtmapExt *self = KMS_SDP_EXTMAP_EXT (ext);
+  guint a;
+
+  for (a = 0;; a++) {
+    const gchar *attr;
+    gchar **tokens;
+    gboolean supported;
+
+    attr = gst_sdp_media_get_attribute_val_n (offer, EXTMAP_ATTR, a);
+    if (attr == NULL) {
+      break;
+    }
+
+    tokens = g_strsplit (attr, " ", 0);
+
+    /* The answer keeps the ids of the offer */
+    supported = tokens[1] != NULL
+        && kms_sdp_extmap_ext_find (self, tokens[1]) != NULL
+        && sdp_utils_get_extmap_id (answer, tokens[1]) == -1;
+
+    if (supported && gst_sdp_media_add_attribute (answer, EXTMAP_ATTR,
+            attr) != GST_SDP_OK) {
+      g_set_error (error, KMS_SDP_AGENT_ERROR, SDP_AGENT_UNEXPECTED_ERROR,
+          "Can not to set attribute '%s:%s'", EXTMAP_ATTR, attr);
+      g_strfreev (tokens);
+      return FALSE;
+    }
+
+    g_strfreev (tokens);
+  }
+
+  kms_sdp_extmap_ext_update_ids (self, answer);
+
+  return TRUE;
+}
+
+static gboolean
+kms_sdp_extmap_ext_can_insert_attribute (KmsISdpMediaExtension * ext,
+    const GstSDPMedia * offer, const GstSDPAttribute * attr,
+    GstSDPMedia * answer, const GstSDPMessage * msg)
+{
+  return FALSE;
+}
+
+static gboolean
+kms_sdp_extmap_ext_process_answer_attributes (KmsISdpMediaExtension * ext,
+    const GstSDPMedia * answer, GError ** error)
+{
+  kms_sdp_extmap_ext_update_ids (KMS_SDP_EXTMAP_EXT (ext), answer);
+
+  return TRUE;
+}
+
+static void
+kms_sdp_extmap_ext_finalize (GObject * object)
+{
+  KmsSdpExtmapExt *self = KMS_SDP_EXTMAP_EXT (object);
+
+  GST_DEBUG_OBJECT (self, "finalize");
+
+  g_slist_free_full (self->priv->extmaps, (GDestroyNotify) extmap_destroy);
+
+  G_OBJECT_CLASS (parent_class)->finalize (object);
+}
+
+static void
+kms_sdp_extmap_ext_class_init (KmsSdpExtmapExtClass * klass)
+{
+  GObjectClass *gobject_class;
+
+  gobject_class = G_OBJECT_CLASS (klass);
+  gobject_class->finalize = kms_sdp_extmap_ext_finalize;
+
+  g_type_class_add_private (klass, sizeof (KmsSdpExtmapExtPrivate));
+}
+
+static void
+kms_sdp_extmap_ext_init (KmsSdpExtmapExt * self)
+{
+  self->priv = KMS_SDP_EXTMAP_EXT_GET_PRIVATE (self);
+}
+
+static void
+kms_i_sdp_media_extension_init (KmsISdpMediaExtensionInterface * iface)
+{
+  iface->add_offer_attributes = kms_sdp_extmap_ext_add_offer_attributes;
+  iface->add_answer_attributes = kms_sdp_extmap_ext_add_answer_attributes;
+  iface->can_insert_attribute = kms_sdp_extmap_ext_can_insert_attribute;
+  iface->process_answer_attributes =
+      kms_sdp_extmap_ext_process_answer_attributes;
+}
+
+KmsSdpExtmapExt *
+kms_sdp_extmap_ext_new ()
+{
+  gpointer obj;
+
+  obj = g_object_new (KMS_TYPE_SDP_EXTMAP_EXT, NULL);
+
+  return KMS_SDP_EXTMAP_EXT (obj);
+}
+
+gboolean
+kms_sdp_extmap_ext_add_uri (KmsSdpExtmapExt * ext, guint8 id,
+    const gchar * uri, GError ** error)
+{
+  Extmap *extmap;
+  GSList *l;
+
+  g_return_val_if_fail (KMS_IS_SDP_EXTMAP_EXT (ext), FALSE);
+  g_return_val_if_fail (uri != NULL, FALSE);
+
+  if (id < EXTMAP_MIN_ID || id > EXTMAP_MAX_ID) {
+    g_set_error (error, KMS_SDP_AGENT_ERROR, SDP_AGENT_INVALID_PARAMETER,
+        "Invalid extmap id '%u'", id);
+    return FALSE;
+  }
+
+  for (l = ext->priv->extmaps; l != NULL; l = g_slist_next (l)) {
+    Extmap *other = l->data;
+
+    if (other->id == id || g_strcmp0 (other->uri, uri) == 0) {
+      g_set_error (error, KMS_SDP_AGENT_ERROR, SDP_AGENT_INVALID_PARAMETER,
+          "Trying to add existing extmap '%u %s'", id, uri);
+      return FALSE;
+    }
+  }
+
+  extmap = g_slice_new0 (Extmap);
+  extmap->uri = g_strdup (uri);
+  extmap->id = id;
+
+  ext->priv->extmaps = g_slist_append (ext->priv->extmaps, extmap);
+
+  return TRUE;
+}
@@ -0,0 +1,81 @@
+/*
+ * (C) Copyright 2016 Kurento (http://kurento.org/)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+#ifndef _KMS_SDP_EXTMAP_EXT_H_
+#define _KMS_SDP_EXTMAP_EXT_H_
+
+#include <gst/gst.h>
+
+G_BEGIN_DECLS
+
+#define KMS_TYPE_SDP_EXTMAP_EXT \
+  (kms_sdp_extmap_ext_get_type())
+
+#define KMS_SDP_EXTMAP_EXT(obj) ( \
+  G_TYPE_CHECK_INSTANCE_CAST (       \
+    (obj),                           \
+    KMS_TYPE_SDP_EXTMAP_EXT,      \
+    KmsSdpExtmapExt               \
+  )                                  \
+)
+#define KMS_SDP_EXTMAP_EXT_CLASS(klass) ( \
+  G_TYPE_CHECK_CLASS_CAST (                  \
+    (klass),                                 \
+    KMS_TYPE_SDP_EXTMAP_EXT,              \
+    KmsSdpExtmapExtClass                  \
+  )                                          \
+)
+#define KMS_IS_SDP_EXTMAP_EXT(obj) ( \
+  G_TYPE_CHECK_INSTANCE_TYPE (          \
+    (obj),                              \
+    KMS_TYPE_SDP_EXTMAP_EXT          \
+  )                                     \
+)
+#define KMS_IS_SDP_EXTMAP_EXT_CLASS(klass) \
+  (G_TYPE_CHECK_CLASS_TYPE((klass),KMS_TYPE_SDP_EXTMAP_EXT))
+#define KMS_SDP_EXTMAP_EXT_GET_CLASS(obj) (  \
+  G_TYPE_INSTANCE_GET_CLASS (                   \
+    (obj),                                      \
+    KMS_TYPE_SDP_EXTMAP_EXT,                 \
+    KmsSdpExtmapExtClass                     \
+  )                                             \
+)
+
+typedef struct _KmsSdpExtmapExt KmsSdpExtmapExt;
+typedef struct _KmsSdpExtmapExtClass KmsSdpExtmapExtClass;
+typedef struct _KmsSdpExtmapExtPrivate KmsSdpExtmapExtPrivate;
+
+struct _KmsSdpExtmapExt
+{
+  GObject parent;
+
+  /*< private > */
+  KmsSdpExtmapExtPrivate *priv;
+};
+
+struct _KmsSdpExtmapExtClass
+{
+  GObjectClass parent_class;
+};
+
+GType kms_sdp_extmap_ext_get_type ();
+
+KmsSdpExtmapExt * kms_sdp_extmap_ext_new ();
+
+/* Offers @uri with @id, unless it is taken or @uri was negotiated before */
+gboolean kms_sdp_extmap_ext_add_uri (KmsSdpExtmapExt * ext, guint8 id, const gchar * uri, GError ** error);
+
+#endif /* _KMS_SDP_EXTMAP_EXT_H_ */
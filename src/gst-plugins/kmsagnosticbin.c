@@ -26,14 +26,24 @@
 #include "kmsdectreebin.h"
 #include "kmsenctreebin.h"
 #include "kmsrtppaytreebin.h"
+#include "kmstranscodingmanager.h"
+#include "kmstreebinpool.h"
 
 #include "kms-core-enumtypes.h"
 
+#include <gst/video/video.h>
+
 #define PLUGIN_NAME "agnosticbin"
 
 #define UNLINKING_DATA "unlinking-data"
 G_DEFINE_QUARK (UNLINKING_DATA, unlinking_data);
 
+#define RENDITION_DATA "rendition-data"
+G_DEFINE_QUARK (RENDITION_DATA, rendition_data);
+
+#define IDLE_SINCE "idle-since"
+G_DEFINE_QUARK (IDLE_SINCE, idle_since);
+
 #define KMS_AGNOSTIC_PAD_STARTED (GST_PAD_FLAG_LAST << 1)
 
 static GstStaticCaps static_raw_audio_caps =
@@ -68,8 +78,23 @@ G_DEFINE_TYPE (KmsAgnosticBin2, kms_agnostic_bin2, GST_TYPE_BIN);
 #define TARGET_BITRATE_DEFAULT 300000
 #define MIN_BITRATE_DEFAULT 0
 #define MAX_BITRATE_DEFAULT G_MAXINT
+#define DIRECT_MODE_DEFAULT FALSE
 #define LEAKY_TIME 600000000    /*600 ms */
 
+/* Codec configuration field with the renditions, e.g. "1080p/720p/360p". */
+/* A rendition can set its bitrate, e.g. "720p@1500000"                   */
+#define RENDITION_LADDER "rendition-ladder"
+/* Default bitrate of a rendition: 16:9, 30 fps and 0.07 bits per pixel */
+#define RENDITION_FRAMERATE 30
+#define RENDITION_BITS_PER_PIXEL_PERCENT 7
+/* Bandwidth over the bitrate needed to move a sink to a better rendition */
+#define RENDITION_UP_MARGIN_PERCENT 10
+
+/* Codec configuration field with the milliseconds a transcoding branch is */
+/* kept after its last sink goes away. Negative values keep it forever    */
+#define TRANSCODING_IDLE_TIMEOUT "transcoding-idle-timeout"
+#define TRANSCODING_IDLE_TIMEOUT_DEFAULT 5000
+
 enum
 {
   SIGNAL_MEDIA_TRANSCODING,
@@ -78,9 +103,48 @@ enum
 
 static guint kms_agnostic_bin2_signals[LAST_SIGNAL] = { 0 };
 
+typedef struct _KmsCapsMatch
+{
+  GstBin *bin;
+  guint generation;
+} KmsCapsMatch;
+
+typedef struct _KmsRendition
+{
+  gint height;
+  gint bitrate;
+  /* Scaler fed by the previous, bigger, rendition */
+  GstElement *queue;
+  GstElement *scale;
+  GstElement *filter;
+  GstElement *tee;
+  GstBin *enc_bin;
+} KmsRendition;
+
+typedef struct _KmsRenditionLadder
+{
+  /* KmsRendition *, biggest first */
+  GPtrArray *renditions;
+  GstCaps *caps;
+  /* Monotonic time its last sink went away, 0 while in use */
+  gint64 idle_since;
+} KmsRenditionLadder;
+
+/* Attached to the src pads fed by a rendition ladder */
+typedef struct _KmsRenditionPadData
+{
+  RembEventManager *remb_manager;
+  gchar *ladder_key;
+  guint index;
+} KmsRenditionPadData;
+
 struct _KmsAgnosticBin2Private
 {
   GHashTable *bins;
+  /* Serialized wanted caps -> KmsCapsMatch, the bin found for them */
+  GHashTable *caps_index;
+  /* Serialized wanted caps -> KmsRenditionLadder */
+  GHashTable *ladders;
 
   GRecMutex thread_mutex;
 
@@ -95,6 +159,19 @@ struct _KmsAgnosticBin2Private
   gboolean started;
 
   GThreadPool *remove_pool;
+  GThreadPool *rendition_pool;
+  GThreadPool *reap_pool;
+
+  /* Next look for idle tree bins, protected by the object lock */
+  GstClockID reap_id;
+  GstClockTime reap_time;
+
+  /* Whether a sole consumer may skip the tree bins */
+  gboolean direct_mode;
+  /* Sole consumer fed straight from the sink pad, protected by the object */
+  /* lock as it is read for every buffer                                   */
+  GstPad *direct_pad;
+  gulong direct_probe;
 
   gint max_bitrate;
   gint min_bitrate;
@@ -103,6 +180,8 @@ struct _KmsAgnosticBin2Private
   gboolean bitrate_unlimited;
 
   gboolean transcoding_emitted;
+  gboolean transcoding_active;
+  gboolean transcoding_stopped;
 };
 
 enum
@@ -111,6 +190,7 @@ enum
   PROP_MIN_BITRATE,
   PROP_MAX_BITRATE,
   PROP_CODEC_CONFIG,
+  PROP_DIRECT_MODE,
   N_PROPERTIES
 };
 
@@ -131,6 +211,16 @@ static gboolean kms_agnostic_bin2_process_pad (KmsAgnosticBin2 * self,
 static GstBin *kms_agnostic_bin2_find_or_create_bin_for_caps (KmsAgnosticBin2 *
     self, GstCaps * caps);
 
+static void kms_agnostic_bin2_schedule_reap (KmsAgnosticBin2 * self,
+    GstClockTime delay);
+
+static void
+kms_caps_match_destroy (KmsCapsMatch * match)
+{
+  g_object_unref (match->bin);
+  g_slice_free (KmsCapsMatch, match);
+}
+
 static void
 kms_agnostic_bin2_insert_bin (KmsAgnosticBin2 * self, GstBin * bin)
 {
@@ -309,16 +399,41 @@ remove_element_on_unlinked (GstElement * element, const gchar * pad_name,
   g_object_unref (pad);
 }
 
+static KmsAgnosticBin2 *
+get_agnosticbin (GstElement * element)
+{
+  GstObject *object, *parent;
+
+  object = gst_object_ref (element);
+
+  while (object != NULL && !KMS_IS_AGNOSTIC_BIN2 (object)) {
+    parent = gst_object_get_parent (object);
+    gst_object_unref (object);
+    object = parent;
+  }
+
+  return (KmsAgnosticBin2 *) object;
+}
+
 static void
 remove_tee_pad_on_unlink (GstPad * pad, GstPad * peer, gpointer user_data)
 {
   GstElement *tee = gst_pad_get_parent_element (pad);
+  KmsAgnosticBin2 *self;
 
   if (tee == NULL) {
     return;
   }
 
   gst_element_release_request_pad (tee, pad);
+
+  /* The branch of the tee may have lost its last consumer */
+  self = get_agnosticbin (tee);
+  if (self != NULL) {
+    kms_agnostic_bin2_schedule_reap (self, 0);
+    g_object_unref (self);
+  }
+
   g_object_unref (tee);
 }
 
@@ -413,6 +528,57 @@ proxy_src_pad_query_function (GstPad * pad, GstObject * parent,
   return ret;
 }
 
+/* Adapts the raw media coming out of @queue to what the sink accepts */
+static GstPad *
+kms_agnostic_bin2_link_raw_adapter (KmsAgnosticBin2 * self,
+    GstElement * queue, GstCaps * caps)
+{
+  GstElement *adapter = kms_utils_create_video_adapter_for_caps (caps);
+  GstElement *convert, *rate, *mediator;
+
+  if (adapter != NULL) {
+    /* Drops, scales and converts frames on its own, in one pass */
+    remove_element_on_unlinked (adapter, "src", "sink");
+    gst_bin_add (GST_BIN (self), adapter);
+    gst_element_sync_state_with_parent (adapter);
+    gst_element_link (queue, adapter);
+
+    return gst_element_get_static_pad (adapter, "src");
+  }
+
+  convert = kms_utils_create_convert_for_caps (caps);
+  rate = kms_utils_create_rate_for_caps (caps);
+  mediator = kms_utils_create_mediator_element (caps);
+
+  remove_element_on_unlinked (convert, "src", "sink");
+  if (rate) {
+    remove_element_on_unlinked (rate, "src", "sink");
+  }
+  remove_element_on_unlinked (mediator, "src", "sink");
+
+  if (rate) {
+    gst_bin_add (GST_BIN (self), rate);
+  }
+
+  gst_bin_add_many (GST_BIN (self), convert, mediator, NULL);
+
+  gst_element_sync_state_with_parent (mediator);
+  gst_element_sync_state_with_parent (convert);
+  if (rate) {
+    gst_element_sync_state_with_parent (rate);
+  }
+
+  if (rate) {
+    gst_element_link_many (queue, rate, mediator, NULL);
+  } else {
+    gst_element_link (queue, mediator);
+  }
+
+  gst_element_link_many (mediator, convert, NULL);
+
+  return gst_element_get_static_pad (convert, "src");
+}
+
 static void
 kms_agnostic_bin2_link_to_tee (KmsAgnosticBin2 * self, GstPad * pad,
     GstElement * tee, GstCaps * caps)
@@ -426,40 +592,11 @@ kms_agnostic_bin2_link_to_tee (KmsAgnosticBin2 * self, GstPad * pad,
 
   if (!(gst_caps_is_any (caps) || gst_caps_is_empty (caps))
       && kms_utils_caps_is_raw (caps)) {
-    GstElement *convert = kms_utils_create_convert_for_caps (caps);
-    GstElement *rate = kms_utils_create_rate_for_caps (caps);
-    GstElement *mediator = kms_utils_create_mediator_element (caps);
-
     if (kms_utils_caps_is_video (caps)) {
       g_object_set (queue, "leaky", 2, "max-size-time", LEAKY_TIME, NULL);
     }
 
-    remove_element_on_unlinked (convert, "src", "sink");
-    if (rate) {
-      remove_element_on_unlinked (rate, "src", "sink");
-    }
-    remove_element_on_unlinked (mediator, "src", "sink");
-
-    if (rate) {
-      gst_bin_add (GST_BIN (self), rate);
-    }
-
-    gst_bin_add_many (GST_BIN (self), convert, mediator, NULL);
-
-    gst_element_sync_state_with_parent (mediator);
-    gst_element_sync_state_with_parent (convert);
-    if (rate) {
-      gst_element_sync_state_with_parent (rate);
-    }
-
-    if (rate) {
-      gst_element_link_many (queue, rate, mediator, NULL);
-    } else {
-      gst_element_link (queue, mediator);
-    }
-
-    gst_element_link_many (mediator, convert, NULL);
-    target = gst_element_get_static_pad (convert, "src");
+    target = kms_agnostic_bin2_link_raw_adapter (self, queue, caps);
   } else {
     target = gst_element_get_static_pad (queue, "src");
   }
@@ -493,17 +630,20 @@ check_bin (KmsTreeBin * tree_bin, const GstCaps * caps)
   GST_DEBUG_OBJECT (tree_bin, "TreeBin '%" GST_PTR_FORMAT "' caps: %"
       GST_PTR_FORMAT, tree_bin, current_caps);
 
-  if (current_caps != NULL) {
+  if (current_caps != NULL && gst_caps_get_size (current_caps) > 0
+      && !gst_caps_features_is_equal (gst_caps_get_features (current_caps, 0),
+          GST_CAPS_FEATURES_MEMORY_SYSTEM_MEMORY)) {
     //TODO: Remove this when problem in negotiation with features will be
     //resolved
-    GstCaps *caps_without_features = gst_caps_make_writable (current_caps);
+    current_caps = gst_caps_make_writable (current_caps);
+    gst_caps_set_features (current_caps, 0, gst_caps_features_new_empty ());
+  }
 
-    gst_caps_set_features (caps_without_features, 0,
-        gst_caps_features_new_empty ());
-    if (gst_caps_can_intersect (caps, caps_without_features)) {
+  if (current_caps != NULL) {
+    if (gst_caps_can_intersect (caps, current_caps)) {
       ret = TRUE;
     }
-    gst_caps_unref (caps_without_features);
+    gst_caps_unref (current_caps);
   }
 
   g_object_unref (tee_sink);
@@ -511,16 +651,61 @@ check_bin (KmsTreeBin * tree_bin, const GstCaps * caps)
   return ret;
 }
 
+static GstBin *
+kms_agnostic_bin2_lookup_caps_index (KmsAgnosticBin2 * self,
+    const gchar * key)
+{
+  KmsCapsMatch *match = g_hash_table_lookup (self->priv->caps_index, key);
+
+  if (match == NULL) {
+    return NULL;
+  }
+
+  if (g_hash_table_lookup (self->priv->bins,
+          GST_OBJECT_NAME (match->bin)) != match->bin
+      || kms_tree_bin_get_caps_generation (KMS_TREE_BIN (match->bin)) !=
+      match->generation) {
+    /* Removed or renegotiated after the match was found */
+    g_hash_table_remove (self->priv->caps_index, key);
+    return NULL;
+  }
+
+  return match->bin;
+}
+
+static void
+kms_agnostic_bin2_add_to_caps_index (KmsAgnosticBin2 * self, gchar * key,
+    GstBin * bin)
+{
+  KmsCapsMatch *match = g_slice_new (KmsCapsMatch);
+
+  match->bin = g_object_ref (bin);
+  match->generation = kms_tree_bin_get_caps_generation (KMS_TREE_BIN (bin));
+
+  g_hash_table_insert (self->priv->caps_index, key, match);
+}
+
 static GstBin *
 kms_agnostic_bin2_find_bin_for_caps (KmsAgnosticBin2 * self, GstCaps * caps)
 {
   GList *bins, *l;
   GstBin *bin = NULL;
+  gchar *key;
 
   if (gst_caps_is_any (caps) || gst_caps_is_empty (caps)) {
     return self->priv->input_bin;
   }
 
+  /* Sinks of the same kind ask for the very same caps, so the result of */
+  /* the scan is kept until the bin goes away or gets new caps           */
+  key = gst_caps_to_string (caps);
+  bin = kms_agnostic_bin2_lookup_caps_index (self, key);
+
+  if (bin != NULL) {
+    g_free (key);
+    return bin;
+  }
+
   if (check_bin (KMS_TREE_BIN (self->priv->input_bin), caps)) {
     bin = self->priv->input_bin;
   }
@@ -540,6 +725,12 @@ kms_agnostic_bin2_find_bin_for_caps (KmsAgnosticBin2 * self, GstCaps * caps)
   }
   g_list_free (bins);
 
+  if (bin != NULL) {
+    kms_agnostic_bin2_add_to_caps_index (self, key, bin);
+  } else {
+    g_free (key);
+  }
+
   return bin;
 }
 
@@ -569,11 +760,17 @@ kms_agnostic_bin2_create_dec_bin (KmsAgnosticBin2 * self,
     return NULL;
   }
 
-  dec_bin = kms_dec_tree_bin_new (caps, raw_caps);
+  dec_bin = kms_tree_bin_pool_get_decoder (caps, raw_caps);
+  if (dec_bin == NULL) {
+    dec_bin = kms_dec_tree_bin_new (caps, raw_caps);
+  }
   if (dec_bin == NULL) {
     return NULL;
   }
 
+  kms_transcoding_manager_add_branch (GST_ELEMENT (self),
+      GST_ELEMENT (dec_bin), KMS_TRANSCODING_BRANCH_DECODER, raw_caps, 0);
+
   gst_bin_add (GST_BIN (self), GST_ELEMENT (dec_bin));
   gst_element_sync_state_with_parent (GST_ELEMENT (dec_bin));
 
@@ -630,127 +827,898 @@ kms_agnostic_bin2_create_rtp_pay_bin (KmsAgnosticBin2 * self, GstCaps * caps)
   GstCaps *input_caps;
   GstPad *sink;
 
-  bin = kms_rtp_pay_tree_bin_new (caps);
+  bin = kms_rtp_pay_tree_bin_new (caps);
+
+  if (bin == NULL) {
+    return NULL;
+  }
+
+  gst_bin_add (GST_BIN (self), GST_ELEMENT (bin));
+  gst_element_sync_state_with_parent (GST_ELEMENT (bin));
+
+  input_element = kms_tree_bin_get_input_element (KMS_TREE_BIN (bin));
+  sink = gst_element_get_static_pad (input_element, "sink");
+  input_caps = gst_pad_query_caps (sink, NULL);
+  g_object_unref (sink);
+
+  enc_bin = kms_agnostic_bin2_find_or_create_bin_for_caps (self, input_caps);
+  kms_agnostic_bin2_insert_bin (self, GST_BIN (bin));
+  gst_caps_unref (input_caps);
+
+  output_tee = kms_tree_bin_get_output_tee (KMS_TREE_BIN (enc_bin));
+  gst_element_link (output_tee, input_element);
+
+  return GST_BIN (bin);
+}
+
+static GstBin *
+kms_agnostic_bin2_create_bin_for_caps (KmsAgnosticBin2 * self, GstCaps * caps)
+{
+  GstBin *dec_bin;
+  KmsEncTreeBin *enc_bin;
+  GstElement *input_element, *output_tee;
+
+  if (kms_utils_caps_is_rtp (caps)) {
+    return kms_agnostic_bin2_create_rtp_pay_bin (self, caps);
+  }
+
+  dec_bin = kms_agnostic_bin2_get_or_create_dec_bin (self, caps);
+  if (dec_bin == NULL) {
+    return NULL;
+  }
+
+  if (kms_utils_caps_is_raw (caps)) {
+    return dec_bin;
+  }
+
+  enc_bin = kms_tree_bin_pool_get_encoder (caps, TARGET_BITRATE_DEFAULT,
+      self->priv->min_bitrate, self->priv->max_bitrate,
+      self->priv->codec_config);
+  if (enc_bin == NULL) {
+    enc_bin =
+        kms_enc_tree_bin_new (caps, TARGET_BITRATE_DEFAULT,
+        self->priv->min_bitrate, self->priv->max_bitrate,
+        self->priv->codec_config);
+  }
+  if (enc_bin == NULL) {
+    return NULL;
+  }
+
+  kms_transcoding_manager_add_branch (GST_ELEMENT (self),
+      GST_ELEMENT (enc_bin), KMS_TRANSCODING_BRANCH_ENCODER, caps,
+      self->priv->max_bitrate);
+
+  gst_bin_add (GST_BIN (self), GST_ELEMENT (enc_bin));
+  gst_element_sync_state_with_parent (GST_ELEMENT (enc_bin));
+
+  output_tee = kms_tree_bin_get_output_tee (KMS_TREE_BIN (dec_bin));
+  input_element = kms_tree_bin_get_input_element (KMS_TREE_BIN (enc_bin));
+  gst_element_link (output_tee, input_element);
+
+  kms_agnostic_bin2_insert_bin (self, GST_BIN (enc_bin));
+
+  return GST_BIN (enc_bin);
+}
+
+static void
+kms_agnostic_bin2_notify_transcoding (KmsAgnosticBin2 * self,
+    GstCaps * caps, gboolean transcoding)
+{
+  KmsMediaType type;
+  const gchar *media_type;
+  const gchar *state = transcoding ? "ACTIVE" : "INACTIVE";
+
+  if (kms_utils_caps_is_audio (caps)) {
+    type = KMS_MEDIA_TYPE_AUDIO;
+    media_type = "audio";
+  } else {
+    type = KMS_MEDIA_TYPE_VIDEO;
+    media_type = "video";
+  }
+
+  /* Once stopped, only a new transcoding is worth an event */
+  if (!self->priv->transcoding_emitted
+      && !(self->priv->transcoding_stopped && !transcoding)) {
+    self->priv->transcoding_emitted = TRUE;
+    self->priv->transcoding_active = transcoding;
+    self->priv->transcoding_stopped = FALSE;
+    g_signal_emit (GST_BIN (self),
+        kms_agnostic_bin2_signals[SIGNAL_MEDIA_TRANSCODING], 0, transcoding,
+        type);
+    GST_INFO_OBJECT (self, "TRANSCODING %s for %s", state, media_type);
+  } else {
+    GST_DEBUG_OBJECT (self, "Suppressed - TRANSCODING %s for %s", state,
+        media_type);
+  }
+}
+
+/* Called when the last decoder or encoder is released */
+static void
+kms_agnostic_bin2_notify_transcoding_stopped (KmsAgnosticBin2 * self)
+{
+  if (!self->priv->transcoding_active
+      || self->priv->input_bin_src_caps == NULL) {
+    return;
+  }
+
+  self->priv->transcoding_emitted = FALSE;
+  kms_agnostic_bin2_notify_transcoding (self, self->priv->input_bin_src_caps,
+      FALSE);
+  self->priv->transcoding_emitted = FALSE;
+  self->priv->transcoding_stopped = TRUE;
+}
+
+static GstBin *
+kms_agnostic_bin2_find_or_create_bin_for_caps (KmsAgnosticBin2 * self,
+    GstCaps * caps)
+{
+  GstBin *bin;
+
+  GST_DEBUG_OBJECT (self, "Find TreeBin with wanted caps: %" GST_PTR_FORMAT, caps);
+
+  bin = kms_agnostic_bin2_find_bin_for_caps (self, caps);
+
+  if (bin == NULL) {
+    GST_DEBUG_OBJECT (self, "TreeBin not found! Transcoding required");
+
+    bin = kms_agnostic_bin2_create_bin_for_caps (self, caps);
+    GST_LOG_OBJECT (self, "Created TreeBin: %" GST_PTR_FORMAT, bin);
+
+    kms_agnostic_bin2_notify_transcoding (self, caps, TRUE);
+  } else {
+    GST_DEBUG_OBJECT (self, "TreeBin found! Use it");
+
+    kms_agnostic_bin2_notify_transcoding (self, caps, FALSE);
+  }
+
+  return bin;
+}
+
+static KmsRendition *
+kms_rendition_new (gint height, gint bitrate)
+{
+  KmsRendition *rendition = g_slice_new0 (KmsRendition);
+
+  rendition->height = height;
+  rendition->bitrate = bitrate;
+
+  return rendition;
+}
+
+static void
+kms_rendition_free (KmsRendition * rendition)
+{
+  g_slice_free (KmsRendition, rendition);
+}
+
+static gint
+kms_rendition_compare (gconstpointer a, gconstpointer b)
+{
+  const KmsRendition *ra = *(KmsRendition **) a;
+  const KmsRendition *rb = *(KmsRendition **) b;
+
+  return rb->height - ra->height;
+}
+
+static gint
+kms_rendition_default_bitrate (gint height)
+{
+  gint64 width = (gint64) height * 16 / 9;
+
+  return (gint) MIN (width * height * RENDITION_FRAMERATE *
+      RENDITION_BITS_PER_PIXEL_PERCENT / 100, G_MAXINT);
+}
+
+/* Returns the renditions in @description, biggest first */
+static GPtrArray *
+kms_rendition_ladder_parse (const gchar * description)
+{
+  GPtrArray *renditions;
+  gchar **steps;
+  guint i;
+
+  renditions =
+      g_ptr_array_new_with_free_func ((GDestroyNotify) kms_rendition_free);
+  steps = g_strsplit (description, "/", -1);
+
+  for (i = 0; steps[i] != NULL; i++) {
+    gchar *step = g_strstrip (steps[i]);
+    gint64 height, bitrate = 0;
+    gchar *end;
+
+    height = g_ascii_strtoll (step, &end, 10);
+
+    if (height <= 0 || height > G_MAXINT || (*end != 'p' && *end != 'P')) {
+      GST_WARNING ("Invalid rendition '%s' in ladder '%s'", step, description);
+      continue;
+    }
+
+    end++;
+
+    if (*end == '@') {
+      bitrate = g_ascii_strtoll (end + 1, &end, 10);
+    }
+
+    if (*end != '\0' || bitrate < 0 || bitrate > G_MAXINT) {
+      GST_WARNING ("Invalid rendition '%s' in ladder '%s'", step, description);
+      continue;
+    }
+
+    if (bitrate == 0) {
+      bitrate = kms_rendition_default_bitrate (height);
+    }
+
+    g_ptr_array_add (renditions, kms_rendition_new (height, bitrate));
+  }
+
+  g_strfreev (steps);
+
+  g_ptr_array_sort (renditions, kms_rendition_compare);
+
+  return renditions;
+}
+
+static void
+kms_rendition_ladder_destroy (KmsRenditionLadder * ladder)
+{
+  g_ptr_array_unref (ladder->renditions);
+  gst_caps_unref (ladder->caps);
+  g_slice_free (KmsRenditionLadder, ladder);
+}
+
+static void
+kms_rendition_pad_data_destroy (KmsRenditionPadData * data)
+{
+  kms_utils_remb_event_manager_destroy (data->remb_manager);
+  g_free (data->ladder_key);
+  g_slice_free (KmsRenditionPadData, data);
+}
+
+static gboolean
+kms_agnostic_bin2_create_rendition (KmsAgnosticBin2 * self,
+    KmsRendition * rendition, GstElement * source, GstCaps * caps)
+{
+  KmsEncTreeBin *enc_bin;
+  GstCaps *filter_caps;
+  gint bitrate = MIN (rendition->bitrate, self->priv->max_bitrate);
+
+  /* Renditions are selected by bandwidth, their encoders keep a fixed */
+  /* bitrate instead of following the REMB of the sinks                */
+  enc_bin = kms_tree_bin_pool_get_encoder (caps, bitrate, bitrate, bitrate,
+      self->priv->codec_config);
+  if (enc_bin == NULL) {
+    enc_bin = kms_enc_tree_bin_new (caps, bitrate, bitrate, bitrate,
+        self->priv->codec_config);
+  }
+  if (enc_bin == NULL) {
+    return FALSE;
+  }
+
+  rendition->enc_bin = GST_BIN (enc_bin);
+  rendition->queue = kms_utils_element_factory_make ("queue", "agnosticbin_");
+  rendition->scale = gst_element_factory_make ("videoscale", NULL);
+  rendition->filter =
+      kms_utils_element_factory_make ("capsfilter", "agnosticbin_");
+  rendition->tee = kms_utils_element_factory_make ("tee", "agnosticbin_");
+
+  g_object_set (rendition->queue, "leaky", 2, "max-size-time", LEAKY_TIME,
+      NULL);
+
+  /* Smaller inputs are not upscaled */
+  filter_caps = gst_caps_new_simple ("video/x-raw", "height", GST_TYPE_INT_RANGE,
+      1, rendition->height, NULL);
+  g_object_set (rendition->filter, "caps", filter_caps, NULL);
+  gst_caps_unref (filter_caps);
+
+  kms_transcoding_manager_add_branch (GST_ELEMENT (self),
+      GST_ELEMENT (enc_bin), KMS_TRANSCODING_BRANCH_ENCODER, caps, bitrate);
+
+  gst_bin_add_many (GST_BIN (self), rendition->queue, rendition->scale,
+      rendition->filter, rendition->tee, GST_ELEMENT (enc_bin), NULL);
+  gst_element_sync_state_with_parent (GST_ELEMENT (enc_bin));
+  gst_element_sync_state_with_parent (rendition->tee);
+  gst_element_sync_state_with_parent (rendition->filter);
+  gst_element_sync_state_with_parent (rendition->scale);
+  gst_element_sync_state_with_parent (rendition->queue);
+
+  gst_element_link_many (rendition->queue, rendition->scale, rendition->filter,
+      rendition->tee, NULL);
+  gst_element_link (rendition->tee,
+      kms_tree_bin_get_input_element (KMS_TREE_BIN (enc_bin)));
+  gst_element_link (source, rendition->queue);
+
+  GST_DEBUG_OBJECT (self, "Created %dp rendition at %d bps", rendition->height,
+      bitrate);
+
+  return TRUE;
+}
+
+static void
+kms_agnostic_bin2_remove_rendition (KmsAgnosticBin2 * self,
+    KmsRendition * rendition)
+{
+  GstElement *elements[] = { rendition->queue, rendition->scale,
+    rendition->filter, rendition->tee, GST_ELEMENT (rendition->enc_bin)
+  };
+  guint i;
+
+  for (i = 0; i < G_N_ELEMENTS (elements); i++) {
+    if (elements[i] != NULL) {
+      kms_utils_bin_remove (GST_BIN (self), elements[i]);
+    }
+  }
+}
+
+static void
+remove_ladder (gpointer key, gpointer value, gpointer agnosticbin)
+{
+  KmsRenditionLadder *ladder = value;
+  guint i;
+
+  for (i = 0; i < ladder->renditions->len; i++) {
+    kms_agnostic_bin2_remove_rendition (agnosticbin,
+        g_ptr_array_index (ladder->renditions, i));
+  }
+}
+
+/*
+ * One decoded stream feeds a cascade of scalers, each rendition scaling the
+ * previous one, with an encoder per rendition shared by all the sinks
+ * attached to it.
+ */
+static KmsRenditionLadder *
+kms_agnostic_bin2_get_or_create_ladder (KmsAgnosticBin2 * self,
+    GstCaps * caps, const gchar * key, const gchar * description)
+{
+  KmsRenditionLadder *ladder;
+  GstBin *dec_bin;
+  GstElement *source;
+  GPtrArray *renditions;
+  guint i;
+
+  ladder = g_hash_table_lookup (self->priv->ladders, key);
+  if (ladder != NULL) {
+    return ladder;
+  }
+
+  renditions = kms_rendition_ladder_parse (description);
+  if (renditions->len == 0) {
+    g_ptr_array_unref (renditions);
+    return NULL;
+  }
+
+  dec_bin = kms_agnostic_bin2_get_or_create_dec_bin (self, caps);
+  if (dec_bin == NULL) {
+    g_ptr_array_unref (renditions);
+    return NULL;
+  }
+
+  ladder = g_slice_new0 (KmsRenditionLadder);
+  ladder->renditions = renditions;
+  ladder->caps = gst_caps_ref (caps);
+
+  source = kms_tree_bin_get_output_tee (KMS_TREE_BIN (dec_bin));
+
+  for (i = 0; i < renditions->len; i++) {
+    KmsRendition *rendition = g_ptr_array_index (renditions, i);
+
+    if (!kms_agnostic_bin2_create_rendition (self, rendition, source, caps)) {
+      GST_WARNING_OBJECT (self, "Cannot create rendition ladder for %"
+          GST_PTR_FORMAT, caps);
+      remove_ladder (NULL, ladder, self);
+      kms_rendition_ladder_destroy (ladder);
+      return NULL;
+    }
+
+    source = rendition->tee;
+  }
+
+  g_hash_table_insert (self->priv->ladders, g_strdup (key), ladder);
+
+  return ladder;
+}
+
+/*
+ * Biggest rendition whose bitrate fits in @bandwidth, asking for some margin
+ * to move up so that sinks near a threshold do not keep switching.
+ */
+static guint
+kms_rendition_ladder_select (KmsRenditionLadder * ladder, guint bandwidth,
+    guint current)
+{
+  guint i;
+
+  if (bandwidth == 0) {
+    /* No estimation yet */
+    return current;
+  }
+
+  for (i = 0; i < ladder->renditions->len; i++) {
+    KmsRendition *rendition = g_ptr_array_index (ladder->renditions, i);
+    guint64 needed = rendition->bitrate;
+
+    if (i < current) {
+      needed = needed * (100 + RENDITION_UP_MARGIN_PERCENT) / 100;
+    }
+
+    if (bandwidth >= needed) {
+      return i;
+    }
+  }
+
+  return ladder->renditions->len - 1;
+}
+
+static void
+kms_agnostic_bin2_link_to_rendition (KmsAgnosticBin2 * self, GstPad * pad,
+    KmsRenditionLadder * ladder, guint index)
+{
+  KmsRendition *rendition = g_ptr_array_index (ladder->renditions, index);
+  GstElement *tee =
+      kms_tree_bin_get_output_tee (KMS_TREE_BIN (rendition->enc_bin));
+
+  GST_DEBUG_OBJECT (pad, "Attaching to %dp rendition", rendition->height);
+
+  /* Sinks only change of rendition on keyframes */
+  kms_utils_drop_until_keyframe (pad, TRUE);
+  kms_agnostic_bin2_link_to_tee (self, pad, tee, ladder->caps);
+}
+
+static void
+rendition_bitrate_cb (RembEventManager * manager, guint bitrate,
+    gpointer user_data)
+{
+  GstPad *pad = user_data;
+  GstElement *parent = gst_pad_get_parent_element (pad);
+
+  if (parent == NULL) {
+    return;
+  }
+
+  /* Switching needs the agnosticbin lock, not to be taken from here */
+  g_thread_pool_push (KMS_AGNOSTIC_BIN2 (parent)->priv->rendition_pool,
+      g_object_ref (pad), NULL);
+
+  g_object_unref (parent);
+}
+
+static void
+kms_agnostic_bin2_switch_rendition (gpointer data, gpointer not_used)
+{
+  GstPad *pad = data;
+  KmsAgnosticBin2 *self;
+  KmsRenditionPadData *pad_data;
+  KmsRenditionLadder *ladder;
+  guint bandwidth, index;
+
+  self = (KmsAgnosticBin2 *) gst_pad_get_parent_element (pad);
+  if (self == NULL) {
+    goto end;
+  }
+
+  KMS_AGNOSTIC_BIN2_LOCK (self);
+
+  pad_data = g_object_get_qdata (G_OBJECT (pad), rendition_data_quark ());
+  if (pad_data == NULL || !gst_pad_is_linked (pad)) {
+    goto unlock;
+  }
+
+  ladder = g_hash_table_lookup (self->priv->ladders, pad_data->ladder_key);
+  if (ladder == NULL) {
+    goto unlock;
+  }
+
+  bandwidth = kms_utils_remb_event_manager_get_min (pad_data->remb_manager);
+  index = kms_rendition_ladder_select (ladder, bandwidth, pad_data->index);
+
+  if (index != pad_data->index) {
+    GST_DEBUG_OBJECT (pad, "Bandwidth %u bps, moving from rendition %u to %u",
+        bandwidth, pad_data->index, index);
+    pad_data->index = index;
+    remove_target_pad (pad);
+    kms_agnostic_bin2_link_to_rendition (self, pad, ladder, index);
+  }
+
+unlock:
+  KMS_AGNOSTIC_BIN2_UNLOCK (self);
+  g_object_unref (self);
+
+end:
+  g_object_unref (pad);
+}
+
+static void
+kms_agnostic_bin2_clear_rendition_data (GstPad * pad)
+{
+  /* The REMB manager keeps a reference to the pad */
+  g_object_set_qdata (G_OBJECT (pad), rendition_data_quark (), NULL);
+}
+
+/* Microseconds, negative if idle branches are never released */
+static gint64
+kms_agnostic_bin2_get_idle_timeout (KmsAgnosticBin2 * self)
+{
+  const gchar *value = NULL;
+  gint64 timeout;
+  gchar *end;
+
+  if (self->priv->codec_config != NULL) {
+    value = gst_structure_get_string (self->priv->codec_config,
+        TRANSCODING_IDLE_TIMEOUT);
+  }
+
+  if (value == NULL) {
+    return TRANSCODING_IDLE_TIMEOUT_DEFAULT * G_TIME_SPAN_MILLISECOND;
+  }
+
+  timeout = g_ascii_strtoll (value, &end, 10);
+
+  if (end == value || *end != '\0') {
+    GST_WARNING_OBJECT (self, "Invalid transcoding idle timeout '%s'", value);
+    return TRANSCODING_IDLE_TIMEOUT_DEFAULT * G_TIME_SPAN_MILLISECOND;
+  }
+
+  if (timeout < 0) {
+    return -1;
+  }
+
+  return MIN (timeout, G_MAXINT) * G_TIME_SPAN_MILLISECOND;
+}
+
+/*
+ * Whether a branch has been without consumers for @timeout. @idle_since
+ * keeps when it lost them and @next is lowered to the time left otherwise.
+ */
+static gboolean
+idle_expired (gint64 * idle_since, guint consumers, gint64 now,
+    gint64 timeout, gint64 * next)
+{
+  gint64 left;
+
+  if (consumers > 0) {
+    *idle_since = 0;
+    return FALSE;
+  }
+
+  if (*idle_since == 0) {
+    *idle_since = now;
+  }
+
+  left = *idle_since + timeout - now;
+
+  if (left <= 0) {
+    return TRUE;
+  }
+
+  if (*next < 0 || left < *next) {
+    *next = left;
+  }
+
+  return FALSE;
+}
+
+static gint64 *
+get_bin_idle_since (GstBin * bin)
+{
+  gint64 *idle_since;
+
+  idle_since = g_object_get_qdata (G_OBJECT (bin), idle_since_quark ());
+
+  if (idle_since == NULL) {
+    idle_since = g_new0 (gint64, 1);
+    g_object_set_qdata_full (G_OBJECT (bin), idle_since_quark (), idle_since,
+        g_free);
+  }
+
+  return idle_since;
+}
+
+static guint
+kms_rendition_ladder_get_consumers (KmsRenditionLadder * ladder)
+{
+  guint i, consumers = 0;
+
+  for (i = 0; i < ladder->renditions->len; i++) {
+    KmsRendition *rendition = g_ptr_array_index (ladder->renditions, i);
+
+    consumers +=
+        kms_tree_bin_get_consumers (KMS_TREE_BIN (rendition->enc_bin));
+  }
+
+  return consumers;
+}
+
+/*
+ * Releases the tee pad feeding @element, along with the ghost pads created
+ * to link them across bins.
+ */
+static void
+release_feeding_tee_pad (GstElement * element)
+{
+  GstIterator *it = gst_element_iterate_sink_pads (element);
+  GValue item = G_VALUE_INIT;
+  GstPad *upstream = NULL;
+  GstElement *parent;
+
+  if (gst_iterator_next (it, &item) == GST_ITERATOR_OK) {
+    GstPad *sink = g_value_get_object (&item);
+
+    upstream = gst_pad_get_peer (sink);
+    if (upstream != NULL) {
+      gst_pad_unlink (upstream, sink);
+    }
+    g_value_unset (&item);
+  }
+  gst_iterator_free (it);
+
+  while (upstream != NULL && GST_IS_GHOST_PAD (upstream)) {
+    GstPad *target = gst_ghost_pad_get_target (GST_GHOST_PAD (upstream));
+
+    parent = gst_pad_get_parent_element (upstream);
+    if (parent != NULL) {
+      gst_element_remove_pad (parent, upstream);
+      g_object_unref (parent);
+    }
+
+    g_object_unref (upstream);
+    upstream = target;
+  }
+
+  if (upstream == NULL) {
+    return;
+  }
+
+  parent = gst_pad_get_parent_element (upstream);
+  if (parent != NULL) {
+    gst_element_release_request_pad (parent, upstream);
+    g_object_unref (parent);
+  }
+
+  g_object_unref (upstream);
+}
+
+static gboolean
+caps_match_is_bin (gpointer key, gpointer value, gpointer bin)
+{
+  return ((KmsCapsMatch *) value)->bin == bin;
+}
+
+static gboolean
+kms_agnostic_bin2_is_transcoding (KmsAgnosticBin2 * self)
+{
+  GHashTableIter iter;
+  gpointer bin;
+
+  if (g_hash_table_size (self->priv->ladders) > 0) {
+    return TRUE;
+  }
+
+  g_hash_table_iter_init (&iter, self->priv->bins);
+  while (g_hash_table_iter_next (&iter, NULL, &bin)) {
+    if (KMS_IS_DEC_TREE_BIN (bin) || KMS_IS_ENC_TREE_BIN (bin)) {
+      return TRUE;
+    }
+  }
+
+  return FALSE;
+}
+
+/* Returns TRUE if any ladder or tree bin was released */
+static gboolean
+kms_agnostic_bin2_release_idle (KmsAgnosticBin2 * self, gint64 now,
+    gint64 timeout, gint64 * next)
+{
+  GHashTableIter iter;
+  gpointer value;
+  gboolean released = FALSE;
+
+  g_hash_table_iter_init (&iter, self->priv->ladders);
+  while (g_hash_table_iter_next (&iter, NULL, &value)) {
+    KmsRenditionLadder *ladder = value;
+    KmsRendition *first = g_ptr_array_index (ladder->renditions, 0);
+
+    if (!idle_expired (&ladder->idle_since,
+            kms_rendition_ladder_get_consumers (ladder), now, timeout, next)) {
+      continue;
+    }
+
+    GST_DEBUG_OBJECT (self, "Releasing idle rendition ladder for %"
+        GST_PTR_FORMAT, ladder->caps);
+    release_feeding_tee_pad (first->queue);
+    remove_ladder (NULL, ladder, self);
+    g_hash_table_iter_remove (&iter);
+    released = TRUE;
+  }
+
+  g_hash_table_iter_init (&iter, self->priv->bins);
+  while (g_hash_table_iter_next (&iter, NULL, &value)) {
+    GstBin *bin = value;
+
+    if (bin == self->priv->input_bin) {
+      continue;
+    }
+
+    if (!idle_expired (get_bin_idle_since (bin),
+            kms_tree_bin_get_consumers (KMS_TREE_BIN (bin)), now, timeout,
+            next)) {
+      continue;
+    }
+
+    GST_DEBUG_OBJECT (self, "Releasing idle %" GST_PTR_FORMAT, bin);
+    release_feeding_tee_pad (GST_ELEMENT (bin));
+    g_hash_table_foreach_remove (self->priv->caps_index, caps_match_is_bin,
+        bin);
+    kms_utils_bin_remove (GST_BIN (self), GST_ELEMENT (bin));
+    g_hash_table_iter_remove (&iter);
+    released = TRUE;
+  }
+
+  return released;
+}
+
+/*
+ * Branches nobody consumes are released after a grace period, so that sinks
+ * reconnecting right away find them. Releasing an encoder may leave its
+ * decoder idle, that is released later in turn.
+ */
+static void
+kms_agnostic_bin2_reap_idle_bins (gpointer data, gpointer not_used)
+{
+  KmsAgnosticBin2 *self = data;
+  gint64 timeout, next = -1;
+  gboolean released = FALSE;
+
+  KMS_AGNOSTIC_BIN2_LOCK (self);
+
+  timeout = kms_agnostic_bin2_get_idle_timeout (self);
+
+  if (timeout >= 0) {
+    while (kms_agnostic_bin2_release_idle (self, g_get_monotonic_time (),
+            timeout, &next)) {
+      released = TRUE;
+    }
+  }
+
+  if (released && !kms_agnostic_bin2_is_transcoding (self)) {
+    kms_agnostic_bin2_notify_transcoding_stopped (self);
+  }
+
+  if (next >= 0) {
+    kms_agnostic_bin2_schedule_reap (self, next * GST_USECOND);
+  }
+
+  KMS_AGNOSTIC_BIN2_UNLOCK (self);
+
+  g_object_unref (self);
+}
+
+static void
+weak_ref_free (GWeakRef * ref)
+{
+  g_weak_ref_clear (ref);
+  g_slice_free (GWeakRef, ref);
+}
+
+static gboolean
+reap_timeout_cb (GstClock * clock, GstClockTime time, GstClockID id,
+    gpointer ref)
+{
+  KmsAgnosticBin2 *self = g_weak_ref_get (ref);
 
-  if (bin == NULL) {
-    return NULL;
+  if (self == NULL) {
+    return TRUE;
   }
 
-  gst_bin_add (GST_BIN (self), GST_ELEMENT (bin));
-  gst_element_sync_state_with_parent (GST_ELEMENT (bin));
-
-  input_element = kms_tree_bin_get_input_element (KMS_TREE_BIN (bin));
-  sink = gst_element_get_static_pad (input_element, "sink");
-  input_caps = gst_pad_query_caps (sink, NULL);
-  g_object_unref (sink);
+  GST_OBJECT_LOCK (self);
+  if (self->priv->reap_id == id) {
+    gst_clock_id_unref (self->priv->reap_id);
+    self->priv->reap_id = NULL;
 
-  enc_bin = kms_agnostic_bin2_find_or_create_bin_for_caps (self, input_caps);
-  kms_agnostic_bin2_insert_bin (self, GST_BIN (bin));
-  gst_caps_unref (input_caps);
+    /* Tree bins are not to be removed from the clock thread */
+    g_thread_pool_push (self->priv->reap_pool, g_object_ref (self), NULL);
+  }
+  GST_OBJECT_UNLOCK (self);
 
-  output_tee = kms_tree_bin_get_output_tee (KMS_TREE_BIN (enc_bin));
-  gst_element_link (output_tee, input_element);
+  g_object_unref (self);
 
-  return GST_BIN (bin);
+  return TRUE;
 }
 
-static GstBin *
-kms_agnostic_bin2_create_bin_for_caps (KmsAgnosticBin2 * self, GstCaps * caps)
+static void
+kms_agnostic_bin2_schedule_reap (KmsAgnosticBin2 * self, GstClockTime delay)
 {
-  GstBin *dec_bin;
-  KmsEncTreeBin *enc_bin;
-  GstElement *input_element, *output_tee;
+  GstClock *clock = gst_system_clock_obtain ();
+  GstClockTime time = gst_clock_get_time (clock) + delay;
+  GWeakRef *ref;
 
-  if (kms_utils_caps_is_rtp (caps)) {
-    return kms_agnostic_bin2_create_rtp_pay_bin (self, caps);
-  }
+  GST_OBJECT_LOCK (self);
 
-  dec_bin = kms_agnostic_bin2_get_or_create_dec_bin (self, caps);
-  if (dec_bin == NULL) {
-    return NULL;
+  if (self->priv->reap_pool == NULL) {
+    /* Disposed */
+    goto end;
   }
 
-  if (kms_utils_caps_is_raw (caps)) {
-    return dec_bin;
-  }
+  if (self->priv->reap_id != NULL) {
+    if (self->priv->reap_time <= time) {
+      goto end;
+    }
 
-  enc_bin =
-      kms_enc_tree_bin_new (caps, TARGET_BITRATE_DEFAULT,
-      self->priv->min_bitrate, self->priv->max_bitrate,
-      self->priv->codec_config);
-  if (enc_bin == NULL) {
-    return NULL;
+    gst_clock_id_unschedule (self->priv->reap_id);
+    gst_clock_id_unref (self->priv->reap_id);
   }
 
-  gst_bin_add (GST_BIN (self), GST_ELEMENT (enc_bin));
-  gst_element_sync_state_with_parent (GST_ELEMENT (enc_bin));
-
-  output_tee = kms_tree_bin_get_output_tee (KMS_TREE_BIN (dec_bin));
-  input_element = kms_tree_bin_get_input_element (KMS_TREE_BIN (enc_bin));
-  gst_element_link (output_tee, input_element);
+  ref = g_slice_new (GWeakRef);
+  g_weak_ref_init (ref, self);
 
-  kms_agnostic_bin2_insert_bin (self, GST_BIN (enc_bin));
+  self->priv->reap_time = time;
+  self->priv->reap_id = gst_clock_new_single_shot_id (clock, time);
+  gst_clock_id_wait_async (self->priv->reap_id, reap_timeout_cb, ref,
+      (GDestroyNotify) weak_ref_free);
 
-  return GST_BIN (enc_bin);
+end:
+  GST_OBJECT_UNLOCK (self);
+  gst_object_unref (clock);
 }
 
-static GstBin *
-kms_agnostic_bin2_find_or_create_bin_for_caps (KmsAgnosticBin2 * self,
+/* Returns FALSE if the pad is not to be fed by a rendition ladder */
+static gboolean
+kms_agnostic_bin2_link_to_ladder (KmsAgnosticBin2 * self, GstPad * pad,
     GstCaps * caps)
 {
-  GstBin *bin;
-  KmsMediaType type;
-  gchar* media_type = NULL;
+  KmsRenditionPadData *pad_data;
+  KmsRenditionLadder *ladder;
+  const gchar *description;
+  gchar *key;
 
-  if (kms_utils_caps_is_audio (caps)) {
-    type = KMS_MEDIA_TYPE_AUDIO;
-    media_type = g_strdup ("audio");
-  }
-  else {
-    type = KMS_MEDIA_TYPE_VIDEO;
-    media_type = g_strdup ("video");
+  if (self->priv->codec_config == NULL) {
+    return FALSE;
   }
 
-  GST_DEBUG_OBJECT (self, "Find TreeBin with wanted caps: %" GST_PTR_FORMAT, caps);
+  description = gst_structure_get_string (self->priv->codec_config,
+      RENDITION_LADDER);
 
-  bin = kms_agnostic_bin2_find_bin_for_caps (self, caps);
+  if (description == NULL || gst_caps_is_any (caps) || gst_caps_is_empty (caps)
+      || !kms_utils_caps_is_video (caps) || kms_utils_caps_is_raw (caps)
+      || kms_utils_caps_is_rtp (caps)) {
+    return FALSE;
+  }
 
-  if (bin == NULL) {
-    GST_DEBUG_OBJECT (self, "TreeBin not found! Transcoding required for %s",
-        media_type);
+  if (kms_agnostic_bin2_find_bin_for_caps (self, caps) != NULL) {
+    /* No transcoding needed */
+    return FALSE;
+  }
 
-    bin = kms_agnostic_bin2_create_bin_for_caps (self, caps);
-    GST_LOG_OBJECT (self, "Created TreeBin: %" GST_PTR_FORMAT, bin);
+  key = gst_caps_to_string (caps);
+  ladder = kms_agnostic_bin2_get_or_create_ladder (self, caps, key,
+      description);
 
-    if (!self->priv->transcoding_emitted) {
-      self->priv->transcoding_emitted = TRUE;
-      g_signal_emit (GST_BIN (self),
-          kms_agnostic_bin2_signals[SIGNAL_MEDIA_TRANSCODING], 0, TRUE, type);
-      GST_INFO_OBJECT (self, "TRANSCODING ACTIVE for %s", media_type);
-    }
-    else {
-      GST_DEBUG_OBJECT (self, "Suppressed - TRANSCODING ACTIVE for %s",
-          media_type);
-    }
+  if (ladder == NULL) {
+    g_free (key);
+    return FALSE;
   }
-  else {
-    GST_DEBUG_OBJECT (self, "TreeBin found! Use it for %s", media_type);
 
-    if (!self->priv->transcoding_emitted) {
-      self->priv->transcoding_emitted = TRUE;
-      g_signal_emit (GST_BIN (self),
-          kms_agnostic_bin2_signals[SIGNAL_MEDIA_TRANSCODING], 0, FALSE, type);
-      GST_INFO_OBJECT (self, "TRANSCODING INACTIVE for %s", media_type);
-    }
-    else {
-      GST_DEBUG_OBJECT (self, "Suppressed - TRANSCODING INACTIVE for %s",
-          media_type);
-    }
+  pad_data = g_object_get_qdata (G_OBJECT (pad), rendition_data_quark ());
+
+  if (pad_data == NULL) {
+    pad_data = g_slice_new0 (KmsRenditionPadData);
+    /* Start with the smallest rendition until there is an estimation */
+    pad_data->index = ladder->renditions->len - 1;
+    pad_data->remb_manager = kms_utils_remb_event_manager_create (pad);
+    kms_utils_remb_event_manager_set_callback (pad_data->remb_manager,
+        rendition_bitrate_cb, pad, NULL);
+    g_object_set_qdata_full (G_OBJECT (pad), rendition_data_quark (),
+        pad_data, (GDestroyNotify) kms_rendition_pad_data_destroy);
+  } else {
+    pad_data->index = MIN (pad_data->index, ladder->renditions->len - 1);
   }
 
-  g_free (media_type);
+  g_free (pad_data->ladder_key);
+  pad_data->ladder_key = key;
 
-  return bin;
+  kms_agnostic_bin2_notify_transcoding (self, caps, TRUE);
+  kms_agnostic_bin2_link_to_rendition (self, pad, ladder, pad_data->index);
+
+  return TRUE;
 }
 
 /**
@@ -782,6 +1750,12 @@ kms_agnostic_bin2_link_pad (KmsAgnosticBin2 * self, GstPad * pad, GstPad * peer)
 
   GST_INFO_OBJECT (self, "Downstream wanted caps: %" GST_PTR_FORMAT, peer_caps);
 
+  if (kms_agnostic_bin2_link_to_ladder (self, pad, peer_caps)) {
+    gst_caps_unref (peer_caps);
+    goto end;
+  }
+
+  kms_agnostic_bin2_clear_rendition_data (pad);
   bin = kms_agnostic_bin2_find_or_create_bin_for_caps (self, peer_caps);
 
   if (bin != NULL) {
@@ -825,6 +1799,11 @@ kms_agnostic_bin2_process_pad (KmsAgnosticBin2 * self, GstPad * pad)
     return FALSE;
   }
 
+  if (pad == self->priv->direct_pad) {
+    /* Not fed by the tree bins */
+    return FALSE;
+  }
+
   peer = gst_pad_get_peer (pad);
 
   if (peer != NULL) {
@@ -859,6 +1838,182 @@ kms_agnostic_bin2_process_pad (KmsAgnosticBin2 * self, GstPad * pad)
   return TRUE;
 }
 
+typedef struct _KmsDirectCandidate
+{
+  guint linked;
+  GstPad *pad;
+} KmsDirectCandidate;
+
+static void
+count_linked_pads (GstPad * pad, KmsDirectCandidate * candidate)
+{
+  if (!gst_pad_is_linked (pad)
+      || !GST_OBJECT_FLAG_IS_SET (pad, KMS_AGNOSTIC_PAD_STARTED)) {
+    return;
+  }
+
+  candidate->linked++;
+  candidate->pad = pad;
+}
+
+/* Returns the only consumer if it accepts the input as it comes */
+static GstPad *
+kms_agnostic_bin2_get_direct_candidate (KmsAgnosticBin2 * self)
+{
+  KmsDirectCandidate candidate = { 0, NULL };
+  GstCaps *caps = self->priv->input_caps;
+  GstPad *peer;
+
+  if (!self->priv->direct_mode || !self->priv->started || caps == NULL
+      || !gst_caps_is_fixed (caps) || kms_utils_caps_is_raw (caps)) {
+    /* Raw consumers need their own converters */
+    return NULL;
+  }
+
+  kms_element_for_each_src_pad (GST_ELEMENT (self),
+      (KmsPadIterationAction) count_linked_pads, &candidate);
+
+  if (candidate.linked != 1) {
+    return NULL;
+  }
+
+  peer = gst_pad_get_peer (candidate.pad);
+  if (peer == NULL) {
+    return NULL;
+  }
+
+  if (!gst_pad_query_accept_caps (peer, caps)) {
+    candidate.pad = NULL;
+  }
+
+  g_object_unref (peer);
+
+  return candidate.pad;
+}
+
+static GstPad *
+kms_agnostic_bin2_ref_direct_pad (KmsAgnosticBin2 * self)
+{
+  GstPad *pad = NULL;
+
+  GST_OBJECT_LOCK (self);
+  if (self->priv->direct_pad != NULL) {
+    pad = g_object_ref (self->priv->direct_pad);
+  }
+  GST_OBJECT_UNLOCK (self);
+
+  return pad;
+}
+
+static GstPadProbeReturn
+direct_pad_upstream_probe (GstPad * pad, GstPadProbeInfo * info,
+    gpointer agnosticbin)
+{
+  KmsAgnosticBin2 *self = agnosticbin;
+
+  if (GST_PAD_PROBE_INFO_TYPE (info) & GST_PAD_PROBE_TYPE_EVENT_UPSTREAM) {
+    GstEvent *event = gst_pad_probe_info_get_event (info);
+
+    if (GST_EVENT_TYPE (event) == GST_EVENT_RECONFIGURE) {
+      return GST_PAD_PROBE_OK;
+    }
+
+    gst_pad_push_event (self->priv->sink, gst_event_ref (event));
+
+    return GST_PAD_PROBE_DROP;
+  }
+
+  if (GST_PAD_PROBE_INFO_TYPE (info) & GST_PAD_PROBE_TYPE_QUERY_UPSTREAM) {
+    GstQuery *query = gst_pad_probe_info_get_query (info);
+
+    if (gst_pad_peer_query (self->priv->sink, query)) {
+      return GST_PAD_PROBE_HANDLED;
+    }
+  }
+
+  return GST_PAD_PROBE_OK;
+}
+
+static gboolean
+forward_sticky_event (GstPad * pad, GstEvent ** event, gpointer direct_pad)
+{
+  gst_pad_push_event (GST_PAD (direct_pad), gst_event_ref (*event));
+
+  return TRUE;
+}
+
+static void
+kms_agnostic_bin2_start_direct (KmsAgnosticBin2 * self, GstPad * pad)
+{
+  GST_INFO_OBJECT (self, "Single consumer %" GST_PTR_FORMAT
+      ", bypassing tree bins", pad);
+
+  remove_target_pad (pad);
+
+  self->priv->direct_probe = gst_pad_add_probe (pad,
+      GST_PAD_PROBE_TYPE_EVENT_UPSTREAM | GST_PAD_PROBE_TYPE_QUERY_UPSTREAM,
+      direct_pad_upstream_probe, self, NULL);
+
+  gst_pad_sticky_events_foreach (self->priv->sink, forward_sticky_event, pad);
+  kms_utils_drop_until_keyframe (pad, TRUE);
+
+  GST_OBJECT_LOCK (self);
+  self->priv->direct_pad = g_object_ref (pad);
+  GST_OBJECT_UNLOCK (self);
+
+  /* The consumer drops until then, do not wait for the next natural one */
+  gst_pad_push_event (self->priv->sink,
+      gst_video_event_new_upstream_force_key_unit (GST_CLOCK_TIME_NONE, TRUE,
+          0));
+}
+
+static void
+kms_agnostic_bin2_stop_direct (KmsAgnosticBin2 * self)
+{
+  GstPad *pad;
+
+  GST_OBJECT_LOCK (self);
+  pad = self->priv->direct_pad;
+  self->priv->direct_pad = NULL;
+  GST_OBJECT_UNLOCK (self);
+
+  GST_INFO_OBJECT (self, "Feeding %" GST_PTR_FORMAT " from tree bins again",
+      pad);
+
+  gst_pad_remove_probe (pad, self->priv->direct_probe);
+  self->priv->direct_probe = 0;
+
+  /* Linked later if the input is not started yet */
+  kms_agnostic_bin2_process_pad (self, pad);
+
+  g_object_unref (pad);
+}
+
+/*
+ * Buffers skip the tree bins when a single consumer accepts the input, which
+ * is the usual case of a relay. The consumer then runs in the upstream
+ * streaming thread, as the queue of its tree bin is skipped too, so a slow
+ * consumer stalls the producer. That is why it is only done when the
+ * "direct-mode" property is set. Must be called with the agnosticbin lock.
+ */
+static void
+kms_agnostic_bin2_update_direct_mode (KmsAgnosticBin2 * self)
+{
+  GstPad *candidate = kms_agnostic_bin2_get_direct_candidate (self);
+
+  if (candidate == self->priv->direct_pad) {
+    return;
+  }
+
+  if (self->priv->direct_pad != NULL) {
+    kms_agnostic_bin2_stop_direct (self);
+  }
+
+  if (candidate != NULL) {
+    kms_agnostic_bin2_start_direct (self, candidate);
+  }
+}
+
 static void
 add_linked_pads (GstPad * pad, KmsAgnosticBin2 * self)
 {
@@ -902,6 +2057,7 @@ input_bin_src_caps_probe (GstPad * pad, GstPadProbeInfo * info, gpointer bin)
 
   kms_element_for_each_src_pad (GST_ELEMENT (self),
       (KmsPadIterationAction) add_linked_pads, self);
+  kms_agnostic_bin2_update_direct_mode (self);
 
   KMS_AGNOSTIC_BIN2_UNLOCK (self);
 
@@ -951,6 +2107,9 @@ kms_agnostic_bin2_configure_input (KmsAgnosticBin2 * self, const GstCaps * caps)
   GST_LOG_OBJECT (self, "Removing old treebins");
   g_hash_table_foreach (self->priv->bins, remove_bin, self);
   g_hash_table_remove_all (self->priv->bins);
+  g_hash_table_remove_all (self->priv->caps_index);
+  g_hash_table_foreach (self->priv->ladders, remove_ladder, self);
+  g_hash_table_remove_all (self->priv->ladders);
 
   KMS_AGNOSTIC_BIN2_UNLOCK (self);
 }
@@ -1013,6 +2172,10 @@ kms_agnostic_bin2_sink_caps_probe (GstPad * pad, GstPadProbeInfo * info,
     kms_agnostic_bin2_configure_input (self, new_caps);
   }
 
+  KMS_AGNOSTIC_BIN2_LOCK (self);
+  kms_agnostic_bin2_update_direct_mode (self);
+  KMS_AGNOSTIC_BIN2_UNLOCK (self);
+
   return GST_PAD_PROBE_OK;
 }
 
@@ -1039,6 +2202,7 @@ kms_agnostic_bin2_src_reconfigure_probe (GstPad * pad, GstPadProbeInfo * info,
       KMS_AGNOSTIC_BIN2_LOCK (self);
       GST_OBJECT_FLAG_SET (pad, KMS_AGNOSTIC_PAD_STARTED);
       kms_agnostic_bin2_process_pad (self, pad);
+      kms_agnostic_bin2_update_direct_mode (self);
       KMS_AGNOSTIC_BIN2_UNLOCK (self);
     }
   }
@@ -1056,6 +2220,8 @@ kms_agnostic_bin2_src_unlinked (GstPad * pad, GstPad * peer,
   KMS_AGNOSTIC_BIN2_LOCK (self);
   GST_OBJECT_FLAG_UNSET (pad, KMS_AGNOSTIC_PAD_STARTED);
   remove_target_pad (pad);
+  kms_agnostic_bin2_clear_rendition_data (pad);
+  kms_agnostic_bin2_update_direct_mode (self);
   KMS_AGNOSTIC_BIN2_UNLOCK (self);
 }
 
@@ -1096,6 +2262,10 @@ kms_agnostic_bin2_request_new_pad (GstElement * element,
 static void
 kms_agnostic_bin2_release_pad (GstElement * element, GstPad * pad)
 {
+  KMS_AGNOSTIC_BIN2_LOCK (element);
+  kms_agnostic_bin2_clear_rendition_data (pad);
+  KMS_AGNOSTIC_BIN2_UNLOCK (element);
+
   gst_element_remove_pad (element, pad);
 }
 
@@ -1108,6 +2278,20 @@ kms_agnostic_bin2_dispose (GObject * object)
 
   KMS_AGNOSTIC_BIN2_LOCK (self);
   g_thread_pool_free (self->priv->remove_pool, FALSE, FALSE);
+  g_thread_pool_free (self->priv->rendition_pool, FALSE, FALSE);
+
+  GST_OBJECT_LOCK (self);
+  g_clear_object (&self->priv->direct_pad);
+  if (self->priv->reap_id != NULL) {
+    gst_clock_id_unschedule (self->priv->reap_id);
+    gst_clock_id_unref (self->priv->reap_id);
+    self->priv->reap_id = NULL;
+  }
+  if (self->priv->reap_pool != NULL) {
+    g_thread_pool_free (self->priv->reap_pool, FALSE, FALSE);
+    self->priv->reap_pool = NULL;
+  }
+  GST_OBJECT_UNLOCK (self);
 
   if (self->priv->input_bin_src_caps) {
     gst_caps_unref (self->priv->input_bin_src_caps);
@@ -1140,6 +2324,8 @@ kms_agnostic_bin2_finalize (GObject * object)
   g_rec_mutex_clear (&self->priv->thread_mutex);
 
   g_hash_table_unref (self->priv->bins);
+  g_hash_table_unref (self->priv->caps_index);
+  g_hash_table_unref (self->priv->ladders);
 
   /* chain up */
   G_OBJECT_CLASS (kms_agnostic_bin2_parent_class)->finalize (object);
@@ -1215,6 +2401,12 @@ kms_agnostic_bin2_set_property (GObject * object, guint property_id,
       self->priv->codec_config = g_value_dup_boxed (value);
       KMS_AGNOSTIC_BIN2_UNLOCK (self);
       break;
+    case PROP_DIRECT_MODE:
+      KMS_AGNOSTIC_BIN2_LOCK (self);
+      self->priv->direct_mode = g_value_get_boolean (value);
+      kms_agnostic_bin2_update_direct_mode (self);
+      KMS_AGNOSTIC_BIN2_UNLOCK (self);
+      break;
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
       break;
@@ -1247,6 +2439,11 @@ kms_agnostic_bin2_get_property (GObject * object, guint property_id,
       g_value_set_boxed (value, self->priv->codec_config);
       KMS_AGNOSTIC_BIN2_UNLOCK (self);
       break;
+    case PROP_DIRECT_MODE:
+      KMS_AGNOSTIC_BIN2_LOCK (self);
+      g_value_set_boolean (value, self->priv->direct_mode);
+      KMS_AGNOSTIC_BIN2_UNLOCK (self);
+      break;
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
       break;
@@ -1299,6 +2496,12 @@ kms_agnostic_bin2_class_init (KmsAgnosticBin2Class * klass)
       g_param_spec_boxed ("codec-config", "codec config",
           "Codec configuration", GST_TYPE_STRUCTURE, G_PARAM_READWRITE));
 
+  g_object_class_install_property (gobject_class, PROP_DIRECT_MODE,
+      g_param_spec_boolean ("direct-mode", "direct mode",
+          "Feed a single compatible consumer from the upstream thread,"
+          " skipping the tree bins and their queues",
+          DIRECT_MODE_DEFAULT, G_PARAM_READWRITE));
+
   /* Signal "KmsAgnosticBin::media-transcoding"
    * Arguments:
    * - Is transcoding?
@@ -1401,11 +2604,45 @@ check_ret_error (GstPad * pad, GstFlowReturn ret)
   return ret;
 }
 
+static GstFlowReturn
+check_direct_ret (KmsAgnosticBin2 * self, GstPad * direct, GstFlowReturn ret)
+{
+  switch (ret) {
+    case GST_FLOW_NOT_NEGOTIATED:
+    case GST_FLOW_NOT_LINKED:
+      GST_WARNING_OBJECT (direct, "Flow status: %s, feeding from tree bins",
+          gst_flow_get_name (ret));
+
+      /* Tree bins take over, unless direct mode was already left. As in */
+      /* check_ret_error, a single consumer must not fail the source     */
+      KMS_AGNOSTIC_BIN2_LOCK (self);
+      if (self->priv->direct_pad == direct) {
+        kms_agnostic_bin2_stop_direct (self);
+      }
+      KMS_AGNOSTIC_BIN2_UNLOCK (self);
+      ret = GST_FLOW_OK;
+      break;
+    default:
+      break;
+  }
+
+  g_object_unref (direct);
+
+  return ret;
+}
+
 static GstFlowReturn
 kms_agnostic_bin2_sink_chain (GstPad * pad,
     GstObject * parent, GstBuffer * buffer)
 {
   GstFlowReturn ret;
+  GstPad *direct = kms_agnostic_bin2_ref_direct_pad (KMS_AGNOSTIC_BIN2 (parent));
+
+  if (direct != NULL) {
+    ret = gst_pad_push (direct, buffer);
+
+    return check_direct_ret (KMS_AGNOSTIC_BIN2 (parent), direct, ret);
+  }
 
   ret = gst_proxy_pad_chain_default (pad, parent, buffer);
 
@@ -1417,12 +2654,47 @@ kms_agnostic_bin2_sink_chain_list (GstPad * pad,
     GstObject * parent, GstBufferList * list)
 {
   GstFlowReturn ret;
+  GstPad *direct = kms_agnostic_bin2_ref_direct_pad (KMS_AGNOSTIC_BIN2 (parent));
+
+  if (direct != NULL) {
+    ret = gst_pad_push_list (direct, list);
+
+    return check_direct_ret (KMS_AGNOSTIC_BIN2 (parent), direct, ret);
+  }
 
   ret = gst_proxy_pad_chain_list_default (pad, parent, list);
 
   return check_ret_error (pad, ret);
 }
 
+static gboolean
+kms_agnostic_bin2_sink_event (GstPad * pad, GstObject * parent,
+    GstEvent * event)
+{
+  GstPad *direct = kms_agnostic_bin2_ref_direct_pad (KMS_AGNOSTIC_BIN2 (parent));
+
+  if (direct != NULL) {
+    gboolean forward = TRUE;
+
+    if (GST_EVENT_TYPE (event) == GST_EVENT_CAPS) {
+      GstCaps *caps;
+
+      /* Otherwise direct mode is left when the caps reach the tree bins */
+      gst_event_parse_caps (event, &caps);
+      forward = gst_pad_peer_query_accept_caps (direct, caps);
+    }
+
+    if (forward) {
+      gst_pad_push_event (direct, gst_event_ref (event));
+    }
+
+    g_object_unref (direct);
+  }
+
+  /* Tree bins keep track of the input */
+  return gst_pad_event_default (pad, parent, event);
+}
+
 static void
 kms_agnostic_bin2_init (KmsAgnosticBin2 * self)
 {
@@ -1451,6 +2723,7 @@ kms_agnostic_bin2_init (KmsAgnosticBin2 * self)
   gst_pad_set_chain_function (self->priv->sink, kms_agnostic_bin2_sink_chain);
   gst_pad_set_chain_list_function (self->priv->sink,
       kms_agnostic_bin2_sink_chain_list);
+  gst_pad_set_event_function (self->priv->sink, kms_agnostic_bin2_sink_event);
   kms_utils_pad_monitor_gaps (self->priv->sink);
   g_object_unref (templ);
   g_object_unref (target);
@@ -1463,15 +2736,30 @@ kms_agnostic_bin2_init (KmsAgnosticBin2 * self)
   gst_element_add_pad (GST_ELEMENT (self), self->priv->sink);
 
   self->priv->started = FALSE;
+  self->priv->direct_mode = DIRECT_MODE_DEFAULT;
   self->priv->remove_pool =
       g_thread_pool_new (remove_on_unlinked_async, NULL, -1, FALSE, NULL);
+  self->priv->rendition_pool =
+      g_thread_pool_new (kms_agnostic_bin2_switch_rendition, NULL, 1, FALSE,
+      NULL);
+  self->priv->reap_pool =
+      g_thread_pool_new (kms_agnostic_bin2_reap_idle_bins, NULL, 1, FALSE,
+      NULL);
   self->priv->bins =
       g_hash_table_new_full (g_str_hash, g_str_equal, NULL, g_object_unref);
+  self->priv->caps_index =
+      g_hash_table_new_full (g_str_hash, g_str_equal, g_free,
+      (GDestroyNotify) kms_caps_match_destroy);
+  self->priv->ladders =
+      g_hash_table_new_full (g_str_hash, g_str_equal, g_free,
+      (GDestroyNotify) kms_rendition_ladder_destroy);
   g_rec_mutex_init (&self->priv->thread_mutex);
   self->priv->min_bitrate = MIN_BITRATE_DEFAULT;
   self->priv->max_bitrate = MAX_BITRATE_DEFAULT;
   self->priv->bitrate_unlimited = FALSE;
   self->priv->transcoding_emitted = FALSE;
+  self->priv->transcoding_active = FALSE;
+  self->priv->transcoding_stopped = FALSE;
 }
 
 gboolean
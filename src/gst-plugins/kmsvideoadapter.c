@@ -0,0 +1,642 @@
+/*
+ * (C) Copyright 2016 Kurento (http://kurento.org/)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#  include <config.h>
+#endif
+
+#include <string.h>
+
+#include "kmsvideoadapter.h"
+#include "commons/kmsvideokernels.h"
+
+#define PLUGIN_NAME "videoadapter"
+
+#define GST_CAT_DEFAULT kms_video_adapter_debug
+GST_DEBUG_CATEGORY_STATIC (GST_CAT_DEFAULT);
+
+#define kms_video_adapter_parent_class parent_class
+G_DEFINE_TYPE (KmsVideoAdapter, kms_video_adapter, GST_TYPE_VIDEO_FILTER);
+
+#define KMS_VIDEO_ADAPTER_GET_PRIVATE(obj) ( \
+  G_TYPE_INSTANCE_GET_PRIVATE (              \
+    (obj),                                   \
+    KMS_TYPE_VIDEO_ADAPTER,                  \
+    KmsVideoAdapterPrivate                   \
+  )                                          \
+)
+
+#define PLANE_ROW(frame, plane, y)                  \
+  ((guint8 *) GST_VIDEO_FRAME_PLANE_DATA (frame, plane) + \
+      (y) * GST_VIDEO_FRAME_PLANE_STRIDE (frame, plane))
+
+typedef struct _KmsPlaneScale
+{
+  /* In samples of each channel */
+  guint src_width, src_height;
+  guint dst_width, dst_height;
+
+  guint *h_offsets, *v_offsets;
+  guint8 *h_weights, *v_weights;
+} KmsPlaneScale;
+
+struct _KmsVideoAdapterPrivate
+{
+  const KmsVideoKernels *kernels;
+
+  /* I420 and NV12 go through the kernels, the rest through the converter */
+  KmsPlaneScale luma, chroma;
+  guint8 *blend_row, *row_a, *row_b;
+  GstVideoConverter *converter;
+
+  /* Of the output, when frames have to be dropped */
+  GstClockTime frame_duration;
+  GstClockTime next_ts;
+  gboolean discont;
+};
+
+static GstStaticPadTemplate sinktemplate = GST_STATIC_PAD_TEMPLATE ("sink",
+    GST_PAD_SINK,
+    GST_PAD_ALWAYS,
+    GST_STATIC_CAPS (GST_VIDEO_CAPS_MAKE (GST_VIDEO_FORMATS_ALL)));
+
+static GstStaticPadTemplate srctemplate = GST_STATIC_PAD_TEMPLATE ("src",
+    GST_PAD_SRC,
+    GST_PAD_ALWAYS,
+    GST_STATIC_CAPS (GST_VIDEO_CAPS_MAKE (GST_VIDEO_FORMATS_ALL)));
+
+static void
+kms_plane_scale_init (KmsPlaneScale * ps, guint src_width, guint src_height,
+    guint dst_width, guint dst_height)
+{
+  ps->src_width = src_width;
+  ps->src_height = src_height;
+  ps->dst_width = dst_width;
+  ps->dst_height = dst_height;
+
+  ps->h_offsets = g_new (guint, dst_width);
+  ps->h_weights = g_new (guint8, dst_width);
+  kms_video_kernels_compute_taps (src_width, dst_width, ps->h_offsets,
+      ps->h_weights);
+
+  ps->v_offsets = g_new (guint, dst_height);
+  ps->v_weights = g_new (guint8, dst_height);
+  kms_video_kernels_compute_taps (src_height, dst_height, ps->v_offsets,
+      ps->v_weights);
+}
+
+static void
+kms_plane_scale_clear (KmsPlaneScale * ps)
+{
+  g_clear_pointer (&ps->h_offsets, g_free);
+  g_clear_pointer (&ps->h_weights, g_free);
+  g_clear_pointer (&ps->v_offsets, g_free);
+  g_clear_pointer (&ps->v_weights, g_free);
+}
+
+static void
+kms_video_adapter_reset (KmsVideoAdapter * self)
+{
+  kms_plane_scale_clear (&self->priv->luma);
+  kms_plane_scale_clear (&self->priv->chroma);
+  g_clear_pointer (&self->priv->blend_row, g_free);
+  g_clear_pointer (&self->priv->row_a, g_free);
+  g_clear_pointer (&self->priv->row_b, g_free);
+  g_clear_pointer (&self->priv->converter, gst_video_converter_free);
+}
+
+static gboolean
+is_fast_format (GstVideoFormat format)
+{
+  return format == GST_VIDEO_FORMAT_I420 || format == GST_VIDEO_FORMAT_NV12;
+}
+
+/*
+ * Returns output row @y of a plane of @channels interleaved samples. It is
+ * written in @out unless the source row can be used as it is.
+ */
+static const guint8 *
+kms_video_adapter_scale_row (KmsVideoAdapter * self, const KmsPlaneScale * ps,
+    const guint8 * src, gint stride, guint channels, guint y, guint8 * out)
+{
+  const guint8 *row = src + ps->v_offsets[y] * stride;
+  gboolean same_width = ps->src_width == ps->dst_width;
+
+  if (ps->v_weights[y] != 0) {
+    guint8 *blended = same_width ? out : self->priv->blend_row;
+
+    self->priv->kernels->blend_row (blended, row, row + stride,
+        ps->v_weights[y], ps->src_width * channels);
+    row = blended;
+  }
+
+  if (same_width) {
+    return row;
+  }
+
+  kms_video_kernels_resample_row (out, row, ps->h_offsets, ps->h_weights,
+      ps->dst_width, channels);
+
+  return out;
+}
+
+static void
+kms_video_adapter_scale_plane (KmsVideoAdapter * self,
+    const KmsPlaneScale * ps, GstVideoFrame * in, guint in_plane,
+    GstVideoFrame * out, guint out_plane, guint channels)
+{
+  const guint8 *src = GST_VIDEO_FRAME_PLANE_DATA (in, in_plane);
+  gint stride = GST_VIDEO_FRAME_PLANE_STRIDE (in, in_plane);
+  guint y;
+
+  for (y = 0; y < ps->dst_height; y++) {
+    guint8 *dst = PLANE_ROW (out, out_plane, y);
+    const guint8 *row;
+
+    row = kms_video_adapter_scale_row (self, ps, src, stride, channels, y,
+        dst);
+    if (row != dst) {
+      memcpy (dst, row, ps->dst_width * channels);
+    }
+  }
+}
+
+static void
+kms_video_adapter_transform_fast (KmsVideoAdapter * self,
+    GstVideoFrame * in, GstVideoFrame * out)
+{
+  KmsVideoAdapterPrivate *priv = self->priv;
+  gboolean in_nv12, out_nv12;
+  guint y;
+
+  in_nv12 = GST_VIDEO_FRAME_FORMAT (in) == GST_VIDEO_FORMAT_NV12;
+  out_nv12 = GST_VIDEO_FRAME_FORMAT (out) == GST_VIDEO_FORMAT_NV12;
+
+  kms_video_adapter_scale_plane (self, &priv->luma, in, 0, out, 0, 1);
+
+  if (in_nv12 && out_nv12) {
+    kms_video_adapter_scale_plane (self, &priv->chroma, in, 1, out, 1, 2);
+  } else if (!in_nv12 && !out_nv12) {
+    kms_video_adapter_scale_plane (self, &priv->chroma, in, 1, out, 1, 1);
+    kms_video_adapter_scale_plane (self, &priv->chroma, in, 2, out, 2, 1);
+  } else if (out_nv12) {
+    for (y = 0; y < priv->chroma.dst_height; y++) {
+      const guint8 *u, *v;
+
+      u = kms_video_adapter_scale_row (self, &priv->chroma,
+          GST_VIDEO_FRAME_PLANE_DATA (in, 1),
+          GST_VIDEO_FRAME_PLANE_STRIDE (in, 1), 1, y, priv->row_a);
+      v = kms_video_adapter_scale_row (self, &priv->chroma,
+          GST_VIDEO_FRAME_PLANE_DATA (in, 2),
+          GST_VIDEO_FRAME_PLANE_STRIDE (in, 2), 1, y, priv->row_b);
+      priv->kernels->interleave_row (PLANE_ROW (out, 1, y), u, v,
+          priv->chroma.dst_width);
+    }
+  } else {
+    for (y = 0; y < priv->chroma.dst_height; y++) {
+      const guint8 *uv;
+
+      uv = kms_video_adapter_scale_row (self, &priv->chroma,
+          GST_VIDEO_FRAME_PLANE_DATA (in, 1),
+          GST_VIDEO_FRAME_PLANE_STRIDE (in, 1), 2, y, priv->row_a);
+      priv->kernels->deinterleave_row (PLANE_ROW (out, 1, y),
+          PLANE_ROW (out, 2, y), uv, priv->chroma.dst_width);
+    }
+  }
+}
+
+static GstFlowReturn
+kms_video_adapter_transform_frame (GstVideoFilter * filter,
+    GstVideoFrame * in, GstVideoFrame * out)
+{
+  KmsVideoAdapter *self = KMS_VIDEO_ADAPTER (filter);
+
+  if (self->priv->converter != NULL) {
+    gst_video_converter_frame (self->priv->converter, in, out);
+  } else {
+    kms_video_adapter_transform_fast (self, in, out);
+  }
+
+  return GST_FLOW_OK;
+}
+
+static gboolean
+kms_video_adapter_set_info (GstVideoFilter * filter, GstCaps * incaps,
+    GstVideoInfo * in_info, GstCaps * outcaps, GstVideoInfo * out_info)
+{
+  KmsVideoAdapter *self = KMS_VIDEO_ADAPTER (filter);
+  KmsVideoAdapterPrivate *priv = self->priv;
+  GstClockTime frame_duration = 0;
+  gboolean same_frames;
+
+  kms_video_adapter_reset (self);
+
+  if (GST_VIDEO_INFO_FPS_N (out_info) > 0 &&
+      (GST_VIDEO_INFO_FPS_N (in_info) == 0 ||
+          gst_util_fraction_compare (GST_VIDEO_INFO_FPS_N (out_info),
+              GST_VIDEO_INFO_FPS_D (out_info), GST_VIDEO_INFO_FPS_N (in_info),
+              GST_VIDEO_INFO_FPS_D (in_info)) < 0)) {
+    frame_duration = gst_util_uint64_scale_int (GST_SECOND,
+        GST_VIDEO_INFO_FPS_D (out_info), GST_VIDEO_INFO_FPS_N (out_info));
+  }
+
+  if (frame_duration != priv->frame_duration) {
+    priv->frame_duration = frame_duration;
+    priv->next_ts = GST_CLOCK_TIME_NONE;
+  }
+
+  /* Dropping frames does not need to touch the ones that go through */
+  same_frames = GST_VIDEO_INFO_FORMAT (in_info) ==
+      GST_VIDEO_INFO_FORMAT (out_info) &&
+      GST_VIDEO_INFO_WIDTH (in_info) == GST_VIDEO_INFO_WIDTH (out_info) &&
+      GST_VIDEO_INFO_HEIGHT (in_info) == GST_VIDEO_INFO_HEIGHT (out_info);
+  gst_base_transform_set_passthrough (GST_BASE_TRANSFORM (self), same_frames);
+
+  if (same_frames) {
+    return TRUE;
+  }
+
+  if (is_fast_format (GST_VIDEO_INFO_FORMAT (in_info)) &&
+      is_fast_format (GST_VIDEO_INFO_FORMAT (out_info))) {
+    kms_plane_scale_init (&priv->luma, GST_VIDEO_INFO_COMP_WIDTH (in_info, 0),
+        GST_VIDEO_INFO_COMP_HEIGHT (in_info, 0),
+        GST_VIDEO_INFO_COMP_WIDTH (out_info, 0),
+        GST_VIDEO_INFO_COMP_HEIGHT (out_info, 0));
+    kms_plane_scale_init (&priv->chroma,
+        GST_VIDEO_INFO_COMP_WIDTH (in_info, 1),
+        GST_VIDEO_INFO_COMP_HEIGHT (in_info, 1),
+        GST_VIDEO_INFO_COMP_WIDTH (out_info, 1),
+        GST_VIDEO_INFO_COMP_HEIGHT (out_info, 1));
+
+    priv->blend_row = g_malloc (MAX (priv->luma.src_width,
+            2 * priv->chroma.src_width));
+    priv->row_a = g_malloc (2 * priv->chroma.dst_width);
+    priv->row_b = g_malloc (priv->chroma.dst_width);
+
+    GST_DEBUG_OBJECT (self, "Adapting with %s kernels",
+        priv->kernels->name);
+  } else {
+    priv->converter = gst_video_converter_new (in_info, out_info, NULL);
+
+    if (priv->converter == NULL) {
+      GST_ERROR_OBJECT (self, "Cannot convert %" GST_PTR_FORMAT " to %"
+          GST_PTR_FORMAT, incaps, outcaps);
+      return FALSE;
+    }
+  }
+
+  return TRUE;
+}
+
+/* Frames are only dropped, so the output rate cannot be over the input */
+static void
+kms_video_adapter_transform_framerate (GstStructure * s,
+    GstPadDirection direction)
+{
+  gint n, d;
+
+  if (!gst_structure_get_fraction (s, "framerate", &n, &d) || n == 0) {
+    gst_structure_remove_field (s, "framerate");
+    return;
+  }
+
+  if (direction == GST_PAD_SINK) {
+    gst_structure_set (s, "framerate", GST_TYPE_FRACTION_RANGE, 0, 1, n, d,
+        NULL);
+  } else {
+    gst_structure_set (s, "framerate", GST_TYPE_FRACTION_RANGE, n, d,
+        G_MAXINT, 1, NULL);
+  }
+}
+
+static GstCaps *
+kms_video_adapter_transform_caps (GstBaseTransform * trans,
+    GstPadDirection direction, GstCaps * caps, GstCaps * filter)
+{
+  GstCaps *ret = gst_caps_new_empty ();
+  guint i, n = gst_caps_get_size (caps);
+
+  for (i = 0; i < n; i++) {
+    GstStructure *s = gst_caps_get_structure (caps, i);
+    GstCapsFeatures *f = gst_caps_get_features (caps, i);
+
+    if (i > 0 && gst_caps_is_subset_structure_full (ret, s, f)) {
+      continue;
+    }
+
+    s = gst_structure_copy (s);
+
+    if (!gst_caps_features_is_any (f) && gst_caps_features_is_equal (f,
+            GST_CAPS_FEATURES_MEMORY_SYSTEM_MEMORY)) {
+      gst_structure_set (s, "width", GST_TYPE_INT_RANGE, 1, G_MAXINT,
+          "height", GST_TYPE_INT_RANGE, 1, G_MAXINT, NULL);
+      gst_structure_remove_fields (s, "format", "colorimetry", "chroma-site",
+          NULL);
+
+      if (gst_structure_has_field (s, "pixel-aspect-ratio")) {
+        gst_structure_set (s, "pixel-aspect-ratio", GST_TYPE_FRACTION_RANGE,
+            1, G_MAXINT, G_MAXINT, 1, NULL);
+      }
+
+      kms_video_adapter_transform_framerate (s, direction);
+    }
+
+    gst_caps_append_structure_full (ret, s, gst_caps_features_copy (f));
+  }
+
+  if (filter != NULL) {
+    GstCaps *intersection;
+
+    intersection = gst_caps_intersect_full (filter, ret,
+        GST_CAPS_INTERSECT_FIRST);
+    gst_caps_unref (ret);
+    ret = intersection;
+  }
+
+  GST_DEBUG_OBJECT (trans, "Transformed %" GST_PTR_FORMAT " into %"
+      GST_PTR_FORMAT, caps, ret);
+
+  return ret;
+}
+
+static void
+fixate_int (GstStructure * s, const gchar * field, gint target)
+{
+  if (gst_structure_has_field (s, field)) {
+    gst_structure_fixate_field_nearest_int (s, field, MAX (target, 1));
+  }
+}
+
+/*
+ * Keeps the size of the input, or its display aspect ratio when it cannot.
+ * The output PAR is fixated first, to that of the input if allowed, so that
+ * the free dimension follows from it.
+ */
+static void
+kms_video_adapter_fixate_size (GstStructure * s, gint in_width,
+    gint in_height, gint par_n, gint par_d)
+{
+  gint width, height, out_par_n = 1, out_par_d = 1, dar_n, dar_d;
+  gboolean fixed_width, fixed_height;
+
+  fixed_width = gst_structure_get_int (s, "width", &width);
+  fixed_height = gst_structure_get_int (s, "height", &height);
+
+  if (fixed_width && fixed_height) {
+    return;
+  }
+
+  if (gst_structure_has_field (s, "pixel-aspect-ratio")) {
+    gst_structure_fixate_field_nearest_fraction (s, "pixel-aspect-ratio",
+        par_n, par_d);
+    gst_structure_get_fraction (s, "pixel-aspect-ratio", &out_par_n,
+        &out_par_d);
+  }
+
+  /* Output width / height = DAR / output PAR */
+  if (!gst_util_fraction_multiply (in_width, in_height, par_n, par_d, &dar_n,
+          &dar_d)
+      || !gst_util_fraction_multiply (dar_n, dar_d, out_par_d, out_par_n,
+          &dar_n, &dar_d)) {
+    dar_n = in_width;
+    dar_d = in_height;
+  }
+
+  if (fixed_width) {
+    fixate_int (s, "height", gst_util_uint64_scale_int_round (width, dar_d,
+            dar_n));
+    return;
+  }
+
+  if (!fixed_height) {
+    fixate_int (s, "height", in_height);
+
+    if (!gst_structure_get_int (s, "height", &height)) {
+      return;
+    }
+  }
+
+  fixate_int (s, "width", gst_util_uint64_scale_int_round (height, dar_n,
+          dar_d));
+}
+
+/* Chooses the PAR that keeps the DAR of the input with the output size */
+static void
+kms_video_adapter_fixate_par (GstStructure * s, gint in_width,
+    gint in_height, gint par_n, gint par_d)
+{
+  gint width, height, n, d;
+
+  if (!gst_structure_has_field (s, "pixel-aspect-ratio")
+      || !gst_structure_get_int (s, "width", &width)
+      || !gst_structure_get_int (s, "height", &height)) {
+    return;
+  }
+
+  /* Output PAR = DAR * height / width */
+  if (gst_util_fraction_multiply (in_width, in_height, par_n, par_d, &n, &d)
+      && gst_util_fraction_multiply (n, d, height, width, &n, &d)) {
+    gst_structure_fixate_field_nearest_fraction (s, "pixel-aspect-ratio",
+        n, d);
+  } else {
+    gst_structure_fixate_field_nearest_fraction (s, "pixel-aspect-ratio",
+        par_n, par_d);
+  }
+}
+
+static GstCaps *
+kms_video_adapter_fixate_caps (GstBaseTransform * trans,
+    GstPadDirection direction, GstCaps * caps, GstCaps * othercaps)
+{
+  GstStructure *ins, *outs;
+  const gchar *format;
+  gint width, height, n, d, par_n, par_d;
+
+  othercaps = gst_caps_truncate (othercaps);
+  othercaps = gst_caps_make_writable (othercaps);
+  ins = gst_caps_get_structure (caps, 0);
+  outs = gst_caps_get_structure (othercaps, 0);
+
+  format = gst_structure_get_string (ins, "format");
+  if (format != NULL && gst_structure_has_field (outs, "format")) {
+    gst_structure_fixate_field_string (outs, "format", format);
+  }
+
+  if (!gst_structure_get_fraction (ins, "pixel-aspect-ratio", &par_n, &par_d)) {
+    par_n = par_d = 1;
+  }
+
+  if (gst_structure_get_int (ins, "width", &width) &&
+      gst_structure_get_int (ins, "height", &height)) {
+    kms_video_adapter_fixate_size (outs, width, height, par_n, par_d);
+    kms_video_adapter_fixate_par (outs, width, height, par_n, par_d);
+  }
+
+  if (gst_structure_get_fraction (ins, "framerate", &n, &d) &&
+      gst_structure_has_field (outs, "framerate")) {
+    gst_structure_fixate_field_nearest_fraction (outs, "framerate", n, d);
+  }
+
+  if (gst_structure_has_field (outs, "pixel-aspect-ratio")) {
+    gst_structure_fixate_field_nearest_fraction (outs, "pixel-aspect-ratio",
+        par_n, par_d);
+  }
+
+  othercaps = gst_caps_fixate (othercaps);
+
+  GST_DEBUG_OBJECT (trans, "Fixated to %" GST_PTR_FORMAT, othercaps);
+
+  return othercaps;
+}
+
+static gboolean
+kms_video_adapter_drop_frame (KmsVideoAdapter * self, GstClockTime pts)
+{
+  KmsVideoAdapterPrivate *priv = self->priv;
+  GstClockTime duration = priv->frame_duration;
+
+  if (duration == 0 || !GST_CLOCK_TIME_IS_VALID (pts)) {
+    return FALSE;
+  }
+
+  if (GST_CLOCK_TIME_IS_VALID (priv->next_ts)) {
+    /* Some margin, for timestamps that do not match the rate exactly */
+    if (pts + duration / 4 < priv->next_ts) {
+      return TRUE;
+    }
+
+    /* Keep the cadence, unless the stream jumped ahead */
+    if (pts < priv->next_ts + duration) {
+      priv->next_ts += duration;
+      return FALSE;
+    }
+  }
+
+  priv->next_ts = pts + duration;
+
+  return FALSE;
+}
+
+static GstFlowReturn
+kms_video_adapter_submit_input_buffer (GstBaseTransform * trans,
+    gboolean is_discont, GstBuffer * buffer)
+{
+  KmsVideoAdapter *self = KMS_VIDEO_ADAPTER (trans);
+
+  if (kms_video_adapter_drop_frame (self, GST_BUFFER_PTS (buffer))) {
+    GST_LOG_OBJECT (self, "Dropping frame %" GST_TIME_FORMAT,
+        GST_TIME_ARGS (GST_BUFFER_PTS (buffer)));
+    if (GST_BUFFER_IS_DISCONT (buffer)) {
+      self->priv->discont = TRUE;
+    }
+    gst_buffer_unref (buffer);
+
+    /* Dropping is not an error, nor a discontinuity to mark downstream */
+    return GST_FLOW_OK;
+  }
+
+  if (self->priv->discont) {
+    buffer = gst_buffer_make_writable (buffer);
+    GST_BUFFER_FLAG_SET (buffer, GST_BUFFER_FLAG_DISCONT);
+    self->priv->discont = FALSE;
+  }
+
+  return GST_BASE_TRANSFORM_CLASS (parent_class)->submit_input_buffer (trans,
+      is_discont, buffer);
+}
+
+static gboolean
+kms_video_adapter_sink_event (GstBaseTransform * trans, GstEvent * event)
+{
+  KmsVideoAdapter *self = KMS_VIDEO_ADAPTER (trans);
+
+  switch (GST_EVENT_TYPE (event)) {
+    case GST_EVENT_FLUSH_STOP:
+    case GST_EVENT_SEGMENT:
+      self->priv->next_ts = GST_CLOCK_TIME_NONE;
+      self->priv->discont = FALSE;
+      break;
+    default:
+      break;
+  }
+
+  return GST_BASE_TRANSFORM_CLASS (parent_class)->sink_event (trans, event);
+}
+
+static void
+kms_video_adapter_finalize (GObject * object)
+{
+  KmsVideoAdapter *self = KMS_VIDEO_ADAPTER (object);
+
+  kms_video_adapter_reset (self);
+
+  /* chain up */
+  G_OBJECT_CLASS (parent_class)->finalize (object);
+}
+
+static void
+kms_video_adapter_init (KmsVideoAdapter * self)
+{
+  self->priv = KMS_VIDEO_ADAPTER_GET_PRIVATE (self);
+  self->priv->kernels = kms_video_kernels_get ();
+  self->priv->next_ts = GST_CLOCK_TIME_NONE;
+}
+
+static void
+kms_video_adapter_class_init (KmsVideoAdapterClass * klass)
+{
+  GObjectClass *gobject_class = G_OBJECT_CLASS (klass);
+  GstElementClass *gstelement_class = GST_ELEMENT_CLASS (klass);
+  GstBaseTransformClass *trans_class = GST_BASE_TRANSFORM_CLASS (klass);
+  GstVideoFilterClass *filter_class = GST_VIDEO_FILTER_CLASS (klass);
+
+  gobject_class->finalize = kms_video_adapter_finalize;
+
+  gst_element_class_set_details_simple (gstelement_class,
+      "VideoAdapter",
+      "Filter/Converter/Video/Scaler",
+      "Drops, scales and converts raw video frames in a single pass.",
+      "Kurento <kurento@googlegroups.com>");
+
+  gst_element_class_add_pad_template (gstelement_class,
+      gst_static_pad_template_get (&srctemplate));
+  gst_element_class_add_pad_template (gstelement_class,
+      gst_static_pad_template_get (&sinktemplate));
+
+  trans_class->transform_caps =
+      GST_DEBUG_FUNCPTR (kms_video_adapter_transform_caps);
+  trans_class->fixate_caps = GST_DEBUG_FUNCPTR (kms_video_adapter_fixate_caps);
+  trans_class->submit_input_buffer =
+      GST_DEBUG_FUNCPTR (kms_video_adapter_submit_input_buffer);
+  trans_class->sink_event = GST_DEBUG_FUNCPTR (kms_video_adapter_sink_event);
+  trans_class->passthrough_on_same_caps = FALSE;
+
+  filter_class->set_info = GST_DEBUG_FUNCPTR (kms_video_adapter_set_info);
+  filter_class->transform_frame =
+      GST_DEBUG_FUNCPTR (kms_video_adapter_transform_frame);
+
+  GST_DEBUG_CATEGORY_INIT (GST_CAT_DEFAULT, PLUGIN_NAME, 0, PLUGIN_NAME);
+
+  g_type_class_add_private (klass, sizeof (KmsVideoAdapterPrivate));
+}
+
+gboolean
+kms_video_adapter_plugin_init (GstPlugin * plugin)
+{
+  return gst_element_register (plugin, PLUGIN_NAME, GST_RANK_NONE,
+      KMS_TYPE_VIDEO_ADAPTER);
+}
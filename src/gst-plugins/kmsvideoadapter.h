@@ -0,0 +1,62 @@
+/*
+ * (C) Copyright 2016 Kurento (http://kurento.org/)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#ifndef __KMS_VIDEO_ADAPTER_H__
+#define __KMS_VIDEO_ADAPTER_H__
+
+#include <gst/gst.h>
+#include <gst/video/gstvideofilter.h>
+
+G_BEGIN_DECLS
+#define KMS_TYPE_VIDEO_ADAPTER \
+  (kms_video_adapter_get_type())
+#define KMS_VIDEO_ADAPTER(obj) \
+  (G_TYPE_CHECK_INSTANCE_CAST((obj),KMS_TYPE_VIDEO_ADAPTER,KmsVideoAdapter))
+#define KMS_VIDEO_ADAPTER_CLASS(klass) \
+  (G_TYPE_CHECK_CLASS_CAST((klass),KMS_TYPE_VIDEO_ADAPTER,KmsVideoAdapterClass))
+#define KMS_IS_VIDEO_ADAPTER(obj) \
+  (G_TYPE_CHECK_INSTANCE_TYPE((obj),KMS_TYPE_VIDEO_ADAPTER))
+#define KMS_IS_VIDEO_ADAPTER_CLASS(klass) \
+  (G_TYPE_CHECK_CLASS_TYPE((klass),KMS_TYPE_VIDEO_ADAPTER))
+#define KMS_VIDEO_ADAPTER_CAST(obj) ((KmsVideoAdapter*)(obj))
+
+typedef struct _KmsVideoAdapter KmsVideoAdapter;
+typedef struct _KmsVideoAdapterClass KmsVideoAdapterClass;
+typedef struct _KmsVideoAdapterPrivate KmsVideoAdapterPrivate;
+
+/*
+ * Adapts raw video to the caps downstream asks for: drops frames to lower
+ * the framerate, scales and converts the format in a single pass.
+ */
+struct _KmsVideoAdapter
+{
+  GstVideoFilter parent;
+
+  KmsVideoAdapterPrivate *priv;
+};
+
+struct _KmsVideoAdapterClass
+{
+  GstVideoFilterClass parent_class;
+};
+
+GType kms_video_adapter_get_type (void);
+
+gboolean kms_video_adapter_plugin_init (GstPlugin * plugin);
+
+G_END_DECLS
+#endif /* __KMS_VIDEO_ADAPTER_H__ */
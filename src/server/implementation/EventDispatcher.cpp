@@ -0,0 +1,216 @@
+/*
+ * (C) Copyright 2016 Kurento (http://kurento.org/)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#include <gst/gst.h>
+
+#include "EventDispatcher.hpp"
+#include "MetricsRegistry.hpp"
+
+#define GST_CAT_DEFAULT kurento_event_dispatcher
+GST_DEBUG_CATEGORY_STATIC (GST_CAT_DEFAULT);
+#define GST_DEFAULT_NAME "KurentoEventDispatcher"
+
+const int EVENT_DISPATCHER_LANES_DEFAULT = 1;
+
+namespace kurento
+{
+
+int EventDispatcher::lanesNumber = EVENT_DISPATCHER_LANES_DEFAULT;
+std::atomic<bool> EventDispatcher::created (false);
+
+void
+EventDispatcher::setLanes (int lanes)
+{
+  if (created) {
+    GST_WARNING ("Event dispatcher already created, lanes ignored");
+    return;
+  }
+
+  lanesNumber = std::max (lanes, 1);
+}
+
+int
+EventDispatcher::getLanes ()
+{
+  return lanesNumber;
+}
+
+EventDispatcher &
+EventDispatcher::getDispatcher ()
+{
+  static EventDispatcher dispatcher (lanesNumber);
+
+  return dispatcher;
+}
+
+EventDispatcher::EventDispatcher (int lanes)
+{
+  created = true;
+
+  for (int i = 0; i < lanes; i++) {
+    this->lanes.emplace_back (new Lane () );
+  }
+
+  for (auto &lane : this->lanes) {
+    lane->thread = std::thread (std::bind (&EventDispatcher::laneLoop, this,
+                                           std::ref (*lane) ) );
+  }
+}
+
+EventDispatcher::~EventDispatcher ()
+{
+  terminated = true;
+
+  for (auto &lane : lanes) {
+    std::unique_lock <std::mutex> lock (lane->mutex);
+    lane->cond.notify_all ();
+  }
+
+  for (auto &lane : lanes) {
+    try {
+      if (lane->thread.joinable () ) {
+        lane->thread.join ();
+      }
+    } catch (std::system_error &e) {
+      GST_ERROR ("Error joining: %s", e.what() );
+    }
+
+    /* Deliver what is still pending, as the former worker pool did */
+    dispatchBatch (*lane, lane->queue);
+  }
+}
+
+void
+EventDispatcher::enqueue (size_t key, Item &&item)
+{
+  Lane &lane = *lanes[key % lanes.size ()];
+  std::unique_lock <std::mutex> lock (lane.mutex);
+
+  item.queued = std::chrono::steady_clock::now ();
+  lane.queue.push_back (std::move (item) );
+  lane.queueDepth++;
+
+  /* Only the first item of a burst needs to wake the lane up */
+  if (lane.queue.size () == 1) {
+    lane.cond.notify_one ();
+  }
+}
+
+void
+EventDispatcher::dispatch (size_t key, std::function<void () > cb)
+{
+  Item item;
+
+  item.cb = cb;
+
+  enqueue (key, std::move (item) );
+}
+
+void
+EventDispatcher::laneLoop (Lane &lane)
+{
+  std::deque<Item> batch;
+
+  while (true) {
+    std::unique_lock <std::mutex> lock (lane.mutex);
+
+    while (lane.queue.empty () && !terminated) {
+      lane.cond.wait (lock);
+    }
+
+    if (terminated) {
+      return;
+    }
+
+    batch.swap (lane.queue);
+    lock.unlock ();
+
+    dispatchBatch (lane, batch);
+    batch.clear ();
+  }
+}
+
+void
+EventDispatcher::dispatchBatch (Lane &lane, std::deque<Item> &batch)
+{
+  static MetricsRegistry::Histogram &latencyHistogram =
+    MetricsRegistry::getRegistry ().histogram (
+      "kurento_event_dispatch_latency_seconds",
+      "Time events wait in a dispatcher lane", MetricsRegistry::latencyBounds () );
+  auto now = std::chrono::steady_clock::now ();
+
+  if (batch.empty () ) {
+    return;
+  }
+
+  lane.queueDepth -= batch.size ();
+  lane.dispatchedEvents += batch.size ();
+  lane.batches++;
+
+  for (auto &item : batch) {
+    int64_t latency = std::chrono::duration_cast<std::chrono::microseconds>
+                      (now - item.queued).count ();
+    int64_t max = lane.latencyMax;
+
+    lane.latencySum += latency;
+    latencyHistogram.observe (latency / 1000000.0);
+
+    while (latency > max && !lane.latencyMax.compare_exchange_weak (max,
+           latency) ) {
+    }
+
+    try {
+      item.cb ();
+    } catch (std::exception &e) {
+      GST_WARNING ("Error sending event: %s", e.what() );
+    } catch (...) {
+      GST_WARNING ("Error sending event");
+    }
+  }
+}
+
+std::vector<EventDispatcher::LaneStats>
+EventDispatcher::getStats ()
+{
+  std::vector<LaneStats> ret;
+
+  for (size_t i = 0; i < lanes.size (); i++) {
+    Lane &lane = *lanes[i];
+    LaneStats stats;
+
+    stats.lane = i;
+    stats.queueDepth = lane.queueDepth;
+    stats.dispatchedEvents = lane.dispatchedEvents;
+    stats.batches = lane.batches;
+    stats.avgDispatchLatency = stats.dispatchedEvents > 0 ?
+                               lane.latencySum / stats.dispatchedEvents : 0;
+    stats.maxDispatchLatency = lane.latencyMax;
+    ret.push_back (stats);
+  }
+
+  return ret;
+}
+
+EventDispatcher::StaticConstructor EventDispatcher::staticConstructor;
+
+EventDispatcher::StaticConstructor::StaticConstructor()
+{
+  GST_DEBUG_CATEGORY_INIT (GST_CAT_DEFAULT, GST_DEFAULT_NAME, 0,
+                           GST_DEFAULT_NAME);
+}
+
+} /* kurento */
@@ -0,0 +1,111 @@
+/*
+ * (C) Copyright 2016 Kurento (http://kurento.org/)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#ifndef __EVENT_DISPATCHER_HPP__
+#define __EVENT_DISPATCHER_HPP__
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace kurento
+{
+
+/*
+ * Delivers events to EventHandlers from a set of lanes, each one served by
+ * its own thread. Handlers are assigned to a lane by session, so a slow
+ * subscriber only delays the sessions sharing its lane, and events of a
+ * handler are always delivered in order. Every lane wakes up once per
+ * burst and runs all the callbacks pending in it.
+ *
+ * With more than one lane, handlers of different sessions send at the same
+ * time, so it is only worth it with transports that allow it. The default
+ * is a single lane, as the former single worker.
+ */
+class EventDispatcher
+{
+public:
+  struct LaneStats {
+    int lane;
+    int64_t queueDepth;
+    int64_t dispatchedEvents;
+    int64_t batches;
+    /* Time between the event being queued and sent, in microseconds */
+    int64_t avgDispatchLatency;
+    int64_t maxDispatchLatency;
+  };
+
+  ~EventDispatcher ();
+
+  void dispatch (size_t key, std::function<void () > cb);
+
+  std::vector<LaneStats> getStats ();
+
+  static EventDispatcher &getDispatcher ();
+  /* Only takes effect if called before the first event is dispatched */
+  static void setLanes (int lanes);
+  static int getLanes ();
+
+private:
+  struct Item {
+    std::function<void () > cb;
+    std::chrono::steady_clock::time_point queued;
+  };
+
+  struct Lane {
+    std::mutex mutex;
+    std::condition_variable cond;
+    std::deque<Item> queue;
+    std::thread thread;
+
+    std::atomic<int64_t> queueDepth{0};
+    std::atomic<int64_t> dispatchedEvents{0};
+    std::atomic<int64_t> batches{0};
+    std::atomic<int64_t> latencySum{0};
+    std::atomic<int64_t> latencyMax{0};
+  };
+
+  EventDispatcher (int lanes);
+
+  void enqueue (size_t key, Item &&item);
+  void laneLoop (Lane &lane);
+  void dispatchBatch (Lane &lane, std::deque<Item> &batch);
+
+  std::vector<std::unique_ptr<Lane>> lanes;
+  std::atomic<bool> terminated{false};
+
+  static int lanesNumber;
+  static std::atomic<bool> created;
+
+  class StaticConstructor
+  {
+  public:
+    StaticConstructor();
+  };
+
+  static StaticConstructor staticConstructor;
+};
+
+} /* kurento */
+
+#endif /* __EVENT_DISPATCHER_HPP__ */
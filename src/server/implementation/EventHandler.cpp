@@ -16,22 +16,55 @@
  */
 
 #include "EventHandler.hpp"
-#include <WorkerPool.hpp>
+#include "EventDispatcher.hpp"
+#include "MetricsRegistry.hpp"
+#include <MediaObjectImpl.hpp>
 
 namespace kurento
 {
 
-static void
-post_task (std::function <void () > cb)
+EventHandler::EventHandler (std::shared_ptr <MediaObjectImpl> object) :
+  EventHandler (object, "")
 {
-  static WorkerPool workers (1);
+}
 
-  workers.post (cb);
+EventHandler::EventHandler (std::shared_ptr <MediaObjectImpl> object,
+                            const std::string &sessionId) :
+  object (object), sessionId (sessionId)
+{
+  /* Without a session, keep at least the events of the object together */
+  if (!sessionId.empty() || !object) {
+    laneKey = std::hash<std::string> () (sessionId);
+  } else {
+    laneKey = std::hash<std::string> () (object->getId() );
+  }
 }
 
-EventHandler::EventHandler (std::shared_ptr <MediaObjectImpl> object) :
-  object (object)
+std::string
+EventHandler::getSessionId ()
 {
+  std::unique_lock <std::mutex> lock (mutex);
+
+  return sessionId;
+}
+
+void
+EventHandler::setSessionId (const std::string &sessionId)
+{
+  std::unique_lock <std::mutex> lock (mutex);
+
+  if (sessionId.empty () || this->sessionId == sessionId) {
+    return;
+  }
+
+  this->sessionId = sessionId;
+
+  if (dispatched) {
+    /* Moving would let the old lane and the new one send at once */
+    return;
+  }
+
+  laneKey = std::hash<std::string> () (sessionId);
 }
 
 EventHandler::~EventHandler()
@@ -46,10 +79,27 @@ EventHandler::~EventHandler()
   }
 }
 
+static MetricsRegistry::Counter &
+eventsCounter ()
+{
+  static MetricsRegistry::Counter &counter =
+    MetricsRegistry::getRegistry ().counter ("kurento_events_total",
+        "Events queued for delivery to subscribers");
+
+  return counter;
+}
+
 void
 EventHandler::sendEventAsync  (std::function <void () > cb)
 {
-  post_task (cb);
+  std::unique_lock <std::mutex> lock (mutex);
+  size_t key = laneKey;
+
+  dispatched = true;
+  lock.unlock();
+
+  eventsCounter ().inc ();
+  EventDispatcher::getDispatcher ().dispatch (key, cb);
 }
 
 } /* kurento */
@@ -19,6 +19,7 @@
 #define __EVENT_HANDLER_HPP__
 
 #include <memory>
+#include <mutex>
 #include <sigc++/sigc++.h>
 #include <string>
 #include <json/json.h>
@@ -33,12 +34,25 @@ class EventHandler : public std::enable_shared_from_this<EventHandler>
 {
 public:
   EventHandler (std::shared_ptr <MediaObjectImpl> object);
+  EventHandler (std::shared_ptr <MediaObjectImpl> object,
+                const std::string &sessionId);
 
   virtual ~EventHandler();
 
   virtual void sendEvent (Json::Value &value) = 0;
+
   void sendEventAsync  (std::function <void () > cb);
 
+  std::string getSessionId ();
+
+  /*
+   * Binds the handler to the lane of @sessionId. MediaSet does it when the
+   * subscription is registered, as transports create handlers without it.
+   * Once the handler has sent anything it keeps its lane, so that its
+   * sends never run at the same time.
+   */
+  void setSessionId (const std::string &sessionId);
+
   void setConnection (sigc::connection conn)
   {
     this->conn = conn;
@@ -47,6 +61,12 @@ public:
 private:
   std::weak_ptr<MediaObjectImpl> object;
   sigc::connection conn;
+
+  std::mutex mutex;
+  std::string sessionId;
+  /* Selects the dispatcher lane, all events of a session share it */
+  size_t laneKey;
+  bool dispatched = false;
 };
 
 } /* kurento */
@@ -0,0 +1,256 @@
+/*
+ * (C) Copyright 2016 Kurento (http://kurento.org/)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#include <gst/gst.h>
+
+#include "EventPolicy.hpp"
+
+#include <thread>
+
+#define GST_CAT_DEFAULT kurento_event_policy
+GST_DEBUG_CATEGORY_STATIC (GST_CAT_DEFAULT);
+#define GST_DEFAULT_NAME "KurentoEventPolicy"
+
+namespace kurento
+{
+
+/* Runs the timers of the changes held by every policy */
+class EventPolicyTimers
+{
+public:
+  EventPolicyTimers () : work (new boost::asio::io_service::work (service) )
+  {
+    thread = std::thread ([this] () {
+      service.run ();
+    });
+  }
+
+  ~EventPolicyTimers ()
+  {
+    work.reset ();
+    service.stop ();
+
+    try {
+      if (thread.joinable () ) {
+        thread.join ();
+      }
+    } catch (std::system_error &e) {
+      GST_ERROR ("Error joining: %s", e.what() );
+    }
+  }
+
+  boost::asio::io_service service;
+
+private:
+  std::unique_ptr<boost::asio::io_service::work> work;
+  std::thread thread;
+};
+
+static boost::asio::io_service &
+getTimerService ()
+{
+  static EventPolicyTimers timers;
+
+  return timers.service;
+}
+
+std::shared_ptr<EventPolicy::Bucket>
+EventPolicy::getBucket (const std::string &rateKey, int rateLimit)
+{
+  static std::mutex bucketsMutex;
+  static std::map<std::string, std::weak_ptr<Bucket>> buckets;
+  std::unique_lock <std::mutex> lock (bucketsMutex);
+  std::shared_ptr<Bucket> bucket;
+
+  for (auto it = buckets.begin (); it != buckets.end ();) {
+    if (it->second.expired () ) {
+      it = buckets.erase (it);
+    } else {
+      ++it;
+    }
+  }
+
+  bucket = buckets[rateKey].lock ();
+
+  if (!bucket) {
+    bucket = std::make_shared<Bucket> ();
+    bucket->tokens = rateLimit;
+    bucket->last = std::chrono::steady_clock::now ();
+    buckets[rateKey] = bucket;
+  }
+
+  return bucket;
+}
+
+EventPolicy::EventPolicy (const Config &config, const std::string &rateKey) :
+  config (config)
+{
+  if (config.rateLimit > 0) {
+    bucket = getBucket (rateKey, config.rateLimit);
+  }
+}
+
+EventPolicy::~EventPolicy ()
+{
+  std::unique_lock <std::mutex> lock (mutex);
+
+  for (auto &it : states) {
+    if (it.second.timer) {
+      it.second.timer->cancel ();
+    }
+  }
+}
+
+/* Takes a token from the bucket or returns how long to wait for one */
+std::chrono::microseconds
+EventPolicy::reserve ()
+{
+  if (!bucket) {
+    return std::chrono::microseconds (0);
+  }
+
+  std::unique_lock <std::mutex> lock (bucket->mutex);
+  auto now = std::chrono::steady_clock::now ();
+  double elapsed = std::chrono::duration_cast<std::chrono::microseconds>
+                   (now - bucket->last).count () / 1000000.0;
+
+  bucket->last = now;
+  bucket->tokens = std::min<double> (config.rateLimit,
+                                     bucket->tokens + elapsed * config.rateLimit);
+
+  if (bucket->tokens >= 1) {
+    bucket->tokens -= 1;
+    return std::chrono::microseconds (0);
+  }
+
+  return std::chrono::microseconds (static_cast<int64_t> ( (1 - bucket->tokens)
+                                    * 1000000 / config.rateLimit) + 1);
+}
+
+void
+EventPolicy::schedule (const std::string &key, State &state,
+                       std::chrono::microseconds delay)
+{
+  std::weak_ptr<EventPolicy> weak = shared_from_this ();
+  uint64_t generation = ++state.generation;
+
+  if (!state.timer) {
+    state.timer = std::make_shared<boost::asio::steady_timer>
+                  (getTimerService () );
+  }
+
+  state.timer->expires_from_now (delay);
+  state.timer->async_wait ([weak, key, generation] (
+  const boost::system::error_code & ec) {
+    std::shared_ptr<EventPolicy> self = weak.lock ();
+
+    if (ec || !self) {
+      return;
+    }
+
+    self->fire (key, generation);
+  });
+}
+
+void
+EventPolicy::fire (const std::string &key, uint64_t generation)
+{
+  std::function<void () > emit;
+
+  {
+    std::unique_lock <std::mutex> lock (mutex);
+    State &state = states[key];
+    std::chrono::microseconds wait;
+
+    if (!state.hasPending || state.generation != generation) {
+      return;
+    }
+
+    wait = reserve ();
+
+    if (wait.count () > 0) {
+      schedule (key, state, wait);
+      return;
+    }
+
+    state.reported = state.pending;
+    state.hasPending = false;
+    emit.swap (state.emit);
+  }
+
+  emit ();
+}
+
+void
+EventPolicy::submit (const std::string &key, int value,
+                     std::function<void () > emit)
+{
+  std::unique_lock <std::mutex> lock (mutex);
+  State &state = states[key];
+  std::chrono::microseconds wait (0);
+
+  if (state.hasPending) {
+    /* Last value wins, the held change is never reported */
+    droppedEvents++;
+
+    if (value == state.reported) {
+      GST_DEBUG ("Change of '%s' reverted before being reported", key.c_str() );
+      state.hasPending = false;
+      state.emit = nullptr;
+      state.generation++;
+      state.timer->cancel ();
+    } else {
+      state.pending = value;
+      state.emit = emit;
+    }
+
+    return;
+  }
+
+  if (value == state.reported) {
+    droppedEvents++;
+    return;
+  }
+
+  if (config.debounce > 0) {
+    wait = std::chrono::milliseconds (config.debounce);
+  } else {
+    wait = reserve ();
+  }
+
+  if (wait.count () == 0) {
+    state.reported = value;
+    lock.unlock ();
+    emit ();
+    return;
+  }
+
+  state.hasPending = true;
+  state.pending = value;
+  state.emit = emit;
+  schedule (key, state, wait);
+}
+
+EventPolicy::StaticConstructor EventPolicy::staticConstructor;
+
+EventPolicy::StaticConstructor::StaticConstructor()
+{
+  GST_DEBUG_CATEGORY_INIT (GST_CAT_DEFAULT, GST_DEFAULT_NAME, 0,
+                           GST_DEFAULT_NAME);
+}
+
+} /* kurento */
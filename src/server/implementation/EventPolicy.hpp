@@ -0,0 +1,109 @@
+/*
+ * (C) Copyright 2016 Kurento (http://kurento.org/)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#ifndef __EVENT_POLICY_HPP__
+#define __EVENT_POLICY_HPP__
+
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <boost/asio.hpp>
+#include <boost/asio/steady_timer.hpp>
+
+namespace kurento
+{
+
+/*
+ * Filters the state change events of an element before they are raised.
+ * A change to the state already reported is discarded. With a debounce
+ * window, a change is held for that time and only the last value is
+ * reported, so a state that flaps back within the window raises nothing.
+ * The rate limit is shared by every policy created with the same rate key
+ * and delays, instead of discarding, the changes exceeding it.
+ */
+class EventPolicy : public std::enable_shared_from_this<EventPolicy>
+{
+public:
+  struct Config {
+    /* Time a change is held before being reported, in milliseconds */
+    int debounce = 0;
+    /* Changes per second allowed for the rate key, 0 means no limit */
+    int rateLimit = 0;
+  };
+
+  EventPolicy (const Config &config, const std::string &rateKey);
+  ~EventPolicy ();
+
+  /*
+   * Reports "value" as the new state of "key" calling "emit", unless it is
+   * redundant or it is superseded by a newer value before being reported
+   */
+  void submit (const std::string &key, int value, std::function<void () > emit);
+
+  int64_t getDroppedEvents ()
+  {
+    return droppedEvents;
+  }
+
+private:
+  struct Bucket {
+    std::mutex mutex;
+    double tokens;
+    std::chrono::steady_clock::time_point last;
+  };
+
+  struct State {
+    int reported = -1;
+    bool hasPending = false;
+    int pending = -1;
+    std::function<void () > emit;
+    uint64_t generation = 0;
+    std::shared_ptr<boost::asio::steady_timer> timer;
+  };
+
+  std::chrono::microseconds reserve ();
+  void schedule (const std::string &key, State &state,
+                 std::chrono::microseconds delay);
+  void fire (const std::string &key, uint64_t generation);
+
+  static std::shared_ptr<Bucket> getBucket (const std::string &rateKey,
+      int rateLimit);
+
+  Config config;
+  std::shared_ptr<Bucket> bucket;
+
+  std::mutex mutex;
+  std::map<std::string, State> states;
+
+  std::atomic<int64_t> droppedEvents{0};
+
+  class StaticConstructor
+  {
+  public:
+    StaticConstructor();
+  };
+
+  static StaticConstructor staticConstructor;
+};
+
+} /* kurento */
+
+#endif /* __EVENT_POLICY_HPP__ */
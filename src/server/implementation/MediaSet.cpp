@@ -21,6 +21,7 @@
 #include <KurentoException.hpp>
 #include <MediaPipelineImpl.hpp>
 #include <ServerManagerImpl.hpp>
+#include "MetricsRegistry.hpp"
 
 #include <functional>
 
@@ -42,6 +43,10 @@ static const std::chrono::seconds COLLECTOR_INTERVAL_DEFAULT =
   std::chrono::seconds (
     240);
 
+/* Granularity of session expiration */
+static const std::chrono::milliseconds COLLECTOR_TICK =
+  std::chrono::milliseconds (1000);
+
 std::chrono::seconds MediaSet::collectorInterval = COLLECTOR_INTERVAL_DEFAULT;
 
 void
@@ -56,10 +61,82 @@ MediaSet::getCollectorInterval()
   return collectorInterval;
 }
 
+static WorkerPool::Config
+defaultWorkerPoolConfig ()
+{
+  WorkerPool::Config config;
+
+  config.threads = MEDIASET_THREADS_DEFAULT;
+
+  return config;
+}
+
+WorkerPool::Config MediaSet::workerPoolConfig = defaultWorkerPoolConfig ();
 
 static std::shared_ptr<MediaSet> mediaSet;
 static std::recursive_mutex mutex;
 
+/* The pool of an already created MediaSet is rebuilt with the new config */
+void
+MediaSet::setWorkerPoolConfig (const WorkerPool::Config &config)
+{
+  std::unique_lock <std::recursive_mutex> lock (mutex);
+  std::shared_ptr<MediaSet> current = mediaSet;
+  WorkerPool::Config poolConfig = config;
+
+  /* Tasks are posted with recMutex held, blocking there could deadlock */
+  if (config.maxQueueDepth > 0
+      && config.overflowPolicy == WorkerPool::OverflowPolicy::BLOCK) {
+    GST_WARNING ("BLOCK overflow policy not allowed, using CALLER_RUNS");
+    poolConfig.overflowPolicy = WorkerPool::OverflowPolicy::CALLER_RUNS;
+  }
+
+  workerPoolConfig = poolConfig;
+  lock.unlock();
+
+  if (current) {
+    current->rebuildWorkerPool (poolConfig);
+  }
+}
+
+WorkerPool::Config
+MediaSet::getWorkerPoolConfig()
+{
+  std::unique_lock <std::recursive_mutex> lock (mutex);
+
+  return workerPoolConfig;
+}
+
+void
+MediaSet::rebuildWorkerPool (const WorkerPool::Config &config)
+{
+  std::unique_lock <std::recursive_mutex> lock (recMutex);
+  std::shared_ptr<WorkerPool> old = workers;
+
+  if (terminated) {
+    return;
+  }
+
+  GST_INFO ("Rebuilding MediaSet worker pool");
+  workers = std::make_shared<WorkerPool> (config, "MediaSet");
+  lock.unlock();
+
+  /* Runs the tasks still queued in the old pool */
+  old.reset();
+}
+
+WorkerPool::Stats
+MediaSet::getWorkerPoolStats ()
+{
+  std::unique_lock <std::recursive_mutex> lock (recMutex);
+  std::shared_ptr<WorkerPool> pool = workers;
+
+  lock.unlock();
+
+  return pool->getStats ();
+}
+
+
 std::shared_ptr<MediaSet>
 MediaSet::getMediaSet()
 {
@@ -115,49 +192,104 @@ MediaSet::deleteMediaSet()
 
 void MediaSet::doGarbageCollection ()
 {
-  std::unique_lock <std::recursive_mutex> lock (recMutex);
-  auto sessions = sessionInUse;
+  auto start = std::chrono::steady_clock::now ();
+  std::vector<TimerWheel::Entry> due;
+  std::vector<std::string> inactive;
 
-  lock.unlock();
+  sessionWheel.advance (start, due);
 
-  GST_DEBUG ("Running garbage collector");
+  if (due.empty () ) {
+    return;
+  }
 
-  for (auto it : sessions) {
-    if (it.second) {
-      lock.lock();
-      sessionInUse[it.first] = false;
-      lock.unlock();
+  GST_DEBUG ("Running garbage collector, %zu sessions to check", due.size () );
+
+  for (auto &entry : due) {
+    SessionShard &shard = getSessionShard (entry.key);
+    std::unique_lock <std::mutex> lock (shard.mutex);
+    auto it = shard.sessionState.find (entry.key);
+
+    if (it == shard.sessionState.end() || it->second.token != entry.token) {
+      /* Session released or rescheduled since this entry was added */
+      continue;
+    }
+
+    if (it->second.lastKeepAlive + it->second.timeout > start) {
+      scheduleSession (entry.key, it->second);
     } else {
-      GST_WARNING ("Remove inactive session: %s", it.first.c_str() );
-      unrefSession (it.first);
+      inactive.push_back (entry.key);
     }
   }
+
+  for (auto &sessionId : inactive) {
+    GST_WARNING ("Remove inactive session: %s", sessionId.c_str() );
+    unrefSession (sessionId);
+  }
+
+  int64_t pause = std::chrono::duration_cast<std::chrono::microseconds>
+                  (std::chrono::steady_clock::now () - start).count ();
+  int64_t max = maxPause;
+
+  static MetricsRegistry::Histogram &pauseHistogram =
+    MetricsRegistry::getRegistry ().histogram ("kurento_gc_pause_seconds",
+        "Time spent on each run of the session garbage collector",
+        MetricsRegistry::latencyBounds () );
+
+  expiredSessions += inactive.size ();
+  lastPause = pause;
+  pauseHistogram.observe (pause / 1000000.0);
+
+  while (pause > max && !maxPause.compare_exchange_weak (max, pause) ) {
+  }
+}
+
+MediaSet::GarbageCollectorStats
+MediaSet::getGarbageCollectorStats ()
+{
+  GarbageCollectorStats stats;
+
+  stats.activeSessions = 0;
+
+  for (auto &shard : sessionShards) {
+    std::unique_lock <std::mutex> lock (shard.mutex);
+
+    stats.activeSessions += shard.sessionState.size ();
+  }
+
+  stats.expiredSessions = expiredSessions;
+  stats.lastPause = lastPause;
+  stats.maxPause = maxPause;
+
+  return stats;
 }
 
-MediaSet::MediaSet()
+MediaSet::MediaSet() : sessionWheel (COLLECTOR_TICK)
 {
   terminated = false;
 
-  workers = std::make_shared<WorkerPool>(MEDIASET_THREADS_DEFAULT);
+  workers = std::make_shared<WorkerPool> (getWorkerPoolConfig (), "MediaSet");
 
   thread = std::thread ( [&] () {
     std::unique_lock <std::recursive_mutex> lock (recMutex);
 
-
-    while (!terminated && waitCond.wait_for (lock,
-           collectorInterval) == std::cv_status::timeout) {
+    while (!terminated) {
+      waitCond.wait_for (lock, sessionWheel.getTick () );
 
       if (terminated) {
         return;
       }
 
+      /* Collection only needs the shard locks, let requests go on */
+      lock.unlock();
+
       try {
         doGarbageCollection();
       } catch (...) {
         GST_ERROR ("Error during garbage collection");
       }
-    }
 
+      lock.lock();
+    }
   });
 }
 
@@ -171,7 +303,7 @@ MediaSet::~MediaSet ()
 
   terminated = true;
 
-  serverManager.reset();
+  std::atomic_store (&serverManager, std::shared_ptr <ServerManagerImpl> () );
   waitCond.notify_all();
 
   lock.unlock();
@@ -201,7 +333,14 @@ MediaSet::post (std::function<void (void) > f)
   std::unique_lock <std::recursive_mutex> lock (recMutex);
 
   if (!terminated && workers) {
-    workers->post (f);
+    try {
+      workers->post (f);
+    } catch (KurentoException &e) {
+      /* Releases cannot be dropped, run it here instead of leaking */
+      GST_WARNING ("Cannot post task: %s, running it synchronously", e.what() );
+      lock.unlock();
+      f();
+    }
   } else {
     lock.unlock();
     f();
@@ -216,7 +355,7 @@ MediaSet::setServerManager (std::shared_ptr <ServerManagerImpl> serverManager)
   if (this->serverManager) {
     GST_WARNING ("ServerManager can only set once, ignoring");
   } else {
-    this->serverManager = serverManager;
+    std::atomic_store (&this->serverManager, serverManager);
   }
 }
 
@@ -236,7 +375,7 @@ MediaSet::ref (MediaObjectImpl *mediaObjectPtr)
     this->releasePointer (obj);
   });
 
-  objectsMap[mediaObject->getId()] = std::weak_ptr<MediaObjectImpl> (mediaObject);
+  objectsMap.insert (mediaObject->getId(), mediaObject);
 
   if (mediaObject->getParent() ) {
     std::shared_ptr<MediaObjectImpl> parent = std::dynamic_pointer_cast
@@ -270,7 +409,7 @@ MediaSet::ref (const std::string &sessionId,
 {
   std::unique_lock <std::recursive_mutex> lock (recMutex);
 
-  if (objectsMap.find (mediaObject->getId() ) == objectsMap.end() ) {
+  if (!objectsMap.find (mediaObject->getId() ) ) {
     throw KurentoException (MEDIA_OBJECT_NOT_FOUND,
                             "Cannot register media object, it was not created by MediaSet");
   }
@@ -283,7 +422,11 @@ MediaSet::ref (const std::string &sessionId,
   }
 
   sessionMap[sessionId][mediaObject->getId()] = mediaObject;
-  reverseSessionMap[mediaObject->getId()].insert (sessionId);
+
+  auto &sessions = reverseSessionMap[mediaObject->getId()];
+
+  sessions.insert (sessionId);
+  objectsMap.setSessions (mediaObject->getId(), sessions.size() );
 }
 
 void
@@ -301,22 +444,79 @@ MediaSet::keepAliveSession (const std::string &sessionId)
   keepAliveSession (sessionId, false);
 }
 
+MediaSet::SessionShard &
+MediaSet::getSessionShard (const std::string &sessionId)
+{
+  return sessionShards[std::hash<std::string> () (sessionId) % SESSION_SHARDS];
+}
+
+void
+MediaSet::eraseSession (const std::string &sessionId)
+{
+  SessionShard &shard = getSessionShard (sessionId);
+  SessionEventHandlers handlers;
+  std::unique_lock <std::mutex> lock (shard.mutex);
+
+  shard.sessionState.erase (sessionId);
+
+  auto it = shard.eventHandler.find (sessionId);
+
+  if (it != shard.eventHandler.end() ) {
+    /* Handlers are destroyed out of the shard lock */
+    handlers.swap (it->second);
+    shard.eventHandler.erase (it);
+  }
+}
+
+void
+MediaSet::scheduleSession (const std::string &sessionId, SessionState &state)
+{
+  state.token = ++wheelTokens;
+  sessionWheel.schedule (sessionId, state.token,
+                         state.lastKeepAlive + state.timeout);
+}
+
 void
 MediaSet::keepAliveSession (const std::string &sessionId, bool create)
 {
-  std::unique_lock <std::recursive_mutex> lock (recMutex);
+  SessionShard &shard = getSessionShard (sessionId);
+  std::unique_lock <std::mutex> lock (shard.mutex);
+  auto now = std::chrono::steady_clock::now ();
 
-  auto it = sessionInUse.find (sessionId);
+  auto it = shard.sessionState.find (sessionId);
 
-  if (it == sessionInUse.end() ) {
+  if (it == shard.sessionState.end() ) {
     if (create) {
-      sessionInUse[sessionId] = true;
+      SessionState &state = shard.sessionState[sessionId];
+
+      /* Sessions used to survive between one and two collector intervals */
+      state.lastKeepAlive = now;
+      state.timeout = 2 * collectorInterval;
+      scheduleSession (sessionId, state);
     } else {
       throw KurentoException (INVALID_SESSION, "Invalid session");
     }
   } else {
-    it->second = true;
+    /* The wheel entry is not touched, it is rescheduled lazily on expiry */
+    it->second.lastKeepAlive = now;
+  }
+}
+
+void
+MediaSet::setSessionTimeout (const std::string &sessionId,
+                             std::chrono::milliseconds timeout)
+{
+  SessionShard &shard = getSessionShard (sessionId);
+  std::unique_lock <std::mutex> lock (shard.mutex);
+
+  auto it = shard.sessionState.find (sessionId);
+
+  if (it == shard.sessionState.end() ) {
+    throw KurentoException (INVALID_SESSION, "Invalid session");
   }
+
+  it->second.timeout = timeout;
+  scheduleSession (sessionId, it->second);
 }
 
 void
@@ -335,8 +535,7 @@ MediaSet::releaseSession (const std::string &sessionId)
   }
 
   sessionMap.erase (sessionId);
-  sessionInUse.erase (sessionId);
-  eventHandler.erase (sessionId);
+  eraseSession (sessionId);
   lock.unlock ();
 
 }
@@ -357,8 +556,7 @@ MediaSet::unrefSession (const std::string &sessionId)
   }
 
   sessionMap.erase (sessionId);
-  sessionInUse.erase (sessionId);
-  eventHandler.erase (sessionId);
+  eraseSession (sessionId);
 
   lock.unlock();
 }
@@ -416,6 +614,7 @@ MediaSet::unref (const std::string &sessionId,
 
   if (it3 != reverseSessionMap.end() ) {
     it3->second.erase (sessionId);
+    objectsMap.setSessions (mediaObject->getId(), it3->second.size() );
 
     if (it3->second.empty() ) {
       released = true;
@@ -436,12 +635,16 @@ MediaSet::unref (const std::string &sessionId,
     reverseSessionMap.erase (mediaObject->getId() );
   }
 
-  auto eventIt = eventHandler.find (sessionId);
+  SessionShard &shard = getSessionShard (sessionId);
+  std::unique_lock <std::mutex> shardLock (shard.mutex);
+  auto eventIt = shard.eventHandler.find (sessionId);
 
-  if (eventIt != eventHandler.end() ) {
+  if (eventIt != shard.eventHandler.end() ) {
     eventIt->second.erase (mediaObject->getId() );
   }
 
+  shardLock.unlock();
+
   if (released) {
     post (std::bind (call_release, mediaObject) );
   }
@@ -477,7 +680,7 @@ void MediaSet::releasePointer (MediaObjectImpl *mediaObject)
   std::unique_lock <std::recursive_mutex> lock (recMutex);
   std::string id = mediaObject->getId();
 
-  objectsMap.erase (id );
+  objectsMap.erase (id);
 
   post (std::bind (async_delete, mediaObject, id) );
 
@@ -535,33 +738,28 @@ MediaSet::getMediaObject (const std::string &mediaObjectRef)
                             "object without committing the transaction.");
   }
 
+  /* No MediaSet lock, this is the hot path of every request */
   std::shared_ptr <MediaObjectImpl> objectLocked;
-  std::unique_lock <std::recursive_mutex> lock (recMutex);
-
-  auto it = objectsMap.find (mediaObjectRef);
+  auto entry = objectsMap.find (mediaObjectRef);
 
-  if (it == objectsMap.end() ) {
+  if (!entry) {
     throw KurentoException (MEDIA_OBJECT_NOT_FOUND,
                             "Object '" + mediaObjectRef + "' not found");
   }
 
-  try {
-    objectLocked = it->second.lock();
-  } catch (...) {
-    throw KurentoException (MEDIA_OBJECT_NOT_FOUND,
-                            "Object '" + mediaObjectRef + "' not found");
-  }
+  objectLocked = entry->lock();
 
   if (!objectLocked) {
     throw KurentoException (MEDIA_OBJECT_NOT_FOUND,
                             "Object '" + mediaObjectRef + "' not found");
   }
 
-  auto it2 = reverseSessionMap.find (objectLocked->getId() );
+  if (entry->sessions == 0) {
+    std::shared_ptr <ServerManagerImpl> manager =
+      std::atomic_load (&serverManager);
 
-  if (it2 == reverseSessionMap.end() || it2->second.empty() ) {
-    if (serverManager && mediaObjectRef == serverManager->getId() ) {
-      return serverManager;
+    if (manager && mediaObjectRef == manager->getId() ) {
+      return manager;
     }
 
     throw KurentoException (MEDIA_OBJECT_NOT_FOUND,
@@ -588,9 +786,15 @@ MediaSet::addEventHandler (const std::string &sessionId,
                            const std::string &subscriptionId,
                            std::shared_ptr<EventHandler> handler)
 {
-  std::unique_lock <std::recursive_mutex> lock (recMutex);
+  SessionShard &shard = getSessionShard (sessionId);
 
-  eventHandler[sessionId][objectId][subscriptionId] = handler;
+  if (handler) {
+    handler->setSessionId (sessionId);
+  }
+
+  std::unique_lock <std::mutex> lock (shard.mutex);
+
+  shard.eventHandler[sessionId][objectId][subscriptionId] = handler;
 }
 
 void
@@ -598,13 +802,14 @@ MediaSet::removeEventHandler (const std::string &sessionId,
                               const std::string &objectId,
                               const std::string &handlerId)
 {
-  std::unique_lock <std::recursive_mutex> lock (recMutex);
-  auto it = eventHandler.find (sessionId);
+  SessionShard &shard = getSessionShard (sessionId);
+  std::unique_lock <std::mutex> lock (shard.mutex);
+  auto it = shard.eventHandler.find (sessionId);
 
-  if (it != eventHandler.end() ) {
-    auto it2 = eventHandler[sessionId].find (objectId);
+  if (it != shard.eventHandler.end() ) {
+    auto it2 = it->second.find (objectId);
 
-    if (it2 != eventHandler[sessionId].end() ) {
+    if (it2 != it->second.end() ) {
       it2->second.erase (handlerId);
     }
   }
@@ -630,7 +835,7 @@ MediaSet::empty()
   if (serverManager) {
     return objectsMap.size () == 1;
   } else {
-    return objectsMap.empty();
+    return objectsMap.size () == 0;
   }
 }
 
@@ -653,11 +858,9 @@ std::list<std::shared_ptr<MediaObjectImpl>>
   std::unique_lock <std::recursive_mutex> lock (recMutex);
   std::list<std::shared_ptr<MediaObjectImpl>> ret;
 
-  auto copy = objectsMap;
-
-  for (auto it : copy) {
+  for (auto &id : objectsMap.getIds() ) {
     try {
-      auto obj = getMediaObject (sessionId, it.first);
+      auto obj = getMediaObject (sessionId, id);
 
       if (std::dynamic_pointer_cast <MediaPipelineImpl> (obj) ) {
         ret.push_back (obj);
@@ -669,6 +872,28 @@ std::list<std::shared_ptr<MediaObjectImpl>>
   return ret;
 }
 
+std::list<std::shared_ptr<MediaObjectImpl>>
+    MediaSet::getAllPipelines ()
+{
+  std::list<std::shared_ptr<MediaObjectImpl>> ret;
+
+  for (auto &id : objectsMap.getIds() ) {
+    auto entry = objectsMap.find (id);
+
+    if (!entry) {
+      continue;
+    }
+
+    auto obj = entry->lock ();
+
+    if (std::dynamic_pointer_cast <MediaPipelineImpl> (obj) ) {
+      ret.push_back (obj);
+    }
+  }
+
+  return ret;
+}
+
 std::list<std::shared_ptr<MediaObjectImpl>>
     MediaSet::getChildren (std::shared_ptr<MediaObjectImpl> obj)
 {
@@ -686,12 +911,39 @@ std::list<std::shared_ptr<MediaObjectImpl>>
   return ret;
 }
 
+static void
+collectMetrics (MetricsRegistry &registry)
+{
+  std::shared_ptr<MediaSet> current;
+
+  {
+    /* Do not create the MediaSet just to report it */
+    std::unique_lock <std::recursive_mutex> lock (mutex);
+    current = mediaSet;
+  }
+
+  if (!current) {
+    return;
+  }
+
+  MediaSet::GarbageCollectorStats stats = current->getGarbageCollectorStats ();
+
+  registry.gauge ("kurento_media_objects",
+                  "Media objects alive").set (current->getObjectCount () );
+  registry.gauge ("kurento_sessions",
+                  "Sessions tracked by the garbage collector").set (stats.activeSessions);
+  registry.counter ("kurento_gc_expired_sessions_total",
+                    "Sessions released for being inactive").set (stats.expiredSessions);
+}
+
 MediaSet::StaticConstructor MediaSet::staticConstructor;
 
 MediaSet::StaticConstructor::StaticConstructor()
 {
   GST_DEBUG_CATEGORY_INIT (GST_CAT_DEFAULT, GST_DEFAULT_NAME, 0,
                            GST_DEFAULT_NAME);
+
+  MetricsRegistry::getRegistry ().addCollector (collectMetrics);
 }
 
 } // kurento
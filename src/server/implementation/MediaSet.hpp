@@ -21,6 +21,7 @@
 #include <MediaObjectImpl.hpp>
 
 #include <unordered_set>
+#include <unordered_map>
 #include <map>
 #include <memory>
 #include <mutex>
@@ -29,6 +30,8 @@
 #include <atomic>
 
 #include "WorkerPool.hpp"
+#include "ObjectRegistry.hpp"
+#include "TimerWheel.hpp"
 
 namespace kurento
 {
@@ -40,6 +43,14 @@ class ServerManagerImpl;
 class MediaSet
 {
 public:
+  struct GarbageCollectorStats {
+    int64_t activeSessions;
+    int64_t expiredSessions;
+    /* Time spent on each collector run, in microseconds */
+    int64_t lastPause;
+    int64_t maxPause;
+  };
+
   ~MediaSet ();
 
   void ref (const std::string &sessionId,
@@ -62,6 +73,8 @@ public:
   void releaseSession (const std::string &sessionId);
   void unrefSession (const std::string &sessionId);
   void keepAliveSession (const std::string &sessionId);
+  void setSessionTimeout (const std::string &sessionId,
+                          std::chrono::milliseconds timeout);
 
   void release (std::shared_ptr<MediaObjectImpl> mediaObject);
   void release (const std::string &mediaObjectRef);
@@ -76,15 +89,29 @@ public:
         const std::string &sessionId = "");
   std::list<std::shared_ptr<MediaObjectImpl>> getChildren (
         std::shared_ptr<MediaObjectImpl> obj);
+  /* Pipelines alive, without referencing them from any session. For
+   * monitoring, that must not keep objects from being collected */
+  std::list<std::shared_ptr<MediaObjectImpl>> getAllPipelines ();
 
   void setServerManager (std::shared_ptr <ServerManagerImpl> serverManager);
 
   bool empty();
 
+  size_t getObjectCount ()
+  {
+    return objectsMap.size ();
+  }
+
+  GarbageCollectorStats getGarbageCollectorStats ();
+
   static std::shared_ptr<MediaSet> getMediaSet();
   static void deleteMediaSet();
   static void setCollectorInterval (std::chrono::seconds interval);
   static std::chrono::seconds getCollectorInterval();
+  static void setWorkerPoolConfig (const WorkerPool::Config &config);
+  static WorkerPool::Config getWorkerPoolConfig();
+
+  WorkerPool::Stats getWorkerPoolStats ();
 
   sigc::signal<void> signalEmptyLocked;
   sigc::signal<void> signalEmpty;
@@ -92,6 +119,7 @@ public:
 private:
 
   void keepAliveSession (const std::string &sessionId, bool create);
+  void rebuildWorkerPool (const WorkerPool::Config &config);
   void doGarbageCollection ();
 
   std::thread thread;
@@ -111,10 +139,7 @@ private:
 
   std::shared_ptr <ServerManagerImpl> serverManager;
 
-  std::map<
-      std::string,
-      std::weak_ptr<MediaObjectImpl>
-  > objectsMap;
+  ObjectRegistry objectsMap;
 
   std::map<
       std::string,  // Parent Object ID
@@ -139,25 +164,59 @@ private:
       >
   > reverseSessionMap;
 
-  std::map<
-      std::string,  // Session ID
-      bool
-  > sessionInUse;
-
-  std::map<
-      std::string,  // Session ID
+  typedef std::map<
+      std::string,  // Object ID
       std::map<
-          std::string,  // Object ID
-          std::map<
-              std::string,  // Subscription ID
-              std::shared_ptr<EventHandler>
-          >
+          std::string,  // Subscription ID
+          std::shared_ptr<EventHandler>
       >
-  > eventHandler;
+  > SessionEventHandlers;
+
+  struct SessionState {
+    std::chrono::steady_clock::time_point lastKeepAlive;
+    std::chrono::milliseconds timeout;
+    /* Identifies the wheel entry currently watching this session */
+    uint64_t token;
+  };
+
+  /*
+   * Per session data that is accessed without taking recMutex. If both are
+   * needed, recMutex has to be taken before the shard mutex, and the shard
+   * mutex before the one of sessionWheel.
+   */
+  struct SessionShard {
+    std::mutex mutex;
+
+    std::unordered_map<
+        std::string,  // Session ID
+        SessionState
+    > sessionState;
+
+    std::unordered_map<
+        std::string,  // Session ID
+        SessionEventHandlers
+    > eventHandler;
+  };
+
+  static const size_t SESSION_SHARDS = 32;
+
+  SessionShard &getSessionShard (const std::string &sessionId);
+  void eraseSession (const std::string &sessionId);
+  void scheduleSession (const std::string &sessionId, SessionState &state);
+
+  SessionShard sessionShards[SESSION_SHARDS];
+
+  TimerWheel sessionWheel;
+  std::atomic<uint64_t> wheelTokens{0};
+
+  std::atomic<int64_t> expiredSessions{0};
+  std::atomic<int64_t> lastPause{0};
+  std::atomic<int64_t> maxPause{0};
 
   std::shared_ptr<WorkerPool> workers;
 
   static std::chrono::seconds collectorInterval;
+  static WorkerPool::Config workerPoolConfig;
 
   class StaticConstructor
   {
@@ -0,0 +1,180 @@
+/*
+ * (C) Copyright 2016 Kurento (http://kurento.org/)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#include <gst/gst.h>
+
+#include "MetricsExporter.hpp"
+#include "MetricsRegistry.hpp"
+
+#include <cstdio>
+#include <unistd.h>
+#include <fstream>
+
+#define GST_CAT_DEFAULT kurento_metrics_exporter
+GST_DEBUG_CATEGORY_STATIC (GST_CAT_DEFAULT);
+#define GST_DEFAULT_NAME "KurentoMetricsExporter"
+
+#define METRICS "metrics"
+
+namespace kurento
+{
+
+bool
+MetricsExporter::getConfig (const boost::property_tree::ptree &config,
+                            Config &metricsConfig)
+{
+  boost::optional<const boost::property_tree::ptree &> node =
+    config.get_child_optional (METRICS);
+
+  if (!node) {
+    GST_LOG ("No %s in config file", METRICS);
+    return false;
+  }
+
+  metricsConfig.file = node->get<std::string> ("file", "");
+  metricsConfig.socket = node->get<std::string> ("socket", "");
+  metricsConfig.interval = node->get<int> ("interval", metricsConfig.interval);
+
+  return !metricsConfig.file.empty () || !metricsConfig.socket.empty ();
+}
+
+MetricsExporter::MetricsExporter (const Config &config) : config (config),
+  work (new boost::asio::io_service::work (service) ), timer (service)
+{
+  if (!config.socket.empty () ) {
+    boost::asio::local::stream_protocol::endpoint endpoint (config.socket);
+
+    ::unlink (config.socket.c_str () );
+
+    try {
+      acceptor.reset (new boost::asio::local::stream_protocol::acceptor (
+                        service, endpoint) );
+      accept ();
+      GST_INFO ("Serving metrics on %s", config.socket.c_str () );
+    } catch (boost::system::system_error &e) {
+      GST_ERROR ("Cannot listen on %s: %s", config.socket.c_str (), e.what () );
+    }
+  }
+
+  if (!config.file.empty () ) {
+    GST_INFO ("Writing metrics to %s every %d ms", config.file.c_str (),
+              config.interval);
+    scheduleFile ();
+  }
+
+  thread = std::thread ([this] () {
+    service.run ();
+  });
+}
+
+MetricsExporter::~MetricsExporter ()
+{
+  work.reset ();
+  service.stop ();
+
+  try {
+    if (thread.joinable () ) {
+      thread.join ();
+    }
+  } catch (std::system_error &e) {
+    GST_ERROR ("Error joining: %s", e.what() );
+  }
+
+  if (acceptor) {
+    ::unlink (config.socket.c_str () );
+  }
+}
+
+void
+MetricsExporter::writeFile ()
+{
+  /* Write and rename, so scrapers never read a partial file */
+  std::string tmp = config.file + ".tmp";
+  std::ofstream out (tmp, std::ios::trunc);
+
+  out << MetricsRegistry::getRegistry ().exposition ();
+  out.close ();
+
+  if (!out || std::rename (tmp.c_str (), config.file.c_str () ) != 0) {
+    GST_WARNING ("Cannot write metrics to %s", config.file.c_str () );
+  }
+}
+
+void
+MetricsExporter::scheduleFile ()
+{
+  timer.expires_from_now (std::chrono::milliseconds (config.interval) );
+  timer.async_wait ([this] (const boost::system::error_code & ec) {
+    if (ec) {
+      return;
+    }
+
+    writeFile ();
+    scheduleFile ();
+  });
+}
+
+void
+MetricsExporter::accept ()
+{
+  auto socket = std::make_shared<boost::asio::local::stream_protocol::socket>
+                (service);
+
+  acceptor->async_accept (*socket, [this,
+  socket] (const boost::system::error_code & ec) {
+    if (ec) {
+      if (ec != boost::asio::error::operation_aborted) {
+        GST_WARNING ("Error accepting metrics connection: %s",
+                     ec.message ().c_str () );
+        accept ();
+      }
+
+      return;
+    }
+
+    auto request = std::make_shared<boost::asio::streambuf> ();
+
+    /* Any request gets the metrics, only wait for the end of its headers */
+    boost::asio::async_read_until (*socket, *request, "\r\n\r\n",
+    [socket, request] (const boost::system::error_code &, std::size_t) {
+      auto response = std::make_shared<std::string> (
+                        "HTTP/1.0 200 OK\r\n"
+                        "Content-Type: text/plain; version=0.0.4\r\n\r\n" +
+                        MetricsRegistry::getRegistry ().exposition () );
+
+      boost::asio::async_write (*socket, boost::asio::buffer (*response),
+      [socket, response] (const boost::system::error_code &, std::size_t) {
+        boost::system::error_code ignored;
+
+        socket->shutdown (boost::asio::local::stream_protocol::socket::shutdown_both,
+                          ignored);
+      });
+    });
+
+    accept ();
+  });
+}
+
+MetricsExporter::StaticConstructor MetricsExporter::staticConstructor;
+
+MetricsExporter::StaticConstructor::StaticConstructor()
+{
+  GST_DEBUG_CATEGORY_INIT (GST_CAT_DEFAULT, GST_DEFAULT_NAME, 0,
+                           GST_DEFAULT_NAME);
+}
+
+} /* kurento */
@@ -0,0 +1,78 @@
+/*
+ * (C) Copyright 2016 Kurento (http://kurento.org/)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#ifndef __METRICS_EXPORTER_HPP__
+#define __METRICS_EXPORTER_HPP__
+
+#include <memory>
+#include <string>
+#include <thread>
+#include <boost/asio.hpp>
+#include <boost/asio/steady_timer.hpp>
+#include <boost/property_tree/ptree.hpp>
+
+namespace kurento
+{
+
+/*
+ * Publishes the MetricsRegistry in the Prometheus text format. It can
+ * periodically rewrite a file, suitable for the node exporter textfile
+ * collector, and answer HTTP requests on a local unix socket.
+ */
+class MetricsExporter
+{
+public:
+  struct Config {
+    /* Empty disables each output */
+    std::string file;
+    std::string socket;
+    /* Time between file updates, in milliseconds */
+    int interval = 5000;
+  };
+
+  MetricsExporter (const Config &config);
+  ~MetricsExporter ();
+
+  /* Reads the "metrics" node of the server configuration */
+  static bool getConfig (const boost::property_tree::ptree &config,
+                         Config &metricsConfig);
+
+private:
+  void writeFile ();
+  void scheduleFile ();
+  void accept ();
+
+  Config config;
+
+  boost::asio::io_service service;
+  std::unique_ptr<boost::asio::io_service::work> work;
+  boost::asio::steady_timer timer;
+  std::unique_ptr<boost::asio::local::stream_protocol::acceptor> acceptor;
+  std::thread thread;
+
+  class StaticConstructor
+  {
+  public:
+    StaticConstructor();
+  };
+
+  static StaticConstructor staticConstructor;
+};
+
+} /* kurento */
+
+#endif /* __METRICS_EXPORTER_HPP__ */
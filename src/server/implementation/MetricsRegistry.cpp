@@ -0,0 +1,299 @@
+/*
+ * (C) Copyright 2016 Kurento (http://kurento.org/)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#include "MetricsRegistry.hpp"
+#include <KurentoException.hpp>
+
+#include <algorithm>
+#include <limits>
+#include <sstream>
+
+namespace kurento
+{
+
+static void
+atomicAdd (std::atomic<double> &target, double value)
+{
+  double current = target;
+
+  while (!target.compare_exchange_weak (current, current + value) ) {
+  }
+}
+
+void
+MetricsRegistry::Gauge::add (double value)
+{
+  atomicAdd (this->value, value);
+}
+
+MetricsRegistry::Histogram::Histogram (const std::vector<double> &bounds) :
+  bounds (bounds), buckets (new std::atomic<uint64_t>[bounds.size ()])
+{
+  std::sort (this->bounds.begin (), this->bounds.end () );
+
+  for (size_t i = 0; i < this->bounds.size (); i++) {
+    buckets[i] = 0;
+  }
+}
+
+void
+MetricsRegistry::Histogram::observe (double value)
+{
+  auto it = std::lower_bound (bounds.begin (), bounds.end (), value);
+
+  /* Values over the last bound are only accounted in the +Inf bucket */
+  if (it != bounds.end () ) {
+    buckets[it - bounds.begin ()]++;
+  }
+
+  count++;
+  atomicAdd (sum, value);
+}
+
+std::vector<uint64_t>
+MetricsRegistry::Histogram::getBuckets () const
+{
+  std::vector<uint64_t> ret;
+  uint64_t accumulated = 0;
+
+  for (size_t i = 0; i < bounds.size (); i++) {
+    accumulated += buckets[i];
+    ret.push_back (accumulated);
+  }
+
+  return ret;
+}
+
+MetricsRegistry &
+MetricsRegistry::getRegistry ()
+{
+  static MetricsRegistry registry;
+
+  return registry;
+}
+
+const std::vector<double> &
+MetricsRegistry::latencyBounds ()
+{
+  static const std::vector<double> bounds = {
+    0.0001, 0.0005, 0.001, 0.005, 0.01, 0.05, 0.1, 0.5, 1, 5
+  };
+
+  return bounds;
+}
+
+MetricsRegistry::Family &
+MetricsRegistry::getFamily (const std::string &name, const std::string &help,
+                            Type type)
+{
+  auto it = families.find (name);
+
+  if (it == families.end () ) {
+    Family &family = families[name];
+
+    family.type = type;
+    family.help = help;
+
+    return family;
+  }
+
+  if (it->second.type != type) {
+    throw KurentoException (UNEXPECTED_ERROR,
+                            "Metric " + name + " registered with another type");
+  }
+
+  return it->second;
+}
+
+static std::string
+escapeLabel (const std::string &value)
+{
+  std::string ret;
+
+  for (char c : value) {
+    if (c == '\\' || c == '"') {
+      ret += '\\';
+      ret += c;
+    } else if (c == '\n') {
+      ret += "\\n";
+    } else {
+      ret += c;
+    }
+  }
+
+  return ret;
+}
+
+std::string
+MetricsRegistry::formatLabels (const Labels &labels)
+{
+  std::string ret;
+
+  for (auto &label : labels) {
+    ret += ret.empty () ? "{" : ",";
+    ret += label.first + "=\"" + escapeLabel (label.second) + "\"";
+  }
+
+  if (!ret.empty () ) {
+    ret += "}";
+  }
+
+  return ret;
+}
+
+MetricsRegistry::Counter &
+MetricsRegistry::counter (const std::string &name, const std::string &help,
+                          const Labels &labels)
+{
+  std::unique_lock <std::mutex> lock (mutex);
+  auto &metric = getFamily (name, help, Type::COUNTER).counters[formatLabels (
+                   labels)];
+
+  if (!metric) {
+    metric.reset (new Counter () );
+  }
+
+  return *metric;
+}
+
+MetricsRegistry::Gauge &
+MetricsRegistry::gauge (const std::string &name, const std::string &help,
+                        const Labels &labels)
+{
+  std::unique_lock <std::mutex> lock (mutex);
+  auto &metric = getFamily (name, help, Type::GAUGE).gauges[formatLabels (
+                   labels)];
+
+  if (!metric) {
+    metric.reset (new Gauge () );
+  }
+
+  return *metric;
+}
+
+MetricsRegistry::Histogram &
+MetricsRegistry::histogram (const std::string &name, const std::string &help,
+                            const std::vector<double> &bounds, const Labels &labels)
+{
+  std::unique_lock <std::mutex> lock (mutex);
+  Family &family = getFamily (name, help, Type::HISTOGRAM);
+  auto &metric = family.histograms[formatLabels (labels)];
+
+  if (family.bounds.empty () ) {
+    family.bounds = bounds;
+  }
+
+  if (!metric) {
+    metric.reset (new Histogram (family.bounds) );
+  }
+
+  return *metric;
+}
+
+void
+MetricsRegistry::addCollector (std::function<void (MetricsRegistry &) >
+                               collector)
+{
+  std::unique_lock <std::mutex> lock (collectorsMutex);
+
+  collectors.push_back (collector);
+}
+
+/* Adds the "le" label to the labels of a histogram series */
+static std::string
+bucketLabels (const std::string &labels, const std::string &le)
+{
+  if (labels.empty () ) {
+    return "{le=\"" + le + "\"}";
+  }
+
+  return labels.substr (0, labels.size () - 1) + ",le=\"" + le + "\"}";
+}
+
+std::string
+MetricsRegistry::exposition ()
+{
+  std::ostringstream out;
+
+  out.precision (std::numeric_limits<double>::digits10);
+
+  {
+    std::unique_lock <std::mutex> lock (collectorsMutex);
+
+    for (auto &collector : collectors) {
+      collector (*this);
+    }
+  }
+
+  std::unique_lock <std::mutex> lock (mutex);
+
+  for (auto &it : families) {
+    const std::string &name = it.first;
+    Family &family = it.second;
+
+    out << "# HELP " << name << " " << family.help << "\n";
+
+    switch (family.type) {
+    case Type::COUNTER:
+      out << "# TYPE " << name << " counter\n";
+
+      for (auto &metric : family.counters) {
+        out << name << metric.first << " " << metric.second->get () << "\n";
+      }
+
+      break;
+
+    case Type::GAUGE:
+      out << "# TYPE " << name << " gauge\n";
+
+      for (auto &metric : family.gauges) {
+        out << name << metric.first << " " << metric.second->get () << "\n";
+      }
+
+      break;
+
+    case Type::HISTOGRAM:
+      out << "# TYPE " << name << " histogram\n";
+
+      for (auto &metric : family.histograms) {
+        Histogram &histogram = *metric.second;
+        std::vector<uint64_t> buckets = histogram.getBuckets ();
+        std::ostringstream le;
+
+        for (size_t i = 0; i < buckets.size (); i++) {
+          le.str ("");
+          le << histogram.getBounds () [i];
+          out << name << "_bucket" << bucketLabels (metric.first, le.str () )
+              << " " << buckets[i] << "\n";
+        }
+
+        out << name << "_bucket" << bucketLabels (metric.first, "+Inf") << " "
+            << histogram.getCount () << "\n";
+        out << name << "_sum" << metric.first << " " << histogram.getSum ()
+            << "\n";
+        out << name << "_count" << metric.first << " " << histogram.getCount ()
+            << "\n";
+      }
+
+      break;
+    }
+  }
+
+  return out.str ();
+}
+
+} /* kurento */
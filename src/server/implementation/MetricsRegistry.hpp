@@ -0,0 +1,171 @@
+/*
+ * (C) Copyright 2016 Kurento (http://kurento.org/)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#ifndef __METRICS_REGISTRY_HPP__
+#define __METRICS_REGISTRY_HPP__
+
+#include <atomic>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace kurento
+{
+
+/*
+ * Process wide registry of counters, gauges and histograms, exposed in the
+ * Prometheus text format. Looking a metric up takes a lock, so callers in
+ * hot paths keep the returned reference, which is valid for the whole life
+ * of the process; updating it is just an atomic operation.
+ *
+ * Values already tracked elsewhere are pulled by collectors, which are run
+ * right before every exposition.
+ */
+class MetricsRegistry
+{
+public:
+  typedef std::map<std::string, std::string> Labels;
+
+  class Counter
+  {
+  public:
+    void inc (int64_t value = 1)
+    {
+      this->value += value;
+    }
+
+    /* Only for collectors mirroring a counter kept somewhere else */
+    void set (int64_t value)
+    {
+      this->value = value;
+    }
+
+    int64_t get () const
+    {
+      return value;
+    }
+
+  private:
+    std::atomic<int64_t> value{0};
+  };
+
+  class Gauge
+  {
+  public:
+    void set (double value)
+    {
+      this->value = value;
+    }
+
+    void add (double value);
+
+    double get () const
+    {
+      return value;
+    }
+
+  private:
+    std::atomic<double> value{0};
+  };
+
+  class Histogram
+  {
+  public:
+    Histogram (const std::vector<double> &bounds);
+
+    void observe (double value);
+
+    const std::vector<double> &getBounds () const
+    {
+      return bounds;
+    }
+
+    /* Cumulative count of observations less or equal than each bound */
+    std::vector<uint64_t> getBuckets () const;
+
+    uint64_t getCount () const
+    {
+      return count;
+    }
+
+    double getSum () const
+    {
+      return sum;
+    }
+
+  private:
+    std::vector<double> bounds;
+    std::unique_ptr<std::atomic<uint64_t>[]> buckets;
+    std::atomic<uint64_t> count{0};
+    std::atomic<double> sum{0};
+  };
+
+  static MetricsRegistry &getRegistry ();
+
+  Counter &counter (const std::string &name, const std::string &help,
+                    const Labels &labels = Labels () );
+  Gauge &gauge (const std::string &name, const std::string &help,
+                const Labels &labels = Labels () );
+  /* Bounds are only used the first time a name is registered */
+  Histogram &histogram (const std::string &name, const std::string &help,
+                        const std::vector<double> &bounds,
+                        const Labels &labels = Labels () );
+
+  void addCollector (std::function<void (MetricsRegistry &) > collector);
+
+  /* Runs the collectors and renders every metric */
+  std::string exposition ();
+
+  /* Bounds suited for latencies measured in seconds */
+  static const std::vector<double> &latencyBounds ();
+
+private:
+  enum class Type {
+    COUNTER,
+    GAUGE,
+    HISTOGRAM
+  };
+
+  struct Family {
+    Type type;
+    std::string help;
+    std::vector<double> bounds;
+    std::map<std::string, std::unique_ptr<Counter>> counters;
+    std::map<std::string, std::unique_ptr<Gauge>> gauges;
+    std::map<std::string, std::unique_ptr<Histogram>> histograms;
+  };
+
+  MetricsRegistry () {}
+
+  Family &getFamily (const std::string &name, const std::string &help,
+                     Type type);
+
+  static std::string formatLabels (const Labels &labels);
+
+  std::mutex mutex;
+  std::map<std::string, Family> families;
+
+  std::mutex collectorsMutex;
+  std::vector<std::function<void (MetricsRegistry &) >> collectors;
+};
+
+} /* kurento */
+
+#endif /* __METRICS_REGISTRY_HPP__ */
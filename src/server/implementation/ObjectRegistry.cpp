@@ -0,0 +1,123 @@
+/*
+ * (C) Copyright 2016 Kurento (http://kurento.org/)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#include "ObjectRegistry.hpp"
+
+#include <algorithm>
+#include <functional>
+
+namespace kurento
+{
+
+ObjectRegistry::ObjectRegistry (size_t shards)
+{
+  for (size_t i = 0; i < std::max<size_t> (shards, 1); i++) {
+    std::unique_ptr<Shard> shard (new Shard () );
+
+    shard->table = std::make_shared<const Table> ();
+    this->shards.push_back (std::move (shard) );
+  }
+}
+
+ObjectRegistry::Shard &
+ObjectRegistry::getShard (const std::string &id) const
+{
+  return *shards[std::hash<std::string> () (id) % shards.size ()];
+}
+
+void
+ObjectRegistry::insert (const std::string &id,
+                        std::shared_ptr<MediaObjectImpl> object)
+{
+  Shard &shard = getShard (id);
+  std::unique_lock <std::mutex> lock (shard.mutex);
+  std::shared_ptr<Table> table = std::make_shared<Table> (*shard.table);
+  auto entry = std::make_shared<Entry> (object);
+  auto it = table->find (id);
+
+  if (it != table->end () ) {
+    /* Keep the sessions of the object being replaced */
+    entry->sessions = it->second->sessions.load ();
+    it->second = entry;
+  } else {
+    table->emplace (id, entry);
+    count++;
+  }
+
+  std::atomic_store (&shard.table, std::shared_ptr<const Table> (table) );
+}
+
+bool
+ObjectRegistry::erase (const std::string &id)
+{
+  Shard &shard = getShard (id);
+  std::unique_lock <std::mutex> lock (shard.mutex);
+
+  if (shard.table->find (id) == shard.table->end () ) {
+    return false;
+  }
+
+  std::shared_ptr<Table> table = std::make_shared<Table> (*shard.table);
+
+  table->erase (id);
+  count--;
+
+  std::atomic_store (&shard.table, std::shared_ptr<const Table> (table) );
+
+  return true;
+}
+
+std::shared_ptr<ObjectRegistry::Entry>
+ObjectRegistry::find (const std::string &id) const
+{
+  std::shared_ptr<const Table> table = std::atomic_load (&getShard (id).table);
+  auto it = table->find (id);
+
+  if (it == table->end () ) {
+    return std::shared_ptr<Entry> ();
+  }
+
+  return it->second;
+}
+
+void
+ObjectRegistry::setSessions (const std::string &id, size_t sessions)
+{
+  std::shared_ptr<Entry> entry = find (id);
+
+  if (entry) {
+    entry->sessions = sessions;
+  }
+}
+
+std::vector<std::string>
+ObjectRegistry::getIds () const
+{
+  std::vector<std::string> ids;
+
+  for (auto &shard : shards) {
+    std::shared_ptr<const Table> table = std::atomic_load (&shard->table);
+
+    for (auto &it : *table) {
+      ids.push_back (it.first);
+    }
+  }
+
+  return ids;
+}
+
+} /* kurento */
@@ -0,0 +1,101 @@
+/*
+ * (C) Copyright 2016 Kurento (http://kurento.org/)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#ifndef __OBJECT_REGISTRY_HPP__
+#define __OBJECT_REGISTRY_HPP__
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace kurento
+{
+
+class MediaObjectImpl;
+
+/*
+ * Hash table of weak references to media objects, split in shards.
+ *
+ * Each shard publishes an immutable snapshot of its table. Readers load
+ * the snapshot with std::atomic_load, writers copy the shard table under
+ * the shard mutex and publish the new version with std::atomic_store
+ * (copy on write). Writes only happen on object creation and destruction,
+ * so lookups are favored.
+ *
+ * The atomic shared_ptr functions are not lock free: libstdc++ guards them
+ * with a small pool of spinlocks picked by address. Readers only hold one
+ * for the time of a reference count update, never during the lookup, and
+ * do not contend with the shard mutex.
+ */
+class ObjectRegistry
+{
+public:
+  class Entry
+  {
+  public:
+    Entry (std::shared_ptr<MediaObjectImpl> object) : object (object) {}
+
+    std::shared_ptr<MediaObjectImpl> lock ()
+    {
+      return object.lock ();
+    }
+
+    /* Number of sessions holding a reference to the object */
+    std::atomic<size_t> sessions{0};
+
+  private:
+    std::weak_ptr<MediaObjectImpl> object;
+  };
+
+  ObjectRegistry (size_t shards = DEFAULT_SHARDS);
+
+  void insert (const std::string &id, std::shared_ptr<MediaObjectImpl> object);
+  bool erase (const std::string &id);
+
+  std::shared_ptr<Entry> find (const std::string &id) const;
+
+  void setSessions (const std::string &id, size_t sessions);
+
+  size_t size () const
+  {
+    return count;
+  }
+
+  std::vector<std::string> getIds () const;
+
+  static const size_t DEFAULT_SHARDS = 64;
+
+private:
+  typedef std::unordered_map<std::string, std::shared_ptr<Entry>> Table;
+
+  struct Shard {
+    std::mutex mutex;
+    std::shared_ptr<const Table> table;
+  };
+
+  Shard &getShard (const std::string &id) const;
+
+  std::vector<std::unique_ptr<Shard>> shards;
+  std::atomic<size_t> count{0};
+};
+
+} /* kurento */
+
+#endif /* __OBJECT_REGISTRY_HPP__ */
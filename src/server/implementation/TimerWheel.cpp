@@ -0,0 +1,128 @@
+/*
+ * (C) Copyright 2016 Kurento (http://kurento.org/)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#include "TimerWheel.hpp"
+
+namespace kurento
+{
+
+TimerWheel::TimerWheel (std::chrono::milliseconds tick) :
+  tick (tick.count () > 0 ? tick : std::chrono::milliseconds (1) ),
+  start (std::chrono::steady_clock::now () )
+{
+}
+
+void
+TimerWheel::insert (Entry &&entry)
+{
+  uint64_t delta = entry.tick > currentTick ? entry.tick - currentTick : 0;
+  uint64_t tick = entry.tick > currentTick ? entry.tick : currentTick;
+
+  for (int level = 0; level < LEVELS; level++) {
+    uint64_t range = (uint64_t) 1 << (SLOT_BITS * (level + 1) );
+
+    if (level == LEVELS - 1 && delta >= range) {
+      /* Out of range, park it in the farthest slot, it will be cascaded */
+      tick = currentTick + range - 1;
+    } else if (delta >= range) {
+      continue;
+    }
+
+    slots[level][ (tick >> (SLOT_BITS * level) ) & SLOT_MASK].push_back (
+      std::move (entry) );
+    return;
+  }
+}
+
+void
+TimerWheel::schedule (const std::string &key, uint64_t token,
+                      std::chrono::steady_clock::time_point deadline)
+{
+  std::unique_lock <std::mutex> lock (mutex);
+  uint64_t deadlineTick = 0;
+
+  if (deadline > start) {
+    deadlineTick = (std::chrono::duration_cast<std::chrono::milliseconds>
+                    (deadline - start) + tick - std::chrono::milliseconds (1) ) / tick;
+  }
+
+  /* Slot of the current tick has already been processed */
+  if (deadlineTick <= currentTick) {
+    deadlineTick = currentTick + 1;
+  }
+
+  insert (Entry {key, token, deadlineTick});
+  entries++;
+}
+
+void
+TimerWheel::advance (std::chrono::steady_clock::time_point now,
+                     std::vector<Entry> &expired)
+{
+  std::unique_lock <std::mutex> lock (mutex);
+
+  if (now <= start) {
+    return;
+  }
+
+  uint64_t target = std::chrono::duration_cast<std::chrono::milliseconds>
+                    (now - start) / tick;
+
+  while (currentTick < target) {
+    currentTick++;
+
+    int wrapped = 0;
+
+    while (wrapped + 1 < LEVELS && (currentTick & ( ( (uint64_t) 1 <<
+                                    (SLOT_BITS * (wrapped + 1) ) ) - 1) ) == 0) {
+      wrapped++;
+    }
+
+    /* Cascade entries from the upper levels whose lower level wrapped
+     * around, starting by the highest one so they can fall through */
+    for (int level = wrapped; level > 0; level--) {
+      std::vector<Entry> cascade;
+
+      cascade.swap (slots[level][ (currentTick >> (SLOT_BITS * level) ) &
+                                  SLOT_MASK]);
+
+      for (auto &entry : cascade) {
+        insert (std::move (entry) );
+      }
+    }
+
+    std::vector<Entry> &slot = slots[0][currentTick & SLOT_MASK];
+
+    entries -= slot.size ();
+
+    for (auto &entry : slot) {
+      expired.push_back (std::move (entry) );
+    }
+
+    slot.clear ();
+  }
+}
+
+size_t
+TimerWheel::size ()
+{
+  std::unique_lock <std::mutex> lock (mutex);
+
+  return entries;
+}
+
+} /* kurento */
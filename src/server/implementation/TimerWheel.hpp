@@ -0,0 +1,81 @@
+/*
+ * (C) Copyright 2016 Kurento (http://kurento.org/)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#ifndef __TIMER_WHEEL_HPP__
+#define __TIMER_WHEEL_HPP__
+
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace kurento
+{
+
+/*
+ * Hierarchical timer wheel. Scheduling is O(1) and every tick only visits
+ * the slot that expires, plus one slot of an upper level each time a lower
+ * level wraps around. Entries are never cancelled; owners tag them with a
+ * token and ignore the ones that are no longer current when they expire.
+ */
+class TimerWheel
+{
+public:
+  struct Entry {
+    std::string key;
+    uint64_t token;
+    uint64_t tick;
+  };
+
+  TimerWheel (std::chrono::milliseconds tick);
+
+  void schedule (const std::string &key, uint64_t token,
+                 std::chrono::steady_clock::time_point deadline);
+
+  /* Moves the wheel up to now, appending expired entries to the vector */
+  void advance (std::chrono::steady_clock::time_point now,
+                std::vector<Entry> &expired);
+
+  size_t size ();
+
+  std::chrono::milliseconds getTick () const
+  {
+    return tick;
+  }
+
+private:
+  static const int LEVELS = 4;
+  static const int SLOT_BITS = 6;
+  static const uint64_t SLOTS = 1 << SLOT_BITS;
+  static const uint64_t SLOT_MASK = SLOTS - 1;
+
+  void insert (Entry &&entry);
+
+  std::chrono::milliseconds tick;
+  std::chrono::steady_clock::time_point start;
+  uint64_t currentTick = 0;
+  size_t entries = 0;
+
+  std::vector<Entry> slots[LEVELS][SLOTS];
+
+  std::mutex mutex;
+};
+
+} /* kurento */
+
+#endif /* __TIMER_WHEEL_HPP__ */
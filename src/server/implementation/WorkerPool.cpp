@@ -18,18 +18,48 @@
 #include <gst/gst.h>
 
 #include "WorkerPool.hpp"
+#include <KurentoException.hpp>
 #include <atomic>
 #include <memory>
+#include <set>
 
 #define GST_CAT_DEFAULT kurento_worker_pool
 GST_DEBUG_CATEGORY_STATIC (GST_CAT_DEFAULT);
 #define GST_DEFAULT_NAME "KurentoWorkerPool"
 
+#define WORKER_POOL "workerPool"
+
 const int WORKER_THREADS_TIMEOUT = 3; /* seconds */
 
+/* Time an idle shard worker sleeps before trying to steal work again */
+const std::chrono::milliseconds STEAL_INTERVAL (50);
+
+/* Time a BLOCK caller waits before checking again for room in the queue */
+const std::chrono::milliseconds OVERFLOW_RETRY_INTERVAL (100);
+
 namespace kurento
 {
 
+/* Pool the current thread works for, used to avoid self deadlocks */
+static thread_local WorkerPool *currentPool = nullptr;
+static thread_local size_t currentShard = 0;
+
+static std::mutex &
+poolsMutex ()
+{
+  static std::mutex mutex;
+
+  return mutex;
+}
+
+static std::set<WorkerPool *> &
+pools ()
+{
+  static std::set<WorkerPool *> pools;
+
+  return pools;
+}
+
 static void
 workerThreadLoop ( boost::shared_ptr< boost::asio::io_service > io_service )
 {
@@ -50,8 +80,90 @@ workerThreadLoop ( boost::shared_ptr< boost::asio::io_service > io_service )
   GST_DEBUG ("Working thread finished");
 }
 
-WorkerPool::WorkerPool (int threads)
+static WorkerPool::Config
+sharedConfig (int threads)
+{
+  WorkerPool::Config config;
+
+  config.mode = WorkerPool::Mode::SHARED;
+  config.threads = threads;
+
+  return config;
+}
+
+bool
+WorkerPool::getConfig (const boost::property_tree::ptree &config,
+                       Config &poolConfig)
+{
+  boost::optional<const boost::property_tree::ptree &> node =
+    config.get_child_optional (WORKER_POOL);
+
+  if (!node) {
+    GST_LOG ("No %s in config file", WORKER_POOL);
+    return false;
+  }
+
+  std::string mode = node->get<std::string> ("mode", "shared");
+  std::string policy = node->get<std::string> ("overflowPolicy", "block");
+
+  if (mode == "sharded") {
+    poolConfig.mode = Mode::SHARDED;
+  } else if (mode == "shared") {
+    poolConfig.mode = Mode::SHARED;
+  } else {
+    GST_WARNING ("Unknown %s.mode: %s, using shared", WORKER_POOL,
+                 mode.c_str () );
+    poolConfig.mode = Mode::SHARED;
+  }
+
+  poolConfig.threads = node->get<int> ("threads", poolConfig.threads);
+  poolConfig.maxThreads = node->get<int> ("maxThreads", poolConfig.maxThreads);
+  poolConfig.maxQueueDepth = node->get<size_t> ("maxQueueDepth",
+                             poolConfig.maxQueueDepth);
+
+  if (policy == "reject") {
+    poolConfig.overflowPolicy = OverflowPolicy::REJECT;
+  } else if (policy == "caller-runs") {
+    poolConfig.overflowPolicy = OverflowPolicy::CALLER_RUNS;
+  } else if (policy == "block") {
+    poolConfig.overflowPolicy = OverflowPolicy::BLOCK;
+  } else {
+    GST_WARNING ("Unknown %s.overflowPolicy: %s, using block", WORKER_POOL,
+                 policy.c_str () );
+    poolConfig.overflowPolicy = OverflowPolicy::BLOCK;
+  }
+
+  return true;
+}
+
+WorkerPool::WorkerPool (int threads, const std::string &name) :
+  WorkerPool (sharedConfig (threads), name)
 {
+}
+
+WorkerPool::WorkerPool (const Config &config, const std::string &name) :
+  config (config), name (name),
+  queueLatencyHistogram (MetricsRegistry::getRegistry ().histogram (
+                           "kurento_worker_pool_queue_latency_seconds",
+                           "Time tasks wait in the queue of a worker pool",
+                           MetricsRegistry::latencyBounds (), { {"pool", name} }) )
+{
+  if (this->config.threads <= 0) {
+    this->config.threads = std::max (1u, std::thread::hardware_concurrency () );
+  }
+
+  if (this->config.mode == Mode::SHARDED) {
+    if (this->config.maxThreads <= 0) {
+      this->config.maxThreads = this->config.threads * 2;
+    }
+
+    this->config.maxThreads = std::max (this->config.maxThreads,
+                                        this->config.threads);
+  } else if (this->config.maxThreads > 0) {
+    this->config.maxThreads = std::max (this->config.maxThreads,
+                                        this->config.threads);
+  }
+
   /* Prepare watcher */
   watcher_service = boost::shared_ptr< boost::asio::io_service >
                     ( new boost::asio::io_service () );
@@ -59,24 +171,55 @@ WorkerPool::WorkerPool (int threads)
       std::make_shared<boost::asio::io_service::work>(*watcher_service);
   watcher = std::thread (std::bind (&workerThreadLoop, watcher_service) );
 
-  /* Prepare pool of threads */
-  io_service = boost::shared_ptr< boost::asio::io_service >
-               ( new boost::asio::io_service () );
-  work = std::make_shared<boost::asio::io_service::work>(*io_service);
+  if (this->config.mode == Mode::SHARDED) {
+    /* Shards for the extra workers are created upfront so that posting
+     * threads never see the vector being resized */
+    for (int i = 0; i < this->config.maxThreads; i++) {
+      shards.emplace_back (new Shard () );
+    }
+
+    activeShards = this->config.threads;
+
+    for (int i = 0; i < this->config.threads; i++) {
+      workers.emplace_back (std::bind (&WorkerPool::shardLoop, this, i) );
+    }
+
+    watcher_service->post (std::bind (&WorkerPool::watchShards, this) );
+  } else {
+    /* Prepare pool of threads */
+    io_service = boost::shared_ptr< boost::asio::io_service >
+                 ( new boost::asio::io_service () );
+    work = std::make_shared<boost::asio::io_service::work>(*io_service);
 
-  for (int i = 0; i < threads; i++) {
-    workers.emplace_back(std::bind(&workerThreadLoop, io_service));
+    for (int i = 0; i < this->config.threads; i++) {
+      workers.emplace_back(std::bind(&workerThreadLoop, io_service));
+    }
   }
+
+  std::unique_lock <std::mutex> lock (poolsMutex () );
+  pools ().insert (this);
 }
 
 WorkerPool::~WorkerPool()
 {
+  std::unique_lock <std::mutex> poolsLock (poolsMutex () );
+  pools ().erase (this);
+  poolsLock.unlock ();
+
   std::unique_lock <std::mutex> lock (mutex);
   terminated = true ;
   lock.unlock();
 
   watcher_service->stop();
-  io_service->stop();
+
+  if (io_service) {
+    io_service->stop();
+  }
+
+  for (auto &shard : shards) {
+    std::unique_lock <std::mutex> shardLock (shard->mutex);
+    shard->cond.notify_all ();
+  }
 
   try {
     if (std::this_thread::get_id() != watcher.get_id() ) {
@@ -115,12 +258,343 @@ WorkerPool::~WorkerPool()
   workers.empty();
 
   // Executing queued tasks
-  io_service->reset();
+  if (io_service) {
+    io_service->reset();
 
-  while (io_service->poll() ) {
+    while (io_service->poll() ) {
+    }
+  }
+
+  for (auto &shard : shards) {
+    while (!shard->queue.empty () ) {
+      Task task = std::move (shard->queue.front () );
+
+      shard->queue.pop_front ();
+
+      try {
+        run (task);
+      } catch (...) {
+        GST_ERROR ("Unexpected error while running pending task");
+      }
+    }
+  }
+}
+
+void
+WorkerPool::post (std::function<void () > task)
+{
+  if (config.mode == Mode::SHARDED) {
+    postSharded (task);
+  } else {
+    postShared (task);
   }
 }
 
+void
+WorkerPool::postShared (std::function<void () > &task)
+{
+  /* The bound is not strict, concurrent callers may overtake it slightly */
+  while (config.maxQueueDepth > 0
+         && queueDepth >= (int64_t) config.maxQueueDepth) {
+    if (!overflow (task) ) {
+      return;
+    }
+  }
+
+  setWatcher();
+
+  Task wrapper {task, std::chrono::steady_clock::now ()};
+
+  queueDepth++;
+  io_service->post ([this, wrapper] () mutable {
+    run (wrapper);
+  });
+}
+
+void
+WorkerPool::postSharded (std::function<void () > &task)
+{
+  do {
+    size_t active = activeShards;
+    size_t home;
+
+    if (currentPool == this && currentShard < active) {
+      /* Tasks posted from a worker stay in its shard to keep cache locality */
+      home = currentShard;
+    } else {
+      home = nextShard++ % active;
+    }
+
+    for (size_t i = 0; i < active; i++) {
+      Shard &shard = *shards[ (home + i) % active];
+      std::unique_lock <std::mutex> lock (shard.mutex);
+
+      if (config.maxQueueDepth > 0
+          && shard.queue.size () >= config.maxQueueDepth) {
+        continue;
+      }
+
+      shard.queue.push_back (Task {task, std::chrono::steady_clock::now ()});
+      queueDepth++;
+      lock.unlock ();
+
+      shard.cond.notify_one ();
+
+      if (shard.busy) {
+        wakeIdleShard ();
+      }
+
+      return;
+    }
+  } while (overflow (task) );
+}
+
+/*
+ * Applies the overflow policy to a task that does not fit in the queue.
+ * Returns true if the caller should try to enqueue the task again.
+ */
+bool
+WorkerPool::overflow (std::function<void () > &task)
+{
+  if (config.overflowPolicy == OverflowPolicy::REJECT) {
+    rejectedTasks++;
+    GST_WARNING ("Pool %s is full, rejecting task", name.c_str() );
+    throw KurentoException (NOT_ENOUGH_RESOURCES,
+                            "Worker pool " + name + " queue is full");
+  }
+
+  /* A worker blocking on its own pool could never be woken up */
+  if (config.overflowPolicy == OverflowPolicy::CALLER_RUNS
+      || currentPool == this || terminated) {
+    callerRunsTasks++;
+    task ();
+    return false;
+  }
+
+  std::unique_lock <std::mutex> lock (spaceMutex);
+
+  spaceCond.wait_for (lock, OVERFLOW_RETRY_INTERVAL);
+
+  return true;
+}
+
+void
+WorkerPool::run (Task &task)
+{
+  int64_t latency = std::chrono::duration_cast<std::chrono::microseconds>
+                    (std::chrono::steady_clock::now () - task.queued).count ();
+  int64_t max = queueLatencyMax;
+
+  queueDepth--;
+  queueLatencySum += latency;
+  queueLatencyHistogram.observe (latency / 1000000.0);
+
+  while (latency > max && !queueLatencyMax.compare_exchange_weak (max,
+         latency) ) {
+  }
+
+  if (config.maxQueueDepth > 0) {
+    spaceCond.notify_all ();
+  }
+
+  executedTasks++;
+  task.func ();
+}
+
+void
+WorkerPool::shardLoop (size_t index)
+{
+  currentPool = this;
+  currentShard = index;
+
+  GST_DEBUG ("Shard worker %zu of %s starting", index, name.c_str() );
+
+  Task task;
+
+  while (nextTask (index, task) ) {
+    try {
+      run (task);
+    } catch (std::exception &e) {
+      GST_ERROR ("Unexpected error while running the server: %s", e.what() );
+    } catch (...) {
+      GST_ERROR ("Unexpected error while running the server");
+    }
+
+    task.func = nullptr;
+  }
+
+  GST_DEBUG ("Shard worker %zu of %s finished", index, name.c_str() );
+}
+
+bool
+WorkerPool::nextTask (size_t index, Task &task)
+{
+  Shard &shard = *shards[index];
+
+  while (!terminated) {
+    std::unique_lock <std::mutex> lock (shard.mutex);
+
+    if (!shard.queue.empty () ) {
+      task = std::move (shard.queue.front () );
+      shard.queue.pop_front ();
+      shard.busy = true;
+      return true;
+    }
+
+    shard.busy = false;
+    lock.unlock ();
+
+    if (steal (index, task) ) {
+      shard.busy = true;
+      return true;
+    }
+
+    lock.lock ();
+
+    if (shard.queue.empty () && !terminated) {
+      shard.cond.wait_for (lock, STEAL_INTERVAL);
+    }
+  }
+
+  return false;
+}
+
+bool
+WorkerPool::steal (size_t index, Task &task)
+{
+  size_t active = activeShards;
+
+  for (size_t i = 1; i < active; i++) {
+    Shard &victim = *shards[ (index + i) % active];
+    std::unique_lock <std::mutex> lock (victim.mutex, std::try_to_lock);
+
+    if (!lock.owns_lock () || victim.queue.empty () ) {
+      continue;
+    }
+
+    /* Take the oldest task, as the owner would. Order is still not
+     * guaranteed: it may run at the same time as the next one */
+    task = std::move (victim.queue.front () );
+    victim.queue.pop_front ();
+    stolenTasks++;
+
+    return true;
+  }
+
+  return false;
+}
+
+void
+WorkerPool::wakeIdleShard ()
+{
+  size_t active = activeShards;
+
+  for (size_t i = 0; i < active; i++) {
+    Shard &shard = *shards[i];
+
+    if (!shard.busy) {
+      shard.cond.notify_one ();
+      return;
+    }
+  }
+}
+
+void
+WorkerPool::watchShards ()
+{
+  boost::shared_ptr< boost::asio::deadline_timer > timer (
+    new boost::asio::deadline_timer ( *watcher_service ) );
+
+  timer->expires_from_now ( boost::posix_time::seconds (
+                              WORKER_THREADS_TIMEOUT) );
+  timer->async_wait ( [timer, this] (const boost::system::error_code & error) {
+    if (error) {
+      return;
+    }
+
+    checkShards ();
+    watchShards ();
+  });
+}
+
+void
+WorkerPool::checkShards ()
+{
+  auto now = std::chrono::steady_clock::now ();
+  size_t active = activeShards;
+  bool stuck = false;
+
+  for (size_t i = 0; i < active && !stuck; i++) {
+    Shard &shard = *shards[i];
+    std::unique_lock <std::mutex> lock (shard.mutex);
+
+    if (!shard.queue.empty () && now - shard.queue.front ().queued >
+        std::chrono::seconds (WORKER_THREADS_TIMEOUT) ) {
+      stuck = true;
+    }
+  }
+
+  if (!stuck) {
+    return;
+  }
+
+  std::unique_lock <std::mutex> lock (mutex);
+
+  if (terminated) {
+    return;
+  }
+
+  if (active >= shards.size () ) {
+    GST_WARNING ("Worker threads of %s locked, limit of %zu threads reached",
+                 name.c_str(), shards.size () );
+    return;
+  }
+
+  GST_WARNING ("Worker threads of %s locked. Spawning a new one.",
+               name.c_str() );
+
+  workers.emplace_back (std::bind (&WorkerPool::shardLoop, this, active) );
+  activeShards = active + 1;
+}
+
+WorkerPool::Stats
+WorkerPool::getStats ()
+{
+  Stats stats;
+  int64_t executed = executedTasks;
+  std::unique_lock <std::mutex> lock (mutex);
+
+  stats.name = name;
+  stats.mode = config.mode;
+  stats.threads = workers.size ();
+  lock.unlock ();
+
+  stats.maxThreads = config.maxThreads;
+  stats.queueDepth = queueDepth;
+  stats.maxQueueDepth = config.maxQueueDepth;
+  stats.executedTasks = executed;
+  stats.stolenTasks = stolenTasks;
+  stats.rejectedTasks = rejectedTasks;
+  stats.callerRunsTasks = callerRunsTasks;
+  stats.avgQueueLatency = executed > 0 ? queueLatencySum / executed : 0;
+  stats.maxQueueLatency = queueLatencyMax;
+
+  return stats;
+}
+
+std::vector<WorkerPool::Stats>
+WorkerPool::getAllStats ()
+{
+  std::vector<Stats> ret;
+  std::unique_lock <std::mutex> lock (poolsMutex () );
+
+  for (auto pool : pools () ) {
+    ret.push_back (pool->getStats () );
+  }
+
+  return ret;
+}
+
 static void
 async_worker_test (std::shared_ptr<std::atomic<bool>> alive)
 {
@@ -152,10 +626,16 @@ WorkerPool::checkWorkers ()
       return;
     }
 
-    GST_WARNING ("Worker threads locked. Spawning a new one.");
-
     std::unique_lock <std::mutex> lock (mutex);
 
+    if (config.maxThreads > 0 && (int) workers.size () >= config.maxThreads) {
+      GST_WARNING ("Worker threads of %s locked, limit of %d threads reached",
+                   name.c_str(), config.maxThreads);
+      return;
+    }
+
+    GST_WARNING ("Worker threads locked. Spawning a new one.");
+
     if (!terminated) {
       workers.emplace_back(std::bind(&workerThreadLoop, io_service));
     }
@@ -170,10 +650,36 @@ WorkerPool::setWatcher ()
 
 WorkerPool::StaticConstructor WorkerPool::staticConstructor;
 
+static void
+collectMetrics (MetricsRegistry &registry)
+{
+  for (auto &stats : WorkerPool::getAllStats () ) {
+    MetricsRegistry::Labels labels = { {"pool", stats.name} };
+
+    registry.gauge ("kurento_worker_pool_threads",
+                    "Workers of a worker pool", labels).set (stats.threads);
+    registry.gauge ("kurento_worker_pool_queue_depth",
+                    "Tasks waiting in a worker pool", labels).set (stats.queueDepth);
+    registry.counter ("kurento_worker_pool_executed_tasks_total",
+                      "Tasks executed by a worker pool", labels).set (stats.executedTasks);
+    registry.counter ("kurento_worker_pool_stolen_tasks_total",
+                      "Tasks stolen between the shards of a worker pool",
+                      labels).set (stats.stolenTasks);
+    registry.counter ("kurento_worker_pool_rejected_tasks_total",
+                      "Tasks rejected because the queue was full",
+                      labels).set (stats.rejectedTasks);
+    registry.counter ("kurento_worker_pool_caller_runs_tasks_total",
+                      "Tasks run by the caller because the queue was full",
+                      labels).set (stats.callerRunsTasks);
+  }
+}
+
 WorkerPool::StaticConstructor::StaticConstructor()
 {
   GST_DEBUG_CATEGORY_INIT (GST_CAT_DEFAULT, GST_DEFAULT_NAME, 0,
                            GST_DEFAULT_NAME);
+
+  MetricsRegistry::getRegistry ().addCollector (collectMetrics);
 }
 
 } // kurento
@@ -20,7 +20,17 @@
 
 #include <mutex>
 #include <thread>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
 #include <boost/asio.hpp>
+#include <boost/property_tree/ptree.hpp>
+#include "MetricsRegistry.hpp"
 
 namespace kurento
 {
@@ -28,32 +38,127 @@ namespace kurento
 class WorkerPool
 {
 public:
-  WorkerPool (int threads);
+  enum class Mode {
+    /* All workers run tasks from a single shared io_service */
+    SHARED,
+    /* One queue per worker; idle workers steal tasks from busy ones, so
+     * tasks posted by the same producer may run out of order */
+    SHARDED
+  };
+
+  enum class OverflowPolicy {
+    /* Caller waits until there is room in the queue */
+    BLOCK,
+    /* Task is discarded and a NOT_ENOUGH_RESOURCES exception is thrown */
+    REJECT,
+    /* Task is executed synchronously in the caller thread */
+    CALLER_RUNS
+  };
+
+  struct Config {
+    Mode mode = Mode::SHARED;
+    /* Initial number of workers, 0 means one per core */
+    int threads = 0;
+    /* Workers the watcher is allowed to reach when the pool gets stuck.
+     * 0 means no limit in SHARED mode and twice "threads" in SHARDED mode */
+    int maxThreads = 0;
+    /* Queued tasks allowed (per shard in SHARDED mode), 0 means no limit */
+    size_t maxQueueDepth = 0;
+    OverflowPolicy overflowPolicy = OverflowPolicy::BLOCK;
+  };
+
+  struct Stats {
+    std::string name;
+    Mode mode;
+    int threads;
+    int maxThreads;
+    int64_t queueDepth;
+    int64_t maxQueueDepth;
+    int64_t executedTasks;
+    int64_t stolenTasks;
+    int64_t rejectedTasks;
+    int64_t callerRunsTasks;
+    /* Time between post and execution, in microseconds */
+    int64_t avgQueueLatency;
+    int64_t maxQueueLatency;
+  };
+
+  WorkerPool (int threads, const std::string &name = "WorkerPool");
+  WorkerPool (const Config &config, const std::string &name);
   ~WorkerPool();
 
-  template <typename CompletionHandler>
-  BOOST_ASIO_INITFN_RESULT_TYPE (CompletionHandler, void () )
-  post (BOOST_ASIO_MOVE_ARG (CompletionHandler) handler)
-  {
-    setWatcher();
-    return io_service->post (handler);
-  }
+  void post (std::function<void () > task);
+
+  Stats getStats ();
+
+  static std::vector<Stats> getAllStats ();
+
+  /* Reads the "workerPool" section of the server configuration, returns
+   * false when there is none */
+  static bool getConfig (const boost::property_tree::ptree &config,
+                         Config &poolConfig);
 
 private:
+  struct Task {
+    std::function<void () > func;
+    std::chrono::steady_clock::time_point queued;
+  };
+
+  struct Shard {
+    std::mutex mutex;
+    std::condition_variable cond;
+    std::deque<Task> queue;
+    std::atomic<bool> busy{false};
+  };
+
   void setWatcher();
   void checkWorkers();
 
+  void postShared (std::function<void () > &task);
+  void postSharded (std::function<void () > &task);
+  bool overflow (std::function<void () > &task);
+  void run (Task &task);
+
+  void shardLoop (size_t index);
+  bool nextTask (size_t index, Task &task);
+  bool steal (size_t index, Task &task);
+  void wakeIdleShard ();
+  void watchShards ();
+  void checkShards ();
+
+  Config config;
+  std::string name;
+
+  MetricsRegistry::Histogram &queueLatencyHistogram;
+
   boost::shared_ptr< boost::asio::io_service > io_service;
   std::shared_ptr< boost::asio::io_service::work > work;
   std::vector<std::thread> workers;
 
+  /* Only used in SHARDED mode, preallocated up to maxThreads */
+  std::vector<std::unique_ptr<Shard>> shards;
+  std::atomic<size_t> activeShards{0};
+  std::atomic<size_t> nextShard{0};
+
   boost::shared_ptr< boost::asio::io_service > watcher_service;
   std::shared_ptr< boost::asio::io_service::work > watcher_work;
   std::thread watcher;
 
   std::mutex mutex;
 
-  bool terminated = false;
+  /* Signaled when a task leaves the queue and "BLOCK" callers may retry */
+  std::mutex spaceMutex;
+  std::condition_variable spaceCond;
+
+  std::atomic<bool> terminated{false};
+
+  std::atomic<int64_t> queueDepth{0};
+  std::atomic<int64_t> executedTasks{0};
+  std::atomic<int64_t> stolenTasks{0};
+  std::atomic<int64_t> rejectedTasks{0};
+  std::atomic<int64_t> callerRunsTasks{0};
+  std::atomic<int64_t> queueLatencySum{0};
+  std::atomic<int64_t> queueLatencyMax{0};
 
   class StaticConstructor
   {
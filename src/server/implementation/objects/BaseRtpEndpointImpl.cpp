@@ -21,6 +21,7 @@
 #include <KurentoException.hpp>
 #include <MediaState.hpp>
 #include <ConnectionState.hpp>
+#include <BandwidthEstimator.hpp>
 #include <ctime>
 #include <SignalHandler.hpp>
 #include <MediaType.hpp>
@@ -33,6 +34,7 @@
 #include "EndpointStats.hpp"
 #include "kmsstats.h"
 #include "kmsutils.h"
+#include "kmsbandwidthestimator.h"
 
 #define GST_CAT_DEFAULT kurento_base_rtp_endpoint_impl
 GST_DEBUG_CATEGORY_STATIC (GST_CAT_DEFAULT);
@@ -231,6 +233,44 @@ void BaseRtpEndpointImpl::setMaxVideoSendBandwidth (int maxVideoSendBandwidth)
   g_object_set (element, "max-video-send-bandwidth", maxVideoSendBandwidth, NULL);
 }
 
+std::shared_ptr<BandwidthEstimator>
+BaseRtpEndpointImpl::getBandwidthEstimator ()
+{
+  KmsBandwidthEstimator estimator;
+
+  g_object_get (element, "bandwidth-estimator", &estimator, NULL);
+
+  switch (estimator) {
+  case KMS_BANDWIDTH_ESTIMATOR_DELAY:
+    return std::make_shared <BandwidthEstimator>
+           (BandwidthEstimator::DELAY_BASED);
+
+  case KMS_BANDWIDTH_ESTIMATOR_LOSS:
+  default:
+    return std::make_shared <BandwidthEstimator>
+           (BandwidthEstimator::LOSS_BASED);
+  }
+}
+
+void BaseRtpEndpointImpl::setBandwidthEstimator (
+  std::shared_ptr<BandwidthEstimator> bandwidthEstimator)
+{
+  KmsBandwidthEstimator estimator;
+
+  switch (bandwidthEstimator->getValue () ) {
+  case BandwidthEstimator::DELAY_BASED:
+    estimator = KMS_BANDWIDTH_ESTIMATOR_DELAY;
+    break;
+
+  case BandwidthEstimator::LOSS_BASED:
+  default:
+    estimator = KMS_BANDWIDTH_ESTIMATOR_LOSS;
+    break;
+  }
+
+  g_object_set (element, "bandwidth-estimator", estimator, NULL);
+}
+
 std::shared_ptr<MediaState>
 BaseRtpEndpointImpl::getMediaState ()
 {
@@ -608,10 +648,11 @@ BaseRtpEndpointImpl::collectEndpointStats (std::map
 
   std::vector<std::shared_ptr<MediaLatencyStat>> inputStats;
   std::vector<std::shared_ptr<MediaLatencyStat>> e2eStats;
+  std::vector<std::shared_ptr<MediaLatencyPercentiles>> e2ePercentiles;
 
   if (gst_structure_get (stats, "e2e-latencies", GST_TYPE_STRUCTURE,
                          &e2e_stats, NULL) ) {
-    collectLatencyStats (e2eStats, e2e_stats);
+    collectLatencyStats (e2eStats, e2ePercentiles, e2e_stats);
     gst_structure_free (e2e_stats);
   }
 
@@ -619,6 +660,11 @@ BaseRtpEndpointImpl::collectEndpointStats (std::map
                   std::make_shared <StatsType> (StatsType::endpoint), timestamp,
                   timestampMillis, 0.0, 0.0, inputStats, 0.0, 0.0, e2eStats);
 
+  if (!e2ePercentiles.empty () ) {
+    std::dynamic_pointer_cast <EndpointStats>
+    (endpointStats)->setE2ELatencyPercentiles (e2ePercentiles);
+  }
+
   setDeprecatedProperties (std::dynamic_pointer_cast <EndpointStats>
                            (endpointStats) );
 
@@ -58,6 +58,10 @@ public:
   virtual int getMaxVideoSendBandwidth ();
   virtual void setMaxVideoSendBandwidth (int maxVideoSendBandwidth);
 
+  virtual std::shared_ptr<BandwidthEstimator> getBandwidthEstimator ();
+  virtual void setBandwidthEstimator (std::shared_ptr<BandwidthEstimator>
+                                      bandwidthEstimator);
+
   virtual std::shared_ptr<MediaState> getMediaState ();
   virtual std::shared_ptr<ConnectionState> getConnectionState ();
 
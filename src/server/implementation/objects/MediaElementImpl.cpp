@@ -34,8 +34,12 @@
 #include <GstreamerDotDetails.hpp>
 #include <StatsType.hpp>
 #include "ElementStats.hpp"
+#include "ElementStatsSnapshot.hpp"
 #include "kmsstats.h"
+#include "kmsenctreebin.h"
 #include <SignalHandler.hpp>
+#include <EventPolicy.hpp>
+#include <MetricsRegistry.hpp>
 
 #include <chrono>
 #include <memory>
@@ -49,6 +53,9 @@ GST_DEBUG_CATEGORY_STATIC (GST_CAT_DEFAULT);
 
 #define MIN_OUTPUT_BITRATE "min-output-bitrate"
 #define MAX_OUTPUT_BITRATE "max-output-bitrate"
+#define CODEC_CONFIG "codec-config"
+#define RENDITION_LADDER "rendition-ladder"
+#define TRANSCODING_IDLE_TIMEOUT "transcoding-idle-timeout"
 
 #define TYPE_VIDEO "video_"
 #define TYPE_AUDIO "audio_"
@@ -452,6 +459,27 @@ padTypeToMediaType (KmsElementPadType type)
   throw KurentoException (UNSUPPORTED_MEDIA_TYPE, "Usupported media type");
 }
 
+static void
+countFlowChange (const std::string &direction, KmsElementPadType type,
+    gboolean isFlowing)
+{
+  MetricsRegistry::getRegistry ().counter ("kurento_media_flow_changes_total",
+      "Media flow state changes reported by the elements", {
+        {"direction", direction},
+        {"media", type == KMS_ELEMENT_PAD_TYPE_VIDEO ? "video" : "audio"},
+        {"state", isFlowing ? "flowing" : "not_flowing"}
+      }).inc ();
+}
+
+static void
+addTranscodingBranches (KmsElementPadType type, int value)
+{
+  MetricsRegistry::getRegistry ().gauge ("kurento_transcoding_branches",
+      "Transcoding branches currently active", {
+        {"media", type == KMS_ELEMENT_PAD_TYPE_VIDEO ? "video" : "audio"}
+      }).add (value);
+}
+
 void
 MediaElementImpl::mediaFlowOutStateChange (gboolean isFlowing, gchar *padName,
     KmsElementPadType type)
@@ -474,17 +502,31 @@ MediaElementImpl::mediaFlowOutStateChange (gboolean isFlowing, gchar *padName,
     key = std::string (TYPE_AUDIO) + std::string (padName);
   }
   mediaFlowOutStates[key] = state;
+  countFlowChange ("out", type, isFlowing);
+
+  std::string pad (padName);
+  std::weak_ptr<MediaObjectImpl> weak;
 
   try {
-    MediaFlowOutStateChange event (shared_from_this (),
-        MediaFlowOutStateChange::getName (), state, padName,
-        padTypeToMediaType (type));
-    sigcSignalEmit(signalMediaFlowOutStateChange, event);
+    weak = shared_from_this ();
   } catch (const std::bad_weak_ptr &e) {
     // shared_from_this()
     GST_ERROR ("BUG creating %s: %s",
         MediaFlowOutStateChange::getName ().c_str (), e.what ());
+    return;
   }
+
+  eventPolicy->submit ("out_" + key, isFlowing, [weak, state, pad, type] () {
+    auto self = std::dynamic_pointer_cast<MediaElementImpl> (weak.lock () );
+
+    if (!self) {
+      return;
+    }
+
+    MediaFlowOutStateChange event (self, MediaFlowOutStateChange::getName (),
+        state, pad, padTypeToMediaType (type));
+    self->sigcSignalEmit(self->signalMediaFlowOutStateChange, event);
+  });
 }
 
 void
@@ -509,17 +551,31 @@ MediaElementImpl::mediaFlowInStateChange (gboolean isFlowing, gchar *padName,
     key = std::string (TYPE_AUDIO) + std::string (padName);
   }
   mediaFlowInStates[key] = state;
+  countFlowChange ("in", type, isFlowing);
+
+  std::string pad (padName);
+  std::weak_ptr<MediaObjectImpl> weak;
 
   try {
-    MediaFlowInStateChange event (shared_from_this (),
-        MediaFlowInStateChange::getName (), state, padName,
-        padTypeToMediaType (type));
-    sigcSignalEmit(signalMediaFlowInStateChange, event);
+    weak = shared_from_this ();
   } catch (const std::bad_weak_ptr &e) {
     // shared_from_this()
     GST_ERROR ("BUG creating %s: %s",
         MediaFlowInStateChange::getName ().c_str (), e.what ());
+    return;
   }
+
+  eventPolicy->submit ("in_" + key, isFlowing, [weak, state, pad, type] () {
+    auto self = std::dynamic_pointer_cast<MediaElementImpl> (weak.lock () );
+
+    if (!self) {
+      return;
+    }
+
+    MediaFlowInStateChange event (self, MediaFlowInStateChange::getName (),
+        state, pad, padTypeToMediaType (type));
+    self->sigcSignalEmit(self->signalMediaFlowInStateChange, event);
+  });
 }
 
 void
@@ -545,24 +601,44 @@ MediaElementImpl::onMediaTranscodingStateChange (gboolean isTranscoding,
   } else {
     key = std::string (TYPE_AUDIO) + std::string (binName);
   }
-  mediaTranscodingStates[key] = state;
 
-  try {
+  auto previous = mediaTranscodingStates.find (key);
+  bool wasTranscoding = previous != mediaTranscodingStates.end ()
+      && previous->second->getValue () == MediaTranscodingState::TRANSCODING;
 
-  } catch (std::bad_weak_ptr &e) {
-    GST_WARNING_OBJECT (element, "Cannot emit event: MediaTranscodingStateChange");
+  if (isTranscoding && !wasTranscoding) {
+    addTranscodingBranches (type, 1);
+  } else if (!isTranscoding && wasTranscoding) {
+    addTranscodingBranches (type, -1);
   }
 
+  mediaTranscodingStates[key] = state;
+
+  std::string bin (binName);
+  std::weak_ptr<MediaObjectImpl> weak;
+
   try {
-    MediaTranscodingStateChange event (shared_from_this (),
-        MediaTranscodingStateChange::getName (), state, binName,
-        padTypeToMediaType (type));
-    sigcSignalEmit(signalMediaTranscodingStateChange, event);
+    weak = shared_from_this ();
   } catch (const std::bad_weak_ptr &e) {
     // shared_from_this()
     GST_ERROR ("BUG creating %s: %s",
         MediaTranscodingStateChange::getName ().c_str (), e.what ());
+    return;
   }
+
+  eventPolicy->submit ("transcoding_" + key, isTranscoding,
+      [weak, state, bin, type] () {
+    auto self = std::dynamic_pointer_cast<MediaElementImpl> (weak.lock () );
+
+    if (!self) {
+      return;
+    }
+
+    MediaTranscodingStateChange event (self,
+        MediaTranscodingStateChange::getName (), state, bin,
+        padTypeToMediaType (type));
+    self->sigcSignalEmit(self->signalMediaTranscodingStateChange, event);
+  });
 }
 
 void
@@ -595,6 +671,29 @@ MediaElementImpl::postConstructor ()
                        (shared_from_this() ) );
 }
 
+static void
+setCodecConfigField (GstElement *element, const char *field,
+                     const std::string &value)
+{
+  GstStructure *codecConfig = nullptr;
+
+  if (!g_object_class_find_property (G_OBJECT_GET_CLASS (element),
+                                     CODEC_CONFIG) ) {
+    return;
+  }
+
+  /* Keep any configuration already set by the element */
+  g_object_get (G_OBJECT (element), CODEC_CONFIG, &codecConfig, NULL);
+
+  if (codecConfig == nullptr) {
+    codecConfig = gst_structure_new_empty (CODEC_CONFIG);
+  }
+
+  gst_structure_set (codecConfig, field, G_TYPE_STRING, value.c_str (), NULL);
+  g_object_set (G_OBJECT (element), CODEC_CONFIG, codecConfig, NULL);
+  gst_structure_free (codecConfig);
+}
+
 MediaElementImpl::MediaElementImpl (const boost::property_tree::ptree &config,
                                     std::shared_ptr<MediaObjectImpl> parent,
                                     const std::string &factoryName) : MediaObjectImpl (config, parent)
@@ -621,6 +720,12 @@ MediaElementImpl::MediaElementImpl (const boost::property_tree::ptree &config,
   g_object_ref (element);
   pipe->addElement (element);
 
+  EventPolicy::Config policyConfig;
+  getConfigValue<int, MediaElement> (&policyConfig.debounce, "eventDebounce");
+  getConfigValue<int, MediaElement> (&policyConfig.rateLimit, "eventRateLimit");
+  /* State events of a pipeline belong to the session that created it */
+  eventPolicy = std::make_shared<EventPolicy> (policyConfig, pipe->getId () );
+
   //read default configuration for output bitrate
   int bitrate = 0;
   if (getConfigValue<int, MediaElement> (&bitrate, "outputBitrate")) {
@@ -628,6 +733,30 @@ MediaElementImpl::MediaElementImpl (const boost::property_tree::ptree &config,
     g_object_set (G_OBJECT (element), MIN_OUTPUT_BITRATE, bitrate,
                   MAX_OUTPUT_BITRATE, bitrate, NULL);
   }
+
+  std::string profile;
+
+  if (getConfigValue<std::string, MediaElement> (&profile, "encoderProfile") ) {
+    GST_DEBUG ("Encoder profile configured to %s", profile.c_str () );
+    setCodecConfigField (element, KMS_ENC_TREE_BIN_PROFILE, profile);
+  }
+
+  std::string ladder;
+
+  if (getConfigValue<std::string, MediaElement> (&ladder, "renditionLadder")
+      && !ladder.empty () ) {
+    GST_DEBUG ("Rendition ladder configured to %s", ladder.c_str () );
+    setCodecConfigField (element, RENDITION_LADDER, ladder);
+  }
+
+  int idleTimeout;
+
+  if (getConfigValue<int, MediaElement> (&idleTimeout,
+                                         "transcodingIdleTimeout") ) {
+    GST_DEBUG ("Transcoding idle timeout configured to %d ms", idleTimeout);
+    setCodecConfigField (element, TRANSCODING_IDLE_TIMEOUT,
+                         std::to_string (idleTimeout) );
+  }
 }
 
 MediaElementImpl::~MediaElementImpl ()
@@ -652,6 +781,14 @@ MediaElementImpl::~MediaElementImpl ()
     unregister_signal_handler (element, mediaTranscodingHandler);
   }
 
+  for (auto &it : mediaTranscodingStates) {
+    if (it.second->getValue () == MediaTranscodingState::TRANSCODING) {
+      addTranscodingBranches (it.first.compare (0, strlen (TYPE_VIDEO),
+          TYPE_VIDEO) == 0 ? KMS_ELEMENT_PAD_TYPE_VIDEO :
+          KMS_ELEMENT_PAD_TYPE_AUDIO, -1);
+    }
+  }
+
   disconnectAll();
 
   pipe = std::dynamic_pointer_cast<MediaPipelineImpl> (getMediaPipeline() );
@@ -1275,6 +1412,30 @@ std::map <std::string, std::shared_ptr<Stats>>
   return statsReport;
 }
 
+std::shared_ptr<ElementStatsSnapshot>
+MediaElementImpl::getStatsSnapshot ()
+{
+  KmsStatsSnapshot snapshot = {};
+  std::vector<int64_t> packetsReceived, bytesReceived;
+  std::vector<int64_t> packetsSent, bytesSent, inputLatency;
+
+  if (KMS_IS_ELEMENT (element) ) {
+    kms_element_read_stats_snapshot (KMS_ELEMENT (element), &snapshot);
+  }
+
+  for (int i = 0; i < KMS_STATS_SNAPSHOT_STREAMS; i++) {
+    packetsReceived.push_back (snapshot.packets_received[i]);
+    bytesReceived.push_back (snapshot.bytes_received[i]);
+    packetsSent.push_back (snapshot.packets_sent[i]);
+    bytesSent.push_back (snapshot.bytes_sent[i]);
+    inputLatency.push_back (snapshot.input_latency[i]);
+  }
+
+  return std::make_shared <ElementStatsSnapshot> (getId (), packetsReceived,
+         bytesReceived, packetsSent, bytesSent, inputLatency,
+         snapshot.remb_received, snapshot.remb_sent);
+}
+
 std::map <std::string, std::shared_ptr<Stats>>
     MediaElementImpl::getStats ()
 {
@@ -1323,6 +1484,17 @@ void
 MediaElementImpl::collectLatencyStats (
   std::vector<std::shared_ptr<MediaLatencyStat>> &latencyStats,
   const GstStructure *stats)
+{
+  std::vector<std::shared_ptr<MediaLatencyPercentiles>> percentiles;
+
+  collectLatencyStats (latencyStats, percentiles, stats);
+}
+
+void
+MediaElementImpl::collectLatencyStats (
+  std::vector<std::shared_ptr<MediaLatencyStat>> &latencyStats,
+  std::vector<std::shared_ptr<MediaLatencyPercentiles>> &percentiles,
+  const GstStructure *stats)
 {
   gint i, fields;
 
@@ -1330,9 +1502,10 @@ MediaElementImpl::collectLatencyStats (
 
   for (i = 0; i < fields; i ++) {
     const gchar *fieldname;
+    const GstStructure *padStats;
     const GValue *val;
     gchar *mediaType;
-    guint64 avg;
+    guint64 avg, value, count, p50, p90, p99, max;
 
     fieldname = gst_structure_nth_field_name (stats, i);
     val = gst_structure_get_value (stats, fieldname);
@@ -1342,14 +1515,35 @@ MediaElementImpl::collectLatencyStats (
       continue;
     }
 
-    gst_structure_get (gst_value_get_structure (val), "type", G_TYPE_STRING,
-                       &mediaType, "avg", G_TYPE_UINT64, &avg, NULL);
+    padStats = gst_value_get_structure (val);
+    gst_structure_get (padStats, "type", G_TYPE_STRING, &mediaType, "avg",
+                       G_TYPE_UINT64, &avg, NULL);
 
     std::shared_ptr<MediaType> type = getMediaTypeFromTypeSelector (mediaType);
     std::shared_ptr<MediaLatencyStat> latency =
       std::make_shared <MediaLatencyStat> (fieldname, type, avg);
     g_free (mediaType);
 
+    /* Only there once some buffers have been measured */
+    if (gst_structure_get_uint64 (padStats, "min", &value) ) {
+      latency->setMin (value);
+    }
+
+    if (gst_structure_get_uint64 (padStats, "max", &value) ) {
+      latency->setMax (value);
+    }
+
+    if (gst_structure_get_uint64 (padStats, "p95", &value) ) {
+      latency->setP95 (value);
+    }
+
+    if (gst_structure_get (padStats, "count", G_TYPE_UINT64, &count, "p50",
+                           G_TYPE_UINT64, &p50, "p90", G_TYPE_UINT64, &p90, "p99",
+                           G_TYPE_UINT64, &p99, "max", G_TYPE_UINT64, &max, NULL) ) {
+      percentiles.push_back (std::make_shared <MediaLatencyPercentiles> (
+                               fieldname, type, count, p50, p90, p99, max) );
+    }
+
     latencyStats.push_back (latency);
   }
 }
@@ -1398,10 +1592,11 @@ MediaElementImpl::fillStatsReport (std::map
   }
 
   std::vector<std::shared_ptr<MediaLatencyStat>> inputLatencies;
+  std::vector<std::shared_ptr<MediaLatencyPercentiles>> inputPercentiles;
 
   if (gst_structure_get (gst_value_get_structure (value), "input-latencies",
                          GST_TYPE_STRUCTURE, &latencies, NULL) ) {
-    collectLatencyStats (inputLatencies, latencies);
+    collectLatencyStats (inputLatencies, inputPercentiles, latencies);
     gst_structure_free (latencies);
   }
 
@@ -1418,6 +1613,14 @@ MediaElementImpl::fillStatsReport (std::map
 
   setDeprecatedProperties (std::dynamic_pointer_cast <ElementStats>
                            (report[getId ()]) );
+
+  std::dynamic_pointer_cast <ElementStats> (report[getId ()])->setDroppedEvents (
+    eventPolicy->getDroppedEvents () );
+
+  if (!inputPercentiles.empty () ) {
+    std::dynamic_pointer_cast <ElementStats>
+    (report[getId ()])->setInputLatencyPercentiles (inputPercentiles);
+  }
 }
 
 bool MediaElementImpl::isMediaFlowingIn (std::shared_ptr<MediaType> mediaType)
@@ -21,7 +21,9 @@
 #include "MediaElement.hpp"
 #include "MediaType.hpp"
 #include "MediaLatencyStat.hpp"
+#include "MediaLatencyPercentiles.hpp"
 #include <EventHandler.hpp>
+#include <EventPolicy.hpp>
 #include <gst/gst.h>
 #include <mutex>
 #include <set>
@@ -40,6 +42,7 @@ class MediaType;
 class MediaElementImpl;
 class AudioCodec;
 class VideoCodec;
+class ElementStatsSnapshot;
 
 struct MediaTypeCmp {
   bool operator() (const std::shared_ptr<MediaType> &a,
@@ -74,6 +77,9 @@ public:
   virtual std::map <std::string, std::shared_ptr<Stats>> getStats (
         std::shared_ptr<MediaType> mediaType) override;
 
+  /* Reads the counters kept by the element, without locking it */
+  std::shared_ptr<ElementStatsSnapshot> getStatsSnapshot ();
+
   virtual std::vector<std::shared_ptr<ElementConnectionData>>
       getSourceConnections () override;
   virtual std::vector<std::shared_ptr<ElementConnectionData>>
@@ -168,6 +174,10 @@ protected:
   virtual void postConstructor () override;
   void collectLatencyStats (std::vector<std::shared_ptr<MediaLatencyStat>>
                             &latencyStats, const GstStructure *stats);
+  void collectLatencyStats (std::vector<std::shared_ptr<MediaLatencyStat>>
+                            &latencyStats,
+                            std::vector<std::shared_ptr<MediaLatencyPercentiles>>
+                            &percentiles, const GstStructure *stats);
   virtual void fillStatsReport (std::map <std::string, std::shared_ptr<Stats>>
                                 &report, const GstStructure *stats,
                                 double timestamp, int64_t timestampMillis);
@@ -192,6 +202,9 @@ private:
   gulong mediaFlowInHandler = 0;
   gulong mediaTranscodingHandler = 0;
 
+  /* Filters the state change events before raising them */
+  std::shared_ptr<EventPolicy> eventPolicy;
+
   void disconnectAll();
   void performConnection (std::shared_ptr <ElementConnectionDataInternal> data);
   std::map <std::string, std::shared_ptr<Stats>> generateStats (
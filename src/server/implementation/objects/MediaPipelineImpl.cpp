@@ -25,6 +25,8 @@
 #include <SignalHandler.hpp>
 #include <memory>
 #include "kmselement.h"
+#include "kmstranscodingmanager.h"
+#include "kmsframeallocator.h"
 
 #define GST_CAT_DEFAULT kurento_media_pipeline_impl
 GST_DEBUG_CATEGORY_STATIC (GST_CAT_DEFAULT);
@@ -213,6 +215,108 @@ MediaPipelineImpl::setLatencyStats (bool latencyStats)
   gst_iterator_free (it);
 }
 
+int
+MediaPipelineImpl::getLatencyStatsSampleRate ()
+{
+  std::unique_lock <std::recursive_mutex> lock (recMutex);
+  return latencyStatsSampleRate;
+}
+
+void
+MediaPipelineImpl::setLatencyStatsSampleRate (int latencyStatsSampleRate)
+{
+  std::unique_lock <std::recursive_mutex> lock (recMutex);
+
+  if (latencyStatsSampleRate < 1) {
+    throw KurentoException (MEDIA_OBJECT_ILLEGAL_PARAM_ERROR,
+                            "latencyStatsSampleRate must be at least 1");
+  }
+
+  this->latencyStatsSampleRate = latencyStatsSampleRate;
+  updateLatencySampling ();
+}
+
+int
+MediaPipelineImpl::getLatencyStatsSampleInterval ()
+{
+  std::unique_lock <std::recursive_mutex> lock (recMutex);
+  return latencyStatsSampleInterval;
+}
+
+void
+MediaPipelineImpl::setLatencyStatsSampleInterval (int
+    latencyStatsSampleInterval)
+{
+  std::unique_lock <std::recursive_mutex> lock (recMutex);
+
+  if (latencyStatsSampleInterval < 0) {
+    throw KurentoException (MEDIA_OBJECT_ILLEGAL_PARAM_ERROR,
+                            "latencyStatsSampleInterval can not be negative");
+  }
+
+  this->latencyStatsSampleInterval = latencyStatsSampleInterval;
+  updateLatencySampling ();
+}
+
+std::vector<std::shared_ptr<MediaTranscodingStats>>
+MediaPipelineImpl::getTranscodingStats ()
+{
+  std::vector<std::shared_ptr<MediaTranscodingStats>> ret;
+  GstStructure *stats = kms_transcoding_manager_get_stats (pipeline);
+  const std::vector<std::pair<std::string, MediaType::type>> media = {
+    {"audio", MediaType::AUDIO}, {"video", MediaType::VIDEO}
+  };
+
+  for (auto &it : media) {
+    guint decoders = 0, encoders = 0, consumers = 0, duplicated = 0;
+
+    if (stats != nullptr) {
+      gst_structure_get (stats,
+                         (it.first + "-decoders").c_str (), G_TYPE_UINT, &decoders,
+                         (it.first + "-encoders").c_str (), G_TYPE_UINT, &encoders,
+                         (it.first + "-consumers").c_str (), G_TYPE_UINT, &consumers,
+                         (it.first + "-duplicated").c_str (), G_TYPE_UINT, &duplicated,
+                         NULL);
+    }
+
+    ret.push_back (std::make_shared<MediaTranscodingStats> (
+                     std::make_shared<MediaType> (it.second), decoders, encoders,
+                     consumers, duplicated) );
+  }
+
+  if (stats != nullptr) {
+    gst_structure_free (stats);
+  }
+
+  return ret;
+}
+
+std::shared_ptr<FrameMemoryStats>
+MediaPipelineImpl::getFrameMemoryStats ()
+{
+  GstStructure *stats = kms_frame_allocator_get_stats (pipeline);
+  guint64 inUse = 0, peak = 0, allocations = 0, reuses = 0;
+
+  if (stats != nullptr) {
+    gst_structure_get (stats,
+                       "in-use", G_TYPE_UINT64, &inUse,
+                       "peak", G_TYPE_UINT64, &peak,
+                       "allocations", G_TYPE_UINT64, &allocations,
+                       "reuses", G_TYPE_UINT64, &reuses, NULL);
+    gst_structure_free (stats);
+  }
+
+  return std::make_shared<FrameMemoryStats> (inUse, peak, allocations, reuses);
+}
+
+void
+MediaPipelineImpl::updateLatencySampling ()
+{
+  /* Read by the latency probes of all the elements of this pipeline */
+  kms_stats_set_latency_sampling (pipeline, latencyStatsSampleRate,
+                                  latencyStatsSampleInterval * GST_MSECOND);
+}
+
 bool
 MediaPipelineImpl::addElement (GstElement *element)
 {
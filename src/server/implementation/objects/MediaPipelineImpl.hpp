@@ -19,6 +19,8 @@
 
 #include "MediaObjectImpl.hpp"
 #include "MediaPipeline.hpp"
+#include "MediaTranscodingStats.hpp"
+#include "FrameMemoryStats.hpp"
 #include <EventHandler.hpp>
 #include <gst/gst.h>
 #include <boost/property_tree/ptree.hpp>
@@ -52,6 +54,13 @@ public:
 
   virtual bool getLatencyStats ();
   virtual void setLatencyStats (bool latencyStats);
+  virtual int getLatencyStatsSampleRate ();
+  virtual void setLatencyStatsSampleRate (int latencyStatsSampleRate);
+  virtual int getLatencyStatsSampleInterval ();
+  virtual void setLatencyStatsSampleInterval (int latencyStatsSampleInterval);
+  virtual std::vector<std::shared_ptr<MediaTranscodingStats>>
+      getTranscodingStats ();
+  virtual std::shared_ptr<FrameMemoryStats> getFrameMemoryStats ();
 
   /* Next methods are automatically implemented by code generator */
   virtual bool connect (const std::string &eventType,
@@ -75,6 +84,10 @@ private:
 
   std::recursive_mutex recMutex;
   bool latencyStats = false;
+  int latencyStatsSampleRate = 1;
+  int latencyStatsSampleInterval = 0;
+
+  void updateLatencySampling ();
 
   void processBusMessage (GstMessage *msg);
 
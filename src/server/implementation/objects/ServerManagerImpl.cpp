@@ -17,18 +17,39 @@
 
 #include <gst/gst.h>
 #include "ServerInfo.hpp"
+#include "WorkerPoolStats.hpp"
+#include "GarbageCollectorStats.hpp"
+#include "TreeBinPoolStats.hpp"
+#include "EventLaneStats.hpp"
+#include "PipelineStatsSnapshot.hpp"
+#include "ElementStatsSnapshot.hpp"
+#include "MediaElementImpl.hpp"
 #include "MediaPipelineImpl.hpp"
 #include "ServerManagerImpl.hpp"
 #include <jsonrpc/JsonSerializer.hpp>
 #include <KurentoException.hpp>
 #include <MediaSet.hpp>
+#include <WorkerPool.hpp>
+#include <EventDispatcher.hpp>
+#include <MetricsRegistry.hpp>
+#include <MetricsExporter.hpp>
 #include <boost/property_tree/json_parser.hpp>
+#include "kmstreebinpool.h"
+#include "kmsframeallocator.h"
+#include "kmsrtphdrext.h"
+#include "kmsutils.h"
+#include <chrono>
+#include <mutex>
 
 #define GST_CAT_DEFAULT kurento_server_manager_impl
 GST_DEBUG_CATEGORY_STATIC (GST_CAT_DEFAULT);
 #define GST_DEFAULT_NAME "KurentoServerManagerImpl"
 
 #define METADATA "metadata"
+#define TREE_BIN_POOL_SIZE "modules.kurento.MediaElement.treeBinPoolSize"
+#define VIDEO_ADAPTER "modules.kurento.MediaElement.videoAdapter"
+/* Only for transports that can send from several threads at once */
+#define EVENT_DISPATCHER_LANES "eventDispatcher.lanes"
 
 namespace kurento
 {
@@ -57,7 +78,41 @@ ServerManagerImpl::ServerManagerImpl (const std::shared_ptr<ServerInfo> info,
                                       ModuleManager &moduleManager) : MediaObjectImpl (config),
   info (info), moduleManager (moduleManager)
 {
+  MetricsExporter::Config metricsConfig;
+  WorkerPool::Config workerPoolConfig = MediaSet::getWorkerPoolConfig ();
+
+  int poolSize;
+  int lanes;
+  bool videoAdapter;
+
   metadata = childToString (config, METADATA);
+
+  if (WorkerPool::getConfig (config, workerPoolConfig) ) {
+    MediaSet::setWorkerPoolConfig (workerPoolConfig);
+  }
+
+  /* Read before any subscription is served, while it still takes effect */
+  if (getConfigValue <int> (&lanes, EVENT_DISPATCHER_LANES) ) {
+    EventDispatcher::setLanes (lanes);
+  }
+
+  if (getConfigValue <int> (&poolSize, TREE_BIN_POOL_SIZE) && poolSize >= 0) {
+    kms_tree_bin_pool_set_size (poolSize);
+  }
+
+  if (getConfigValue <bool> (&videoAdapter, VIDEO_ADAPTER) ) {
+    kms_utils_set_video_adapter_enabled (videoAdapter);
+  }
+
+  if (MetricsExporter::getConfig (config, metricsConfig) ) {
+    static std::once_flag collectorsFlag;
+
+    std::call_once (collectorsFlag, [] () {
+      MetricsRegistry::getRegistry ().addCollector (collectMetrics);
+    });
+
+    metricsExporter = std::make_shared <MetricsExporter> (metricsConfig);
+  }
 }
 
 std::shared_ptr<ServerInfo> ServerManagerImpl::getInfo ()
@@ -120,8 +175,8 @@ get_int64 (std::string &str, char sep, int nToken)
   return 0;
 }
 
-int64_t
-ServerManagerImpl::getUsedMemory()
+static int64_t
+readUsedMemory ()
 {
   std::string stat;
   std::ifstream stat_file ("/proc/self/stat");
@@ -132,6 +187,210 @@ ServerManagerImpl::getUsedMemory()
   return get_int64 (stat, ' ', 22) / 1024;
 }
 
+int64_t
+ServerManagerImpl::getUsedMemory()
+{
+  return readUsedMemory ();
+}
+
+std::vector<std::shared_ptr<WorkerPoolStats>>
+ServerManagerImpl::getWorkerPoolStats ()
+{
+  std::vector<std::shared_ptr<WorkerPoolStats>> ret;
+
+  for (auto &stats : WorkerPool::getAllStats () ) {
+    ret.push_back (std::make_shared <WorkerPoolStats> (stats.name,
+                   stats.threads, stats.maxThreads, stats.queueDepth,
+                   stats.maxQueueDepth, stats.executedTasks, stats.stolenTasks,
+                   stats.rejectedTasks, stats.callerRunsTasks,
+                   stats.avgQueueLatency, stats.maxQueueLatency) );
+  }
+
+  return ret;
+}
+
+std::shared_ptr<GarbageCollectorStats>
+ServerManagerImpl::getGarbageCollectorStats ()
+{
+  MediaSet::GarbageCollectorStats stats =
+    MediaSet::getMediaSet ()->getGarbageCollectorStats ();
+
+  return std::make_shared <GarbageCollectorStats> (stats.activeSessions,
+         stats.expiredSessions, stats.lastPause, stats.maxPause);
+}
+
+static void
+getTreeBinPoolCounters (int64_t &size, int64_t &available, int64_t &hits,
+                        int64_t &misses)
+{
+  GstStructure *stats = kms_tree_bin_pool_get_stats ();
+  guint64 hitCount, missCount;
+  guint poolSize, ready;
+
+  gst_structure_get (stats, "size", G_TYPE_UINT, &poolSize,
+                     "available", G_TYPE_UINT, &ready,
+                     "hits", G_TYPE_UINT64, &hitCount,
+                     "misses", G_TYPE_UINT64, &missCount, NULL);
+  gst_structure_free (stats);
+
+  size = poolSize;
+  available = ready;
+  hits = hitCount;
+  misses = missCount;
+}
+
+std::shared_ptr<TreeBinPoolStats>
+ServerManagerImpl::getTreeBinPoolStats ()
+{
+  int64_t size, available, hits, misses;
+
+  getTreeBinPoolCounters (size, available, hits, misses);
+
+  return std::make_shared <TreeBinPoolStats> (size, available, hits, misses);
+}
+
+std::vector<std::shared_ptr<EventLaneStats>>
+ServerManagerImpl::getEventDispatcherStats ()
+{
+  std::vector<std::shared_ptr<EventLaneStats>> ret;
+
+  for (auto &stats : EventDispatcher::getDispatcher ().getStats () ) {
+    ret.push_back (std::make_shared <EventLaneStats> (stats.lane,
+                   stats.queueDepth, stats.dispatchedEvents, stats.batches,
+                   stats.avgDispatchLatency, stats.maxDispatchLatency) );
+  }
+
+  return ret;
+}
+
+static void
+collectStatsSnapshots (std::shared_ptr<MediaObjectImpl> parent,
+                       std::vector<std::shared_ptr<ElementStatsSnapshot>> &elements)
+{
+  for (auto child : MediaSet::getMediaSet ()->getChildren (parent) ) {
+    auto element = std::dynamic_pointer_cast<MediaElementImpl> (child);
+
+    if (element) {
+      elements.push_back (element->getStatsSnapshot () );
+    }
+
+    /* Hubs own their ports */
+    collectStatsSnapshots (child, elements);
+  }
+}
+
+std::shared_ptr<PipelineStatsSnapshot>
+ServerManagerImpl::getStatsSnapshot (std::shared_ptr<MediaPipeline> pipeline)
+{
+  std::vector<std::shared_ptr<ElementStatsSnapshot>> elements;
+  const auto epoch = std::chrono::system_clock::now ().time_since_epoch ();
+  const int64_t timestampMillis =
+    std::chrono::duration_cast<std::chrono::milliseconds> (epoch).count ();
+
+  if (!pipeline) {
+    throw KurentoException (MEDIA_OBJECT_ILLEGAL_PARAM_ERROR,
+                            "A pipeline is required");
+  }
+
+  collectStatsSnapshots (std::dynamic_pointer_cast<MediaObjectImpl> (pipeline),
+                         elements);
+
+  return std::make_shared <PipelineStatsSnapshot> (timestampMillis, elements);
+}
+
+static void
+setMediaGauges (MetricsRegistry &registry, const std::string &name,
+                const std::string &help, const std::vector<int64_t> &values)
+{
+  static const char *media[] = {"audio", "video", "data"};
+
+  for (size_t i = 0; i < values.size () && i < G_N_ELEMENTS (media); i++) {
+    registry.gauge (name, help, { {"media", media[i]} }).set (values[i]);
+  }
+}
+
+void
+ServerManagerImpl::collectMetrics (MetricsRegistry &registry)
+{
+  std::vector<std::shared_ptr<ElementStatsSnapshot>> elements;
+  std::vector<int64_t> packetsReceived (3), bytesReceived (3);
+  std::vector<int64_t> packetsSent (3), bytesSent (3);
+  std::vector<int64_t> decoders (2), encoders (2), consumers (2);
+  int64_t frameMemory = 0;
+
+  registry.gauge ("kurento_process_virtual_memory_kbytes",
+                  "Virtual memory used by the server").set (readUsedMemory () );
+
+  auto pipelines = MediaSet::getMediaSet ()->getAllPipelines ();
+
+  for (auto pipeline : pipelines) {
+    collectStatsSnapshots (pipeline, elements);
+
+    for (auto stats : std::dynamic_pointer_cast<MediaPipelineImpl>
+         (pipeline)->getTranscodingStats () ) {
+      size_t i = stats->getType ()->getValue () == MediaType::AUDIO ? 0 : 1;
+
+      decoders[i] += stats->getDecoders ();
+      encoders[i] += stats->getEncoders ();
+      consumers[i] += stats->getConsumers ();
+    }
+
+    frameMemory += std::dynamic_pointer_cast<MediaPipelineImpl>
+                   (pipeline)->getFrameMemoryStats ()->getInUse ();
+  }
+
+  registry.gauge ("kurento_pipelines", "Media pipelines alive").set (
+    pipelines.size () );
+
+  /* Sums over the live elements, so they are gauges and not counters: they go
+   * down whenever an element is released */
+  for (auto &element : elements) {
+    for (size_t i = 0; i < packetsReceived.size (); i++) {
+      packetsReceived[i] += element->getPacketsReceived ().at (i);
+      bytesReceived[i] += element->getBytesReceived ().at (i);
+      packetsSent[i] += element->getPacketsSent ().at (i);
+      bytesSent[i] += element->getBytesSent ().at (i);
+    }
+  }
+
+  setMediaGauges (registry, "kurento_rtp_packets_received",
+                  "RTP packets received by the live elements", packetsReceived);
+  setMediaGauges (registry, "kurento_rtp_bytes_received",
+                  "RTP bytes received by the live elements", bytesReceived);
+  setMediaGauges (registry, "kurento_rtp_packets_sent",
+                  "RTP packets sent by the live elements", packetsSent);
+  setMediaGauges (registry, "kurento_rtp_bytes_sent",
+                  "RTP bytes sent by the live elements", bytesSent);
+  setMediaGauges (registry, "kurento_transcoding_decoders",
+                  "Decoders running in all the pipelines", decoders);
+  setMediaGauges (registry, "kurento_transcoding_encoders",
+                  "Encoders running in all the pipelines", encoders);
+  setMediaGauges (registry, "kurento_transcoding_encoder_consumers",
+                  "Sinks fed by the encoders of all the pipelines", consumers);
+
+  int64_t poolSize, poolAvailable, poolHits, poolMisses;
+
+  getTreeBinPoolCounters (poolSize, poolAvailable, poolHits, poolMisses);
+  registry.gauge ("kurento_tree_bin_pool_size",
+                  "Encoders and decoders kept ready for each codec").set (poolSize);
+  registry.gauge ("kurento_tree_bin_pool_available",
+                  "Encoders and decoders ready to be used").set (poolAvailable);
+  registry.counter ("kurento_tree_bin_pool_hits_total",
+                    "Encoders and decoders taken from the pool").set (poolHits);
+  registry.counter ("kurento_tree_bin_pool_misses_total",
+                    "Encoders and decoders of pooled codecs built on demand").set (
+                      poolMisses);
+
+  registry.gauge ("kurento_frame_memory_in_use_bytes",
+                  "Raw frame memory used by all the pipelines").set (frameMemory);
+  registry.gauge ("kurento_frame_memory_cached_bytes",
+                  "Raw frame memory kept to be recycled").set (
+                    kms_frame_allocator_get_cached_bytes () );
+  registry.counter ("kurento_rtp_hdrext_copies_avoided_total",
+                    "RTP packets stamped without copying their payload").set (
+                      kms_rtp_hdr_ext_get_copies_avoided () );
+}
+
 ServerManagerImpl::StaticConstructor ServerManagerImpl::staticConstructor;
 
 ServerManagerImpl::StaticConstructor::StaticConstructor()
@@ -23,6 +23,7 @@
 #include <EventHandler.hpp>
 #include <boost/property_tree/ptree.hpp>
 #include <ModuleManager.hpp>
+#include <MetricsExporter.hpp>
 
 namespace kurento
 {
@@ -39,6 +40,13 @@ namespace kurento
 {
 class ServerInfo;
 class MediaPipelineImpl;
+class WorkerPoolStats;
+class GarbageCollectorStats;
+class TreeBinPoolStats;
+class EventLaneStats;
+class PipelineStatsSnapshot;
+class ElementStatsSnapshot;
+class MetricsRegistry;
 } /* kurento */
 
 namespace kurento
@@ -72,6 +80,20 @@ public:
 
   virtual int64_t getUsedMemory() override;
 
+  virtual std::vector<std::shared_ptr<WorkerPoolStats>> getWorkerPoolStats ()
+      override;
+
+  virtual std::shared_ptr<GarbageCollectorStats> getGarbageCollectorStats ()
+      override;
+
+  virtual std::shared_ptr<TreeBinPoolStats> getTreeBinPoolStats () override;
+
+  virtual std::vector<std::shared_ptr<EventLaneStats>> getEventDispatcherStats ()
+      override;
+
+  virtual std::shared_ptr<PipelineStatsSnapshot> getStatsSnapshot (
+    std::shared_ptr<MediaPipeline> pipeline) override;
+
   /* Next methods are automatically implemented by code generator */
   virtual bool connect (const std::string &eventType,
                         std::shared_ptr<EventHandler> handler) override;
@@ -91,6 +113,10 @@ private:
 
   ModuleManager &moduleManager;
 
+  std::shared_ptr<MetricsExporter> metricsExporter;
+
+  static void collectMetrics (MetricsRegistry &registry);
+
   class StaticConstructor
   {
   public:
@@ -19,6 +19,9 @@
 #include <gst/gst.h>
 #include <glib.h>
 
+#include <kmstranscodingmanager.h>
+#include <kmstreebin.h>
+
 #define AGNOSTIC_KEY "agnostic"
 G_DEFINE_QUARK (AGNOSTIC_KEY, agnostic_key);
 
@@ -40,6 +43,8 @@ G_DEFINE_QUARK (COUNT_KEY, count_key);
  */
 #define N_ITERS 200
 
+#define BENCHMARK_PADS 300
+
 typedef struct _ElementsData
 {
   GstElement *agnosticbin;
@@ -1428,6 +1433,493 @@ GST_START_TEST (test_codec_config_openh264)
   test_codec_config (pipeline_str, config_str, codec_name, agnostic_name);
 }
 
+GST_END_TEST;
+
+GST_START_TEST (transcoding_sharing)
+{
+  GstElement *pipeline = gst_parse_launch ("videotestsrc is-live=true"
+      "  ! agnosticbin name=ag"
+      "  ag. ! capsfilter caps=video/x-vp8"
+      "  ! fakesink async=true sync=true name=sink signal-handoffs=true"
+      "  ag. ! capsfilter caps=video/x-vp8 ! fakesink async=true sync=true",
+      NULL);
+  GstBus *bus = gst_pipeline_get_bus (GST_PIPELINE (pipeline));
+  GstElement *fakesink;
+  GstStructure *stats;
+  guint decoders, encoders, consumers, duplicated;
+
+  loop = g_main_loop_new (NULL, TRUE);
+
+  gst_bus_add_signal_watch (bus);
+  g_signal_connect (bus, "message", G_CALLBACK (bus_msg), pipeline);
+
+  fakesink = gst_bin_get_by_name (GST_BIN (pipeline), "sink");
+  g_signal_connect (G_OBJECT (fakesink), "handoff",
+      G_CALLBACK (fakesink_hand_off), loop);
+  g_object_unref (fakesink);
+
+  gst_element_set_state (pipeline, GST_STATE_PLAYING);
+
+  mark_point ();
+  g_main_loop_run (loop);
+  mark_point ();
+
+  /* Raw input, so both sinks must share a single encoder */
+  stats = kms_transcoding_manager_get_stats (pipeline);
+  fail_unless (stats != NULL);
+  fail_unless (gst_structure_get (stats,
+          "video-decoders", G_TYPE_UINT, &decoders,
+          "video-encoders", G_TYPE_UINT, &encoders,
+          "video-consumers", G_TYPE_UINT, &consumers,
+          "video-duplicated", G_TYPE_UINT, &duplicated, NULL));
+  fail_unless_equals_int (decoders, 0);
+  fail_unless_equals_int (encoders, 1);
+  fail_unless_equals_int (consumers, 2);
+  fail_unless_equals_int (duplicated, 0);
+  gst_structure_free (stats);
+
+  gst_element_set_state (pipeline, GST_STATE_NULL);
+  gst_bus_remove_signal_watch (bus);
+  g_object_unref (bus);
+  g_object_unref (pipeline);
+  g_main_loop_unref (loop);
+}
+
+GST_END_TEST;
+
+GST_START_TEST (transcoding_duplicated_across_bins)
+{
+  GstElement *pipeline = gst_parse_launch ("videotestsrc is-live=true"
+      "  ! tee name=t"
+      "  t. ! queue ! agnosticbin ! capsfilter caps=video/x-vp8"
+      "  ! fakesink async=true sync=true name=sink signal-handoffs=true"
+      "  t. ! queue ! agnosticbin ! capsfilter caps=video/x-vp8"
+      "  ! fakesink async=true sync=true",
+      NULL);
+  GstBus *bus = gst_pipeline_get_bus (GST_PIPELINE (pipeline));
+  GstElement *fakesink;
+  GstStructure *stats;
+  guint encoders, duplicated;
+
+  loop = g_main_loop_new (NULL, TRUE);
+
+  gst_bus_add_signal_watch (bus);
+  g_signal_connect (bus, "message", G_CALLBACK (bus_msg), pipeline);
+
+  fakesink = gst_bin_get_by_name (GST_BIN (pipeline), "sink");
+  g_signal_connect (G_OBJECT (fakesink), "handoff",
+      G_CALLBACK (fakesink_hand_off), loop);
+  g_object_unref (fakesink);
+
+  gst_element_set_state (pipeline, GST_STATE_PLAYING);
+
+  mark_point ();
+  g_main_loop_run (loop);
+  mark_point ();
+
+  /* Same stream encoded by two agnosticbins */
+  stats = kms_transcoding_manager_get_stats (pipeline);
+  fail_unless (stats != NULL);
+  fail_unless (gst_structure_get (stats,
+          "video-encoders", G_TYPE_UINT, &encoders,
+          "video-duplicated", G_TYPE_UINT, &duplicated, NULL));
+  fail_unless_equals_int (encoders, 2);
+  fail_unless_equals_int (duplicated, 1);
+  gst_structure_free (stats);
+
+  gst_element_set_state (pipeline, GST_STATE_NULL);
+  gst_bus_remove_signal_watch (bus);
+  g_object_unref (bus);
+  g_object_unref (pipeline);
+  g_main_loop_unref (loop);
+}
+
+GST_END_TEST;
+
+GST_START_TEST (transcoding_duplicated_released)
+{
+  GstElement *pipeline = gst_pipeline_new (NULL);
+  GstElement *source = gst_element_factory_make ("identity", NULL);
+  GstElement *first, *second;
+  GstCaps *caps = gst_caps_from_string ("video/x-vp8");
+  GstStructure *stats;
+  guint encoders, duplicated;
+
+  gst_bin_add (GST_BIN (pipeline), source);
+
+  first = gst_object_ref_sink (g_object_new (KMS_TYPE_TREE_BIN, NULL));
+  second = gst_object_ref_sink (g_object_new (KMS_TYPE_TREE_BIN, NULL));
+
+  kms_transcoding_manager_add_branch (source, first,
+      KMS_TRANSCODING_BRANCH_ENCODER, caps, 300000);
+  kms_transcoding_manager_add_branch (source, second,
+      KMS_TRANSCODING_BRANCH_ENCODER, caps, 300000);
+
+  stats = kms_transcoding_manager_get_stats (pipeline);
+  fail_unless (gst_structure_get (stats,
+          "video-encoders", G_TYPE_UINT, &encoders,
+          "video-duplicated", G_TYPE_UINT, &duplicated, NULL));
+  fail_unless_equals_int (encoders, 2);
+  fail_unless_equals_int (duplicated, 1);
+  gst_structure_free (stats);
+
+  /* Releasing the original leaves the other one as the only branch */
+  g_object_unref (first);
+
+  stats = kms_transcoding_manager_get_stats (pipeline);
+  fail_unless (gst_structure_get (stats,
+          "video-encoders", G_TYPE_UINT, &encoders,
+          "video-duplicated", G_TYPE_UINT, &duplicated, NULL));
+  fail_unless_equals_int (encoders, 1);
+  fail_unless_equals_int (duplicated, 0);
+  gst_structure_free (stats);
+
+  g_object_unref (second);
+  gst_caps_unref (caps);
+  g_object_unref (pipeline);
+}
+
+GST_END_TEST;
+
+static void
+fakesink_hand_off_height (GstElement * fakesink, GstBuffer * buf, GstPad * pad,
+    gpointer data)
+{
+  gint *height = data;
+  GstCaps *caps = gst_pad_get_current_caps (pad);
+
+  if (caps != NULL) {
+    gst_structure_get_int (gst_caps_get_structure (caps, 0), "height", height);
+    gst_caps_unref (caps);
+  }
+}
+
+GST_START_TEST (rendition_ladder)
+{
+  GstElement *pipeline = gst_parse_launch ("videotestsrc is-live=true"
+      "  ! video/x-raw,width=640,height=360 ! agnosticbin name=ag"
+      "  ag. ! capsfilter caps=video/x-vp8"
+      "  ! fakesink async=true sync=true name=sink signal-handoffs=true"
+      "  ag. ! capsfilter caps=video/x-vp8 ! fakesink async=true sync=true",
+      NULL);
+  GstBus *bus = gst_pipeline_get_bus (GST_PIPELINE (pipeline));
+  GstElement *fakesink, *agnostic;
+  GstStructure *config, *stats;
+  guint encoders;
+  gint height = 0;
+
+  loop = g_main_loop_new (NULL, TRUE);
+
+  gst_bus_add_signal_watch (bus);
+  g_signal_connect (bus, "message", G_CALLBACK (bus_msg), pipeline);
+
+  agnostic = gst_bin_get_by_name (GST_BIN (pipeline), "ag");
+  config = gst_structure_new ("codec-config", "rendition-ladder",
+      G_TYPE_STRING, "360p/180p@100000", NULL);
+  g_object_set (agnostic, "codec-config", config, NULL);
+  gst_structure_free (config);
+  g_object_unref (agnostic);
+
+  fakesink = gst_bin_get_by_name (GST_BIN (pipeline), "sink");
+  g_signal_connect (G_OBJECT (fakesink), "handoff",
+      G_CALLBACK (fakesink_hand_off_height), &height);
+  g_signal_connect (G_OBJECT (fakesink), "handoff",
+      G_CALLBACK (fakesink_hand_off), loop);
+  g_object_unref (fakesink);
+
+  gst_element_set_state (pipeline, GST_STATE_PLAYING);
+
+  mark_point ();
+  g_main_loop_run (loop);
+  mark_point ();
+
+  /* One encoder per rendition, whatever the number of sinks */
+  stats = kms_transcoding_manager_get_stats (pipeline);
+  fail_unless (stats != NULL);
+  fail_unless (gst_structure_get (stats,
+          "video-encoders", G_TYPE_UINT, &encoders, NULL));
+  fail_unless_equals_int (encoders, 2);
+  gst_structure_free (stats);
+
+  /* Without bandwidth estimations sinks stay on the smallest rendition */
+  fail_unless_equals_int (height, 180);
+
+  gst_element_set_state (pipeline, GST_STATE_NULL);
+  gst_bus_remove_signal_watch (bus);
+  g_object_unref (bus);
+  g_object_unref (pipeline);
+  g_main_loop_unref (loop);
+}
+
+GST_END_TEST;
+
+static gboolean
+unlink_consumer (gpointer data)
+{
+  GstElement *pipeline = data;
+  GstElement *agnosticbin = gst_bin_get_by_name (GST_BIN (pipeline), "ag");
+  GstElement *filter = gst_bin_get_by_name (GST_BIN (pipeline), "filter");
+  GstPad *sink = gst_element_get_static_pad (filter, "sink");
+  GstPad *src = gst_pad_get_peer (sink);
+
+  fail_unless (gst_pad_unlink (src, sink));
+  gst_element_release_request_pad (agnosticbin, src);
+
+  g_object_unref (src);
+  g_object_unref (sink);
+  g_object_unref (filter);
+  g_object_unref (agnosticbin);
+
+  return FALSE;
+}
+
+static void
+fakesink_hand_off_unlink (GstElement * fakesink, GstBuffer * buf,
+    GstPad * pad, gpointer pipeline)
+{
+  static gint count = 0;
+
+  if (count++ == 20) {
+    g_object_set (G_OBJECT (fakesink), "signal-handoffs", FALSE, NULL);
+    g_idle_add (unlink_consumer, pipeline);
+  }
+}
+
+static void
+transcoding_cb (GstElement * agnosticbin, gboolean transcoding,
+    gint media_type, gpointer data)
+{
+  gboolean *started = data;
+
+  if (transcoding) {
+    *started = TRUE;
+  } else if (*started) {
+    g_idle_add (quit_main_loop_idle, loop);
+  }
+}
+
+GST_START_TEST (idle_branch_release)
+{
+  GstElement *pipeline = gst_parse_launch ("videotestsrc is-live=true"
+      "  ! agnosticbin name=ag ! capsfilter name=filter caps=video/x-vp8"
+      "  ! fakesink async=true sync=true name=sink signal-handoffs=true",
+      NULL);
+  GstBus *bus = gst_pipeline_get_bus (GST_PIPELINE (pipeline));
+  GstElement *fakesink, *agnostic;
+  GstStructure *config, *stats;
+  gboolean started = FALSE;
+  guint encoders;
+
+  loop = g_main_loop_new (NULL, TRUE);
+
+  gst_bus_add_signal_watch (bus);
+  g_signal_connect (bus, "message", G_CALLBACK (bus_msg), pipeline);
+
+  agnostic = gst_bin_get_by_name (GST_BIN (pipeline), "ag");
+  config = gst_structure_new ("codec-config", "transcoding-idle-timeout",
+      G_TYPE_STRING, "100", NULL);
+  g_object_set (agnostic, "codec-config", config, NULL);
+  gst_structure_free (config);
+  g_signal_connect (agnostic, "media-transcoding",
+      G_CALLBACK (transcoding_cb), &started);
+  g_object_unref (agnostic);
+
+  fakesink = gst_bin_get_by_name (GST_BIN (pipeline), "sink");
+  g_signal_connect (G_OBJECT (fakesink), "handoff",
+      G_CALLBACK (fakesink_hand_off_unlink), pipeline);
+  g_object_unref (fakesink);
+
+  gst_element_set_state (pipeline, GST_STATE_PLAYING);
+
+  mark_point ();
+  g_main_loop_run (loop);
+  mark_point ();
+
+  /* The encoder is released once its only sink has gone away */
+  stats = kms_transcoding_manager_get_stats (pipeline);
+  fail_unless (stats != NULL);
+  fail_unless (gst_structure_get (stats,
+          "video-encoders", G_TYPE_UINT, &encoders, NULL));
+  fail_unless_equals_int (encoders, 0);
+  gst_structure_free (stats);
+
+  gst_element_set_state (pipeline, GST_STATE_NULL);
+  gst_bus_remove_signal_watch (bus);
+  g_object_unref (bus);
+  g_object_unref (pipeline);
+  g_main_loop_unref (loop);
+}
+
+GST_END_TEST;
+
+static gboolean
+agnostic_pad_has_target (GstPad * sink_pad)
+{
+  GstPad *src = gst_pad_get_peer (sink_pad);
+  GstPad *target;
+
+  if (src == NULL) {
+    return FALSE;
+  }
+
+  target = gst_ghost_pad_get_target (GST_GHOST_PAD (src));
+  g_object_unref (src);
+
+  if (target == NULL) {
+    return FALSE;
+  }
+
+  g_object_unref (target);
+
+  return TRUE;
+}
+
+static void
+fakesink_hand_off_tree_bins (GstElement * fakesink, GstBuffer * buf,
+    GstPad * pad, gpointer data)
+{
+  GstElement *pipeline = data;
+  GstElement *first = gst_bin_get_by_name (GST_BIN (pipeline), "sink");
+  GstPad *first_pad = gst_element_get_static_pad (first, "sink");
+
+  /* A second consumer makes the first one go through the tree bins */
+  if (agnostic_pad_has_target (pad) && agnostic_pad_has_target (first_pad)) {
+    g_object_set (G_OBJECT (fakesink), "signal-handoffs", FALSE, NULL);
+    g_idle_add (quit_main_loop_idle, loop);
+  }
+
+  g_object_unref (first_pad);
+  g_object_unref (first);
+}
+
+static gboolean
+link_second_consumer (gpointer data)
+{
+  GstElement *pipeline = data;
+  GstElement *agnosticbin = gst_bin_get_by_name (GST_BIN (pipeline), "ag");
+  GstElement *fakesink = gst_element_factory_make ("fakesink", NULL);
+
+  g_object_set (G_OBJECT (fakesink), "async", FALSE, "sync", FALSE,
+      "signal-handoffs", TRUE, NULL);
+  g_signal_connect (G_OBJECT (fakesink), "handoff",
+      G_CALLBACK (fakesink_hand_off_tree_bins), pipeline);
+
+  gst_bin_add (GST_BIN (pipeline), fakesink);
+  gst_element_sync_state_with_parent (fakesink);
+  fail_unless (gst_element_link (agnosticbin, fakesink));
+
+  g_object_unref (agnosticbin);
+
+  return FALSE;
+}
+
+static void
+fakesink_hand_off_direct (GstElement * fakesink, GstBuffer * buf, GstPad * pad,
+    gpointer pipeline)
+{
+  static gint count = 0;
+
+  /* Buffers reach a single consumer without going through the tree bins */
+  if (!agnostic_pad_has_target (pad) && count++ == 20) {
+    g_object_set (G_OBJECT (fakesink), "signal-handoffs", FALSE, NULL);
+    g_idle_add (link_second_consumer, pipeline);
+  }
+}
+
+GST_START_TEST (single_consumer_direct)
+{
+  GstElement *pipeline = gst_parse_launch ("videotestsrc is-live=true"
+      "  ! vp8enc deadline=1 ! agnosticbin name=ag direct-mode=true"
+      "  ! fakesink async=false sync=false name=sink signal-handoffs=true",
+      NULL);
+  GstBus *bus = gst_pipeline_get_bus (GST_PIPELINE (pipeline));
+  GstElement *fakesink;
+
+  loop = g_main_loop_new (NULL, TRUE);
+
+  gst_bus_add_signal_watch (bus);
+  g_signal_connect (bus, "message", G_CALLBACK (bus_msg), pipeline);
+
+  fakesink = gst_bin_get_by_name (GST_BIN (pipeline), "sink");
+  g_signal_connect (G_OBJECT (fakesink), "handoff",
+      G_CALLBACK (fakesink_hand_off_direct), pipeline);
+  g_object_unref (fakesink);
+
+  gst_element_set_state (pipeline, GST_STATE_PLAYING);
+
+  mark_point ();
+  g_main_loop_run (loop);
+  mark_point ();
+
+  gst_element_set_state (pipeline, GST_STATE_NULL);
+  gst_bus_remove_signal_watch (bus);
+  g_object_unref (bus);
+  g_object_unref (pipeline);
+  g_main_loop_unref (loop);
+}
+
+GST_END_TEST;
+
+/* Links many sinks asking for the same encoded caps, each link looks up */
+/* the tree bin that feeds it                                            */
+GST_START_TEST (benchmark_link_pads)
+{
+  GstElement *pipeline = gst_pipeline_new (__FUNCTION__);
+  GstElement *videotestsrc = gst_element_factory_make ("videotestsrc", NULL);
+  GstElement *agnosticbin = gst_element_factory_make ("agnosticbin", NULL);
+  GstElement *fakesink = gst_element_factory_make ("fakesink", NULL);
+  GstBus *bus = gst_pipeline_get_bus (GST_PIPELINE (pipeline));
+  GstCaps *caps = gst_caps_from_string ("video/x-vp8");
+  gint64 start, elapsed;
+  guint i;
+
+  loop = g_main_loop_new (NULL, TRUE);
+
+  gst_bus_add_signal_watch (bus);
+  g_signal_connect (bus, "message", G_CALLBACK (bus_msg), pipeline);
+
+  g_object_set (videotestsrc, "is-live", TRUE, NULL);
+  g_object_set (fakesink, "async", FALSE, "sync", FALSE,
+      "signal-handoffs", TRUE, NULL);
+  g_signal_connect (G_OBJECT (fakesink), "handoff",
+      G_CALLBACK (fakesink_hand_off), loop);
+
+  gst_bin_add_many (GST_BIN (pipeline), videotestsrc, agnosticbin, fakesink,
+      NULL);
+  gst_element_link (videotestsrc, agnosticbin);
+  gst_element_link_filtered (agnosticbin, fakesink, caps);
+
+  gst_element_set_state (pipeline, GST_STATE_PLAYING);
+
+  mark_point ();
+  g_main_loop_run (loop);
+  mark_point ();
+
+  start = g_get_monotonic_time ();
+
+  for (i = 0; i < BENCHMARK_PADS; i++) {
+    GstElement *sink = gst_element_factory_make ("fakesink", NULL);
+
+    g_object_set (sink, "async", FALSE, "sync", FALSE, NULL);
+    gst_bin_add (GST_BIN (pipeline), sink);
+    gst_element_sync_state_with_parent (sink);
+    fail_unless (gst_element_link_filtered (agnosticbin, sink, caps));
+  }
+
+  elapsed = MAX (g_get_monotonic_time () - start, 1);
+
+  GST_INFO ("Linked %d pads: %" G_GINT64_FORMAT " pads/s", BENCHMARK_PADS,
+      (gint64) BENCHMARK_PADS * G_USEC_PER_SEC / elapsed);
+
+  gst_caps_unref (caps);
+
+  gst_element_set_state (pipeline, GST_STATE_NULL);
+  gst_bus_remove_signal_watch (bus);
+  g_object_unref (bus);
+  g_object_unref (pipeline);
+  g_main_loop_unref (loop);
+}
+
 GST_END_TEST;
 /*
  * End of test cases
@@ -1464,6 +1956,13 @@ agnostic2_suite (void)
 
   tcase_add_test (tc_chain, test_raw_to_rtp);
   tcase_add_test (tc_chain, test_codec_to_rtp);
+  tcase_add_test (tc_chain, transcoding_sharing);
+  tcase_add_test (tc_chain, transcoding_duplicated_across_bins);
+  tcase_add_test (tc_chain, transcoding_duplicated_released);
+  tcase_add_test (tc_chain, rendition_ladder);
+  tcase_add_test (tc_chain, idle_branch_release);
+  tcase_add_test (tc_chain, single_consumer_direct);
+  tcase_add_test (tc_chain, benchmark_link_pads);
 
   return s;
 }
@@ -0,0 +1,273 @@
+/*
+ * (C) Copyright 2016 Kurento (http://kurento.org/)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+#include <gst/check/gstcheck.h>
+#include <gst/gst.h>
+
+#include "kmsenctreebin.h"
+
+#define BENCHMARK_FRAMES 150
+#define BENCHMARK_CAPS "video/x-raw,format=I420,width=1280,height=720," \
+  "framerate=30/1"
+
+#define VP8_CAPS "video/x-vp8"
+
+static const gchar *profiles[] = { "low-latency", "throughput", "quality" };
+
+static GstElement *
+get_encoder (KmsEncTreeBin * bin)
+{
+  GstElement *encoder = NULL;
+  GstIterator *it;
+  GValue item = G_VALUE_INIT;
+  gboolean done = FALSE;
+
+  it = gst_bin_iterate_elements (GST_BIN (bin));
+  while (!done) {
+    switch (gst_iterator_next (it, &item)) {
+      case GST_ITERATOR_OK:{
+        GstElement *element = g_value_get_object (&item);
+
+        if (g_str_has_prefix (GST_OBJECT_NAME (element), "vp8enc")) {
+          encoder = gst_object_ref (element);
+          done = TRUE;
+        }
+        g_value_reset (&item);
+        break;
+      }
+      case GST_ITERATOR_RESYNC:
+        gst_iterator_resync (it);
+        break;
+      default:
+        done = TRUE;
+        break;
+    }
+  }
+  g_value_unset (&item);
+  gst_iterator_free (it);
+
+  return encoder;
+}
+
+static KmsEncTreeBin *
+create_enc_bin (const gchar * profile, gint max_bitrate)
+{
+  GstCaps *caps = gst_caps_from_string (VP8_CAPS);
+  GstStructure *config = NULL;
+  KmsEncTreeBin *bin;
+
+  if (profile != NULL) {
+    config = gst_structure_new ("codec-config", KMS_ENC_TREE_BIN_PROFILE,
+        G_TYPE_STRING, profile, NULL);
+  }
+
+  bin = kms_enc_tree_bin_new (caps, 300000, 0, max_bitrate, config);
+
+  if (config != NULL) {
+    gst_structure_free (config);
+  }
+  gst_caps_unref (caps);
+
+  return bin;
+}
+
+GST_START_TEST (profile_selection)
+{
+  KmsEncTreeBin *bin;
+  GstElement *encoder;
+  gint threads, cpu_used;
+
+  /* Default keeps a single thread for low bitrates */
+  bin = create_enc_bin (NULL, G_MAXINT);
+  encoder = get_encoder (bin);
+  fail_unless (encoder != NULL);
+  g_object_get (encoder, "threads", &threads, "cpu-used", &cpu_used, NULL);
+  fail_unless_equals_int (threads, 1);
+  fail_unless_equals_int (cpu_used, 16);
+  g_object_unref (encoder);
+  gst_object_unref (gst_object_ref_sink (bin));
+
+  bin = create_enc_bin ("quality", G_MAXINT);
+  encoder = get_encoder (bin);
+  g_object_get (encoder, "cpu-used", &cpu_used, NULL);
+  fail_unless_equals_int (cpu_used, 4);
+  g_object_unref (encoder);
+  gst_object_unref (gst_object_ref_sink (bin));
+
+  /* Higher bitrates mean bigger resolutions and more threads */
+  bin = create_enc_bin ("throughput", 4000000);
+  encoder = get_encoder (bin);
+  g_object_get (encoder, "threads", &threads, NULL);
+  fail_unless_equals_int (threads, MIN (8, g_get_num_processors ()));
+  g_object_unref (encoder);
+  gst_object_unref (gst_object_ref_sink (bin));
+}
+
+GST_END_TEST;
+
+typedef struct _LatencyData
+{
+  GMutex mutex;
+  /* Input wall clock time by buffer timestamp */
+  GHashTable *input_times;
+  gint64 total_latency;
+  gint64 max_latency;
+  guint frames;
+  GMainLoop *loop;
+} LatencyData;
+
+static GstPadProbeReturn
+input_probe (GstPad * pad, GstPadProbeInfo * info, gpointer user_data)
+{
+  LatencyData *data = user_data;
+  GstBuffer *buffer = gst_pad_probe_info_get_buffer (info);
+  gint64 *now = g_new (gint64, 1);
+
+  *now = g_get_monotonic_time ();
+
+  g_mutex_lock (&data->mutex);
+  g_hash_table_insert (data->input_times,
+      GUINT_TO_POINTER (GST_BUFFER_PTS (buffer) / GST_MSECOND), now);
+  g_mutex_unlock (&data->mutex);
+
+  return GST_PAD_PROBE_OK;
+}
+
+static void
+handoff (GstElement * sink, GstBuffer * buffer, GstPad * pad,
+    gpointer user_data)
+{
+  LatencyData *data = user_data;
+  gint64 *input, latency;
+
+  g_mutex_lock (&data->mutex);
+  input = g_hash_table_lookup (data->input_times,
+      GUINT_TO_POINTER (GST_BUFFER_PTS (buffer) / GST_MSECOND));
+
+  if (input != NULL) {
+    latency = g_get_monotonic_time () - *input;
+    data->total_latency += latency;
+    data->max_latency = MAX (data->max_latency, latency);
+    data->frames++;
+  }
+  g_mutex_unlock (&data->mutex);
+}
+
+static void
+bus_msg (GstBus * bus, GstMessage * message, gpointer user_data)
+{
+  LatencyData *data = user_data;
+
+  switch (GST_MESSAGE_TYPE (message)) {
+    case GST_MESSAGE_ERROR:
+      fail ("Error received on bus");
+      break;
+    case GST_MESSAGE_EOS:
+      g_main_loop_quit (data->loop);
+      break;
+    default:
+      break;
+  }
+}
+
+static void
+run_profile_benchmark (const gchar * profile)
+{
+  GstElement *pipeline = gst_pipeline_new (NULL);
+  GstElement *src = gst_element_factory_make ("videotestsrc", NULL);
+  GstElement *capsfilter = gst_element_factory_make ("capsfilter", NULL);
+  GstElement *sink = gst_element_factory_make ("fakesink", NULL);
+  KmsEncTreeBin *enc = create_enc_bin (profile, G_MAXINT);
+  GstElement *input, *tee;
+  GstCaps *caps = gst_caps_from_string (BENCHMARK_CAPS);
+  GstBus *bus = gst_pipeline_get_bus (GST_PIPELINE (pipeline));
+  LatencyData data = { 0 };
+  GstPad *pad;
+  gint64 start, elapsed;
+
+  g_mutex_init (&data.mutex);
+  data.input_times = g_hash_table_new_full (NULL, NULL, NULL, g_free);
+  data.loop = g_main_loop_new (NULL, FALSE);
+  gst_bus_add_signal_watch (bus);
+  g_signal_connect (bus, "message", G_CALLBACK (bus_msg), &data);
+
+  g_object_set (src, "num-buffers", BENCHMARK_FRAMES, "pattern", 0, NULL);
+  g_object_set (capsfilter, "caps", caps, NULL);
+  g_object_set (sink, "sync", FALSE, "async", FALSE, "signal-handoffs", TRUE,
+      NULL);
+  g_signal_connect (sink, "handoff", G_CALLBACK (handoff), &data);
+
+  gst_bin_add_many (GST_BIN (pipeline), src, capsfilter, GST_ELEMENT (enc),
+      sink, NULL);
+  input = kms_tree_bin_get_input_element (KMS_TREE_BIN (enc));
+  tee = kms_tree_bin_get_output_tee (KMS_TREE_BIN (enc));
+  fail_unless (gst_element_link_many (src, capsfilter, input, NULL));
+  fail_unless (gst_element_link (tee, sink));
+
+  pad = gst_element_get_static_pad (capsfilter, "src");
+  gst_pad_add_probe (pad, GST_PAD_PROBE_TYPE_BUFFER, input_probe, &data,
+      NULL);
+  g_object_unref (pad);
+
+  start = g_get_monotonic_time ();
+  gst_element_set_state (pipeline, GST_STATE_PLAYING);
+  g_main_loop_run (data.loop);
+  elapsed = MAX (g_get_monotonic_time () - start, 1);
+  gst_element_set_state (pipeline, GST_STATE_NULL);
+
+  GST_INFO ("Profile %s: %" G_GINT64_FORMAT " fps, %" G_GINT64_FORMAT
+      " us average latency, %" G_GINT64_FORMAT " us max latency", profile,
+      (gint64) data.frames * G_USEC_PER_SEC / elapsed,
+      data.frames > 0 ? data.total_latency / data.frames : 0,
+      data.max_latency);
+
+  fail_unless (data.frames > 0);
+
+  gst_bus_remove_signal_watch (bus);
+  g_object_unref (bus);
+  gst_object_unref (pipeline);
+  gst_caps_unref (caps);
+  g_main_loop_unref (data.loop);
+  g_hash_table_unref (data.input_times);
+  g_mutex_clear (&data.mutex);
+}
+
+GST_START_TEST (benchmark_profiles)
+{
+  guint i;
+
+  for (i = 0; i < G_N_ELEMENTS (profiles); i++) {
+    run_profile_benchmark (profiles[i]);
+  }
+}
+
+GST_END_TEST;
+
+static Suite *
+enctreebin_suite (void)
+{
+  Suite *s = suite_create ("enctreebin");
+  TCase *tc_chain = tcase_create ("element");
+
+  suite_add_tcase (s, tc_chain);
+
+  tcase_add_test (tc_chain, profile_selection);
+  tcase_add_test (tc_chain, benchmark_profiles);
+
+  return s;
+}
+
+GST_CHECK_MAIN (enctreebin);
@@ -0,0 +1,228 @@
+/*
+ * (C) Copyright 2016 Kurento (http://kurento.org/)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#include <gst/check/gstcheck.h>
+#include <gst/gst.h>
+
+#include "kmsfactorycache.h"
+
+#define BENCHMARK_ENDPOINTS 200
+
+#define VP8_CAPS "video/x-vp8"
+#define VP8_RTP_CAPS "application/x-rtp,media=(string)video," \
+  "clock-rate=(int)90000,encoding-name=(string)VP8,payload=(int)96"
+#define OPUS_RTP_CAPS "application/x-rtp,media=(string)audio," \
+  "clock-rate=(int)48000,encoding-name=(string)OPUS,payload=(int)111"
+#define H263_RTP_CAPS "application/x-rtp,media=(string)video," \
+  "clock-rate=(int)90000,encoding-name=(string)H263,payload=(int)34"
+
+static gboolean
+contains_factory (GList * factories, const gchar * name)
+{
+  GList *l;
+
+  for (l = factories; l != NULL; l = l->next) {
+    if (g_strcmp0 (GST_OBJECT_NAME (l->data), name) == 0) {
+      return TRUE;
+    }
+  }
+
+  return FALSE;
+}
+
+GST_START_TEST (check_same_as_registry)
+{
+  GstCaps *caps = gst_caps_from_string (VP8_CAPS);
+  GList *all, *expected, *first, *second, *l, *e;
+
+  all = gst_element_factory_list_get_elements
+      (GST_ELEMENT_FACTORY_TYPE_ENCODER, GST_RANK_NONE);
+  expected = gst_element_factory_list_filter (all, caps, GST_PAD_SRC, FALSE);
+
+  first = kms_factory_cache_get_factories (KMS_FACTORY_CACHE_ENCODER, caps,
+      GST_PAD_SRC);
+  second = kms_factory_cache_get_factories (KMS_FACTORY_CACHE_ENCODER, caps,
+      GST_PAD_SRC);
+
+  fail_unless_equals_int (g_list_length (first), g_list_length (expected));
+  fail_unless_equals_int (g_list_length (second), g_list_length (expected));
+
+  for (l = first, e = expected; l != NULL; l = l->next, e = e->next) {
+    fail_unless_equals_string (GST_OBJECT_NAME (l->data),
+        GST_OBJECT_NAME (e->data));
+  }
+
+  for (l = first, e = second; l != NULL; l = l->next, e = e->next) {
+    fail_unless (l->data == e->data);
+  }
+
+  gst_plugin_feature_list_free (first);
+  gst_plugin_feature_list_free (second);
+  gst_plugin_feature_list_free (expected);
+  gst_plugin_feature_list_free (all);
+  gst_caps_unref (caps);
+}
+
+GST_END_TEST;
+
+GST_START_TEST (check_rank_overrides)
+{
+  GstCaps *caps = gst_caps_from_string (H263_RTP_CAPS);
+  GList *factories;
+
+  factories = kms_factory_cache_get_factories (KMS_FACTORY_CACHE_DEPAYLOADER,
+      caps, GST_PAD_SINK);
+  fail_if (contains_factory (factories, "asteriskh263"));
+  gst_plugin_feature_list_free (factories);
+  gst_caps_unref (caps);
+
+  if (!kms_factory_cache_has_factory (KMS_FACTORY_CACHE_ENCODER, "openh264")) {
+    GST_WARNING ("openh264 not available, its override is not checked");
+    return;
+  }
+
+  caps = gst_caps_from_string ("video/x-h264");
+  factories = kms_factory_cache_get_factories (KMS_FACTORY_CACHE_ENCODER,
+      caps, GST_PAD_SRC);
+  fail_unless (factories != NULL);
+  fail_unless (g_str_has_prefix (GST_OBJECT_NAME (factories->data),
+          "openh264"));
+  gst_plugin_feature_list_free (factories);
+  gst_caps_unref (caps);
+}
+
+GST_END_TEST;
+
+static GstElement *
+create_uncached (GstElementFactoryListType type, GstCaps * caps,
+    GstPadDirection direction)
+{
+  GList *all, *filtered;
+  GstElement *element = NULL;
+
+  all = gst_element_factory_list_get_elements (type, GST_RANK_NONE);
+  filtered = gst_element_factory_list_filter (all, caps, direction, FALSE);
+
+  if (filtered != NULL) {
+    element = gst_element_factory_create (filtered->data, NULL);
+  }
+
+  gst_plugin_feature_list_free (filtered);
+  gst_plugin_feature_list_free (all);
+
+  return element;
+}
+
+static GstElement *
+create_cached (KmsFactoryCacheType type, GstCaps * caps,
+    GstPadDirection direction)
+{
+  GList *filtered;
+  GstElement *element = NULL;
+
+  filtered = kms_factory_cache_get_factories (type, caps, direction);
+
+  if (filtered != NULL) {
+    element = gst_element_factory_create (filtered->data, NULL);
+  }
+
+  gst_plugin_feature_list_free (filtered);
+
+  return element;
+}
+
+static void
+release (GstElement * element)
+{
+  if (element != NULL) {
+    gst_object_unref (gst_object_ref_sink (element));
+  }
+}
+
+/* Elements looked up by an endpoint negotiating VP8 and Opus: a payloader */
+/* and a depayloader per media, plus a VP8 encoder and decoder            */
+GST_START_TEST (benchmark_endpoint_setup)
+{
+  GstCaps *vp8 = gst_caps_from_string (VP8_CAPS);
+  GstCaps *vp8_rtp = gst_caps_from_string (VP8_RTP_CAPS);
+  GstCaps *opus_rtp = gst_caps_from_string (OPUS_RTP_CAPS);
+  gint64 start, uncached, cached;
+  guint i;
+
+  start = g_get_monotonic_time ();
+
+  for (i = 0; i < BENCHMARK_ENDPOINTS; i++) {
+    release (create_uncached (GST_ELEMENT_FACTORY_TYPE_PAYLOADER, vp8_rtp,
+            GST_PAD_SRC));
+    release (create_uncached (GST_ELEMENT_FACTORY_TYPE_DEPAYLOADER, vp8_rtp,
+            GST_PAD_SINK));
+    release (create_uncached (GST_ELEMENT_FACTORY_TYPE_PAYLOADER, opus_rtp,
+            GST_PAD_SRC));
+    release (create_uncached (GST_ELEMENT_FACTORY_TYPE_DEPAYLOADER, opus_rtp,
+            GST_PAD_SINK));
+    release (create_uncached (GST_ELEMENT_FACTORY_TYPE_ENCODER, vp8,
+            GST_PAD_SRC));
+    release (create_uncached (GST_ELEMENT_FACTORY_TYPE_DECODER, vp8,
+            GST_PAD_SINK));
+  }
+
+  uncached = MAX (g_get_monotonic_time () - start, 1);
+  start = g_get_monotonic_time ();
+
+  for (i = 0; i < BENCHMARK_ENDPOINTS; i++) {
+    release (create_cached (KMS_FACTORY_CACHE_PAYLOADER, vp8_rtp,
+            GST_PAD_SRC));
+    release (create_cached (KMS_FACTORY_CACHE_DEPAYLOADER, vp8_rtp,
+            GST_PAD_SINK));
+    release (create_cached (KMS_FACTORY_CACHE_PAYLOADER, opus_rtp,
+            GST_PAD_SRC));
+    release (create_cached (KMS_FACTORY_CACHE_DEPAYLOADER, opus_rtp,
+            GST_PAD_SINK));
+    release (create_cached (KMS_FACTORY_CACHE_ENCODER, vp8, GST_PAD_SRC));
+    release (create_cached (KMS_FACTORY_CACHE_DECODER, vp8, GST_PAD_SINK));
+  }
+
+  cached = MAX (g_get_monotonic_time () - start, 1);
+
+  GST_INFO ("Endpoint setup: %" G_GINT64_FORMAT " endpoints/s uncached, %"
+      G_GINT64_FORMAT " endpoints/s cached",
+      (gint64) BENCHMARK_ENDPOINTS * G_USEC_PER_SEC / uncached,
+      (gint64) BENCHMARK_ENDPOINTS * G_USEC_PER_SEC / cached);
+
+  gst_caps_unref (vp8);
+  gst_caps_unref (vp8_rtp);
+  gst_caps_unref (opus_rtp);
+}
+
+GST_END_TEST;
+
+static Suite *
+factorycache_suite (void)
+{
+  Suite *s = suite_create ("factorycache");
+  TCase *tc_chain = tcase_create ("element");
+
+  suite_add_tcase (s, tc_chain);
+
+  tcase_add_test (tc_chain, check_same_as_registry);
+  tcase_add_test (tc_chain, check_rank_overrides);
+  tcase_add_test (tc_chain, benchmark_endpoint_setup);
+
+  return s;
+}
+
+GST_CHECK_MAIN (factorycache);
@@ -0,0 +1,165 @@
+/*
+ * (C) Copyright 2016 Kurento (http://kurento.org/)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+#include <gst/check/gstcheck.h>
+#include <gst/gst.h>
+
+#include "kmsframeallocator.h"
+
+/* An I420 640x480 frame */
+#define FRAME_SIZE (640 * 480 * 3 / 2)
+#define FRAMES 8
+#define BENCHMARK_FRAMES 2000
+
+static void
+get_stats (GstElement * pipeline, guint64 * in_use, guint64 * peak,
+    guint64 * allocations, guint64 * reuses)
+{
+  GstStructure *stats = kms_frame_allocator_get_stats (pipeline);
+
+  fail_unless (stats != NULL);
+  gst_structure_get (stats, "in-use", G_TYPE_UINT64, in_use,
+      "peak", G_TYPE_UINT64, peak,
+      "allocations", G_TYPE_UINT64, allocations,
+      "reuses", G_TYPE_UINT64, reuses, NULL);
+  gst_structure_free (stats);
+}
+
+GST_START_TEST (recycling)
+{
+  GstElement *pipeline = gst_pipeline_new (NULL);
+  GstElement *identity = gst_element_factory_make ("identity", NULL);
+  GstAllocator *allocator, *other;
+  GstMemory *frames[FRAMES], *small;
+  guint64 in_use, peak, allocations, reuses;
+  guint i;
+
+  /* Not in a pipeline */
+  fail_unless (kms_frame_allocator_get (identity) == NULL);
+
+  gst_bin_add (GST_BIN (pipeline), identity);
+  fail_unless (kms_frame_allocator_get_stats (pipeline) == NULL);
+
+  allocator = kms_frame_allocator_get (identity);
+  fail_unless (allocator != NULL);
+  other = kms_frame_allocator_get (pipeline);
+  fail_unless (allocator == other);
+  gst_object_unref (other);
+
+  for (i = 0; i < FRAMES; i++) {
+    frames[i] = gst_allocator_alloc (allocator, FRAME_SIZE, NULL);
+    fail_unless (frames[i] != NULL);
+    fail_unless_equals_int (gst_memory_get_sizes (frames[i], NULL, NULL),
+        FRAME_SIZE);
+  }
+
+  get_stats (pipeline, &in_use, &peak, &allocations, &reuses);
+  fail_unless (in_use >= FRAMES * FRAME_SIZE);
+  fail_unless_equals_uint64 (peak, in_use);
+  fail_unless_equals_uint64 (allocations + reuses, FRAMES);
+
+  for (i = 0; i < FRAMES; i++) {
+    gst_memory_unref (frames[i]);
+  }
+
+  get_stats (pipeline, &in_use, &peak, &allocations, &reuses);
+  fail_unless_equals_uint64 (in_use, 0);
+  fail_unless (kms_frame_allocator_get_cached_bytes () >= FRAMES * FRAME_SIZE);
+
+  /* Released frames are handed out again */
+  for (i = 0; i < FRAMES; i++) {
+    frames[i] = gst_allocator_alloc (allocator, FRAME_SIZE, NULL);
+  }
+
+  get_stats (pipeline, &in_use, &peak, &allocations, &reuses);
+  fail_unless (reuses >= FRAMES);
+  fail_unless_equals_uint64 (allocations + reuses, 2 * FRAMES);
+
+  for (i = 0; i < FRAMES; i++) {
+    gst_memory_unref (frames[i]);
+  }
+
+  /* Small blocks are not accounted */
+  small = gst_allocator_alloc (allocator, 1024, NULL);
+  fail_unless (small != NULL);
+  get_stats (pipeline, &in_use, &peak, &allocations, &reuses);
+  fail_unless_equals_uint64 (in_use, 0);
+  gst_memory_unref (small);
+
+  gst_object_unref (allocator);
+  gst_object_unref (pipeline);
+}
+
+GST_END_TEST;
+
+static gint64
+run_allocations (GstAllocator * allocator)
+{
+  gint64 start = g_get_monotonic_time ();
+  GstMapInfo info;
+  GstMemory *mem;
+  gsize j;
+  guint i;
+
+  for (i = 0; i < BENCHMARK_FRAMES; i++) {
+    mem = gst_allocator_alloc (allocator, FRAME_SIZE, NULL);
+    gst_memory_map (mem, &info, GST_MAP_WRITE);
+    /* Touch one byte per page as a decoder would write them all */
+    for (j = 0; j < info.size; j += 4096) {
+      info.data[j] = i;
+    }
+    gst_memory_unmap (mem, &info);
+    gst_memory_unref (mem);
+  }
+
+  return MAX (g_get_monotonic_time () - start, 1);
+}
+
+GST_START_TEST (benchmark)
+{
+  GstElement *pipeline = gst_pipeline_new (NULL);
+  GstAllocator *allocator = kms_frame_allocator_get (pipeline);
+  gint64 sysmem, recycled;
+
+  sysmem = run_allocations (NULL);
+  recycled = run_allocations (allocator);
+
+  GST_INFO ("640x480 frames: %" G_GINT64_FORMAT " frames/s system memory, %"
+      G_GINT64_FORMAT " frames/s recycled",
+      (gint64) BENCHMARK_FRAMES * G_USEC_PER_SEC / sysmem,
+      (gint64) BENCHMARK_FRAMES * G_USEC_PER_SEC / recycled);
+
+  gst_object_unref (allocator);
+  gst_object_unref (pipeline);
+}
+
+GST_END_TEST;
+
+static Suite *
+frameallocator_suite (void)
+{
+  Suite *s = suite_create ("frameallocator");
+  TCase *tc_chain = tcase_create ("element");
+
+  suite_add_tcase (s, tc_chain);
+
+  tcase_add_test (tc_chain, recycling);
+  tcase_add_test (tc_chain, benchmark);
+
+  return s;
+}
+
+GST_CHECK_MAIN (frameallocator);
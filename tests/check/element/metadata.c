@@ -24,6 +24,8 @@
 #include <time.h>
 
 #include "kmsbufferlacentymeta.h"
+#include "kmsrefstruct.h"
+#include "kmsstats.h"
 
 #define KMS_FACTORY_MAKE_IF_AVAILABLE(factory_name) ({      \
   GstElement *_element;                                     \
@@ -416,6 +418,355 @@ GST_START_TEST (check_metadata_enc)
   }
 }
 
+GST_END_TEST
+typedef struct _MarkData
+{
+  KmsRefStruct ref;
+  gchar *id;
+} MarkData;
+
+static gint mark_data_alive;
+
+static void
+mark_data_destroy (MarkData * data)
+{
+  g_free (data->id);
+  g_slice_free (MarkData, data);
+  g_atomic_int_add (&mark_data_alive, -1);
+}
+
+static MarkData *
+mark_data_new (guint i)
+{
+  MarkData *data;
+
+  data = g_slice_new0 (MarkData);
+  kms_ref_struct_init (KMS_REF_STRUCT_CAST (data),
+      (GDestroyNotify) mark_data_destroy);
+  data->id = g_strdup_printf ("element%u_sink", i);
+  g_atomic_int_inc (&mark_data_alive);
+
+  return data;
+}
+
+static gboolean
+count_marks_cb (const gchar * id, KmsRefStruct * data, gpointer user_data)
+{
+  guint *count = user_data;
+
+  fail_unless (g_str_has_suffix (id, "_sink"));
+  (*count)++;
+
+  return TRUE;
+}
+
+static guint
+count_marks (GstBuffer * buffer)
+{
+  KmsBufferLatencyMeta *meta;
+  guint count = 0;
+
+  meta = kms_buffer_get_buffer_latency_meta (buffer);
+  fail_if (meta == NULL);
+
+  kms_buffer_latency_meta_foreach_mark (meta, count_marks_cb, &count);
+
+  return count;
+}
+
+GST_START_TEST (check_latency_marks)
+{
+  GstBuffer *buffer, *copy;
+  KmsBufferLatencyMeta *meta;
+  MarkData *data[20];
+  guint i;
+
+  buffer = gst_buffer_new ();
+  meta = kms_buffer_add_buffer_latency_meta (buffer, 0, TRUE, 0);
+
+  fail_unless (count_marks (buffer) == 0);
+
+  /* More marks than a single block holds */
+  for (i = 0; i < G_N_ELEMENTS (data); i++) {
+    data[i] = mark_data_new (i);
+    fail_unless (kms_buffer_latency_meta_add_mark (meta, data[i]->id,
+            KMS_REF_STRUCT_CAST (data[i])));
+  }
+
+  fail_if (kms_buffer_latency_meta_add_mark (meta, data[0]->id,
+          KMS_REF_STRUCT_CAST (data[0])));
+  fail_unless (count_marks (buffer) == G_N_ELEMENTS (data));
+
+  /* Copies share the marks */
+  copy = gst_buffer_copy (buffer);
+  fail_unless (count_marks (copy) == G_N_ELEMENTS (data));
+
+  for (i = 0; i < G_N_ELEMENTS (data); i++) {
+    kms_ref_struct_unref (KMS_REF_STRUCT_CAST (data[i]));
+  }
+
+  gst_buffer_unref (buffer);
+  fail_unless (g_atomic_int_get (&mark_data_alive) == G_N_ELEMENTS (data));
+
+  gst_buffer_unref (copy);
+  fail_unless (g_atomic_int_get (&mark_data_alive) == 0);
+}
+
+GST_END_TEST
+GST_START_TEST (check_latency_marks_copied_unmarked)
+{
+  GstBuffer *buffer, *copy;
+  MarkData *first, *second;
+
+  buffer = gst_buffer_new ();
+  kms_buffer_add_buffer_latency_meta (buffer, 0, TRUE, 0);
+
+  /* Copied before any mark, storage is still shared */
+  copy = gst_buffer_copy (buffer);
+
+  first = mark_data_new (0);
+  fail_unless (kms_buffer_latency_meta_add_mark
+      (kms_buffer_get_buffer_latency_meta (copy), first->id,
+          KMS_REF_STRUCT_CAST (first)));
+  fail_unless (count_marks (buffer) == 1);
+
+  second = mark_data_new (1);
+  fail_unless (kms_buffer_latency_meta_add_mark
+      (kms_buffer_get_buffer_latency_meta (buffer), second->id,
+          KMS_REF_STRUCT_CAST (second)));
+  fail_unless (count_marks (copy) == 2);
+
+  kms_ref_struct_unref (KMS_REF_STRUCT_CAST (first));
+  kms_ref_struct_unref (KMS_REF_STRUCT_CAST (second));
+  gst_buffer_unref (buffer);
+  gst_buffer_unref (copy);
+  fail_unless (g_atomic_int_get (&mark_data_alive) == 0);
+}
+
+GST_END_TEST
+#define MARK_THREADS 4
+#define CONCURRENT_MARKS 20
+
+typedef struct _AddMarksData
+{
+  KmsBufferLatencyMeta *meta;
+  MarkData **data;
+  gint added;
+} AddMarksData;
+
+static gpointer
+add_marks_thread (AddMarksData * add)
+{
+  guint i;
+
+  for (i = 0; i < CONCURRENT_MARKS; i++) {
+    /* A copy of the id, duplicates are found by content */
+    gchar *id = g_strdup (add->data[i]->id);
+
+    if (kms_buffer_latency_meta_add_mark (add->meta, add->data[i]->id,
+            KMS_REF_STRUCT_CAST (add->data[i]))) {
+      g_atomic_int_inc (&add->added);
+    }
+
+    fail_if (kms_buffer_latency_meta_add_mark (add->meta, id,
+            KMS_REF_STRUCT_CAST (add->data[i])));
+    g_free (id);
+  }
+
+  return NULL;
+}
+
+GST_START_TEST (check_latency_marks_concurrent)
+{
+  MarkData *data[CONCURRENT_MARKS];
+  GThread *threads[MARK_THREADS];
+  AddMarksData add;
+  GstBuffer *buffer;
+  guint i;
+
+  buffer = gst_buffer_new ();
+  add.meta = kms_buffer_add_buffer_latency_meta (buffer, 0, TRUE, 0);
+  add.data = data;
+  add.added = 0;
+
+  for (i = 0; i < CONCURRENT_MARKS; i++) {
+    data[i] = mark_data_new (i);
+  }
+
+  for (i = 0; i < MARK_THREADS; i++) {
+    threads[i] = g_thread_new ("add-marks", (GThreadFunc) add_marks_thread,
+        &add);
+  }
+
+  for (i = 0; i < MARK_THREADS; i++) {
+    g_thread_join (threads[i]);
+  }
+
+  /* Every mark added exactly once */
+  fail_unless (g_atomic_int_get (&add.added) == CONCURRENT_MARKS);
+  fail_unless (count_marks (buffer) == CONCURRENT_MARKS);
+
+  for (i = 0; i < CONCURRENT_MARKS; i++) {
+    kms_ref_struct_unref (KMS_REF_STRUCT_CAST (data[i]));
+  }
+
+  gst_buffer_unref (buffer);
+  fail_unless (g_atomic_int_get (&mark_data_alive) == 0);
+}
+
+GST_END_TEST
+#define SAMPLED_BUFFERS 40
+#define SAMPLE_RATE 4
+
+static void
+count_sampled_cb (GstElement * fakesink, GstBuffer * buffer, GstPad * pad,
+    gint * sampled)
+{
+  if (kms_buffer_get_buffer_latency_meta (buffer) != NULL) {
+    (*sampled)++;
+  }
+}
+
+static void
+run_sampled_pipeline (guint rate, gint * sampled)
+{
+  GstElement *pipeline, *src, *fakesink;
+  GstMessage *msg;
+  GstBus *bus;
+  GstPad *pad;
+
+  pipeline = gst_pipeline_new ("sampling-test");
+  src = gst_element_factory_make ("fakesrc", NULL);
+  fakesink = gst_element_factory_make ("fakesink", NULL);
+
+  g_object_set (src, "num-buffers", SAMPLED_BUFFERS, NULL);
+  g_object_set (fakesink, "sync", FALSE, "signal-handoffs", TRUE, NULL);
+  g_signal_connect (fakesink, "handoff", G_CALLBACK (count_sampled_cb),
+      sampled);
+
+  gst_bin_add_many (GST_BIN (pipeline), src, fakesink, NULL);
+  gst_element_link (src, fakesink);
+
+  kms_stats_set_latency_sampling (pipeline, rate, 0);
+
+  pad = gst_element_get_static_pad (src, "src");
+  kms_stats_add_buffer_latency_meta_probe (pad, TRUE, KMS_MEDIA_TYPE_VIDEO);
+  g_object_unref (pad);
+
+  gst_element_set_state (pipeline, GST_STATE_PLAYING);
+
+  bus = gst_pipeline_get_bus (GST_PIPELINE (pipeline));
+  msg = gst_bus_timed_pop_filtered (bus, GST_CLOCK_TIME_NONE,
+      GST_MESSAGE_EOS | GST_MESSAGE_ERROR);
+  fail_unless (GST_MESSAGE_TYPE (msg) == GST_MESSAGE_EOS);
+  gst_message_unref (msg);
+  g_object_unref (bus);
+
+  gst_element_set_state (pipeline, GST_STATE_NULL);
+  gst_object_unref (pipeline);
+}
+
+GST_START_TEST (check_latency_sampling)
+{
+  gint sampled = 0;
+
+  run_sampled_pipeline (1, &sampled);
+  fail_unless (sampled == SAMPLED_BUFFERS);
+
+  sampled = 0;
+  run_sampled_pipeline (SAMPLE_RATE, &sampled);
+  fail_unless (sampled == SAMPLED_BUFFERS / SAMPLE_RATE);
+}
+
+GST_END_TEST
+GST_START_TEST (check_latency_histogram)
+{
+  KmsStatsLatencyHistogram histogram;
+  guint64 count, min, max, p50, p95;
+  GstStructure *stats;
+  gint i;
+
+  kms_stats_latency_histogram_init (&histogram);
+  stats = gst_structure_new_empty ("latency");
+
+  kms_stats_latency_histogram_to_structure (&histogram, stats);
+  fail_if (gst_structure_has_field (stats, "p95"));
+
+  /* 1..1000 ms in an order that is not sorted */
+  for (i = 0; i < 1000; i++) {
+    kms_stats_latency_histogram_record (&histogram,
+        ((i * 7919) % 1000 + 1) * GST_MSECOND);
+  }
+
+  kms_stats_latency_histogram_to_structure (&histogram, stats);
+  fail_unless (gst_structure_get_uint64 (stats, "count", &count));
+  fail_unless (gst_structure_get_uint64 (stats, "min", &min));
+  fail_unless (gst_structure_get_uint64 (stats, "max", &max));
+  fail_unless (gst_structure_get_uint64 (stats, "p50", &p50));
+  fail_unless (gst_structure_get_uint64 (stats, "p95", &p95));
+
+  /* Extremes are exact, buckets are 12.5% wide */
+  fail_unless (count == 1000);
+  fail_unless (min == GST_MSECOND);
+  fail_unless (max == 1000 * GST_MSECOND);
+  fail_unless (p50 >= 450 * GST_MSECOND && p50 <= 550 * GST_MSECOND);
+  fail_unless (p95 >= 850 * GST_MSECOND && p95 <= 1000 * GST_MSECOND,
+      "p95 is %" G_GUINT64_FORMAT, p95);
+
+  gst_structure_free (stats);
+
+  /* Each read starts a new window */
+  stats = gst_structure_new_empty ("latency");
+  kms_stats_latency_histogram_to_structure (&histogram, stats);
+  fail_if (gst_structure_has_field (stats, "count"));
+
+  kms_stats_latency_histogram_record (&histogram, 5 * GST_MSECOND);
+  kms_stats_latency_histogram_to_structure (&histogram, stats);
+  fail_unless (gst_structure_get_uint64 (stats, "count", &count));
+  fail_unless (gst_structure_get_uint64 (stats, "min", &min));
+  fail_unless (gst_structure_get_uint64 (stats, "max", &max));
+  fail_unless (gst_structure_get_uint64 (stats, "p50", &p50));
+  fail_unless (count == 1);
+  fail_unless (min == 5 * GST_MSECOND && max == 5 * GST_MSECOND);
+  fail_unless (p50 == 5 * GST_MSECOND);
+
+  gst_structure_free (stats);
+}
+
+GST_END_TEST
+#define BENCHMARK_BUFFERS 1000000
+
+/* Buffers per second going through the usual life of a latency meta: added */
+/* by a source, copied by an element and read by a sink. Only uses API that */
+/* has not changed, so it can be run against older versions to compare them */
+GST_START_TEST (benchmark_latency_meta)
+{
+  KmsBufferLatencyMeta *meta;
+  GstBuffer *buffer, *copy;
+  gint64 start, elapsed;
+  guint i;
+
+  start = g_get_monotonic_time ();
+
+  for (i = 0; i < BENCHMARK_BUFFERS; i++) {
+    buffer = gst_buffer_new ();
+    kms_buffer_add_buffer_latency_meta (buffer, i, TRUE, 0);
+
+    copy = gst_buffer_copy (buffer);
+    gst_buffer_unref (buffer);
+
+    meta = kms_buffer_get_buffer_latency_meta (copy);
+    fail_unless (meta != NULL && meta->ts == i);
+
+    gst_buffer_unref (copy);
+  }
+
+  elapsed = MAX (g_get_monotonic_time () - start, 1);
+
+  GST_INFO ("Latency meta: %" G_GINT64_FORMAT " buffers/s",
+      (gint64) BENCHMARK_BUFFERS * G_USEC_PER_SEC / elapsed);
+}
+
 GST_END_TEST
 /******************************/
 /* metadata test suite        */
@@ -429,6 +780,12 @@ metadata_suite (void)
   suite_add_tcase (s, tc_chain);
 
   tcase_add_test (tc_chain, check_metadata_enc);
+  tcase_add_test (tc_chain, check_latency_marks);
+  tcase_add_test (tc_chain, check_latency_marks_copied_unmarked);
+  tcase_add_test (tc_chain, check_latency_marks_concurrent);
+  tcase_add_test (tc_chain, check_latency_sampling);
+  tcase_add_test (tc_chain, check_latency_histogram);
+  tcase_add_test (tc_chain, benchmark_latency_meta);
 
   return s;
 }
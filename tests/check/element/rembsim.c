@@ -0,0 +1,1060 @@
+/*
+ * (C) Copyright 2016 Kurento (http://kurento.org/)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+/*
+ * Offline simulation of the REMB bitrate control: a publisher sends video to
+ * a KmsRembLocal through an uplink, which is forwarded to viewers through
+ * their own downlinks. Each viewer answers with the REMB of its KmsRembLocal,
+ * that goes through a KmsRembRemote as an upstream bitrate event and into
+ * the RembEventManager of the publisher side. The publisher follows the REMB
+ * it receives, as browsers do.
+ *
+ * Links are step functions of capacity, random loss and RTT, with a
+ * drop-tail queue. Everything runs on simulated time, without network.
+ *
+ * Reports, for every scenario, the convergence time after each capacity
+ * change, the overshoot once converged and the utilization of the
+ * bottleneck, and checks them against bounds that the default parameters
+ * meet with some margin. Tighten them when tuning improves the results.
+ *
+ * KMS_REMB_SIM_PARAMS: RembParams for every KmsRembLocal and KmsRembRemote,
+ *   e.g. "remb-params, exponential-factor=(float)0.06"
+ * KMS_REMB_SIM_TRACE: uplink to replay, one step per line:
+ *   "time_ms capacity_kbps loss_percent rtt_ms"
+ */
+
+#include <gst/check/gstcheck.h>
+#include <gst/gst.h>
+#include <gst/rtp/gstrtcpbuffer.h>
+
+#include "kmsremb.h"
+#include "kmsrtcp.h"
+#include "kmsutils.h"
+
+#define PARAMS_ENV "KMS_REMB_SIM_PARAMS"
+#define TRACE_ENV "KMS_REMB_SIM_TRACE"
+
+#define TICK (10 * GST_MSECOND)
+#define RTCP_INTERVAL (500 * GST_MSECOND)
+#define PACKET_SIZE 1200
+/* Queue of the links, in time at their capacity */
+#define QUEUE_DURATION (200 * GST_MSECOND)
+#define INITIAL_BITRATE 300000
+
+/* Within this fraction of the capacity the bitrate has converged */
+#define CONVERGENCE_BAND 0.2
+
+#define PUBLISHER_SSRC 1111
+#define KMS_SSRC 2222
+/* Each viewer receives from a different SSRC of the server */
+#define KMS_VIEWER_SSRC_BASE 2300
+#define VIEWER_SSRC_BASE 3000
+
+#define MAX_VIEWERS 4
+#define MAX_CHANGES 8
+
+/* Fake RTPSource, with the stats KmsRembLocal reads */
+
+typedef struct _KmsSimSource
+{
+  GObject parent;
+
+  guint ssrc;
+  GstStructure *stats;
+} KmsSimSource;
+
+typedef struct _KmsSimSourceClass
+{
+  GObjectClass parent_class;
+} KmsSimSourceClass;
+
+GType kms_sim_source_get_type (void);
+
+G_DEFINE_TYPE (KmsSimSource, kms_sim_source, G_TYPE_OBJECT);
+
+enum
+{
+  PROP_SOURCE_0,
+  PROP_SOURCE_SSRC,
+  PROP_SOURCE_IS_VALIDATED,
+  PROP_SOURCE_IS_SENDER,
+  PROP_SOURCE_STATS
+};
+
+static void
+kms_sim_source_get_property (GObject * object, guint property_id,
+    GValue * value, GParamSpec * pspec)
+{
+  KmsSimSource *self = (KmsSimSource *) object;
+
+  switch (property_id) {
+    case PROP_SOURCE_SSRC:
+      g_value_set_uint (value, self->ssrc);
+      break;
+    case PROP_SOURCE_IS_VALIDATED:
+    case PROP_SOURCE_IS_SENDER:
+      g_value_set_boolean (value, TRUE);
+      break;
+    case PROP_SOURCE_STATS:
+      g_value_set_boxed (value, self->stats);
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
+      break;
+  }
+}
+
+static void
+kms_sim_source_finalize (GObject * object)
+{
+  KmsSimSource *self = (KmsSimSource *) object;
+
+  gst_structure_free (self->stats);
+
+  G_OBJECT_CLASS (kms_sim_source_parent_class)->finalize (object);
+}
+
+static void
+kms_sim_source_class_init (KmsSimSourceClass * klass)
+{
+  GObjectClass *object_class = G_OBJECT_CLASS (klass);
+
+  object_class->get_property = kms_sim_source_get_property;
+  object_class->finalize = kms_sim_source_finalize;
+
+  g_object_class_install_property (object_class, PROP_SOURCE_SSRC,
+      g_param_spec_uint ("ssrc", "SSRC", "SSRC", 0, G_MAXUINT, 0,
+          G_PARAM_READABLE | G_PARAM_STATIC_STRINGS));
+  g_object_class_install_property (object_class, PROP_SOURCE_IS_VALIDATED,
+      g_param_spec_boolean ("is-validated", "Is validated", "Is validated",
+          TRUE, G_PARAM_READABLE | G_PARAM_STATIC_STRINGS));
+  g_object_class_install_property (object_class, PROP_SOURCE_IS_SENDER,
+      g_param_spec_boolean ("is-sender", "Is sender", "Is sender", TRUE,
+          G_PARAM_READABLE | G_PARAM_STATIC_STRINGS));
+  g_object_class_install_property (object_class, PROP_SOURCE_STATS,
+      g_param_spec_boxed ("stats", "Stats", "Stats", GST_TYPE_STRUCTURE,
+          G_PARAM_READABLE | G_PARAM_STATIC_STRINGS));
+}
+
+static void
+kms_sim_source_init (KmsSimSource * self)
+{
+  self->stats = gst_structure_new_empty ("application/x-rtp-source-stats");
+}
+
+/* Fake RTPSession, with the properties and signals of the REMB managers */
+
+typedef struct _KmsSimSession
+{
+  GObject parent;
+
+  guint internal_ssrc;
+  KmsSimSource *source;
+} KmsSimSession;
+
+typedef struct _KmsSimSessionClass
+{
+  GObjectClass parent_class;
+} KmsSimSessionClass;
+
+GType kms_sim_session_get_type (void);
+
+G_DEFINE_TYPE (KmsSimSession, kms_sim_session, G_TYPE_OBJECT);
+
+enum
+{
+  PROP_SESSION_0,
+  PROP_SESSION_INTERNAL_SSRC,
+  PROP_SESSION_SOURCES
+};
+
+enum
+{
+  SIGNAL_ON_SENDING_RTCP,
+  SIGNAL_ON_FEEDBACK_RTCP,
+  LAST_SIGNAL
+};
+
+static guint session_signals[LAST_SIGNAL] = { 0 };
+
+static void
+kms_sim_session_get_property (GObject * object, guint property_id,
+    GValue * value, GParamSpec * pspec)
+{
+  KmsSimSession *self = (KmsSimSession *) object;
+
+  switch (property_id) {
+    case PROP_SESSION_INTERNAL_SSRC:
+      g_value_set_uint (value, self->internal_ssrc);
+      break;
+    case PROP_SESSION_SOURCES:{
+      // FIXME 'GValueArray' is deprecated: Use 'GArray' instead
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wdeprecated-declarations"
+      GValueArray *arr = g_value_array_new (1);
+      GValue source = G_VALUE_INIT;
+
+      if (self->source != NULL) {
+        g_value_init (&source, G_TYPE_OBJECT);
+        g_value_set_object (&source, self->source);
+        g_value_array_append (arr, &source);
+        g_value_unset (&source);
+      }
+
+      g_value_take_boxed (value, arr);
+#pragma GCC diagnostic pop
+      break;
+    }
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
+      break;
+  }
+}
+
+static void
+kms_sim_session_finalize (GObject * object)
+{
+  KmsSimSession *self = (KmsSimSession *) object;
+
+  g_clear_object (&self->source);
+
+  G_OBJECT_CLASS (kms_sim_session_parent_class)->finalize (object);
+}
+
+static void
+kms_sim_session_class_init (KmsSimSessionClass * klass)
+{
+  GObjectClass *object_class = G_OBJECT_CLASS (klass);
+
+  object_class->get_property = kms_sim_session_get_property;
+  object_class->finalize = kms_sim_session_finalize;
+
+  g_object_class_install_property (object_class, PROP_SESSION_INTERNAL_SSRC,
+      g_param_spec_uint ("internal-ssrc", "Internal SSRC", "Internal SSRC", 0,
+          G_MAXUINT, 0, G_PARAM_READABLE | G_PARAM_STATIC_STRINGS));
+
+  // FIXME 'G_TYPE_VALUE_ARRAY' is deprecated: Use 'GArray' instead
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wdeprecated-declarations"
+  g_object_class_install_property (object_class, PROP_SESSION_SOURCES,
+      g_param_spec_boxed ("sources", "Sources", "Sources",
+          G_TYPE_VALUE_ARRAY, G_PARAM_READABLE | G_PARAM_STATIC_STRINGS));
+#pragma GCC diagnostic pop
+
+  session_signals[SIGNAL_ON_SENDING_RTCP] =
+      g_signal_new ("on-sending-rtcp", G_TYPE_FROM_CLASS (klass),
+      G_SIGNAL_RUN_LAST, 0, g_signal_accumulator_true_handled, NULL, NULL,
+      G_TYPE_BOOLEAN, 2, GST_TYPE_BUFFER | G_SIGNAL_TYPE_STATIC_SCOPE,
+      G_TYPE_BOOLEAN);
+
+  session_signals[SIGNAL_ON_FEEDBACK_RTCP] =
+      g_signal_new ("on-feedback-rtcp", G_TYPE_FROM_CLASS (klass),
+      G_SIGNAL_RUN_LAST, 0, NULL, NULL, NULL, G_TYPE_NONE, 5, G_TYPE_UINT,
+      G_TYPE_UINT, G_TYPE_UINT, G_TYPE_UINT,
+      GST_TYPE_BUFFER | G_SIGNAL_TYPE_STATIC_SCOPE);
+}
+
+static void
+kms_sim_session_init (KmsSimSession * self)
+{
+}
+
+static KmsSimSession *
+kms_sim_session_new (guint internal_ssrc, guint remote_ssrc)
+{
+  KmsSimSession *session = g_object_new (kms_sim_session_get_type (), NULL);
+
+  session->internal_ssrc = internal_ssrc;
+  session->source = g_object_new (kms_sim_source_get_type (), NULL);
+  session->source->ssrc = remote_ssrc;
+
+  return session;
+}
+
+/* Links */
+
+typedef struct _LinkStep
+{
+  guint time_ms;
+  guint capacity_kbps;
+  guint loss_percent;
+  guint rtt_ms;
+} LinkStep;
+
+typedef struct _Link
+{
+  const LinkStep *steps;
+  guint n_steps;
+
+  gdouble queue;                /* bytes */
+  gdouble packets_received;
+  gdouble packets_lost;
+  gdouble octets_received;
+
+  /* At the last RTCP */
+  gdouble last_packets_received;
+  gdouble last_packets_lost;
+  gdouble last_octets_received;
+} Link;
+
+static const LinkStep *
+link_get_step (Link * link, GstClockTime t)
+{
+  const LinkStep *step = &link->steps[0];
+  guint i;
+
+  for (i = 1; i < link->n_steps; i++) {
+    if (link->steps[i].time_ms * GST_MSECOND > t) {
+      break;
+    }
+    step = &link->steps[i];
+  }
+
+  return step;
+}
+
+static guint
+link_get_capacity (Link * link, GstClockTime t)
+{
+  return link_get_step (link, t)->capacity_kbps * 1000;
+}
+
+static GstClockTime
+link_get_rtt (Link * link, GstClockTime t)
+{
+  return link_get_step (link, t)->rtt_ms * GST_MSECOND;
+}
+
+/* Sends @bytes during a tick, returns how many arrive */
+static gdouble
+link_transmit (Link * link, GstClockTime t, gdouble bytes)
+{
+  const LinkStep *step = link_get_step (link, t);
+  gdouble capacity, out, dropped, lost;
+
+  capacity = step->capacity_kbps * 1000.0 / 8;
+
+  link->queue += bytes;
+  out = MIN (link->queue, capacity * TICK / GST_SECOND);
+  link->queue -= out;
+
+  dropped = MAX (0, link->queue - capacity * QUEUE_DURATION / GST_SECOND);
+  link->queue -= dropped;
+
+  lost = out * step->loss_percent / 100;
+  out -= lost;
+
+  link->packets_received += out / PACKET_SIZE;
+  link->packets_lost += (dropped + lost) / PACKET_SIZE;
+  link->octets_received += out;
+
+  return out;
+}
+
+/* Updates the stats of @source as RTPSource does when sending a report */
+static void
+link_update_source (Link * link, KmsSimSource * source, GstClockTime interval)
+{
+  guint64 received, lost, octets;
+  guint64 interval_received, interval_lost;
+  guint fraction_lost = 0;
+
+  received = link->packets_received;
+  lost = link->packets_lost;
+  octets = link->octets_received;
+
+  interval_received = received - (guint64) link->last_packets_received;
+  interval_lost = lost - (guint64) link->last_packets_lost;
+
+  if (interval_received + interval_lost > 0) {
+    fraction_lost = MIN (255, interval_lost * 256 /
+        (interval_received + interval_lost));
+  }
+
+  gst_structure_set (source->stats,
+      "bitrate", G_TYPE_UINT64, gst_util_uint64_scale (octets -
+          (guint64) link->last_octets_received, 8 * GST_SECOND, interval),
+      "octets-received", G_TYPE_UINT64, octets,
+      "packets-received", G_TYPE_UINT64, received,
+      "packets-lost", G_TYPE_INT, (gint) lost,
+      "sent-rb-fractionlost", G_TYPE_UINT, fraction_lost, NULL);
+
+  link->last_packets_received = received;
+  link->last_packets_lost = lost;
+  link->last_octets_received = octets;
+}
+
+/* Simulation */
+
+static GstClockTime sim_time;
+
+static GstClockTime
+sim_get_time (void)
+{
+  /* Not 0, which KmsRembLocal takes as never */
+  return sim_time + GST_SECOND;
+}
+
+typedef struct _Scenario
+{
+  const gchar *name;
+  const LinkStep *uplink;
+  guint n_uplink;
+  const LinkStep *downlinks[MAX_VIEWERS];
+  guint n_downlinks[MAX_VIEWERS];
+  guint n_viewers;
+  guint duration_ms;
+
+  /* Capacity changes whose convergence is checked */
+  guint changes_ms[MAX_CHANGES];
+  guint n_changes;
+
+  /* Bounds */
+  gdouble max_convergence_s;
+  gdouble max_overshoot;
+  gdouble min_utilization;
+} Scenario;
+
+typedef struct _Viewer
+{
+  Link link;
+
+  /* Receiving side of the viewer */
+  KmsSimSession *session;
+  KmsRembLocal *rl;
+
+  /* Sending side of the server */
+  KmsSimSession *server_session;
+  KmsRembRemote *rm;
+  GstPad *src;
+  GstPad *sink;
+} Viewer;
+
+typedef struct _Feedback
+{
+  GstClockTime time;
+  /* NULL for the publisher */
+  Viewer *viewer;
+  GstBuffer *fci;
+  guint sender_ssrc;
+  guint media_ssrc;
+} Feedback;
+
+typedef struct _Sample
+{
+  GstClockTime time;
+  guint bitrate;
+  guint capacity;
+} Sample;
+
+typedef struct _Simulation
+{
+  Link uplink;
+  KmsSimSession *session;
+  KmsRembLocal *rl;
+  GstPad *remb_pad;
+
+  Viewer viewers[MAX_VIEWERS];
+  guint n_viewers;
+
+  /* Of the publisher */
+  guint bitrate;
+
+  GQueue feedback;
+  GArray *samples;
+} Simulation;
+
+typedef struct _Results
+{
+  gdouble convergence_s[MAX_CHANGES];
+  gdouble overshoot[MAX_CHANGES];
+  gdouble utilization;
+} Results;
+
+static void
+sim_apply_params (KmsRembLocal * rl, KmsRembRemote * rm)
+{
+  const gchar *str = g_getenv (PARAMS_ENV);
+  GstStructure *params;
+
+  if (str == NULL) {
+    return;
+  }
+
+  params = gst_structure_from_string (str, NULL);
+  fail_unless (params != NULL, "Invalid %s: %s", PARAMS_ENV, str);
+
+  if (rl != NULL) {
+    kms_remb_local_set_params (rl, params);
+  }
+
+  if (rm != NULL) {
+    kms_remb_remote_set_params (rm, params);
+  }
+
+  gst_structure_free (params);
+}
+
+/* Upstream events of the viewers reach the pad of the RembEventManager */
+static gboolean
+sim_forward_event (GstPad * pad, GstObject * parent, GstEvent * event)
+{
+  GstPad *remb_pad = GST_PAD_EVENTDATA (pad);
+
+  return gst_pad_send_event (remb_pad, event);
+}
+
+static void
+sim_init (Simulation * sim, const Scenario * scenario)
+{
+  guint i;
+
+  memset (sim, 0, sizeof (Simulation));
+  g_queue_init (&sim->feedback);
+  sim->samples = g_array_new (FALSE, FALSE, sizeof (Sample));
+  sim->bitrate = INITIAL_BITRATE;
+
+  sim_time = 0;
+  kms_utils_set_time_func (sim_get_time);
+
+  sim->uplink.steps = scenario->uplink;
+  sim->uplink.n_steps = scenario->n_uplink;
+  sim->session = kms_sim_session_new (KMS_SSRC, PUBLISHER_SSRC);
+  sim->rl = kms_remb_local_create (G_OBJECT (sim->session), 0, 0);
+  kms_remb_local_add_remote_session (sim->rl, G_OBJECT (sim->session),
+      PUBLISHER_SSRC);
+  sim_apply_params (sim->rl, NULL);
+
+  sim->remb_pad = gst_pad_new ("remb_src", GST_PAD_SRC);
+  gst_pad_set_active (sim->remb_pad, TRUE);
+  sim->rl->event_manager = kms_utils_remb_event_manager_create (sim->remb_pad);
+
+  sim->n_viewers = scenario->n_viewers;
+  for (i = 0; i < sim->n_viewers; i++) {
+    Viewer *viewer = &sim->viewers[i];
+    guint viewer_ssrc = VIEWER_SSRC_BASE + i;
+    guint kms_ssrc = KMS_VIEWER_SSRC_BASE + i;
+
+    viewer->link.steps = scenario->downlinks[i];
+    viewer->link.n_steps = scenario->n_downlinks[i];
+
+    viewer->session = kms_sim_session_new (viewer_ssrc, kms_ssrc);
+    viewer->rl = kms_remb_local_create (G_OBJECT (viewer->session), 0, 0);
+    kms_remb_local_add_remote_session (viewer->rl,
+        G_OBJECT (viewer->session), kms_ssrc);
+
+    viewer->src = gst_pad_new ("src", GST_PAD_SRC);
+    gst_pad_set_event_function_full (viewer->src, sim_forward_event,
+        gst_object_ref (sim->remb_pad), gst_object_unref);
+    viewer->sink = gst_pad_new ("sink", GST_PAD_SINK);
+    fail_unless (gst_pad_link (viewer->src, viewer->sink) == GST_PAD_LINK_OK);
+    gst_pad_set_active (viewer->src, TRUE);
+    gst_pad_set_active (viewer->sink, TRUE);
+
+    viewer->server_session = kms_sim_session_new (kms_ssrc, viewer_ssrc);
+    viewer->rm = kms_remb_remote_create (G_OBJECT (viewer->server_session),
+        kms_ssrc, 0, 0, viewer->sink);
+
+    sim_apply_params (viewer->rl, viewer->rm);
+  }
+}
+
+static void
+feedback_destroy (Feedback * feedback)
+{
+  gst_buffer_unref (feedback->fci);
+  g_slice_free (Feedback, feedback);
+}
+
+static void
+sim_clear (Simulation * sim)
+{
+  guint i;
+
+  g_queue_foreach (&sim->feedback, (GFunc) feedback_destroy, NULL);
+  g_queue_clear (&sim->feedback);
+
+  for (i = 0; i < sim->n_viewers; i++) {
+    Viewer *viewer = &sim->viewers[i];
+
+    kms_remb_remote_destroy (viewer->rm);
+    kms_remb_local_destroy (viewer->rl);
+    g_object_unref (viewer->server_session);
+    g_object_unref (viewer->session);
+    gst_pad_set_active (viewer->src, FALSE);
+    gst_pad_set_active (viewer->sink, FALSE);
+    gst_object_unref (viewer->src);
+    gst_object_unref (viewer->sink);
+  }
+
+  kms_remb_local_destroy (sim->rl);
+  g_object_unref (sim->session);
+  gst_pad_set_active (sim->remb_pad, FALSE);
+  gst_object_unref (sim->remb_pad);
+
+  g_array_free (sim->samples, TRUE);
+
+  kms_utils_set_time_func (NULL);
+}
+
+/* Takes the REMB that @session adds to an RTCP compound packet, if any */
+static gboolean
+sim_send_rtcp (KmsSimSession * session, Feedback * feedback)
+{
+  GstRTCPBuffer rtcp = GST_RTCP_BUFFER_INIT;
+  GstRTCPPacket packet;
+  GstBuffer *buffer;
+  gboolean sent = FALSE, found = FALSE;
+
+  buffer = gst_rtcp_buffer_new (1400);
+  g_signal_emit (session, session_signals[SIGNAL_ON_SENDING_RTCP], 0, buffer,
+      FALSE, &sent);
+
+  if (!sent) {
+    gst_buffer_unref (buffer);
+    return FALSE;
+  }
+
+  gst_rtcp_buffer_map (buffer, GST_MAP_READ, &rtcp);
+
+  if (gst_rtcp_buffer_get_first_packet (&rtcp, &packet)) {
+    do {
+      guint len;
+
+      if (gst_rtcp_packet_get_type (&packet) != GST_RTCP_TYPE_PSFB
+          || gst_rtcp_packet_fb_get_type (&packet) != GST_RTCP_PSFB_TYPE_AFB) {
+        continue;
+      }
+
+      len = gst_rtcp_packet_fb_get_fci_length (&packet) * 4;
+      feedback->fci = gst_buffer_new_wrapped (g_memdup
+          (gst_rtcp_packet_fb_get_fci (&packet), len), len);
+      feedback->sender_ssrc = gst_rtcp_packet_fb_get_sender_ssrc (&packet);
+      feedback->media_ssrc = gst_rtcp_packet_fb_get_media_ssrc (&packet);
+      found = TRUE;
+    } while (!found && gst_rtcp_packet_move_to_next (&packet));
+  }
+
+  gst_rtcp_buffer_unmap (&rtcp);
+  gst_buffer_unref (buffer);
+
+  return found;
+}
+
+static guint
+feedback_get_bitrate (Feedback * feedback)
+{
+  KmsRTCPPSFBAFBBuffer afb_buffer = { NULL, };
+  KmsRTCPPSFBAFBPacket afb_packet;
+  KmsRTCPPSFBAFBREMBPacket remb_packet;
+  guint bitrate = 0;
+
+  fail_unless (kms_rtcp_psfb_afb_buffer_map (feedback->fci, GST_MAP_READ,
+          &afb_buffer));
+
+  if (kms_rtcp_psfb_afb_get_packet (&afb_buffer, &afb_packet)
+      && kms_rtcp_psfb_afb_packet_get_type (&afb_packet) ==
+      KMS_RTCP_PSFB_AFB_TYPE_REMB
+      && kms_rtcp_psfb_afb_remb_get_packet (&afb_packet, &remb_packet)) {
+    bitrate = remb_packet.bitrate;
+  }
+
+  kms_rtcp_psfb_afb_buffer_unmap (&afb_buffer);
+
+  return bitrate;
+}
+
+static void
+sim_queue_rtcp (Simulation * sim, KmsSimSession * session, Link * link,
+    Viewer * viewer)
+{
+  Feedback feedback = { 0, };
+
+  link_update_source (link, session->source, RTCP_INTERVAL);
+
+  if (!sim_send_rtcp (session, &feedback)) {
+    return;
+  }
+
+  feedback.time = sim_time + link_get_rtt (link, sim_time) / 2;
+  feedback.viewer = viewer;
+  g_queue_push_tail (&sim->feedback, g_slice_dup (Feedback, &feedback));
+}
+
+static void
+sim_deliver_feedback (Simulation * sim)
+{
+  while (!g_queue_is_empty (&sim->feedback)) {
+    Feedback *feedback = g_queue_peek_head (&sim->feedback);
+
+    if (feedback->time > sim_time) {
+      /* RTTs change seldom, later ones arrive later in practice */
+      break;
+    }
+
+    g_queue_pop_head (&sim->feedback);
+
+    if (feedback->viewer == NULL) {
+      sim->bitrate = feedback_get_bitrate (feedback);
+    } else {
+      g_signal_emit (feedback->viewer->server_session,
+          session_signals[SIGNAL_ON_FEEDBACK_RTCP], 0, GST_RTCP_TYPE_PSFB,
+          GST_RTCP_PSFB_TYPE_AFB, feedback->sender_ssrc, feedback->media_ssrc,
+          feedback->fci);
+    }
+
+    feedback_destroy (feedback);
+  }
+}
+
+/* Bitrate that fits the uplink and every downlink */
+static guint
+sim_get_capacity (Simulation * sim, GstClockTime t)
+{
+  guint capacity = link_get_capacity (&sim->uplink, t);
+  guint i;
+
+  for (i = 0; i < sim->n_viewers; i++) {
+    capacity = MIN (capacity, link_get_capacity (&sim->viewers[i].link, t));
+  }
+
+  return capacity;
+}
+
+static void
+sim_run (Simulation * sim, GstClockTime duration)
+{
+  GstClockTime next_rtcp = RTCP_INTERVAL;
+
+  while (sim_time < duration) {
+    Sample sample;
+    gdouble bytes;
+    guint i;
+
+    bytes = link_transmit (&sim->uplink, sim_time,
+        sim->bitrate / 8.0 * TICK / GST_SECOND);
+
+    for (i = 0; i < sim->n_viewers; i++) {
+      link_transmit (&sim->viewers[i].link, sim_time, bytes);
+    }
+
+    sim_time += TICK;
+
+    if (sim_time >= next_rtcp) {
+      for (i = 0; i < sim->n_viewers; i++) {
+        Viewer *viewer = &sim->viewers[i];
+
+        sim_queue_rtcp (sim, viewer->session, &viewer->link, viewer);
+      }
+
+      sim_queue_rtcp (sim, sim->session, &sim->uplink, NULL);
+      next_rtcp += RTCP_INTERVAL;
+    }
+
+    sim_deliver_feedback (sim);
+
+    sample.time = sim_time;
+    sample.bitrate = sim->bitrate;
+    sample.capacity = sim_get_capacity (sim, sim_time);
+    g_array_append_val (sim->samples, sample);
+  }
+}
+
+/* A convergence time < 0 means that it never converged */
+static void
+sim_get_results (Simulation * sim, const guint * changes_ms, guint n_changes,
+    Results * results)
+{
+  gdouble used = 0, available = 0;
+  guint c, i;
+
+  for (c = 0; c < n_changes; c++) {
+    results->convergence_s[c] = -1;
+    results->overshoot[c] = 0;
+  }
+
+  for (i = 0; i < sim->samples->len; i++) {
+    Sample *sample = &g_array_index (sim->samples, Sample, i);
+    GstClockTime start;
+    gdouble deviation;
+
+    used += MIN (sample->bitrate, sample->capacity);
+    available += sample->capacity;
+
+    /* Last change before the sample */
+    for (c = n_changes; c > 0; c--) {
+      if (changes_ms[c - 1] * GST_MSECOND <= sample->time) {
+        break;
+      }
+    }
+
+    if (c == 0) {
+      continue;
+    }
+
+    c--;
+    start = changes_ms[c] * GST_MSECOND;
+    deviation = ((gdouble) sample->bitrate - sample->capacity) /
+        sample->capacity;
+
+    if (results->convergence_s[c] < 0 && ABS (deviation) <= CONVERGENCE_BAND) {
+      results->convergence_s[c] = (gdouble) (sample->time - start) / GST_SECOND;
+    }
+
+    if (results->convergence_s[c] >= 0) {
+      results->overshoot[c] = MAX (results->overshoot[c], deviation);
+    }
+  }
+
+  results->utilization = available > 0 ? used / available : 0;
+}
+
+static void
+run_scenario (const Scenario * scenario, Results * results)
+{
+  Simulation sim;
+  guint c;
+
+  sim_init (&sim, scenario);
+  sim_run (&sim, scenario->duration_ms * GST_MSECOND);
+  sim_get_results (&sim, scenario->changes_ms, scenario->n_changes, results);
+  sim_clear (&sim);
+
+  for (c = 0; c < scenario->n_changes; c++) {
+    GST_INFO ("%s: change at %u ms, convergence: %.2f s, overshoot: %.1f%%",
+        scenario->name, scenario->changes_ms[c], results->convergence_s[c],
+        results->overshoot[c] * 100);
+  }
+
+  GST_INFO ("%s: utilization: %.1f%%", scenario->name,
+      results->utilization * 100);
+}
+
+static void
+check_scenario (const Scenario * scenario)
+{
+  Results results;
+  guint c;
+
+  run_scenario (scenario, &results);
+
+  for (c = 0; c < scenario->n_changes; c++) {
+    fail_unless (results.convergence_s[c] >= 0,
+        "%s: not converged after the change at %u ms", scenario->name,
+        scenario->changes_ms[c]);
+    fail_unless (results.convergence_s[c] <= scenario->max_convergence_s,
+        "%s: converged in %.2f s after the change at %u ms", scenario->name,
+        results.convergence_s[c], scenario->changes_ms[c]);
+    fail_unless (results.overshoot[c] <= scenario->max_overshoot,
+        "%s: overshoot of %.1f%% after the change at %u ms", scenario->name,
+        results.overshoot[c] * 100, scenario->changes_ms[c]);
+  }
+
+  fail_unless (results.utilization >= scenario->min_utilization,
+      "%s: utilization of %.1f%%", scenario->name, results.utilization * 100);
+}
+
+/* Scenarios */
+
+static const LinkStep wide_link[] = {
+  {0, 3000, 0, 50},
+};
+
+static const LinkStep bandwidth_steps_link[] = {
+  {0, 2000, 0, 50},
+  {30000, 800, 0, 50},
+  {60000, 1500, 0, 50},
+};
+
+static const LinkStep loss_burst_link[] = {
+  {0, 1500, 0, 50},
+  {20000, 1500, 10, 50},
+  {25000, 1500, 0, 50},
+};
+
+static const LinkStep rtt_change_link[] = {
+  {0, 1000, 0, 50},
+  {30000, 1000, 0, 400},
+};
+
+static const LinkStep fan_out_uplink[] = {
+  {0, 2000, 0, 50},
+};
+
+static const LinkStep fan_out_medium_link[] = {
+  {0, 2500, 0, 80},
+};
+
+static const LinkStep fan_out_narrow_link[] = {
+  {0, 600, 0, 120},
+};
+
+#define STEPS(s) (s), G_N_ELEMENTS (s)
+
+GST_START_TEST (bandwidth_steps)
+{
+  Scenario scenario = {
+    "bandwidth-steps", STEPS (bandwidth_steps_link),
+    {wide_link}, {G_N_ELEMENTS (wide_link)}, 1, 90000,
+    {0, 30000, 60000}, 3,
+    35, 0.25, 0.55
+  };
+
+  check_scenario (&scenario);
+}
+
+GST_END_TEST;
+
+GST_START_TEST (loss_burst)
+{
+  /* The capacity does not change, the loss burst is not a congestion */
+  Scenario scenario = {
+    "loss-burst", STEPS (loss_burst_link),
+    {wide_link}, {G_N_ELEMENTS (wide_link)}, 1, 60000,
+    {0}, 1,
+    35, 0.25, 0.15
+  };
+
+  check_scenario (&scenario);
+}
+
+GST_END_TEST;
+
+GST_START_TEST (rtt_change)
+{
+  Scenario scenario = {
+    "rtt-change", STEPS (rtt_change_link),
+    {wide_link}, {G_N_ELEMENTS (wide_link)}, 1, 60000,
+    {0, 30000}, 2,
+    35, 0.35, 0.7
+  };
+
+  check_scenario (&scenario);
+}
+
+GST_END_TEST;
+
+GST_START_TEST (fan_out)
+{
+  /* The publisher has to adapt to the narrowest viewer */
+  Scenario scenario = {
+    "fan-out", STEPS (fan_out_uplink),
+    {wide_link, fan_out_medium_link, fan_out_narrow_link, wide_link},
+    {G_N_ELEMENTS (wide_link), G_N_ELEMENTS (fan_out_medium_link),
+          G_N_ELEMENTS (fan_out_narrow_link), G_N_ELEMENTS (wide_link)},
+    4, 60000,
+    {0}, 1,
+    35, 0.4, 0.75
+  };
+
+  check_scenario (&scenario);
+}
+
+GST_END_TEST;
+
+static GArray *
+read_trace (const gchar * file)
+{
+  GArray *steps = g_array_new (FALSE, FALSE, sizeof (LinkStep));
+  gchar *contents, **lines;
+  GError *err = NULL;
+  guint i;
+
+  fail_unless (g_file_get_contents (file, &contents, NULL, &err),
+      "Cannot read %s: %s", file, err != NULL ? err->message : "");
+
+  lines = g_strsplit (contents, "\n", -1);
+
+  for (i = 0; lines[i] != NULL; i++) {
+    LinkStep step;
+
+    if (lines[i][0] == '#' || lines[i][0] == '\0') {
+      continue;
+    }
+
+    if (sscanf (lines[i], "%u %u %u %u", &step.time_ms, &step.capacity_kbps,
+            &step.loss_percent, &step.rtt_ms) != 4) {
+      GST_WARNING ("Invalid trace line: %s", lines[i]);
+      continue;
+    }
+
+    g_array_append_val (steps, step);
+  }
+
+  g_strfreev (lines);
+  g_free (contents);
+
+  return steps;
+}
+
+GST_START_TEST (trace_replay)
+{
+  const gchar *file = g_getenv (TRACE_ENV);
+  Scenario scenario = {
+    "trace", NULL, 0,
+    {wide_link}, {G_N_ELEMENTS (wide_link)}, 1, 0,
+    {0}, 0,
+    0, 0, 0
+  };
+  Results results;
+  GArray *steps;
+  guint i;
+
+  if (file == NULL) {
+    GST_INFO ("Set %s to replay a recorded uplink", TRACE_ENV);
+    return;
+  }
+
+  steps = read_trace (file);
+  fail_unless (steps->len > 0, "No steps in %s", file);
+
+  scenario.uplink = (const LinkStep *) steps->data;
+  scenario.n_uplink = steps->len;
+
+  /* Every step is a change of the capacity, the last one lasts a minute */
+  for (i = 0; i < steps->len && i < MAX_CHANGES; i++) {
+    scenario.changes_ms[i] = g_array_index (steps, LinkStep, i).time_ms;
+  }
+  scenario.n_changes = i;
+  scenario.duration_ms =
+      g_array_index (steps, LinkStep, steps->len - 1).time_ms + 60000;
+
+  run_scenario (&scenario, &results);
+
+  g_array_free (steps, TRUE);
+}
+
+GST_END_TEST;
+
+static Suite *
+rembsim_suite (void)
+{
+  Suite *s = suite_create ("rembsim");
+  TCase *tc_chain = tcase_create ("element");
+
+  suite_add_tcase (s, tc_chain);
+
+  tcase_add_test (tc_chain, bandwidth_steps);
+  tcase_add_test (tc_chain, loss_burst);
+  tcase_add_test (tc_chain, rtt_change);
+  tcase_add_test (tc_chain, fan_out);
+  tcase_add_test (tc_chain, trace_replay);
+
+  return s;
+}
+
+GST_CHECK_MAIN (rembsim);
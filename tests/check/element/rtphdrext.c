@@ -0,0 +1,395 @@
+/*
+ * (C) Copyright 2016 Kurento (http://kurento.org/)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+#include <gst/check/gstcheck.h>
+#include <gst/gst.h>
+#include <gst/rtp/gstrtpbuffer.h>
+
+#include "kmsrtphdrext.h"
+
+#define EXT_ID 3
+#define EXT_SIZE 3
+#define PAYLOAD_SIZE 1200
+
+#define BENCHMARK_LISTS 2000
+#define BENCHMARK_LIST_SIZE 10
+
+static const guint8 zero_time[EXT_SIZE] = { 0, 0, 0 };
+static const guint8 send_time[EXT_SIZE] = { 0x12, 0x34, 0x56 };
+
+/* Header and payload in memories of their own, as payloaders do */
+static GstBuffer *
+create_packet (GstMemory * payload)
+{
+  GstBuffer *buffer = gst_rtp_buffer_new_allocate (0, 0, 0);
+  GstRTPBuffer rtp = GST_RTP_BUFFER_INIT;
+
+  gst_rtp_buffer_map (buffer, GST_MAP_WRITE, &rtp);
+  gst_rtp_buffer_set_payload_type (&rtp, 96);
+  gst_rtp_buffer_set_seq (&rtp, 1);
+  gst_rtp_buffer_unmap (&rtp);
+
+  gst_buffer_append_memory (buffer, gst_memory_ref (payload));
+
+  return buffer;
+}
+
+static GstMemory *
+create_payload (void)
+{
+  GstMemory *mem = gst_allocator_alloc (NULL, PAYLOAD_SIZE, NULL);
+  GstMapInfo info;
+  guint i;
+
+  gst_memory_map (mem, &info, GST_MAP_WRITE);
+  for (i = 0; i < PAYLOAD_SIZE; i++) {
+    info.data[i] = i;
+  }
+  gst_memory_unmap (mem, &info);
+
+  return mem;
+}
+
+static void
+check_element (GstBuffer * buffer, const guint8 * expected)
+{
+  GstRTPBuffer rtp = GST_RTP_BUFFER_INIT;
+  gpointer data;
+  guint size;
+
+  fail_unless (gst_rtp_buffer_map (buffer, GST_MAP_READ, &rtp));
+  fail_unless (gst_rtp_buffer_get_extension_onebyte_header (&rtp, EXT_ID, 0,
+          &data, &size));
+  fail_unless_equals_int (size, EXT_SIZE);
+  fail_unless (memcmp (data, expected, EXT_SIZE) == 0);
+  fail_unless_equals_int (gst_rtp_buffer_get_payload_len (&rtp),
+      PAYLOAD_SIZE);
+  fail_unless_equals_int (gst_rtp_buffer_get_seq (&rtp), 1);
+  gst_rtp_buffer_unmap (&rtp);
+}
+
+static gboolean
+has_extension (GstBuffer * buffer)
+{
+  GstRTPBuffer rtp = GST_RTP_BUFFER_INIT;
+  gboolean ret;
+
+  fail_unless (gst_rtp_buffer_map (buffer, GST_MAP_READ, &rtp));
+  ret = gst_rtp_buffer_get_extension (&rtp);
+  gst_rtp_buffer_unmap (&rtp);
+
+  return ret;
+}
+
+GST_START_TEST (add_and_update)
+{
+  GstMemory *payload = create_payload ();
+  GstBuffer *original = create_packet (payload);
+  GstBuffer *buffer = gst_buffer_ref (original);
+  guint64 copies = kms_rtp_hdr_ext_get_copies_avoided ();
+
+  /* Shared with another sender */
+  fail_unless (kms_rtp_hdr_ext_write (&buffer, EXT_ID, zero_time, EXT_SIZE,
+          KMS_RTP_HDR_EXT_ADD));
+  fail_unless (buffer != original);
+  check_element (buffer, zero_time);
+  fail_unless (gst_buffer_peek_memory (buffer, 1) == payload);
+  fail_if (has_extension (original), "The other sender sees the change");
+  fail_unless (kms_rtp_hdr_ext_get_copies_avoided () == copies + 1);
+
+  /* Already there, adding leaves it as it is */
+  fail_unless (kms_rtp_hdr_ext_write (&buffer, EXT_ID, send_time, EXT_SIZE,
+          KMS_RTP_HDR_EXT_ADD));
+  check_element (buffer, zero_time);
+
+  fail_unless (kms_rtp_hdr_ext_write (&buffer, EXT_ID, send_time, EXT_SIZE,
+          KMS_RTP_HDR_EXT_UPDATE));
+  check_element (buffer, send_time);
+  fail_unless (gst_buffer_peek_memory (buffer, 1) == payload);
+
+  /* Other sizes are not overwritten */
+  fail_if (kms_rtp_hdr_ext_write (&buffer, EXT_ID, send_time, EXT_SIZE - 1,
+          KMS_RTP_HDR_EXT_UPDATE));
+
+  /* Nor missing elements added when not asked to */
+  fail_if (kms_rtp_hdr_ext_write (&original, EXT_ID, send_time, EXT_SIZE,
+          KMS_RTP_HDR_EXT_UPDATE));
+
+  gst_buffer_unref (buffer);
+  gst_buffer_unref (original);
+  gst_memory_unref (payload);
+}
+
+GST_END_TEST;
+
+GST_START_TEST (single_memory_packet)
+{
+  GstBuffer *original = gst_rtp_buffer_new_allocate (PAYLOAD_SIZE, 0, 0);
+  GstBuffer *buffer = gst_buffer_ref (original);
+  GstRTPBuffer rtp = GST_RTP_BUFFER_INIT;
+  GstMapInfo before, after;
+
+  gst_rtp_buffer_map (original, GST_MAP_WRITE, &rtp);
+  gst_rtp_buffer_set_seq (&rtp, 1);
+  memset (gst_rtp_buffer_get_payload (&rtp), 0xab, PAYLOAD_SIZE);
+  gst_rtp_buffer_unmap (&rtp);
+
+  fail_unless (kms_rtp_hdr_ext_write (&buffer, EXT_ID, send_time, EXT_SIZE,
+          KMS_RTP_HDR_EXT_ADD | KMS_RTP_HDR_EXT_UPDATE));
+  check_element (buffer, send_time);
+
+  /* The payload is a part of the original memory, not a copy */
+  fail_unless_equals_int (gst_buffer_n_memory (buffer), 2);
+  gst_memory_map (gst_buffer_peek_memory (original, 0), &before,
+      GST_MAP_READ);
+  gst_memory_map (gst_buffer_peek_memory (buffer, 1), &after, GST_MAP_READ);
+  fail_unless (after.data == before.data + before.size - PAYLOAD_SIZE);
+  gst_memory_unmap (gst_buffer_peek_memory (buffer, 1), &after);
+  gst_memory_unmap (gst_buffer_peek_memory (original, 0), &before);
+
+  gst_buffer_unref (buffer);
+  gst_buffer_unref (original);
+}
+
+GST_END_TEST;
+
+GST_START_TEST (buffer_list)
+{
+  GstMemory *payload = create_payload ();
+  GstBufferList *list = gst_buffer_list_new ();
+  guint i;
+
+  for (i = 0; i < BENCHMARK_LIST_SIZE; i++) {
+    gst_buffer_list_add (list, create_packet (payload));
+  }
+
+  fail_unless_equals_int (kms_rtp_hdr_ext_write_list (&list, EXT_ID,
+          send_time, EXT_SIZE, KMS_RTP_HDR_EXT_ADD), BENCHMARK_LIST_SIZE);
+
+  for (i = 0; i < BENCHMARK_LIST_SIZE; i++) {
+    GstBuffer *buffer = gst_buffer_list_get (list, i);
+
+    check_element (buffer, send_time);
+    fail_unless (gst_buffer_peek_memory (buffer, 1) == payload);
+  }
+
+  gst_buffer_list_unref (list);
+  gst_memory_unref (payload);
+}
+
+GST_END_TEST;
+
+#define AUDIO_LEVEL_ID 1
+#define TRANSPORT_SEQ_ID 5
+#define TWO_BYTE_ID 20
+
+GST_START_TEST (registry_single_pass)
+{
+  GstMemory *payload = create_payload ();
+  GstBuffer *buffer = create_packet (payload);
+  KmsRtpHdrExtAudioLevel level = { 0, FALSE };
+  KmsRtpHdrExtRegistry *registry;
+  GstRTPBuffer rtp = GST_RTP_BUFFER_INIT;
+  guint8 voice = 0x80 | 42;
+  gint seq = 0xfffe;
+  gpointer data;
+  guint size;
+
+  fail_unless (kms_rtp_hdr_ext_write (&buffer, AUDIO_LEVEL_ID, &voice, 1,
+          KMS_RTP_HDR_EXT_ADD));
+
+  registry = kms_rtp_hdr_ext_registry_new ();
+  fail_unless (kms_rtp_hdr_ext_registry_add (registry, AUDIO_LEVEL_ID, 1, 0,
+          kms_rtp_hdr_ext_audio_level, &level, NULL));
+  fail_unless (kms_rtp_hdr_ext_registry_add (registry, EXT_ID, EXT_SIZE,
+          KMS_RTP_HDR_EXT_ADD, kms_rtp_hdr_ext_abs_send_time, NULL, NULL));
+  fail_unless (kms_rtp_hdr_ext_registry_add (registry, TRANSPORT_SEQ_ID, 2,
+          KMS_RTP_HDR_EXT_ADD, kms_rtp_hdr_ext_transport_seq, &seq, NULL));
+  fail_if (kms_rtp_hdr_ext_registry_add (registry, EXT_ID, EXT_SIZE, 0,
+          kms_rtp_hdr_ext_abs_send_time, NULL, NULL));
+  fail_unless_equals_int (kms_rtp_hdr_ext_registry_get_n_handlers (registry),
+      3);
+
+  fail_unless (kms_rtp_hdr_ext_registry_process (registry, &buffer));
+  fail_unless_equals_int (level.level, 42);
+  fail_unless (level.voice);
+
+  fail_unless (kms_rtp_hdr_ext_registry_process (registry, &buffer));
+  fail_unless (gst_buffer_peek_memory (buffer, 1) == payload);
+
+  /* Every element still there, the sequence number wraps */
+  fail_unless (gst_rtp_buffer_map (buffer, GST_MAP_READ, &rtp));
+  fail_unless (gst_rtp_buffer_get_extension_onebyte_header (&rtp,
+          AUDIO_LEVEL_ID, 0, &data, &size));
+  fail_unless_equals_int (*(guint8 *) data, voice);
+  fail_unless (gst_rtp_buffer_get_extension_onebyte_header (&rtp, EXT_ID, 0,
+          &data, &size));
+  fail_unless_equals_int (size, EXT_SIZE);
+  fail_unless (gst_rtp_buffer_get_extension_onebyte_header (&rtp,
+          TRANSPORT_SEQ_ID, 0, &data, &size));
+  fail_unless_equals_int (GST_READ_UINT16_BE (data), 0xffff);
+  fail_unless_equals_int (gst_rtp_buffer_get_payload_len (&rtp),
+      PAYLOAD_SIZE);
+  gst_rtp_buffer_unmap (&rtp);
+
+  fail_unless_equals_int (seq, 0x10000);
+
+  kms_rtp_hdr_ext_registry_free (registry);
+  gst_buffer_unref (buffer);
+  gst_memory_unref (payload);
+}
+
+GST_END_TEST;
+
+GST_START_TEST (two_byte_elements)
+{
+  GstMemory *payload = create_payload ();
+  GstBuffer *buffer = create_packet (payload);
+  GstRTPBuffer rtp = GST_RTP_BUFFER_INIT;
+  guint8 appbits;
+  gpointer data;
+  guint size;
+
+  fail_unless (kms_rtp_hdr_ext_write (&buffer, EXT_ID, send_time, EXT_SIZE,
+          KMS_RTP_HDR_EXT_ADD));
+
+  /* Out of the one-byte range, all the elements become two-byte ones */
+  fail_unless (kms_rtp_hdr_ext_write (&buffer, TWO_BYTE_ID, send_time,
+          EXT_SIZE, KMS_RTP_HDR_EXT_ADD));
+
+  fail_unless (gst_rtp_buffer_map (buffer, GST_MAP_READ, &rtp));
+  fail_unless (gst_rtp_buffer_get_extension_twobytes_header (&rtp, &appbits,
+          EXT_ID, 0, &data, &size));
+  fail_unless_equals_int (size, EXT_SIZE);
+  fail_unless (memcmp (data, send_time, EXT_SIZE) == 0);
+  fail_unless (gst_rtp_buffer_get_extension_twobytes_header (&rtp, &appbits,
+          TWO_BYTE_ID, 0, &data, &size));
+  fail_unless_equals_int (size, EXT_SIZE);
+  fail_unless_equals_int (gst_rtp_buffer_get_payload_len (&rtp),
+      PAYLOAD_SIZE);
+  gst_rtp_buffer_unmap (&rtp);
+
+  /* Updated in place */
+  fail_unless (kms_rtp_hdr_ext_write (&buffer, TWO_BYTE_ID, zero_time,
+          EXT_SIZE, KMS_RTP_HDR_EXT_UPDATE));
+
+  fail_unless (gst_rtp_buffer_map (buffer, GST_MAP_READ, &rtp));
+  fail_unless (gst_rtp_buffer_get_extension_twobytes_header (&rtp, &appbits,
+          TWO_BYTE_ID, 0, &data, &size));
+  fail_unless (memcmp (data, zero_time, EXT_SIZE) == 0);
+  gst_rtp_buffer_unmap (&rtp);
+
+  fail_unless (gst_buffer_peek_memory (buffer, 1) == payload);
+
+  gst_buffer_unref (buffer);
+  gst_memory_unref (payload);
+}
+
+GST_END_TEST;
+
+/* What was done before: map the whole packet writable and add the element */
+static void
+write_mapping (GstBuffer ** buffer)
+{
+  GstRTPBuffer rtp = GST_RTP_BUFFER_INIT;
+  guint8 *time;
+
+  *buffer = gst_buffer_make_writable (*buffer);
+  gst_rtp_buffer_map (*buffer, GST_MAP_WRITE, &rtp);
+  time = g_malloc0 (EXT_SIZE);
+  gst_rtp_buffer_add_extension_onebyte_header (&rtp, EXT_ID, time, EXT_SIZE);
+  g_free (time);
+  gst_rtp_buffer_unmap (&rtp);
+}
+
+static gint64
+run_benchmark (gboolean mapping)
+{
+  GstMemory *payload = create_payload ();
+  gint64 start, elapsed = 0;
+  guint i, j;
+
+  for (i = 0; i < BENCHMARK_LISTS; i++) {
+    GstBufferList *list = gst_buffer_list_new ();
+    GstBufferList *shared;
+
+    for (j = 0; j < BENCHMARK_LIST_SIZE; j++) {
+      gst_buffer_list_add (list, create_packet (payload));
+    }
+
+    /* As seen by one of the senders fed by a tee */
+    shared = gst_buffer_list_ref (list);
+
+    start = g_get_monotonic_time ();
+    if (mapping) {
+      shared = gst_buffer_list_make_writable (shared);
+      for (j = 0; j < BENCHMARK_LIST_SIZE; j++) {
+        GstBuffer *buffer = gst_buffer_ref (gst_buffer_list_get (shared, j));
+
+        write_mapping (&buffer);
+        gst_buffer_list_remove (shared, j, 1);
+        gst_buffer_list_insert (shared, j, buffer);
+      }
+    } else {
+      kms_rtp_hdr_ext_write_list (&shared, EXT_ID, zero_time, EXT_SIZE,
+          KMS_RTP_HDR_EXT_ADD);
+    }
+    elapsed += g_get_monotonic_time () - start;
+
+    gst_buffer_list_unref (shared);
+    gst_buffer_list_unref (list);
+  }
+
+  gst_memory_unref (payload);
+
+  return MAX (elapsed, 1);
+}
+
+GST_START_TEST (benchmark)
+{
+  guint packets = BENCHMARK_LISTS * BENCHMARK_LIST_SIZE;
+  gint64 mapping, header_only;
+
+  mapping = run_benchmark (TRUE);
+  header_only = run_benchmark (FALSE);
+
+  GST_INFO ("Mapping packets: %" G_GINT64_FORMAT " packets/s",
+      (gint64) packets * G_USEC_PER_SEC / mapping);
+  GST_INFO ("Rewriting headers: %" G_GINT64_FORMAT " packets/s",
+      (gint64) packets * G_USEC_PER_SEC / header_only);
+}
+
+GST_END_TEST;
+
+static Suite *
+rtphdrext_suite (void)
+{
+  Suite *s = suite_create ("rtphdrext");
+  TCase *tc_chain = tcase_create ("element");
+
+  suite_add_tcase (s, tc_chain);
+
+  tcase_add_test (tc_chain, add_and_update);
+  tcase_add_test (tc_chain, single_memory_packet);
+  tcase_add_test (tc_chain, buffer_list);
+  tcase_add_test (tc_chain, registry_single_pass);
+  tcase_add_test (tc_chain, two_byte_elements);
+  tcase_add_test (tc_chain, benchmark);
+
+  return s;
+}
+
+GST_CHECK_MAIN (rtphdrext);
@@ -38,6 +38,7 @@
 #include "kmssdpulpfecext.h"
 #include "kmssdpredundantext.h"
 #include "kmssdpmediadirext.h"
+#include "kmssdpextmapext.h"
 #include "kmssdpbundlegroup.h"
 #include "kmssdpagentcommon.h"
 
@@ -2022,6 +2023,101 @@ GST_START_TEST (sdp_agent_test_extmap_attrs)
 
 GST_END_TEST;
 
+static KmsSdpAgent *
+create_extmap_ext_agent (guint8 id, const gchar * uri, gboolean avp_extmap)
+{
+  KmsSdpMediaHandler *handler;
+  KmsSdpExtmapExt *ext;
+  KmsSdpAgent *agent;
+  GError *err = NULL;
+
+  agent = kms_sdp_agent_new ();
+  fail_if (agent == NULL);
+
+  handler = KMS_SDP_MEDIA_HANDLER (kms_sdp_rtp_avp_media_handler_new ());
+  fail_if (handler == NULL);
+
+  if (avp_extmap) {
+    /* Takes the id the extension would rather use */
+    kms_sdp_rtp_avp_media_handler_add_extmap (KMS_SDP_RTP_AVP_MEDIA_HANDLER
+        (handler), id, "URI-C", &err);
+    fail_if (err != NULL);
+  }
+
+  ext = kms_sdp_extmap_ext_new ();
+  fail_unless (kms_sdp_extmap_ext_add_uri (ext, id, uri, &err));
+  fail_if (kms_sdp_extmap_ext_add_uri (ext, id, "URI-B", &err));
+  g_clear_error (&err);
+  fail_unless (kms_sdp_extmap_ext_add_uri (ext, id + 2, "URI-B", &err));
+
+  fail_unless (kms_sdp_media_handler_add_media_extension (handler,
+          KMS_I_SDP_MEDIA_EXTENSION (ext)));
+
+  fail_if (kms_sdp_agent_add_proto_handler (agent, "video", handler,
+          NULL) < 0);
+
+  return agent;
+}
+
+GST_START_TEST (sdp_agent_test_extmap_ext)
+{
+  KmsSdpAgent *offerer, *answerer;
+  GstSDPMessage *offer, *answer;
+  const GstSDPMedia *media;
+  gchar *sdp_str = NULL;
+  GError *err = NULL;
+
+  offerer = create_extmap_ext_agent (3, "URI-A", TRUE);
+  answerer = create_extmap_ext_agent (7, "URI-A", FALSE);
+
+  offer = kms_sdp_agent_create_offer (offerer, &err);
+  fail_if (err != NULL);
+
+  GST_DEBUG ("Offer:\n%s", (sdp_str = gst_sdp_message_as_text (offer)));
+  g_clear_pointer (&sdp_str, g_free);
+
+  /* Id 3 is taken by the media handler */
+  media = gst_sdp_message_get_media (offer, 0);
+  fail_unless (sdp_utils_get_extmap_id (media, "URI-C") == 3);
+  fail_unless (sdp_utils_get_extmap_id (media, "URI-A") == 1);
+  fail_unless (sdp_utils_get_extmap_id (media, "URI-B") == 5);
+
+  fail_if (!kms_sdp_agent_set_local_description (offerer, offer, &err));
+  fail_if (!kms_sdp_agent_set_remote_description (answerer, offer, &err));
+
+  answer = kms_sdp_agent_create_answer (answerer, &err);
+  fail_if (err != NULL);
+
+  GST_DEBUG ("Answer:\n%s", (sdp_str = gst_sdp_message_as_text (answer)));
+  g_clear_pointer (&sdp_str, g_free);
+
+  /* Answered with the ids of the offer */
+  media = gst_sdp_message_get_media (answer, 0);
+  fail_unless (sdp_utils_get_extmap_id (media, "URI-A") == 1);
+  fail_unless (sdp_utils_get_extmap_id (media, "URI-B") == 5);
+  fail_unless (sdp_utils_get_extmap_id (media, "URI-C") == -1);
+
+  fail_if (!kms_sdp_agent_set_remote_description (offerer, answer, &err));
+  fail_if (!kms_sdp_agent_set_local_description (answerer, answer, &err));
+
+  /* The answerer keeps the negotiated ids when it offers */
+  offer = kms_sdp_agent_create_offer (answerer, &err);
+  fail_if (err != NULL);
+
+  GST_DEBUG ("Next Offer:\n%s", (sdp_str = gst_sdp_message_as_text (offer)));
+  g_clear_pointer (&sdp_str, g_free);
+
+  media = gst_sdp_message_get_media (offer, 0);
+  fail_unless (sdp_utils_get_extmap_id (media, "URI-A") == 1);
+  fail_unless (sdp_utils_get_extmap_id (media, "URI-B") == 5);
+
+  gst_sdp_message_free (offer);
+  g_object_unref (offerer);
+  g_object_unref (answerer);
+}
+
+GST_END_TEST;
+
 static void
 test_sdp_dynamic_pts (KmsSdpRtpAvpMediaHandler * handler)
 {
@@ -5737,6 +5833,7 @@ sdp_agent_suite (void)
   tcase_add_test (tc_chain, sdp_agent_test_supported_attrs);
   tcase_add_test (tc_chain, sdp_agent_test_bandwidtth_attrs);
   tcase_add_test (tc_chain, sdp_agent_test_extmap_attrs);
+  tcase_add_test (tc_chain, sdp_agent_test_extmap_ext);
   tcase_add_test (tc_chain, sdp_agent_test_dynamic_pts);
   tcase_add_test (tc_chain, sdp_agent_test_optional_enc_parameters);
   tcase_add_test (tc_chain, sdp_agent_regression_tests);
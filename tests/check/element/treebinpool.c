@@ -0,0 +1,188 @@
+/*
+ * (C) Copyright 2016 Kurento (http://kurento.org/)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+#include <gst/check/gstcheck.h>
+#include <gst/gst.h>
+
+#include "kmstreebinpool.h"
+#include "kmsagnosticcaps.h"
+
+#define BENCHMARK_BINS 20
+#define FILL_TIMEOUT (10 * G_USEC_PER_SEC)
+
+#define VP8_CAPS "video/x-vp8"
+
+static void
+get_stats (guint * size, guint * available, guint64 * hits, guint64 * misses)
+{
+  GstStructure *stats = kms_tree_bin_pool_get_stats ();
+
+  gst_structure_get (stats, "size", G_TYPE_UINT, size,
+      "available", G_TYPE_UINT, available,
+      "hits", G_TYPE_UINT64, hits, "misses", G_TYPE_UINT64, misses, NULL);
+  gst_structure_free (stats);
+}
+
+static void
+release (gpointer bin)
+{
+  gst_object_ref_sink (bin);
+  gst_object_unref (bin);
+}
+
+/* Checks out an encoder as soon as the pool has built one */
+static KmsEncTreeBin *
+wait_encoder (const GstCaps * caps, gint min_bitrate, gint max_bitrate)
+{
+  gint64 end = g_get_monotonic_time () + FILL_TIMEOUT;
+  KmsEncTreeBin *enc = NULL;
+
+  while (enc == NULL && g_get_monotonic_time () < end) {
+    enc = kms_tree_bin_pool_get_encoder (caps, 300000, min_bitrate,
+        max_bitrate, NULL);
+
+    if (enc == NULL) {
+      g_usleep (10000);
+    }
+  }
+
+  return enc;
+}
+
+GST_START_TEST (disabled_by_default)
+{
+  GstCaps *caps = gst_caps_from_string (VP8_CAPS);
+  guint size, available;
+  guint64 hits, misses;
+
+  fail_unless (kms_tree_bin_pool_get_encoder (caps, 300000, 0,
+          G_MAXINT, NULL) == NULL);
+
+  get_stats (&size, &available, &hits, &misses);
+  fail_unless_equals_int (size, 0);
+  fail_unless_equals_int (available, 0);
+  fail_unless_equals_int (hits, 0);
+  fail_unless_equals_int (misses, 0);
+
+  gst_caps_unref (caps);
+}
+
+GST_END_TEST;
+
+GST_START_TEST (checkout_and_reset)
+{
+  GstCaps *caps = gst_caps_from_string (VP8_CAPS);
+  GstCaps *raw = gst_caps_from_string (KMS_AGNOSTIC_RAW_VIDEO_CAPS);
+  KmsEncTreeBin *enc;
+  guint size, available;
+  guint64 hits, misses;
+
+  kms_tree_bin_pool_set_size (1);
+
+  enc = wait_encoder (caps, 100000, 500000);
+  fail_unless (enc != NULL);
+  fail_unless (g_object_is_floating (enc));
+  fail_unless_equals_int (kms_enc_tree_bin_get_min_bitrate (enc), 100000);
+  fail_unless_equals_int (kms_enc_tree_bin_get_max_bitrate (enc), 500000);
+  release (enc);
+
+  get_stats (&size, &available, &hits, &misses);
+  fail_unless_equals_int (size, 1);
+  fail_unless_equals_int (hits, 1);
+
+  /* Codecs not pooled are not accounted */
+  fail_unless (kms_tree_bin_pool_get_decoder (raw, raw) == NULL);
+  get_stats (&size, &available, &hits, &misses);
+  fail_unless_equals_int (hits, 1);
+
+  kms_tree_bin_pool_set_size (0);
+  get_stats (&size, &available, &hits, &misses);
+  fail_unless_equals_int (size, 0);
+  fail_unless_equals_int (available, 0);
+
+  gst_caps_unref (caps);
+  gst_caps_unref (raw);
+}
+
+GST_END_TEST;
+
+GST_START_TEST (benchmark_branch_creation)
+{
+  GstCaps *caps = gst_caps_from_string (VP8_CAPS);
+  KmsEncTreeBin *bins[BENCHMARK_BINS];
+  gint64 start, built, pooled;
+  gint64 end = g_get_monotonic_time () + FILL_TIMEOUT;
+  guint size, available = 0, i;
+  guint64 hits, misses;
+
+  start = g_get_monotonic_time ();
+  for (i = 0; i < BENCHMARK_BINS; i++) {
+    bins[i] = kms_enc_tree_bin_new (caps, 300000, 0, G_MAXINT, NULL);
+  }
+  built = MAX (g_get_monotonic_time () - start, 1);
+
+  for (i = 0; i < BENCHMARK_BINS; i++) {
+    release (bins[i]);
+  }
+
+  kms_tree_bin_pool_set_size (BENCHMARK_BINS);
+
+  /* Encoders and decoders of every pooled codec are built */
+  while (available < BENCHMARK_BINS && g_get_monotonic_time () < end) {
+    g_usleep (10000);
+    get_stats (&size, &available, &hits, &misses);
+  }
+
+  start = g_get_monotonic_time ();
+  for (i = 0; i < BENCHMARK_BINS; i++) {
+    bins[i] = kms_tree_bin_pool_get_encoder (caps, 300000, 0, G_MAXINT,
+        NULL);
+  }
+  pooled = MAX (g_get_monotonic_time () - start, 1);
+
+  for (i = 0; i < BENCHMARK_BINS; i++) {
+    if (bins[i] != NULL) {
+      release (bins[i]);
+    }
+  }
+
+  GST_INFO ("VP8 encoding branches: %" G_GINT64_FORMAT " branches/s built, %"
+      G_GINT64_FORMAT " branches/s pooled",
+      (gint64) BENCHMARK_BINS * G_USEC_PER_SEC / built,
+      (gint64) BENCHMARK_BINS * G_USEC_PER_SEC / pooled);
+
+  kms_tree_bin_pool_set_size (0);
+  gst_caps_unref (caps);
+}
+
+GST_END_TEST;
+
+static Suite *
+treebinpool_suite (void)
+{
+  Suite *s = suite_create ("treebinpool");
+  TCase *tc_chain = tcase_create ("element");
+
+  suite_add_tcase (s, tc_chain);
+
+  tcase_add_test (tc_chain, disabled_by_default);
+  tcase_add_test (tc_chain, checkout_and_reset);
+  tcase_add_test (tc_chain, benchmark_branch_creation);
+
+  return s;
+}
+
+GST_CHECK_MAIN (treebinpool);
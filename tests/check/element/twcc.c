@@ -0,0 +1,373 @@
+/*
+ * (C) Copyright 2016 Kurento (http://kurento.org/)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+#include <gst/check/gstcheck.h>
+#include <gst/gst.h>
+
+#include "kmstwcc.h"
+
+#define MIN_BITRATE 30000
+#define MAX_BITRATE 10000000
+#define PACKET_SIZE 1200
+#define PROPAGATION_DELAY (20 * GST_MSECOND)
+
+/* Trace to replay instead of the embedded one */
+#define TRACE_FILE_ENV "KMS_TWCC_TRACE"
+
+/*
+ * One packet per line, as kmsremb logs them after "twcc-trace"
+ * (GST_DEBUG=kmsremb:7): "transport_seq send_us arrival_us size". This one
+ * is a stable link that wraps the sequence numbers, with a repeated, a lost
+ * and a reordered packet.
+ */
+static const gchar *stable_trace =
+  "# seq send_us arrival_us size\n"
+  "65510 1000000 1036326 1104\n"
+  "65511 1020000 1056617 1012\n"
+  "65512 1040000 1075296 1012\n"
+  "65513 1060000 1096497 1012\n"
+  "65514 1080000 1117078 1104\n"
+  "65515 1100000 1135153 1012\n"
+  "65516 1120000 1156776 1200\n"
+  "65517 1140000 1175286 1104\n"
+  "65518 1160000 1195371 1200\n"
+  "65519 1180000 1215242 1012\n"
+  "65520 1200000 1235914 1012\n"
+  "65521 1220000 1257363 1200\n"
+  "65522 1240000 1275203 1104\n"
+  "65523 1260000 1295190 1104\n"
+  "65524 1280000 1316186 1200\n"
+  "65525 1300000 1335590 1012\n"
+  "65526 1320000 1357338 1188\n"
+  "65527 1340000 1377294 1104\n"
+  "65528 1360000 1395422 1104\n"
+  "65529 1380000 1416525 1012\n"
+  "65529 1380000 1416525 1012\n"
+  "65530 1400000 1437243 1012\n"
+  "65531 1420000 1457311 1012\n"
+  "65532 1440000 1477535 1104\n"
+  "65533 1460000 1497033 1200\n"
+  "65534 1480000 1516286 1200\n"
+  "65535 1500000 1537398 1200\n"
+  "0 1520000 1556481 1188\n"
+  "1 1540000 1576017 1104\n"
+  "2 1560000 1597863 1104\n"
+  "3 1580000 1615335 1188\n"
+  "5 1620000 1656406 1200\n"
+  "6 1640000 1676179 1012\n"
+  "7 1660000 1695483 1200\n"
+  "8 1680000 1715675 1188\n"
+  "9 1700000 1735622 1200\n"
+  "10 1720000 1756727 1012\n"
+  "11 1740000 1777737 1012\n"
+  "12 1760000 1797285 1188\n"
+  "13 1780000 1816393 1188\n"
+  "15 1820000 1857375 1200\n"
+  "14 1800000 1837434 1200\n"
+  "16 1840000 1875281 1012\n"
+  "17 1860000 1896105 1200\n"
+  "18 1880000 1917855 1012\n"
+  "19 1900000 1935248 1188\n"
+  "20 1920000 1957650 1200\n"
+  "21 1940000 1976165 1200\n"
+  "22 1960000 1997738 1188\n"
+  "23 1980000 2015092 1200\n";
+
+typedef struct _Link
+{
+  /* bps, the capacity changes to @capacity_after at @change_time */
+  guint capacity;
+  guint capacity_after;
+  GstClockTime change_time;
+  GstClockTime queue_free;
+  guint16 seq;
+} Link;
+
+/* Sends a packet through the bottleneck @link, returns its queuing delay */
+static GstClockTime
+link_send (Link * link, KmsTwccEstimator * estimator, GstClockTime send_time)
+{
+  GstClockTime start, capacity;
+
+  capacity = send_time < link->change_time ? link->capacity :
+      link->capacity_after;
+  start = MAX (send_time + PROPAGATION_DELAY, link->queue_free);
+  link->queue_free = start + gst_util_uint64_scale (PACKET_SIZE * 8,
+      GST_SECOND, capacity);
+
+  kms_twcc_estimator_add_packet (estimator, link->seq++, send_time,
+      link->queue_free, PACKET_SIZE);
+
+  return link->queue_free - send_time - PROPAGATION_DELAY;
+}
+
+/* Sends at a constant @bitrate for @duration */
+static void
+link_send_cbr (Link * link, KmsTwccEstimator * estimator, guint bitrate,
+    GstClockTime duration, gboolean * overuse)
+{
+  GstClockTime t, interval;
+
+  interval = gst_util_uint64_scale (PACKET_SIZE * 8, GST_SECOND, bitrate);
+
+  for (t = 0; t < duration; t += interval) {
+    link_send (link, estimator, t);
+
+    if (kms_twcc_estimator_get_usage (estimator) == KMS_TWCC_USAGE_OVERUSE) {
+      *overuse = TRUE;
+    }
+  }
+}
+
+/* Returns how many packets were fed */
+static guint
+replay_trace (KmsTwccEstimator * estimator, const gchar * trace)
+{
+  gchar **lines;
+  guint i, packets = 0;
+
+  lines = g_strsplit (trace, "\n", -1);
+
+  for (i = 0; lines[i] != NULL; i++) {
+    guint seq, size;
+    guint64 send_us, arrival_us;
+
+    if (lines[i][0] == '#' || lines[i][0] == '\0') {
+      continue;
+    }
+
+    if (sscanf (lines[i], "%u %" G_GUINT64_FORMAT " %" G_GUINT64_FORMAT " %u",
+            &seq, &send_us, &arrival_us, &size) != 4) {
+      GST_WARNING ("Invalid trace line: %s", lines[i]);
+      continue;
+    }
+
+    kms_twcc_estimator_add_packet (estimator, seq, send_us * GST_USECOND,
+        arrival_us * GST_USECOND, size);
+    packets++;
+
+    GST_LOG ("%" G_GUINT64_FORMAT " us: %u bps", arrival_us,
+        kms_twcc_estimator_get_bitrate (estimator));
+  }
+
+  g_strfreev (lines);
+
+  return packets;
+}
+
+GST_START_TEST (queuing_delay)
+{
+  KmsTwccEstimator *estimator;
+  Link link = { 1000000, 1000000, GST_CLOCK_TIME_NONE, 0, 0 };
+  gboolean overuse = FALSE;
+  guint bitrate;
+
+  estimator = kms_twcc_estimator_new (MIN_BITRATE, MAX_BITRATE);
+
+  /* The queue of the link grows, and so does the delay */
+  link_send_cbr (&link, estimator, 1500000, 3 * GST_SECOND, &overuse);
+  bitrate = kms_twcc_estimator_get_bitrate (estimator);
+
+  GST_INFO ("Estimation after overusing a 1000 kbps link: %u bps", bitrate);
+
+  fail_unless (overuse);
+  fail_unless (bitrate > 0 && bitrate < link.capacity);
+
+  kms_twcc_estimator_free (estimator);
+}
+
+GST_END_TEST;
+
+GST_START_TEST (steady_link)
+{
+  KmsTwccEstimator *estimator;
+  Link link = { 2000000, 2000000, GST_CLOCK_TIME_NONE, 0, 0 };
+  gboolean overuse = FALSE;
+  guint bitrate;
+
+  estimator = kms_twcc_estimator_new (MIN_BITRATE, MAX_BITRATE);
+
+  link_send_cbr (&link, estimator, 500000, 5 * GST_SECOND, &overuse);
+  bitrate = kms_twcc_estimator_get_bitrate (estimator);
+
+  GST_INFO ("Estimation after sending 500 kbps: %u bps", bitrate);
+
+  fail_if (overuse);
+  fail_unless (bitrate > 500000);
+
+  kms_twcc_estimator_free (estimator);
+}
+
+GST_END_TEST;
+
+GST_START_TEST (closed_loop)
+{
+  KmsTwccEstimator *estimator;
+  Link link = { 1000000, 500000, 20 * GST_SECOND, 0, 0 };
+  GstClockTime t = 0, queuing = 0, max_queuing = 0;
+  guint bitrate = 300000;
+
+  estimator = kms_twcc_estimator_new (MIN_BITRATE, MAX_BITRATE);
+
+  /* The sender follows the estimation, as encoders do with REMB */
+  while (t < 40 * GST_SECOND) {
+    queuing = link_send (&link, estimator, t);
+    t += gst_util_uint64_scale (PACKET_SIZE * 8, GST_SECOND, bitrate);
+
+    if (kms_twcc_estimator_get_bitrate (estimator) > 0) {
+      bitrate = kms_twcc_estimator_get_bitrate (estimator);
+    }
+
+    if (t > 25 * GST_SECOND) {
+      /* Converged after the capacity dropped */
+      max_queuing = MAX (max_queuing, queuing);
+    }
+
+    if (t > 10 * GST_SECOND && t < 20 * GST_SECOND) {
+      fail_unless (bitrate > 600000 && bitrate < 1200000,
+          "Not converged to 1000 kbps: %u bps", bitrate);
+    }
+  }
+
+  GST_INFO ("Estimation after dropping to 500 kbps: %u bps"
+      ", max queuing: %" GST_TIME_FORMAT, bitrate,
+      GST_TIME_ARGS (max_queuing));
+
+  fail_unless (bitrate > 300000 && bitrate < 600000);
+  fail_unless (max_queuing < 100 * GST_MSECOND);
+
+  kms_twcc_estimator_free (estimator);
+}
+
+GST_END_TEST;
+
+/*
+ * Audio packets of 160 bytes every 20 ms take transport-wide sequence
+ * numbers from the same counter as video, so video alone has gaps.
+ * Returns the estimation after @duration.
+ */
+static guint
+send_with_audio (gboolean feed_audio, GstClockTime duration)
+{
+  KmsTwccEstimator *estimator;
+  GstClockTime t, next_audio = 0, video_interval;
+  guint16 seq = 0, late_seq = 0;
+  gboolean late_audio = FALSE;
+  guint bitrate;
+
+  estimator = kms_twcc_estimator_new (MIN_BITRATE, MAX_BITRATE);
+  video_interval = gst_util_uint64_scale (PACKET_SIZE * 8, GST_SECOND,
+      500000);
+
+  for (t = 0; t < duration; t += video_interval) {
+    while (next_audio <= t) {
+      if (late_audio && feed_audio) {
+        /* Audio reaches us through another thread, after the next video */
+        kms_twcc_estimator_add_seq (estimator, late_seq);
+      }
+
+      late_seq = seq++;
+      late_audio = TRUE;
+      next_audio += 20 * GST_MSECOND;
+    }
+
+    kms_twcc_estimator_add_packet (estimator, seq++, t,
+        t + PROPAGATION_DELAY, PACKET_SIZE);
+
+    if (late_audio && feed_audio) {
+      kms_twcc_estimator_add_seq (estimator, late_seq);
+      late_audio = FALSE;
+    }
+  }
+
+  bitrate = kms_twcc_estimator_get_bitrate (estimator);
+  kms_twcc_estimator_free (estimator);
+
+  return bitrate;
+}
+
+GST_START_TEST (interleaved_audio)
+{
+  guint with_audio, without_audio;
+
+  with_audio = send_with_audio (TRUE, 10 * GST_SECOND);
+  without_audio = send_with_audio (FALSE, 10 * GST_SECOND);
+
+  GST_INFO ("Estimation after sending 500 kbps with audio: %u bps"
+      ", without its sequence numbers: %u bps", with_audio, without_audio);
+
+  /* Gaps filled by audio are not losses */
+  fail_unless (with_audio > 500000);
+  fail_unless (without_audio < with_audio);
+}
+
+GST_END_TEST;
+
+GST_START_TEST (trace_replay)
+{
+  KmsTwccEstimator *estimator;
+  const gchar *file = g_getenv (TRACE_FILE_ENV);
+  gchar *trace = NULL;
+  guint packets;
+
+  estimator = kms_twcc_estimator_new (MIN_BITRATE, MAX_BITRATE);
+
+  if (file != NULL) {
+    GError *err = NULL;
+
+    fail_unless (g_file_get_contents (file, &trace, NULL, &err),
+        "Cannot read %s: %s", file, err != NULL ? err->message : "");
+    packets = replay_trace (estimator, trace);
+    GST_INFO ("Replayed %u packets from %s: %u bps (incoming %u bps)",
+        packets, file, kms_twcc_estimator_get_bitrate (estimator),
+        kms_twcc_estimator_get_incoming_bitrate (estimator));
+    g_free (trace);
+  } else {
+    packets = replay_trace (estimator, stable_trace);
+    GST_INFO ("Replayed %u packets: %u bps (incoming %u bps)", packets,
+        kms_twcc_estimator_get_bitrate (estimator),
+        kms_twcc_estimator_get_incoming_bitrate (estimator));
+
+    fail_unless (packets == 50);
+    fail_unless (kms_twcc_estimator_get_usage (estimator) !=
+        KMS_TWCC_USAGE_OVERUSE);
+    fail_unless (kms_twcc_estimator_get_bitrate (estimator) >=
+        kms_twcc_estimator_get_incoming_bitrate (estimator));
+  }
+
+  kms_twcc_estimator_free (estimator);
+}
+
+GST_END_TEST;
+
+static Suite *
+twcc_suite (void)
+{
+  Suite *s = suite_create ("twcc");
+  TCase *tc_chain = tcase_create ("element");
+
+  suite_add_tcase (s, tc_chain);
+
+  tcase_add_test (tc_chain, queuing_delay);
+  tcase_add_test (tc_chain, steady_link);
+  tcase_add_test (tc_chain, closed_loop);
+  tcase_add_test (tc_chain, interleaved_audio);
+  tcase_add_test (tc_chain, trace_replay);
+
+  return s;
+}
+
+GST_CHECK_MAIN (twcc);
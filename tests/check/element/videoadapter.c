@@ -0,0 +1,394 @@
+/*
+ * (C) Copyright 2016 Kurento (http://kurento.org/)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+#include <gst/check/gstcheck.h>
+#include <gst/gst.h>
+#include <gst/video/video.h>
+
+#include "kmsvideokernels.h"
+
+#define ROW_SIZE 1283
+
+#define INPUT_FRAMES 30
+#define INPUT_CAPS "video/x-raw,format=I420,width=320,height=240," \
+  "framerate=30/1"
+
+#define BENCHMARK_FRAMES 300
+#define BENCHMARK_INPUT_CAPS "video/x-raw,format=I420,width=1280," \
+  "height=720,framerate=30/1"
+#define BENCHMARK_OUTPUT_CAPS "video/x-raw,format=NV12,width=640," \
+  "height=360,framerate=15/1"
+
+static const gchar *simd_kernels[] = { "sse4.1", "avx2", "neon" };
+
+static GMainLoop *loop;
+
+static void
+bus_msg (GstBus * bus, GstMessage * msg, gpointer pipe)
+{
+  switch (GST_MESSAGE_TYPE (msg)) {
+    case GST_MESSAGE_ERROR:{
+      GST_ERROR ("Error: %" GST_PTR_FORMAT, msg);
+      fail ("Error received on bus");
+      break;
+    }
+    case GST_MESSAGE_EOS:
+      g_main_loop_quit (loop);
+      break;
+    default:
+      break;
+  }
+}
+
+static void
+fill_random (guint8 * data, gsize size, GRand * rand)
+{
+  gsize i;
+
+  for (i = 0; i < size; i++) {
+    data[i] = g_rand_int_range (rand, 0, 256);
+  }
+}
+
+GST_START_TEST (kernels_match_generic)
+{
+  const KmsVideoKernels *generic = kms_video_kernels_get_by_name ("generic");
+  guint8 a[ROW_SIZE], b[ROW_SIZE], interleaved[2 * ROW_SIZE];
+  guint8 expected[2 * ROW_SIZE], result[2 * ROW_SIZE];
+  guint8 u[ROW_SIZE], v[ROW_SIZE];
+  GRand *rand = g_rand_new_with_seed (0);
+  guint i, weight;
+
+  fail_unless (generic != NULL);
+  fail_unless (kms_video_kernels_get () != NULL);
+  GST_INFO ("Using %s kernels", kms_video_kernels_get ()->name);
+
+  fill_random (a, sizeof (a), rand);
+  fill_random (b, sizeof (b), rand);
+  fill_random (interleaved, sizeof (interleaved), rand);
+
+  for (i = 0; i < G_N_ELEMENTS (simd_kernels); i++) {
+    const KmsVideoKernels *k = kms_video_kernels_get_by_name (simd_kernels[i]);
+    gsize n;
+
+    if (k == NULL) {
+      GST_INFO ("No %s kernels on this CPU", simd_kernels[i]);
+      continue;
+    }
+
+    /* Every length, so that the scalar tails are checked too */
+    for (n = 0; n < ROW_SIZE; n += 1 + n / 8) {
+      for (weight = 0; weight <= KMS_VIDEO_KERNELS_WEIGHT_ONE; weight += 8) {
+        generic->blend_row (expected, a, b, weight, n);
+        k->blend_row (result, a, b, weight, n);
+        fail_unless (memcmp (expected, result, n) == 0,
+            "%s blend differs for %" G_GSIZE_FORMAT " samples",
+            k->name, n);
+      }
+
+      generic->interleave_row (expected, a, b, n);
+      k->interleave_row (result, a, b, n);
+      fail_unless (memcmp (expected, result, 2 * n) == 0,
+          "%s interleave differs for %" G_GSIZE_FORMAT " samples",
+          k->name, n);
+
+      generic->deinterleave_row (u, v, interleaved, n);
+      k->deinterleave_row (result, result + n, interleaved, n);
+      fail_unless (memcmp (u, result, n) == 0
+          && memcmp (v, result + n, n) == 0,
+          "%s deinterleave differs for %" G_GSIZE_FORMAT " samples",
+          k->name, n);
+    }
+  }
+
+  /* Blending the same rows keeps them */
+  generic->blend_row (result, a, a, KMS_VIDEO_KERNELS_WEIGHT_ONE / 2,
+      ROW_SIZE);
+  fail_unless (memcmp (result, a, ROW_SIZE) == 0);
+
+  g_rand_free (rand);
+}
+
+GST_END_TEST;
+
+typedef struct _AdaptData
+{
+  guint frames;
+  gint width, height;
+  GstVideoFormat format;
+  /* Checked unless 0 */
+  gint par_n, par_d;
+  /* Of the input, a solid color */
+  guint8 y, u, v;
+} AdaptData;
+
+static GstPadProbeReturn
+input_probe (GstPad * pad, GstPadProbeInfo * info, gpointer user_data)
+{
+  AdaptData *data = user_data;
+  GstBuffer *buffer = gst_pad_probe_info_get_buffer (info);
+  GstCaps *caps = gst_pad_get_current_caps (pad);
+  GstVideoFrame frame;
+  GstVideoInfo vinfo;
+
+  fail_unless (gst_video_info_from_caps (&vinfo, caps));
+  gst_caps_unref (caps);
+
+  fail_unless (gst_video_frame_map (&frame, &vinfo, buffer, GST_MAP_READ));
+  data->y = GST_VIDEO_FRAME_COMP_DATA (&frame, 0)[0];
+  data->u = GST_VIDEO_FRAME_COMP_DATA (&frame, 1)[0];
+  data->v = GST_VIDEO_FRAME_COMP_DATA (&frame, 2)[0];
+  gst_video_frame_unmap (&frame);
+
+  return GST_PAD_PROBE_OK;
+}
+
+static void
+check_component (GstVideoFrame * frame, guint comp, guint8 expected)
+{
+  guint x, y;
+
+  for (y = 0; y < GST_VIDEO_FRAME_COMP_HEIGHT (frame, comp); y++) {
+    const guint8 *row = GST_VIDEO_FRAME_COMP_DATA (frame, comp) +
+        y * GST_VIDEO_FRAME_COMP_STRIDE (frame, comp);
+
+    for (x = 0; x < GST_VIDEO_FRAME_COMP_WIDTH (frame, comp); x++) {
+      fail_unless_equals_int (row[x * GST_VIDEO_FRAME_COMP_PSTRIDE (frame,
+                  comp)], expected);
+    }
+  }
+}
+
+static void
+handoff (GstElement * sink, GstBuffer * buffer, GstPad * pad,
+    gpointer user_data)
+{
+  AdaptData *data = user_data;
+  GstCaps *caps = gst_pad_get_current_caps (pad);
+  GstVideoFrame frame;
+  GstVideoInfo info;
+
+  fail_unless (gst_video_info_from_caps (&info, caps));
+  gst_caps_unref (caps);
+
+  fail_unless_equals_int (GST_VIDEO_INFO_WIDTH (&info), data->width);
+  fail_unless_equals_int (GST_VIDEO_INFO_HEIGHT (&info), data->height);
+  fail_unless_equals_int (GST_VIDEO_INFO_FORMAT (&info), data->format);
+
+  if (data->par_n != 0) {
+    fail_unless_equals_int (GST_VIDEO_INFO_PAR_N (&info), data->par_n);
+    fail_unless_equals_int (GST_VIDEO_INFO_PAR_D (&info), data->par_d);
+  }
+
+  if (GST_VIDEO_INFO_IS_YUV (&info)) {
+    fail_unless (gst_video_frame_map (&frame, &info, buffer, GST_MAP_READ));
+    check_component (&frame, 0, data->y);
+    check_component (&frame, 1, data->u);
+    check_component (&frame, 2, data->v);
+    gst_video_frame_unmap (&frame);
+  }
+
+  data->frames++;
+}
+
+static void
+run_adapter (const gchar * input_caps, const gchar * output_caps,
+    AdaptData * data)
+{
+  gchar *desc;
+  GstElement *pipeline, *adapter, *sink;
+  GstBus *bus;
+  GstPad *pad;
+
+  desc = g_strdup_printf ("videotestsrc pattern=white num-buffers=%d ! %s ! "
+      "videoadapter name=adapter ! %s ! fakesink name=sink sync=false "
+      "signal-handoffs=true", INPUT_FRAMES, input_caps, output_caps);
+  pipeline = gst_parse_launch (desc, NULL);
+  g_free (desc);
+  fail_unless (pipeline != NULL);
+
+  loop = g_main_loop_new (NULL, TRUE);
+  bus = gst_pipeline_get_bus (GST_PIPELINE (pipeline));
+  gst_bus_add_signal_watch (bus);
+  g_signal_connect (bus, "message", G_CALLBACK (bus_msg), pipeline);
+
+  adapter = gst_bin_get_by_name (GST_BIN (pipeline), "adapter");
+  pad = gst_element_get_static_pad (adapter, "sink");
+  gst_pad_add_probe (pad, GST_PAD_PROBE_TYPE_BUFFER, input_probe, data, NULL);
+  g_object_unref (pad);
+  g_object_unref (adapter);
+
+  sink = gst_bin_get_by_name (GST_BIN (pipeline), "sink");
+  g_signal_connect (sink, "handoff", G_CALLBACK (handoff), data);
+  g_object_unref (sink);
+
+  gst_element_set_state (pipeline, GST_STATE_PLAYING);
+  g_main_loop_run (loop);
+  gst_element_set_state (pipeline, GST_STATE_NULL);
+
+  gst_bus_remove_signal_watch (bus);
+  g_object_unref (bus);
+  g_main_loop_unref (loop);
+  gst_object_unref (pipeline);
+}
+
+GST_START_TEST (scale_convert_and_drop)
+{
+  AdaptData data = { 0 };
+
+  /* Through the kernels, half of the frames dropped */
+  data.width = 160;
+  data.height = 90;
+  data.format = GST_VIDEO_FORMAT_NV12;
+  run_adapter (INPUT_CAPS, "video/x-raw,format=NV12,width=160,height=90,"
+      "framerate=15/1", &data);
+  fail_unless (data.frames >= INPUT_FRAMES / 2 - 1
+      && data.frames <= INPUT_FRAMES / 2 + 1, "%u frames", data.frames);
+
+  /* Upscaling, back to planar chroma */
+  memset (&data, 0, sizeof (data));
+  data.width = 640;
+  data.height = 480;
+  data.format = GST_VIDEO_FORMAT_I420;
+  run_adapter ("video/x-raw,format=NV12,width=320,height=240,framerate=30/1",
+      "video/x-raw,format=I420,width=640,height=480", &data);
+  fail_unless_equals_int (data.frames, INPUT_FRAMES);
+
+  /* Other formats go through the generic converter */
+  memset (&data, 0, sizeof (data));
+  data.width = 176;
+  data.height = 144;
+  data.format = GST_VIDEO_FORMAT_BGRx;
+  run_adapter (INPUT_CAPS, "video/x-raw,format=BGRx,width=176,height=144",
+      &data);
+  fail_unless_equals_int (data.frames, INPUT_FRAMES);
+}
+
+GST_END_TEST;
+
+GST_START_TEST (keeps_input_size)
+{
+  AdaptData data = { 0 };
+
+  /* Nothing to do but dropping frames */
+  data.width = 320;
+  data.height = 240;
+  data.format = GST_VIDEO_FORMAT_I420;
+  run_adapter (INPUT_CAPS, "video/x-raw,framerate=10/1", &data);
+  fail_unless (data.frames >= INPUT_FRAMES / 3 - 1
+      && data.frames <= INPUT_FRAMES / 3 + 1, "%u frames", data.frames);
+
+  /* Only the height asked, the aspect ratio is kept */
+  memset (&data, 0, sizeof (data));
+  data.width = 160;
+  data.height = 120;
+  data.format = GST_VIDEO_FORMAT_I420;
+  run_adapter (INPUT_CAPS, "video/x-raw,height=120", &data);
+  fail_unless_equals_int (data.frames, INPUT_FRAMES);
+}
+
+GST_END_TEST;
+
+GST_START_TEST (keeps_display_aspect_ratio)
+{
+  AdaptData data = { 0 };
+
+  /* 4:3 into a 16:9 size, pixels get narrower instead of stretching */
+  data.width = 160;
+  data.height = 90;
+  data.format = GST_VIDEO_FORMAT_I420;
+  data.par_n = 3;
+  data.par_d = 4;
+  run_adapter (INPUT_CAPS ",pixel-aspect-ratio=1/1",
+      "video/x-raw,width=160,height=90", &data);
+  fail_unless_equals_int (data.frames, INPUT_FRAMES);
+
+  /* Square pixels required, the free width follows the input DAR */
+  memset (&data, 0, sizeof (data));
+  data.width = 240;
+  data.height = 120;
+  data.format = GST_VIDEO_FORMAT_I420;
+  data.par_n = 1;
+  data.par_d = 1;
+  run_adapter (INPUT_CAPS ",pixel-aspect-ratio=3/2",
+      "video/x-raw,height=120,pixel-aspect-ratio=1/1", &data);
+  fail_unless_equals_int (data.frames, INPUT_FRAMES);
+}
+
+GST_END_TEST;
+
+static void
+run_benchmark (const gchar * name, const gchar * adapter)
+{
+  gchar *desc;
+  GstElement *pipeline;
+  GstBus *bus;
+  gint64 start, elapsed;
+
+  desc = g_strdup_printf ("videotestsrc num-buffers=%d ! " BENCHMARK_INPUT_CAPS
+      " ! %s ! " BENCHMARK_OUTPUT_CAPS " ! fakesink sync=false",
+      BENCHMARK_FRAMES, adapter);
+  pipeline = gst_parse_launch (desc, NULL);
+  g_free (desc);
+  fail_unless (pipeline != NULL);
+
+  loop = g_main_loop_new (NULL, TRUE);
+  bus = gst_pipeline_get_bus (GST_PIPELINE (pipeline));
+  gst_bus_add_signal_watch (bus);
+  g_signal_connect (bus, "message", G_CALLBACK (bus_msg), pipeline);
+
+  start = g_get_monotonic_time ();
+  gst_element_set_state (pipeline, GST_STATE_PLAYING);
+  g_main_loop_run (loop);
+  elapsed = MAX (g_get_monotonic_time () - start, 1);
+  gst_element_set_state (pipeline, GST_STATE_NULL);
+
+  GST_INFO ("%s: %" G_GINT64_FORMAT " input fps", name,
+      (gint64) BENCHMARK_FRAMES * G_USEC_PER_SEC / elapsed);
+
+  gst_bus_remove_signal_watch (bus);
+  g_object_unref (bus);
+  g_main_loop_unref (loop);
+  gst_object_unref (pipeline);
+}
+
+GST_START_TEST (benchmark)
+{
+  run_benchmark ("videorate ! videoscale ! videoconvert",
+      "videorate drop-only=true ! videoscale ! videoconvert");
+  run_benchmark ("videoadapter", "videoadapter");
+}
+
+GST_END_TEST;
+
+static Suite *
+videoadapter_suite (void)
+{
+  Suite *s = suite_create ("videoadapter");
+  TCase *tc_chain = tcase_create ("element");
+
+  suite_add_tcase (s, tc_chain);
+
+  tcase_add_test (tc_chain, kernels_match_generic);
+  tcase_add_test (tc_chain, scale_convert_and_drop);
+  tcase_add_test (tc_chain, keeps_input_size);
+  tcase_add_test (tc_chain, keeps_display_aspect_ratio);
+  tcase_add_test (tc_chain, benchmark);
+
+  return s;
+}
+
+GST_CHECK_MAIN (videoadapter);
@@ -130,6 +130,53 @@ GST_START_TEST (check_take_into_account_after_clear_time)
 
 GST_END_TEST;
 
+/*
+ * Check that changes of the minimum within the hysteresis are not notified,
+ * but are returned by get_min.
+ */
+GST_START_TEST (check_hysteresis)
+{
+  GstPad *pad;
+  RembEventManager *manager;
+  GstEvent *event;
+  guint min_br;
+
+  pad = gst_pad_new (NULL, GST_PAD_SRC);
+  gst_pad_set_active (pad, TRUE);
+  manager = kms_utils_remb_event_manager_create (pad);
+  kms_utils_remb_event_manager_set_callback (manager, bitrate_cb, &min_br,
+      NULL);
+  kms_utils_remb_event_manager_set_hysteresis (manager, 0.1);
+  fail_unless (kms_utils_remb_event_manager_get_hysteresis (manager) == 0.1f);
+
+  /* SSRC_1: set min */
+  event = kms_utils_remb_event_upstream_new (1000, 1);
+  gst_pad_send_event (pad, event);
+  fail_unless (min_br == 1000);
+
+  /* SSRC_2: within the hysteresis, not notified */
+  event = kms_utils_remb_event_upstream_new (950, 2);
+  gst_pad_send_event (pad, event);
+  fail_unless (min_br == 1000);
+  fail_unless (kms_utils_remb_event_manager_get_min (manager) == 950);
+
+  /* SSRC_1: out of the hysteresis of the last notified value */
+  event = kms_utils_remb_event_upstream_new (880, 1);
+  gst_pad_send_event (pad, event);
+  fail_unless (min_br == 880);
+
+  /* SSRC_1: min back to SSRC_2 br, within the hysteresis */
+  event = kms_utils_remb_event_upstream_new (2000, 1);
+  gst_pad_send_event (pad, event);
+  fail_unless (min_br == 880);
+  fail_unless (kms_utils_remb_event_manager_get_min (manager) == 950);
+
+  kms_utils_remb_event_manager_destroy (manager);
+  g_object_unref (pad);
+}
+
+GST_END_TEST;
+
 /* Suite initialization */
 static Suite *
 rembmanager_suite (void)
@@ -140,6 +187,7 @@ rembmanager_suite (void)
   suite_add_tcase (s, tc_chain);
   tcase_add_test (tc_chain, check_min_br_update);
   tcase_add_test (tc_chain, check_take_into_account_after_clear_time);
+  tcase_add_test (tc_chain, check_hysteresis);
 
   return s;
 }
@@ -0,0 +1,186 @@
+/*
+ * (C) Copyright 2016 Kurento (http://kurento.org/)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#define BOOST_TEST_DYN_LINK
+#define BOOST_TEST_MODULE EventDispatcher
+#include <boost/test/unit_test.hpp>
+#include <gst/gst.h>
+#include <EventHandler.hpp>
+#include <EventDispatcher.hpp>
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+using namespace kurento;
+
+#define SESSIONS 8
+#define EVENTS 1000
+#define LANES 4
+
+struct InitTests {
+  InitTests();
+};
+
+BOOST_GLOBAL_FIXTURE (InitTests);
+
+InitTests::InitTests()
+{
+  gst_init (nullptr, nullptr);
+  /* Before the first event, as the server does when reading its config */
+  EventDispatcher::setLanes (LANES);
+}
+
+class TestHandler : public EventHandler
+{
+public:
+  TestHandler (const std::string &sessionId) :
+    EventHandler (nullptr, sessionId)
+  {
+  }
+
+  void sendEvent (Json::Value &value) override
+  {
+    if (sending++ > 0) {
+      concurrent = true;
+    }
+
+    std::unique_lock <std::mutex> lock (mutex);
+
+    if (value["seq"].asInt() != received) {
+      outOfOrder = true;
+    }
+
+    received++;
+    cond.notify_all();
+    lock.unlock ();
+
+    sending--;
+  }
+
+  /* As the generated code emits events */
+  void emit (int seq)
+  {
+    std::shared_ptr<EventHandler> handler = shared_from_this ();
+
+    sendEventAsync ([handler, seq] () {
+      Json::Value event;
+
+      event["seq"] = seq;
+      handler->sendEvent (event);
+    });
+  }
+
+  bool waitEvents (int expected)
+  {
+    std::unique_lock <std::mutex> lock (mutex);
+
+    return cond.wait_for (lock, std::chrono::seconds (10), [&] () {
+      return received >= expected;
+    });
+  }
+
+  std::mutex mutex;
+  std::condition_variable cond;
+  int received = 0;
+  bool outOfOrder = false;
+  std::atomic<int> sending{0};
+  std::atomic<bool> concurrent{false};
+};
+
+BOOST_AUTO_TEST_CASE (events_in_order)
+{
+  std::vector<std::shared_ptr<TestHandler>> handlers;
+
+  for (int i = 0; i < SESSIONS; i++) {
+    handlers.push_back (std::make_shared<TestHandler> ("session" +
+                        std::to_string (i) ) );
+  }
+
+  for (int seq = 0; seq < EVENTS; seq++) {
+    for (auto &handler : handlers) {
+      handler->emit (seq);
+    }
+  }
+
+  for (auto &handler : handlers) {
+    BOOST_REQUIRE (handler->waitEvents (EVENTS) );
+    BOOST_CHECK (!handler->outOfOrder);
+    BOOST_CHECK (!handler->concurrent);
+  }
+}
+
+BOOST_AUTO_TEST_CASE (bind_session)
+{
+  /* Transports create handlers without session, MediaSet binds them */
+  auto handler = std::make_shared<TestHandler> ("");
+
+  handler->setSessionId ("bound");
+  BOOST_CHECK_EQUAL (handler->getSessionId (), "bound");
+
+  for (int seq = 0; seq < EVENTS; seq++) {
+    handler->emit (seq);
+  }
+
+  BOOST_REQUIRE (handler->waitEvents (EVENTS) );
+  BOOST_CHECK (!handler->outOfOrder);
+}
+
+BOOST_AUTO_TEST_CASE (rebind_after_send)
+{
+  auto handler = std::make_shared<TestHandler> ("first");
+
+  for (int seq = 0; seq < EVENTS; seq++) {
+    handler->emit (seq);
+
+    if (seq == EVENTS / 2) {
+      /* Sends keep the first lane, so they are never concurrent */
+      for (int i = 0; i < LANES; i++) {
+        handler->setSessionId ("second" + std::to_string (i) );
+      }
+    }
+  }
+
+  BOOST_REQUIRE (handler->waitEvents (EVENTS) );
+  BOOST_CHECK_EQUAL (handler->getSessionId (), "second" +
+                     std::to_string (LANES - 1) );
+  BOOST_CHECK (!handler->outOfOrder);
+  BOOST_CHECK (!handler->concurrent);
+}
+
+BOOST_AUTO_TEST_CASE (lane_stats)
+{
+  int64_t dispatched = 0;
+  auto stats = EventDispatcher::getDispatcher ().getStats ();
+
+  BOOST_CHECK_EQUAL (EventDispatcher::getLanes (), LANES);
+  BOOST_CHECK_EQUAL (stats.size(), (size_t) LANES);
+
+  for (auto &lane : stats) {
+    dispatched += lane.dispatchedEvents;
+    BOOST_CHECK (lane.batches <= lane.dispatchedEvents);
+  }
+
+  BOOST_CHECK (dispatched >= SESSIONS * EVENTS + 2 * EVENTS);
+
+  /* Too late, lanes are already running */
+  EventDispatcher::setLanes (LANES * 2);
+  BOOST_CHECK_EQUAL (EventDispatcher::getLanes (), LANES);
+}
@@ -0,0 +1,131 @@
+/*
+ * (C) Copyright 2016 Kurento (http://kurento.org/)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#define BOOST_TEST_DYN_LINK
+#define BOOST_TEST_MODULE EventPolicy
+#include <boost/test/unit_test.hpp>
+#include <gst/gst.h>
+#include <EventPolicy.hpp>
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+
+using namespace kurento;
+
+struct InitTests {
+  InitTests();
+};
+
+BOOST_GLOBAL_FIXTURE (InitTests);
+
+InitTests::InitTests()
+{
+  gst_init (nullptr, nullptr);
+}
+
+BOOST_AUTO_TEST_CASE (redundant_changes)
+{
+  auto policy = std::make_shared<EventPolicy> (EventPolicy::Config (),
+                "pipeline");
+  int emitted = 0;
+
+  for (int i = 0; i < 10; i++) {
+    policy->submit ("video_default", 1, [&emitted] () {
+      emitted++;
+    });
+  }
+
+  policy->submit ("audio_default", 1, [&emitted] () {
+    emitted++;
+  });
+
+  BOOST_CHECK_EQUAL (emitted, 2);
+  BOOST_CHECK_EQUAL (policy->getDroppedEvents (), 9);
+}
+
+BOOST_AUTO_TEST_CASE (debounce)
+{
+  EventPolicy::Config config;
+  std::atomic<int> emitted (0);
+  std::atomic<int> last (-1);
+
+  config.debounce = 50;
+  auto policy = std::make_shared<EventPolicy> (config, "pipeline");
+
+  /* Flapping back to the reported state raises nothing */
+  policy->submit ("key", 1, [&] () {
+    emitted++;
+    last = 1;
+  });
+  policy->submit ("key", 0, [&] () {
+    emitted++;
+    last = 0;
+  });
+  policy->submit ("key", 1, [&] () {
+    emitted++;
+    last = 1;
+  });
+  policy->submit ("key", 0, [&] () {
+    emitted++;
+    last = 0;
+  });
+
+  std::this_thread::sleep_for (std::chrono::milliseconds (200) );
+  BOOST_CHECK_EQUAL (emitted, 1);
+  BOOST_CHECK_EQUAL (last, 0);
+
+  /* A flap from the reported state is discarded */
+  policy->submit ("key", 1, [&] () {
+    emitted++;
+  });
+  policy->submit ("key", 0, [&] () {
+    emitted++;
+  });
+
+  std::this_thread::sleep_for (std::chrono::milliseconds (200) );
+  BOOST_CHECK_EQUAL (emitted, 1);
+  /* Each held change discarded counts once, reverted or superseded */
+  BOOST_CHECK_EQUAL (policy->getDroppedEvents (), 4);
+}
+
+BOOST_AUTO_TEST_CASE (shared_rate_limit)
+{
+  EventPolicy::Config config;
+  std::atomic<int> emitted (0);
+
+  config.rateLimit = 10;
+  auto first = std::make_shared<EventPolicy> (config, "limited");
+  auto second = std::make_shared<EventPolicy> (config, "limited");
+
+  for (int i = 0; i < 10; i++) {
+    first->submit ("key" + std::to_string (i), 1, [&emitted] () {
+      emitted++;
+    });
+    second->submit ("key" + std::to_string (i), 1, [&emitted] () {
+      emitted++;
+    });
+  }
+
+  /* The budget is shared, the rest is delayed but not lost */
+  BOOST_CHECK_EQUAL (emitted, 10);
+
+  std::this_thread::sleep_for (std::chrono::milliseconds (1500) );
+  BOOST_CHECK_EQUAL (emitted, 20);
+  BOOST_CHECK_EQUAL (first->getDroppedEvents () +
+                     second->getDroppedEvents (), 0);
+}
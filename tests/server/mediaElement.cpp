@@ -26,6 +26,7 @@
 #include <GstreamerDotDetails.hpp>
 #include <MediaSet.hpp>
 #include <ModuleManager.hpp>
+#include <ElementStatsSnapshot.hpp>
 
 using namespace kurento;
 
@@ -299,3 +300,27 @@ BOOST_AUTO_TEST_CASE (dot_test)
   src.reset();
   pipe.reset();
 }
+
+BOOST_AUTO_TEST_CASE (stats_snapshot)
+{
+  std::string mediaPipelineId =
+    moduleManager.getFactory ("MediaPipeline")->createObject (
+      config, "",
+      Json::Value() )->getId();
+  std::shared_ptr <MediaElementImpl> element = createDummyElement ("dummysrc",
+      mediaPipelineId);
+
+  auto snapshot = element->getStatsSnapshot ();
+
+  BOOST_CHECK (snapshot->getId () == element->getId () );
+  /* One value per media type: audio, video and data */
+  BOOST_CHECK (snapshot->getPacketsReceived ().size () == 3);
+  BOOST_CHECK (snapshot->getBytesSent ().size () == 3);
+  BOOST_CHECK (snapshot->getInputLatency ().size () == 3);
+  BOOST_CHECK (snapshot->getRembReceived () == 0);
+
+  releaseMediaObject (element->getId() );
+  releaseMediaObject (mediaPipelineId);
+
+  element.reset();
+}
@@ -243,3 +243,112 @@ BOOST_FIXTURE_TEST_CASE (get_pipelines, F)
 
   pipes.clear();
 }
+
+BOOST_FIXTURE_TEST_CASE (get_all_pipelines, F)
+{
+  std::shared_ptr<kurento::Factory> mediaPipelineFactory;
+  std::string mediaPipelineId;
+
+  mediaPipelineFactory = moduleManager->getFactory ("MediaPipeline");
+
+  mediaPipelineId = mediaPipelineFactory->createObject (
+                      boost::property_tree::ptree(), "session_all",
+                      Json::Value() )->getId();
+
+  size_t sessions = MediaSet::getMediaSet()->getSessions ().size();
+  bool found = false;
+
+  for (auto pipe : MediaSet::getMediaSet()->getAllPipelines () ) {
+    found = found || pipe->getId() == mediaPipelineId;
+  }
+
+  BOOST_CHECK (found);
+  /* Listing pipelines does not reference them from any session */
+  BOOST_CHECK_EQUAL (MediaSet::getMediaSet()->getSessions ().size(), sessions);
+
+  MediaSet::getMediaSet()->release (mediaPipelineId);
+}
+
+BOOST_FIXTURE_TEST_CASE (worker_pool_config, F)
+{
+  boost::property_tree::ptree config;
+  WorkerPool::Config defaultConfig = MediaSet::getWorkerPoolConfig ();
+  std::shared_ptr<ServerInfo> serverInfo = std::make_shared<ServerInfo> ("",
+      std::vector<std::shared_ptr<ModuleInfo>> (),
+      std::make_shared<ServerType> (ServerType::KMS),
+      std::vector<std::string> () );
+
+  config.put ("workerPool.mode", "sharded");
+  config.put ("workerPool.threads", 3);
+
+  /* The MediaSet already exists, as it does when the server starts */
+  std::shared_ptr<ServerManagerImpl> configured (new ServerManagerImpl (
+        serverInfo, config, *moduleManager.get() ) );
+
+  WorkerPool::Stats stats = MediaSet::getMediaSet()->getWorkerPoolStats ();
+
+  BOOST_CHECK (stats.mode == WorkerPool::Mode::SHARDED);
+  BOOST_CHECK_EQUAL (stats.threads, 3);
+
+  /* Releases keep working on the new pool */
+  std::string mediaPipelineId = moduleManager->getFactory ("MediaPipeline")
+                                ->createObject (boost::property_tree::ptree(), "session_pool",
+                                    Json::Value() )->getId();
+  MediaSet::getMediaSet()->release (mediaPipelineId);
+
+  configured.reset();
+  MediaSet::setWorkerPoolConfig (defaultConfig);
+
+  BOOST_CHECK (MediaSet::getMediaSet()->getWorkerPoolStats ().mode ==
+               defaultConfig.mode);
+}
+
+BOOST_FIXTURE_TEST_CASE (session_timeout, F)
+{
+  std::mutex mtx;
+  std::condition_variable cv;
+  bool destroyed = false;
+  std::string mediaPipelineId;
+  std::shared_ptr<kurento::Factory> mediaPipelineFactory;
+
+  mediaPipelineFactory = moduleManager->getFactory ("MediaPipeline");
+
+  mediaPipelineId = mediaPipelineFactory->createObject (
+                      boost::property_tree::ptree(), "session_timeout",
+                      Json::Value() )->getId();
+
+  sigc::connection destroyedConn =
+  serverManager->signalObjectDestroyed.connect ([&] (ObjectDestroyed event) {
+    std::unique_lock<std::mutex> lck (mtx);
+
+    if (mediaPipelineId == event.getObjectId() ) {
+      destroyed = true;
+      cv.notify_one();
+    }
+  });
+
+  int64_t expired =
+    MediaSet::getMediaSet()->getGarbageCollectorStats ().expiredSessions;
+
+  MediaSet::getMediaSet()->setSessionTimeout ("session_timeout",
+      std::chrono::milliseconds (500) );
+
+  std::unique_lock<std::mutex> lck (mtx);
+
+  if (!cv.wait_for (lck, std::chrono::seconds (5), [&destroyed] () {
+  return destroyed;
+}) ) {
+    BOOST_FAIL ("Timeout waiting for inactive session to be collected");
+  }
+  destroyedConn.disconnect();
+
+  BOOST_CHECK (MediaSet::getMediaSet()->getGarbageCollectorStats ()
+               .expiredSessions == expired + 1);
+
+  try {
+    MediaSet::getMediaSet()->keepAliveSession ("session_timeout");
+    BOOST_FAIL ("This code should not be reached");
+  } catch (KurentoException e) {
+    BOOST_CHECK (e.getCode() == INVALID_SESSION);
+  }
+}
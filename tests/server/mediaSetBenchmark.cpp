@@ -0,0 +1,139 @@
+/*
+ * (C) Copyright 2016 Kurento (http://kurento.org/)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#define BOOST_TEST_DYN_LINK
+#define BOOST_TEST_MODULE MediaSetBenchmark
+#include <boost/test/unit_test.hpp>
+#include <ModuleManager.hpp>
+#include <KurentoException.hpp>
+#include <gst/gst.h>
+#include <MediaSet.hpp>
+#include <MediaObjectImpl.hpp>
+
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include <config.h>
+
+using namespace kurento;
+
+#define N_OBJECTS 1000
+#define BENCHMARK_DURATION std::chrono::milliseconds (500)
+
+std::shared_ptr <ModuleManager> moduleManager;
+
+struct InitTests {
+  InitTests();
+  ~InitTests();
+};
+
+BOOST_GLOBAL_FIXTURE (InitTests);
+
+InitTests::InitTests()
+{
+  gst_init (nullptr, nullptr);
+
+  moduleManager = std::make_shared<ModuleManager>();
+
+  std::string moduleName = "../../src/server/libkmscoremodule.so";
+
+  moduleManager->loadModule (moduleName);
+}
+
+InitTests::~InitTests()
+{
+  moduleManager.reset();
+  MediaSet::deleteMediaSet();
+}
+
+static double
+lookupThroughput (const std::vector<std::string> &ids, unsigned int threads)
+{
+  std::atomic<bool> running (true);
+  std::atomic<uint64_t> lookups (0);
+  std::vector<std::thread> workers;
+
+  for (unsigned int i = 0; i < threads; i++) {
+    workers.emplace_back ([&ids, &running, &lookups, i] () {
+      uint64_t count = 0;
+      size_t pos = i;
+
+      while (running) {
+        MediaSet::getMediaSet()->getMediaObject (ids[pos % ids.size()]);
+        pos += 7;
+        count++;
+      }
+
+      lookups += count;
+    });
+  }
+
+  std::this_thread::sleep_for (BENCHMARK_DURATION);
+  running = false;
+
+  for (auto &worker : workers) {
+    worker.join();
+  }
+
+  return lookups * 1000.0 / BENCHMARK_DURATION.count();
+}
+
+BOOST_AUTO_TEST_CASE (lookup_scaling)
+{
+  std::shared_ptr<kurento::Factory> mediaPipelineFactory;
+  std::shared_ptr<kurento::Factory> passThroughFactory;
+  std::vector<std::shared_ptr<MediaObjectImpl>> objects;
+  std::vector<std::string> ids;
+  unsigned int cores = std::max (1u, std::thread::hardware_concurrency() );
+  double single = 0;
+
+  mediaPipelineFactory = moduleManager->getFactory ("MediaPipeline");
+  passThroughFactory = moduleManager->getFactory ("PassThrough");
+
+  auto pipeline = mediaPipelineFactory->createObject (
+                    boost::property_tree::ptree(), "session1", Json::Value() );
+
+  Json::Value params;
+  params["mediaPipeline"] = pipeline->getId();
+
+  for (int i = 0; i < N_OBJECTS; i++) {
+    auto obj = passThroughFactory->createObject (boost::property_tree::ptree(),
+               "session1", params);
+
+    ids.push_back (obj->getId() );
+    objects.push_back (std::dynamic_pointer_cast<MediaObjectImpl> (obj) );
+  }
+
+  for (unsigned int threads = 1; threads <= cores; threads *= 2) {
+    double throughput = lookupThroughput (ids, threads);
+
+    if (threads == 1) {
+      single = throughput;
+    }
+
+    BOOST_TEST_MESSAGE ("getMediaObject with " << threads << " threads: "
+                        << (uint64_t) throughput << " lookups/s (x"
+                        << throughput / single << ")");
+    BOOST_CHECK (throughput > 0);
+  }
+
+  objects.clear();
+  MediaSet::getMediaSet()->release (pipeline->getId() );
+}
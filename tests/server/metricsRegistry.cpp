@@ -0,0 +1,147 @@
+/*
+ * (C) Copyright 2016 Kurento (http://kurento.org/)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#define BOOST_TEST_DYN_LINK
+#define BOOST_TEST_MODULE MetricsRegistry
+#include <boost/test/unit_test.hpp>
+#include <gst/gst.h>
+#include <MetricsRegistry.hpp>
+#include <MetricsExporter.hpp>
+#include <KurentoException.hpp>
+
+#include <chrono>
+#include <fstream>
+#include <sstream>
+#include <thread>
+#include <unistd.h>
+
+using namespace kurento;
+
+struct InitTests {
+  InitTests();
+};
+
+BOOST_GLOBAL_FIXTURE (InitTests);
+
+InitTests::InitTests()
+{
+  gst_init (nullptr, nullptr);
+}
+
+static bool
+contains (const std::string &text, const std::string &line)
+{
+  return text.find (line + "\n") != std::string::npos;
+}
+
+BOOST_AUTO_TEST_CASE (counters_and_gauges)
+{
+  MetricsRegistry &registry = MetricsRegistry::getRegistry ();
+
+  registry.counter ("test_requests_total", "Requests").inc ();
+  registry.counter ("test_requests_total", "Requests").inc (2);
+  registry.gauge ("test_queue", "Queue", { {"pool", "a\"b"} }).set (5);
+  registry.gauge ("test_queue", "Queue", { {"pool", "a\"b"} }).add (-2);
+
+  std::string text = registry.exposition ();
+
+  BOOST_CHECK (contains (text, "# HELP test_requests_total Requests") );
+  BOOST_CHECK (contains (text, "# TYPE test_requests_total counter") );
+  BOOST_CHECK (contains (text, "test_requests_total 3") );
+  BOOST_CHECK (contains (text, "# TYPE test_queue gauge") );
+  BOOST_CHECK (contains (text, "test_queue{pool=\"a\\\"b\"} 3") );
+
+  BOOST_CHECK_THROW (registry.gauge ("test_requests_total", "Requests"),
+                     KurentoException);
+}
+
+BOOST_AUTO_TEST_CASE (histogram)
+{
+  MetricsRegistry::Histogram &histogram =
+    MetricsRegistry::getRegistry ().histogram ("test_latency_seconds",
+        "Latency", {0.1, 1}, { {"pool", "test"} });
+
+  histogram.observe (0.05);
+  histogram.observe (0.5);
+  histogram.observe (0.5);
+  histogram.observe (2);
+
+  std::string text = MetricsRegistry::getRegistry ().exposition ();
+
+  BOOST_CHECK (contains (text, "# TYPE test_latency_seconds histogram") );
+  BOOST_CHECK (contains (text,
+                         "test_latency_seconds_bucket{pool=\"test\",le=\"0.1\"} 1") );
+  BOOST_CHECK (contains (text,
+                         "test_latency_seconds_bucket{pool=\"test\",le=\"1\"} 3") );
+  BOOST_CHECK (contains (text,
+                         "test_latency_seconds_bucket{pool=\"test\",le=\"+Inf\"} 4") );
+  BOOST_CHECK (contains (text, "test_latency_seconds_sum{pool=\"test\"} 3.05") );
+  BOOST_CHECK (contains (text, "test_latency_seconds_count{pool=\"test\"} 4") );
+}
+
+BOOST_AUTO_TEST_CASE (collectors)
+{
+  int runs = 0;
+
+  MetricsRegistry::getRegistry ().addCollector ([&runs] (
+  MetricsRegistry & registry) {
+    registry.gauge ("test_collected", "Collected").set (++runs);
+  });
+
+  MetricsRegistry::getRegistry ().exposition ();
+  std::string text = MetricsRegistry::getRegistry ().exposition ();
+
+  BOOST_CHECK_EQUAL (runs, 2);
+  BOOST_CHECK (contains (text, "test_collected 2") );
+}
+
+BOOST_AUTO_TEST_CASE (export_file)
+{
+  boost::property_tree::ptree config;
+  MetricsExporter::Config exporterConfig;
+  std::ostringstream file;
+  std::string text;
+
+  file << "/tmp/kurento-metrics-" << getpid () << ".prom";
+
+  BOOST_CHECK (!MetricsExporter::getConfig (config, exporterConfig) );
+
+  config.put ("metrics.file", file.str () );
+  config.put ("metrics.interval", 10);
+  BOOST_REQUIRE (MetricsExporter::getConfig (config, exporterConfig) );
+  BOOST_CHECK_EQUAL (exporterConfig.interval, 10);
+
+  MetricsRegistry::getRegistry ().counter ("test_exported_total",
+      "Exported").inc ();
+
+  {
+    MetricsExporter exporter (exporterConfig);
+
+    for (int i = 0; i < 100 && text.empty (); i++) {
+      std::this_thread::sleep_for (std::chrono::milliseconds (10) );
+      std::ifstream in (file.str () );
+      std::stringstream content;
+
+      content << in.rdbuf ();
+      text = content.str ();
+    }
+  }
+
+  BOOST_CHECK (contains (text, "test_exported_total 1") );
+
+  unlink (file.str ().c_str () );
+}
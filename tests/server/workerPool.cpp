@@ -0,0 +1,219 @@
+/*
+ * (C) Copyright 2016 Kurento (http://kurento.org/)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#define BOOST_TEST_DYN_LINK
+#define BOOST_TEST_MODULE WorkerPool
+#include <boost/test/unit_test.hpp>
+#include <KurentoException.hpp>
+#include <gst/gst.h>
+#include <WorkerPool.hpp>
+
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+
+using namespace kurento;
+
+#define TASKS 10000
+
+struct InitTests {
+  InitTests();
+};
+
+BOOST_GLOBAL_FIXTURE (InitTests);
+
+InitTests::InitTests()
+{
+  gst_init (nullptr, nullptr);
+}
+
+static void
+run_all_tasks (const WorkerPool::Config &config)
+{
+  std::atomic<int> executed (0);
+
+  {
+    WorkerPool pool (config, "test");
+
+    for (int i = 0; i < TASKS; i++) {
+      pool.post ([&executed] () {
+        executed++;
+      });
+    }
+  }
+
+  /* Pending tasks are executed when the pool is destroyed */
+  BOOST_CHECK_EQUAL (executed, TASKS);
+}
+
+BOOST_AUTO_TEST_CASE (shared_pool)
+{
+  WorkerPool::Config config;
+
+  config.mode = WorkerPool::Mode::SHARED;
+  config.threads = 4;
+
+  run_all_tasks (config);
+}
+
+BOOST_AUTO_TEST_CASE (sharded_pool)
+{
+  WorkerPool::Config config;
+
+  config.mode = WorkerPool::Mode::SHARDED;
+  config.threads = 4;
+
+  run_all_tasks (config);
+
+  config.maxQueueDepth = 4;
+  run_all_tasks (config);
+}
+
+BOOST_AUTO_TEST_CASE (work_stealing)
+{
+  WorkerPool::Config config;
+  std::mutex mtx;
+  std::condition_variable cv;
+  bool blocked = true;
+  std::atomic<int> executed (0);
+
+  config.mode = WorkerPool::Mode::SHARDED;
+  config.threads = 2;
+
+  WorkerPool pool (config, "stealing");
+
+  /* Keep one of the workers busy, the other one has to run everything */
+  pool.post ([&] () {
+    std::unique_lock<std::mutex> lock (mtx);
+
+    cv.wait (lock, [&blocked] () {
+      return !blocked;
+    });
+  });
+
+  for (int i = 0; i < 100; i++) {
+    pool.post ([&executed] () {
+      executed++;
+    });
+  }
+
+  for (int i = 0; i < 100 && executed < 100; i++) {
+    std::this_thread::sleep_for (std::chrono::milliseconds (20) );
+  }
+
+  BOOST_CHECK_EQUAL (executed, 100);
+  BOOST_CHECK (pool.getStats ().stolenTasks > 0);
+
+  std::unique_lock<std::mutex> lock (mtx);
+  blocked = false;
+  cv.notify_all ();
+}
+
+static void
+fill_pool (WorkerPool &pool, std::mutex &mtx, std::condition_variable &cv,
+           bool &blocked)
+{
+  auto blockingTask = [&] () {
+    std::unique_lock<std::mutex> lock (mtx);
+
+    cv.wait (lock, [&blocked] () {
+      return !blocked;
+    });
+  };
+
+  /* The first one is taken by the worker, the second one stays queued */
+  pool.post (blockingTask);
+  std::this_thread::sleep_for (std::chrono::milliseconds (100) );
+  pool.post (blockingTask);
+}
+
+BOOST_AUTO_TEST_CASE (reject_policy)
+{
+  WorkerPool::Config config;
+  std::mutex mtx;
+  std::condition_variable cv;
+  bool blocked = true;
+
+  config.mode = WorkerPool::Mode::SHARDED;
+  config.threads = 1;
+  config.maxThreads = 1;
+  config.maxQueueDepth = 1;
+  config.overflowPolicy = WorkerPool::OverflowPolicy::REJECT;
+
+  WorkerPool pool (config, "reject");
+
+  fill_pool (pool, mtx, cv, blocked);
+
+  try {
+    pool.post ([] () {});
+    BOOST_FAIL ("Task should have been rejected");
+  } catch (KurentoException &e) {
+    BOOST_CHECK_EQUAL (e.getCode (), NOT_ENOUGH_RESOURCES);
+  }
+
+  BOOST_CHECK_EQUAL (pool.getStats ().rejectedTasks, 1);
+
+  std::unique_lock<std::mutex> lock (mtx);
+  blocked = false;
+  cv.notify_all ();
+}
+
+BOOST_AUTO_TEST_CASE (caller_runs_policy)
+{
+  WorkerPool::Config config;
+  std::mutex mtx;
+  std::condition_variable cv;
+  bool blocked = true;
+  std::thread::id runner;
+
+  config.mode = WorkerPool::Mode::SHARDED;
+  config.threads = 1;
+  config.maxThreads = 1;
+  config.maxQueueDepth = 1;
+  config.overflowPolicy = WorkerPool::OverflowPolicy::CALLER_RUNS;
+
+  WorkerPool pool (config, "caller_runs");
+
+  fill_pool (pool, mtx, cv, blocked);
+
+  pool.post ([&runner] () {
+    runner = std::this_thread::get_id ();
+  });
+
+  BOOST_CHECK (runner == std::this_thread::get_id () );
+  BOOST_CHECK_EQUAL (pool.getStats ().callerRunsTasks, 1);
+
+  std::unique_lock<std::mutex> lock (mtx);
+  blocked = false;
+  cv.notify_all ();
+}
+
+BOOST_AUTO_TEST_CASE (registered_stats)
+{
+  WorkerPool pool (2, "registered");
+  bool found = false;
+
+  for (auto &stats : WorkerPool::getAllStats () ) {
+    if (stats.name == "registered") {
+      found = true;
+      BOOST_CHECK_EQUAL (stats.threads, 2);
+    }
+  }
+
+  BOOST_CHECK (found);
+}